@@ -7,17 +7,46 @@
 #ifdef _WIN32
 #include <mswsock.h>
 #endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 // reflector 受信タイムアウト（stamp_protocol.h から移設、reflector 専用の運用定数）
 #define STAMP_REFLECTOR_TIMEOUT_MS 1000
 
-// セッション統計情報
+// ワーカースレッド数の上限（-T）
+#define REFLECTOR_MAX_WORKERS 256
+
+// セッション統計情報（ワーカーごとに保持し、表示時にのみ合算する）
 struct reflector_stats {
 	uint32_t packets_reflected;
 	uint32_t packets_dropped;
+	uint32_t rate_dropped_source; // うち送信元別のレート制限（-r）
+	uint32_t rate_dropped_global; // うち全体の受信上限（-g）
 };
 
-static struct reflector_stats g_stats = {0, 0};
+/**
+ * 受信ワーカー（ソケット・統計・スレッドを 1 組で保持）
+ * -T 未指定時は main スレッドがワーカー 0 として動作する。
+ */
+struct reflector_worker {
+	SOCKET sockfd;
+	struct reflector_stats stats;
+	struct stamp_session_table *sessions; // ステートフル時のみ（-s）
+	struct stamp_client_table *clients;   // 送信元別統計（-S 指定時のみ）
+	unsigned int clients_dump_gen;	      // 出力済みの SIGUSR1 要求の世代
+	unsigned int id;
+#ifdef __linux__
+	struct stamp_t3_followup *t3; // T3 の事後検証（-t 指定時のみ）
+	struct stamp_mmsg_batch batch; // batch.cap == 0: 1 パケット単位処理
+	pthread_t thread;
+	bool thread_started;
+	int cpu; // 固定先 CPU（-1: 固定なし）
+	bool use_uring; // -E uring（リングはワーカースレッド上で生成する）
+	bool use_xdp;	// -E xdp（AF_XDP ソケットはワーカースレッド上で生成する）
+#endif
+};
 
 #ifdef __linux__
 #define REFLECTOR_IFNAME (g_ifname)
@@ -27,10 +56,37 @@ static struct reflector_stats g_stats = {0, 0};
 
 static uint16_t
 	g_error_estimate_nbo; // htons済み Error Estimate（main()で設定）
+// 複数ワーカーから参照されるため __atomic_exchange_n で一度だけ警告する
 static bool g_warned_ttl_unavailable = false;
 // タイムスタンプ形式フラグ（true: PTP/Z=1, false: NTP）。main() が CLI から設定
 static bool g_ptp_mode = false;
 
+// 反射 1 本ごとのログの出力レベル（-L）。main() が CLI から設定
+static struct stamp_log_policy g_log_policy = {STAMP_LOG_ALL, 0};
+// 間引きの状態（ワーカースレッドごと）
+static _Thread_local struct stamp_log_limiter g_log_limiter;
+// 処理中のワーカーのセッション表（ステートフル時のみ非 NULL）
+static _Thread_local struct stamp_session_table *g_session_table;
+// セッション表が満杯で Sender の seq をそのまま返したことを一度だけ警告する
+static bool g_warned_sessions_full = false;
+// 処理中のワーカーの送信元別統計表（-S 指定時のみ非 NULL）
+static _Thread_local struct stamp_client_table *g_client_table;
+// 送信元別統計の出力先（-S）と、SIGUSR1 ごとに増やす出力要求の世代
+static FILE *g_clients_fp = NULL;
+static unsigned int g_clients_dump_gen = 0;
+#ifdef __linux__
+static pthread_mutex_t g_clients_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+// 送信元別のレート制限と全体の受信上限（-r / -g）。全ワーカーで共有する
+static struct stamp_rate_limiter g_rate_limiter;
+// T3 の事後検証（-t）。main() が CLI から設定
+static bool g_t3_followup = false;
+// T3 を打刻する TSC 時計（-C tsc。開始できなければ無効のまま）
+static struct stamp_tsc_clock g_tsc_clock;
+// ログ行のリング。書き出しスレッドの稼働中のみ g_log_async が true
+static struct stamp_logring g_logring;
+static bool g_log_async = false;
+
 #ifndef _WIN32
 // ランタイムデバッグフラグ
 static bool g_debug_mode = false;
@@ -41,6 +97,24 @@ static const char *g_ifname = NULL;
 static bool g_phc_enabled = false;
 // PHC fd は main() の AUTO_CLOSE_FD ローカルで管理（プロセス終了時に自動 close）
 static clockid_t g_phc_clockid = CLOCK_REALTIME;
+// 受信ソケットに付ける入力検査フィルタ（main() が -a から組み立てる）
+static struct stamp_bpf_prog g_input_filter;
+// 許可リスト（-a）指定時はフィルタを付けられなければ起動を中止する
+static bool g_input_filter_required = false;
+static bool g_warned_filter = false;
+// -t で TX HW タイムスタンプと比べるか（-c 指定時に要求し、NIC が対応しな
+// ければソケット生成時に false へ戻す。false なら SW の TX タイムスタンプ）
+static bool g_t3_hw = false;
+// 処理中のワーカーの T3 の記録（-t 指定時のみ非 NULL）
+static _Thread_local struct stamp_t3_followup *g_t3;
+#endif
+#ifdef STAMP_HAVE_AF_XDP
+// -E xdp: -i のインターフェースに付けた XDP プログラム（main() が設定）
+static struct stamp_xdp_prog g_xdp_prog = {-1, -1, -1, false, false};
+static uint32_t g_xdp_ifindex = 0;
+static uint16_t g_xdp_port = 0;
+// AF_XDP の経路はソケットのフィルタを通らないため、許可リストは直接照合する
+static const struct stamp_allowlist *g_allowlist = NULL;
 #endif
 
 #define DEBUG_LOG(fmt, ...)                                                 \
@@ -60,14 +134,114 @@ __attribute__((format(printf, 1, 2), cold)) static inline void debug_log_impl(co
 
 #endif
 
+#ifdef __linux__
+/**
+ * T3 の事後検証（-t）の結果の表示（全ワーカーを合算）
+ */
+__attribute__((cold)) static void
+print_t3_followup(const struct reflector_worker *workers, unsigned int count)
+{
+	if (!g_t3_followup) {
+		return;
+	}
+	struct stamp_t3_error total;
+	uint64_t missed = 0;
+	uint64_t unmatched = 0;
+	memset(&total, 0, sizeof(total));
+	for (unsigned int i = 0; i < count; i++) {
+		const struct stamp_t3_followup *f = workers[i].t3;
+		if (f == NULL) {
+			continue;
+		}
+		stamp_t3_error_merge(&total, &f->total);
+		missed += f->missed + f->outstanding;
+		unmatched += f->unmatched;
+	}
+	printf("T3 error (%s TX timestamp - embedded T3): %" PRIu64 " samples",
+	       g_t3_hw ? "HW" : "SW",
+	       total.count);
+	if (total.count > 0) {
+		printf(", mean %" PRId64 " ns, min %" PRId64 " ns, max %" PRId64
+		       " ns",
+		       total.sum_ns / (int64_t)total.count,
+		       total.min_ns,
+		       total.max_ns);
+	}
+	printf(", %" PRIu64 " without timestamp\n", missed);
+	if (unmatched > 0) {
+		printf("  TX timestamps without a matching reply: %" PRIu64 "\n",
+		       unmatched);
+	}
+}
+#endif
+
 /**
- * 統計情報の表示
+ * 統計情報の表示（全ワーカーの統計を合算）
+ * ワーカー停止後に呼ぶこと。
  */
-__attribute__((cold)) static void print_statistics(void)
+__attribute__((cold)) static void
+print_statistics(const struct reflector_worker *workers, unsigned int count)
 {
+	uint64_t reflected = 0;
+	uint64_t dropped = 0;
+	uint64_t rate_source = 0;
+	uint64_t rate_global = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		reflected += workers[i].stats.packets_reflected;
+		dropped += workers[i].stats.packets_dropped;
+		rate_source += workers[i].stats.rate_dropped_source;
+		rate_global += workers[i].stats.rate_dropped_global;
+	}
 	printf("\n--- STAMP Reflector Statistics ---\n");
-	printf("Packets reflected: %u\n", g_stats.packets_reflected);
-	printf("Packets dropped: %u\n", g_stats.packets_dropped);
+	printf("Packets reflected: %" PRIu64 "\n", reflected);
+	printf("Packets dropped: %" PRIu64 "\n", dropped);
+	if (stamp_rate_enabled(&g_rate_limiter)) {
+		printf("  Rate limited: %" PRIu64 " per-source, %" PRIu64
+		       " global cap\n",
+		       rate_source,
+		       rate_global);
+	}
+#ifdef __linux__
+	print_t3_followup(workers, count);
+#endif
+	uint64_t log_dropped = __atomic_load_n(&g_logring.dropped, __ATOMIC_RELAXED);
+	if (log_dropped > 0) {
+		printf("Log lines dropped (ring full): %" PRIu64 "\n", log_dropped);
+	}
+	if (workers[0].sessions != NULL) {
+		uint64_t active = 0;
+		uint64_t created = 0;
+		uint64_t expired = 0;
+		uint64_t overflow = 0;
+		for (unsigned int i = 0; i < count; i++) {
+			const struct stamp_session_table *tbl = workers[i].sessions;
+			if (tbl == NULL) {
+				continue;
+			}
+			active += tbl->pool.active;
+			created += tbl->created;
+			expired += tbl->pool.expired;
+			overflow += tbl->overflow;
+		}
+		printf("Sessions: %" PRIu64 " active, %" PRIu64 " created, %" PRIu64
+		       " expired\n",
+		       active,
+		       created,
+		       expired);
+		if (overflow > 0) {
+			printf("Packets beyond session limit (stateless reply): "
+			       "%" PRIu64 "\n",
+			       overflow);
+		}
+	}
+	if (count > 1) {
+		for (unsigned int i = 0; i < count; i++) {
+			printf("  Worker %u: reflected %u, dropped %u\n",
+			       i,
+			       workers[i].stats.packets_reflected,
+			       workers[i].stats.packets_dropped);
+		}
+	}
 }
 
 /**
@@ -77,7 +251,10 @@ __attribute__((cold)) static void print_statistics(void)
 __attribute__((cold)) static void print_usage(const char *prog)
 {
 	fprintf(stderr,
-		"Usage: %s [-4|-6] [-d] [-P] [-c] [-i iface] [port]\n",
+		"Usage: %s [-4|-6] [-d] [-P] [-c] [-i iface] [-b batch] "
+		"[-T threads] [-E engine] [-L level] [-s sessions] "
+		"[-e sec] [-S file] [-a prefix[,...]] [-r pps[:burst]] "
+		"[-g pps] [-t] [-C clock] [port]\n",
 		prog ? prog : "reflector");
 	fprintf(stderr, "Options:\n");
 	fprintf(stderr, "  -4    IPv4 only\n");
@@ -91,7 +268,48 @@ __attribute__((cold)) static void print_usage(const char *prog)
 	fprintf(stderr,
 		"  -c    Use PHC (PTP Hardware Clock) "
 		"(requires -i)\n");
+	fprintf(stderr,
+		"  -b    Batch up to N packets per recvmmsg/sendmmsg "
+		"(1-%d, default: 1)\n",
+		STAMP_MMSG_MAX_BATCH);
+	fprintf(stderr,
+		"  -T    Worker threads, one SO_REUSEPORT socket each, "
+		"pinned to CPUs (1-%d, default: 1)\n",
+		REFLECTOR_MAX_WORKERS);
+	fprintf(stderr,
+		"  -E    I/O engine: socket (default), uring "
+		"(io_uring multishot recvmsg) or xdp (AF_XDP on the -i "
+		"interface, queues 0..T-1)\n");
+#endif
+	fprintf(stderr,
+		"  -L    Per-packet log: all (default), silent, sample:N "
+		"(1 in N), or rate:N (N lines/s)\n");
+	fprintf(stderr,
+		"  -s    Stateful mode: per-session reflector sequence "
+		"numbers, up to N sessions (1-%u)\n",
+		STAMP_SESSION_MAX);
+	fprintf(stderr,
+		"  -e    Expire idle stateful sessions after N seconds "
+		"(default: %u)\n",
+		STAMP_SESSION_DEFAULT_IDLE_SEC);
+	fprintf(stderr,
+		"  -S    Per-client statistics as JSON lines to file ('-' for "
+		"stdout), written at exit and on SIGUSR1\n");
+	fprintf(stderr,
+		"  -a    Accept only sources in these prefixes (in-kernel "
+		"filter, repeatable, Linux only)\n");
+	fprintf(stderr,
+		"  -r    Per-source rate limit in packets/s, with optional "
+		"burst (default burst: pps)\n");
+	fprintf(stderr, "  -g    Global receive cap in packets/s\n");
+#ifdef __linux__
+	fprintf(stderr,
+		"  -t    Check embedded T3 against TX timestamps (software, "
+		"or hardware with -c) and report the error per client\n");
 #endif
+	fprintf(stderr,
+		"  -C    T3 clock: system (default) or tsc (calibrated "
+		"invariant TSC)\n");
 	fprintf(stderr,
 		"  (default: dual-stack, accepting both IPv4 and IPv6)\n");
 }
@@ -214,27 +432,75 @@ __attribute__((cold)) static void configure_reflector_socket_unix(
 #endif
 
 	// reflector は RX HW (T2) のみ。RX HW 非対応 NIC は警告を出す。
+	// -t 指定時は T3 と比べるキー付きの TX タイムスタンプも要求する。
 #ifdef SO_TIMESTAMPING
 	struct stamp_so_timestamping_opts ts_opts = {
 		.ifname = ifname,
-		.want_tx_hw = false,
+		.want_tx_hw = g_t3_hw,
+		.tx_keyed = g_t3_followup,
 		.require_rx_hw = true,
 		.hw_kind = "RX HW",
 		.rx_label = "RX (T2)",
-		.tx_label = NULL,
+		.tx_label = "TX (T3 check)",
 	};
 	int ts_flags = 0;
-	if (stamp_setup_so_timestamping(sockfd, &ts_opts, NULL, &ts_flags) < 0) {
+	bool tx_hw = false;
+	if (stamp_setup_so_timestamping(sockfd, &ts_opts, &tx_hw, &ts_flags) <
+	    0) {
 		DEBUG_LOG("SO_TIMESTAMPING not available (error %d)", errno);
+		if (g_t3_followup) {
+			fprintf(stderr,
+				"Warning: TX timestamps unavailable; -t will "
+				"report no samples\n");
+		}
 	} else {
 		DEBUG_LOG("SO_TIMESTAMPING enabled (flags=0x%x)",
 			  (unsigned)ts_flags);
 	}
+	if (g_t3_hw && !tx_hw) {
+		// 以降のワーカーのソケットも SW の TX タイムスタンプに揃える
+		fprintf(stderr,
+			"Warning: no TX HW timestamps on %s; -t compares "
+			"software TX timestamps with the PHC T3 (the error "
+			"includes the PHC-to-system clock offset)\n",
+			ifname != NULL ? ifname : "(none)");
+		g_t3_hw = false;
+	}
 #endif
 #endif // __linux__
 }
 #endif
 
+#ifdef __linux__
+/**
+ * 入力検査フィルタ（cBPF）をソケットへ付ける（bind 前に呼ぶ）
+ * 長さ・multiplier の検査はユーザー空間でも行うため、付けられなくても警告
+ * のみで続行する。許可リストはフィルタでのみ適用するため、その場合は失敗とする。
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((cold)) static int attach_input_filter(SOCKET sockfd)
+{
+	if (stamp_bpf_attach(sockfd, &g_input_filter) == 0) {
+		DEBUG_LOG("Input filter attached (%u instructions)",
+			  (unsigned)g_input_filter.len);
+		return 0;
+	}
+	if (g_input_filter_required) {
+		fprintf(stderr,
+			"Failed to attach source allowlist filter: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	if (!__atomic_exchange_n(&g_warned_filter, true, __ATOMIC_RELAXED)) {
+		fprintf(stderr,
+			"Warning: in-kernel input filter not available (%s); "
+			"validating in user space only\n",
+			strerror(errno));
+	}
+	return 0;
+}
+#endif
+
 /**
  * reflector ソケットのバインド
  * @return 成功時0、エラー時-1
@@ -262,15 +528,41 @@ __attribute__((cold)) static int bind_reflector_socket(SOCKET sockfd,
 		    stamp_get_sockaddr_len(family));
 }
 
+/**
+ * SO_REUSEPORT の設定（-T のワーカーごとに同一ポートへ bind するため）
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((cold)) static int enable_reuseport(SOCKET sockfd)
+{
+#ifdef SO_REUSEPORT
+	int opt = 1;
+	if (setsockopt(sockfd,
+		       SOL_SOCKET,
+		       SO_REUSEPORT,
+		       (const char *)&opt,
+		       sizeof(opt)) < 0) {
+		PRINT_SOCKET_ERROR("setsockopt SO_REUSEPORT failed");
+		return -1;
+	}
+	return 0;
+#else
+	(void)sockfd;
+	fprintf(stderr, "SO_REUSEPORT not available on this platform\n");
+	return -1;
+#endif
+}
+
 /**
  * リスニングソケットの初期化
+ * @param reuseport true なら SO_REUSEPORT を必須として設定する（-T 用）
  * @return ソケットディスクリプタ、エラー時INVALID_SOCKET
  */
 __attribute__((cold)) static SOCKET init_reflector_socket(
 	uint16_t port,
 	int af_hint,
 	int *out_family,
-	__attribute__((unused)) const char *ifname)
+	__attribute__((unused)) const char *ifname,
+	bool reuseport)
 {
 	SOCKET sockfd;
 	int opt = 1;
@@ -304,6 +596,11 @@ __attribute__((cold)) static SOCKET init_reflector_socket(
 				"not be immediately reusable after restart)\n");
 		}
 
+		if (reuseport && enable_reuseport(sockfd) < 0) {
+			CLOSE_SOCKET(sockfd);
+			return INVALID_SOCKET;
+		}
+
 		if (family == AF_INET6 && af_hint == AF_UNSPEC) {
 #ifdef IPV6_V6ONLY
 			int v6only = 0;
@@ -322,6 +619,12 @@ __attribute__((cold)) static SOCKET init_reflector_socket(
 #ifndef _WIN32
 		configure_reflector_socket_unix(sockfd, ifname);
 #endif
+#ifdef __linux__
+		if (attach_input_filter(sockfd) != 0) {
+			CLOSE_SOCKET(sockfd);
+			return INVALID_SOCKET;
+		}
+#endif
 
 		if (bind_reflector_socket(sockfd, family, port) < 0) {
 			if (try_ipv4_fallback && family == AF_INET6) {
@@ -344,23 +647,187 @@ __attribute__((cold)) static SOCKET init_reflector_socket(
 }
 
 /**
- * STAMPパケットの反射処理
- * @return 成功時0、エラー時-1
+ * 毎パケット参照する秒単位の現在時刻（ログの間引き・セッションの期限）
+ * 単調クロックを粗い精度で読む。
  */
-__attribute__((hot)) static inline int reflect_packet(
-	SOCKET sockfd,
-	uint8_t *buffer,
-	int send_len,
-	const struct sockaddr_storage *cliaddr,
-	socklen_t len,
-	uint8_t ttl,
-	uint32_t t2_sec,
-	uint32_t t2_frac)
+static uint64_t coarse_now_sec(void)
 {
-	struct stamp_reflector_packet *packet;
-	uint32_t t3_sec;
-	uint32_t t3_frac;
+#ifdef _WIN32
+	return GetTickCount64() / 1000U;
+#else
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (uint64_t)ts.tv_sec;
+#endif
+}
+
+/**
+ * レート制限の判定に使う現在時刻（ns、単調クロック）
+ * 制限が無効なら時計を読まずに 0 を返す。Windows はミリ秒精度。
+ */
+static uint64_t rate_now_ns(void)
+{
+	if (!stamp_rate_enabled(&g_rate_limiter)) {
+		return 0;
+	}
+#ifdef _WIN32
+	return GetTickCount64() * 1000000U;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * レート制限（-r / -g）: 超過したパケットを検査・応答の組み立て・T3 の打刻より
+ * 前に捨て、理由別に数える（送信元別統計には載せない。偽装された送信元で
+ * 表を埋めないため）
+ * @return 処理を続ける場合 true、捨てた場合 false
+ */
+__attribute__((hot)) static inline bool
+admit_packet(const struct sockaddr_storage *cliaddr,
+	     uint64_t now_ns,
+	     struct reflector_stats *stats)
+{
+	if (likely(!stamp_rate_enabled(&g_rate_limiter))) {
+		return true;
+	}
+	enum stamp_rate_verdict verdict =
+		stamp_rate_admit(&g_rate_limiter, cliaddr, now_ns);
+	if (likely(verdict == STAMP_RATE_PASS)) {
+		return true;
+	}
+	if (verdict == STAMP_RATE_DROP_SOURCE) {
+		stats->rate_dropped_source++;
+	} else {
+		stats->rate_dropped_global++;
+	}
+	stats->packets_dropped++;
+	return false;
+}
+
+/**
+ * 送信元別統計: 破棄 1 本を理由別に計上する
+ */
+static void count_client_drop(const struct sockaddr_storage *cliaddr,
+			      enum stamp_client_drop reason)
+{
+	if (g_client_table == NULL) {
+		return;
+	}
+	struct stamp_client *c =
+		stamp_client_lookup(g_client_table, cliaddr, coarse_now_sec());
+	if (c != NULL) {
+		c->drops[reason]++;
+	}
+}
+
+/**
+ * 送信元別統計: 反射 1 本を計上する（滞留時間は送信直前の応答の T3 − T2）
+ */
+__attribute__((hot)) static inline void
+count_client_reflected(const uint8_t *buffer,
+		       size_t send_len,
+		       const struct sockaddr_storage *cliaddr)
+{
+	if (g_client_table == NULL) {
+		return;
+	}
+	struct stamp_client *c =
+		stamp_client_lookup(g_client_table, cliaddr, coarse_now_sec());
+	if (c == NULL) {
+		return;
+	}
+	const struct stamp_reflector_packet *packet =
+		(const struct stamp_reflector_packet *)buffer;
+	uint16_t err = ntohs(packet->error_estimate);
+	uint64_t t3 = stamp_timestamp_to_ns(packet->timestamp_sec,
+					    packet->timestamp_frac,
+					    err);
+	uint64_t t2 = stamp_timestamp_to_ns(packet->rx_sec, packet->rx_frac, err);
+	stamp_client_count_reflected(c, (uint32_t)send_len, t3 > t2 ? t3 - t2 : 0);
+}
+
+#ifdef __linux__
+/**
+ * T3 の事後検証（-t）: 送信した応答の T3 を OPT_ID のキーと対応付けて記録する
+ */
+__attribute__((hot)) static inline void
+note_t3_sent(const uint8_t *buffer, const struct sockaddr_storage *cliaddr)
+{
+	if (g_t3 == NULL) {
+		return;
+	}
+	const struct stamp_reflector_packet *packet =
+		(const struct stamp_reflector_packet *)buffer;
+	stamp_t3_record(g_t3,
+			stamp_timestamp_to_ns(packet->timestamp_sec,
+					      packet->timestamp_frac,
+					      ntohs(packet->error_estimate)),
+			cliaddr);
+}
+
+/**
+ * 送信失敗でもカーネルが OPT_ID のキーを払い出し済みの場合（datagram を
+ * 組み立てた後の送信バッファ不足）、キーを 1 つ進めて記録との対応を保つ
+ */
+static void skip_t3_key(int err)
+{
+	if (g_t3 != NULL && (IS_WOULDBLOCK(err) || err == ENOBUFS)) {
+		stamp_t3_skip_key(g_t3);
+	}
+}
+#endif
+
+/**
+ * ステートフル時、応答の Reflector seq をセッションごとの番号に置き換える
+ * (RFC 8762 Section 4.3)。セッション表が満杯なら Sender の seq のまま返す
+ * （ステートレス動作）。
+ */
+__attribute__((hot)) static inline void
+set_session_seq(uint8_t *buffer,
+		const struct sockaddr_storage *cliaddr,
+		uint16_t ssid)
+{
+	struct stamp_session_key key;
+	uint32_t seq;
+	stamp_session_key_from(&key, cliaddr, ssid);
+	if (unlikely(!stamp_session_next_seq(g_session_table,
+					     &key,
+					     coarse_now_sec(),
+					     &seq))) {
+		if (!__atomic_exchange_n(&g_warned_sessions_full,
+					 true,
+					 __ATOMIC_RELAXED)) {
+			fprintf(stderr,
+				"Warning: session table full; replying "
+				"statelessly to new senders\n");
+		}
+		return;
+	}
+	struct stamp_reflector_packet *packet =
+		(struct stamp_reflector_packet *)buffer;
+	packet->seq_num = htonl(seq);
+}
 
+/**
+ * 応答パケットの構築（T3 以外のフィールドを設定）
+ * @param cliaddr 送信元（ステートフル時のセッションのキー）
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((hot)) static inline int
+build_reply_packet(uint8_t *buffer,
+		   int send_len,
+		   uint8_t ttl,
+		   uint32_t t2_sec,
+		   uint32_t t2_frac,
+		   const struct sockaddr_storage *cliaddr)
+{
 	if (unlikely(send_len <= 0 || send_len > STAMP_MAX_PACKET_SIZE)) {
 		fprintf(stderr,
 			"Invalid packet size: %d (valid range: 1-%d)\n",
@@ -375,19 +842,36 @@ __attribute__((hot)) static inline int reflect_packet(
 			STAMP_BASE_PACKET_SIZE);
 	}
 
+	// SSID は応答の MBZ と同じ位置にあるため、応答の構築前に読む
+	uint16_t ssid = g_session_table != NULL ? stamp_sender_ssid(buffer) : 0;
 	stamp_build_reflector_packet(buffer,
 				     send_len,
 				     ttl,
 				     t2_sec,
 				     t2_frac,
 				     g_error_estimate_nbo);
+	if (g_session_table != NULL) {
+		set_session_seq(buffer, cliaddr, ssid);
+	}
+	return 0;
+}
 
-	packet = (struct stamp_reflector_packet *)buffer;
+/**
+ * 応答パケットへの T3（送信時刻）の打刻
+ *
+ * T3 はパケットに格納してから送信するため、T1 のように送信後に
+ * MSG_ERRQUEUE から HW TX タイムスタンプを取得する方式は使えない。
+ * PHC 有効時は NIC と同一の HW クロックを読み取ることで近似する。
+ * 呼び出し元は送信システムコールの直前に呼ぶこと。
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((hot)) static inline int set_reply_t3(uint8_t *buffer)
+{
+	struct stamp_reflector_packet *packet =
+		(struct stamp_reflector_packet *)buffer;
+	uint32_t t3_sec;
+	uint32_t t3_frac;
 
-	// T3: 送信時刻（sendto() 直前に取得）
-	// T3 はパケットに格納してから送信するため、T1 のように sendto() 後に
-	// MSG_ERRQUEUE から HW TX タイムスタンプを取得する方式は使えない。
-	// PHC 有効時は NIC と同一の HW クロックを読み取ることで近似する。
 #ifdef __linux__
 	if (g_phc_enabled) {
 		if (unlikely(stamp_get_phc_timestamp(g_phc_clockid,
@@ -399,77 +883,228 @@ __attribute__((hot)) static inline int reflect_packet(
 		}
 	} else
 #endif
-		if (unlikely(stamp_get_timestamp(&t3_sec,
-						 &t3_frac,
-						 g_ptp_mode) != 0)) {
+		if (stamp_tsc_enabled(&g_tsc_clock)) {
+		stamp_tsc_get_timestamp(&g_tsc_clock, &t3_sec, &t3_frac, g_ptp_mode);
+	} else if (unlikely(stamp_get_timestamp(&t3_sec,
+						&t3_frac,
+						g_ptp_mode) != 0)) {
 		fprintf(stderr, "Failed to get T3 timestamp\n");
 		return -1;
 	}
 	packet->timestamp_sec = t3_sec;
 	packet->timestamp_frac = t3_frac;
+	return 0;
+}
 
-	ssize_t send_result = sendto(sockfd,
-				     (const char *)buffer,
-				     (size_t)send_len,
-				     0,
-				     (const struct sockaddr *)cliaddr,
-				     len);
-	if (unlikely(send_result < 0)) {
-		int err = SOCKET_ERRNO;
-		char addr_str[INET6_ADDRSTRLEN];
-		stamp_sockaddr_to_string_safe(cliaddr,
-					      addr_str,
-					      sizeof(addr_str));
+/**
+ * ログ 1 行を整形出力する（書き出しスレッド、または同期出力時）
+ * 反射ログは stdout、警告は stderr へ書く。
+ */
+static void print_log_record(const struct stamp_log_record *rec)
+{
+	char addr_str[STAMP_ADDR_PORT_BUFSIZE];
+	switch (rec->kind) {
+	case STAMP_LOG_INVALID:
+		fprintf(stderr,
+			"Warning: invalid STAMP/TWAMP-Test payload received "
+			"(%d bytes, invalid Error Estimate or too short); "
+			"dropping\n",
+			rec->len);
+		return;
+	case STAMP_LOG_UNDERSIZED:
+		fprintf(stderr,
+			"Warning: undersized STAMP packet received (%d "
+			"bytes); will pad to %d bytes.\n",
+			rec->len,
+			STAMP_BASE_PACKET_SIZE);
+		return;
+	case STAMP_LOG_SEND_FAILED:
+		stamp_sockaddr_to_string_safe(&rec->addr, addr_str, sizeof(addr_str));
 		fprintf(stderr,
-			"sendto failed: error=%d, dest=%s, addrlen=%d, "
+			"sendto failed: error=%d, dest=%s, addrlen=%u, "
 			"family=%d, send_len=%d\n",
-			err,
+			rec->err,
 			addr_str,
-			(int)len,
-			cliaddr->ss_family,
-			send_len);
-		g_stats.packets_dropped++;
-		return -1;
+			rec->addrlen,
+			rec->addr.ss_family,
+			rec->len);
+		return;
+	case STAMP_LOG_REFLECTED:
+	default:
+		break;
 	}
+	stamp_format_sockaddr_with_port(&rec->addr, addr_str, sizeof(addr_str));
+	const char *ttl_label =
+		(rec->addr.ss_family == AF_INET6) ? "Hop Limit" : "TTL";
+	printf("Reflected packet Seq: %" PRIu32 " from %s (%s: %d)\n",
+	       rec->seq,
+	       addr_str,
+	       ttl_label,
+	       rec->ttl);
+}
 
-	g_stats.packets_reflected++;
-	return 0;
+/**
+ * ログ 1 行を出力する
+ * 書き出しスレッドの稼働中はリングへ積むだけで、整形も stdio も呼ばない
+ * （リングが満杯なら破棄）。
+ */
+static void emit_log_record(const struct stamp_log_record *rec)
+{
+	if (g_log_async) {
+		(void)stamp_logring_push(&g_logring, rec);
+		return;
+	}
+	print_log_record(rec);
 }
 
 /**
- * reflector のコマンドラインオプション
+ * 受信したパケットの警告（不正ペイロード・規定サイズ未満）
  */
-struct reflector_options {
-	int af_hint;
-	uint16_t port;
-	bool ptp_mode;
-#ifndef _WIN32
-	bool debug_mode;
-#endif
-#ifdef __linux__
-	bool phc_requested;
-#endif
-};
+__attribute__((cold)) static void
+report_bad_request(enum stamp_log_kind kind,
+		   const struct sockaddr_storage *cliaddr,
+		   int n)
+{
+	struct stamp_log_record rec;
+	memset(&rec, 0, sizeof(rec));
+	memcpy(&rec.addr, cliaddr, stamp_get_sockaddr_len(cliaddr->ss_family));
+	rec.kind = kind;
+	rec.len = n;
+	emit_log_record(&rec);
+}
 
 /**
- * コマンドラインオプションの解析
- * @return 成功時0、エラー時1
+ * 応答送信失敗の警告
  */
-__attribute__((cold)) static int
-parse_reflector_options(int argc, char *argv[], struct reflector_options *opts)
+__attribute__((cold)) static void
+report_send_failure(int err,
+		    const struct sockaddr_storage *cliaddr,
+		    socklen_t len,
+		    int send_len)
 {
-	opts->af_hint = AF_UNSPEC;
-	opts->port = STAMP_PORT;
-	opts->ptp_mode = false;
-#ifndef _WIN32
-	opts->debug_mode = false;
+	struct stamp_log_record rec;
+	memset(&rec, 0, sizeof(rec));
+	size_t copy = (size_t)len < sizeof(rec.addr) ? (size_t)len : sizeof(rec.addr);
+	memcpy(&rec.addr, cliaddr, copy);
+	rec.kind = STAMP_LOG_SEND_FAILED;
+	rec.err = err;
+	rec.addrlen = (uint32_t)len;
+	rec.len = send_len;
+	emit_log_record(&rec);
+}
+
+/**
+ * STAMPパケットの反射処理
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((hot)) static inline int reflect_packet(
+	SOCKET sockfd,
+	uint8_t *buffer,
+	int send_len,
+	const struct sockaddr_storage *cliaddr,
+	socklen_t len,
+	uint8_t ttl,
+	uint32_t t2_sec,
+	uint32_t t2_frac,
+	struct reflector_stats *stats)
+{
+	if (build_reply_packet(buffer, send_len, ttl, t2_sec, t2_frac, cliaddr) !=
+	    0) {
+		return -1;
+	}
+
+	// T3: 送信時刻（sendto() 直前に取得）
+	if (set_reply_t3(buffer) != 0) {
+		return -1;
+	}
+
+	ssize_t send_result = sendto(sockfd,
+				     (const char *)buffer,
+				     (size_t)send_len,
+				     0,
+				     (const struct sockaddr *)cliaddr,
+				     len);
+	if (unlikely(send_result < 0)) {
+		int err = SOCKET_ERRNO;
+		report_send_failure(err, cliaddr, len, send_len);
+		stats->packets_dropped++;
+		count_client_drop(cliaddr, STAMP_CLIENT_DROP_SEND);
+#ifdef __linux__
+		skip_t3_key(err);
+#endif
+		return -1;
+	}
+
+	stats->packets_reflected++;
+	count_client_reflected(buffer, (size_t)send_len, cliaddr);
+#ifdef __linux__
+	note_t3_sent(buffer, cliaddr);
+#endif
+	return 0;
+}
+
+/**
+ * reflector のコマンドラインオプション
+ */
+struct reflector_options {
+	int af_hint;
+	uint16_t port;
+	bool ptp_mode;
+	struct stamp_log_policy log_policy; // -L
+	uint32_t max_sessions; // -s: ステートフル時のセッション数上限（0=ステートレス）
+	uint32_t idle_sec;     // -e: セッションの無受信期限（秒）
+	const char *clients_path; // -S: 送信元別統計の出力先（NULL=無効）
+	struct stamp_allowlist allow; // -a: 送信元の許可リスト（空=全て許可）
+	uint32_t rate_pps;   // -r: 送信元ごとの上限（0=無効）
+	uint32_t rate_burst; // -r: 送信元ごとのバースト
+	uint32_t global_pps; // -g: 全体の上限（0=無効）
+	bool t3_followup;    // -t
+	enum stamp_clock_source clock_source; // -C: T3 を打刻する時計
+#ifndef _WIN32
+	bool debug_mode;
+#endif
+#ifdef __linux__
+	bool phc_requested;
+	uint32_t batch_size; // 1: 従来の1パケット単位処理
+	uint32_t threads;    // 1: main スレッドのみ
+	bool use_uring;	     // -E uring
+	bool use_xdp;	     // -E xdp
+#endif
+};
+
+/**
+ * コマンドラインオプションの解析
+ * @return 成功時0、エラー時1
+ */
+__attribute__((cold)) static int
+parse_reflector_options(int argc, char *argv[], struct reflector_options *opts)
+{
+	opts->af_hint = AF_UNSPEC;
+	opts->port = STAMP_PORT;
+	opts->ptp_mode = false;
+	opts->log_policy = (struct stamp_log_policy){STAMP_LOG_ALL, 0};
+	opts->max_sessions = 0;
+	opts->idle_sec = STAMP_SESSION_DEFAULT_IDLE_SEC;
+	opts->clients_path = NULL;
+	opts->allow.count = 0;
+	opts->rate_pps = 0;
+	opts->rate_burst = 0;
+	opts->global_pps = 0;
+	opts->t3_followup = false;
+	opts->clock_source = STAMP_CLOCK_SYSTEM;
+#ifndef _WIN32
+	opts->debug_mode = false;
 #endif
 #ifdef __linux__
 	opts->phc_requested = false;
+	opts->batch_size = 1;
+	opts->threads = 1;
+	opts->use_uring = false;
+	opts->use_xdp = false;
 #endif
 
 	int opt;
-	while ((opt = getopt(argc, argv, "46di:Pc")) != -1) {
+	while ((opt = getopt(argc, argv, "46di:Pcb:T:E:L:s:e:S:a:r:g:tC:")) != -1) {
 		switch (opt) {
 		case '4':
 			opts->af_hint = AF_INET;
@@ -507,6 +1142,166 @@ parse_reflector_options(int argc, char *argv[], struct reflector_options *opts)
 				"Linux\n");
 #endif
 			break;
+		case 'b':
+#ifdef __linux__
+			if (stamp_parse_u32_range(optarg,
+						  &opts->batch_size,
+						  STAMP_MMSG_MAX_BATCH) != 0) {
+				fprintf(stderr,
+					"Invalid batch size: %s (valid range: "
+					"1-%d)\n",
+					optarg,
+					STAMP_MMSG_MAX_BATCH);
+				return 1;
+			}
+#else
+			fprintf(stderr,
+				"Warning: -b option is only supported on "
+				"Linux\n");
+#endif
+			break;
+		case 'T':
+#ifdef __linux__
+			if (stamp_parse_u32_range(optarg,
+						  &opts->threads,
+						  REFLECTOR_MAX_WORKERS) != 0) {
+				fprintf(stderr,
+					"Invalid thread count: %s (valid range: "
+					"1-%d)\n",
+					optarg,
+					REFLECTOR_MAX_WORKERS);
+				return 1;
+			}
+#else
+			fprintf(stderr,
+				"Warning: -T option is only supported on "
+				"Linux\n");
+#endif
+			break;
+		case 'E':
+			if (strcmp(optarg, "socket") == 0) {
+#ifdef __linux__
+				opts->use_uring = false;
+				opts->use_xdp = false;
+#endif
+			} else if (strcmp(optarg, "uring") == 0) {
+#ifdef __linux__
+				opts->use_uring = true;
+				opts->use_xdp = false;
+#else
+				fprintf(stderr,
+					"Warning: -E uring is only supported "
+					"on Linux; using socket engine\n");
+#endif
+			} else if (strcmp(optarg, "xdp") == 0) {
+#ifdef __linux__
+				opts->use_xdp = true;
+				opts->use_uring = false;
+#else
+				fprintf(stderr,
+					"Warning: -E xdp is only supported "
+					"on Linux; using socket engine\n");
+#endif
+			} else {
+				fprintf(stderr,
+					"Invalid engine: %s (expected socket, "
+					"uring or xdp)\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'L':
+			if (stamp_log_policy_parse(optarg, &opts->log_policy) !=
+			    0) {
+				fprintf(stderr,
+					"Invalid log level: %s (expected all, "
+					"silent, sample:N or rate:N)\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			if (stamp_parse_u32_range(optarg,
+						  &opts->max_sessions,
+						  STAMP_SESSION_MAX) != 0) {
+				fprintf(stderr,
+					"Invalid session limit: %s (valid "
+					"range: 1-%u)\n",
+					optarg,
+					STAMP_SESSION_MAX);
+				return 1;
+			}
+			break;
+		case 'e':
+			if (stamp_parse_u32_range(optarg,
+						  &opts->idle_sec,
+						  UINT32_MAX) != 0) {
+				fprintf(stderr,
+					"Invalid idle timeout: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'S':
+			opts->clients_path = optarg;
+			break;
+		case 'a':
+#ifdef __linux__
+			if (stamp_allowlist_add(&opts->allow, optarg) != 0) {
+				fprintf(stderr,
+					"Invalid source prefix list: %s (up to "
+					"%u prefixes)\n",
+					optarg,
+					STAMP_ALLOW_MAX);
+				return 1;
+			}
+#else
+			// 許可リストはカーネル内フィルタでのみ適用する
+			fprintf(stderr,
+				"-a option is only supported on Linux\n");
+			return 1;
+#endif
+			break;
+		case 'r':
+			if (stamp_rate_parse(optarg,
+					     &opts->rate_pps,
+					     &opts->rate_burst) != 0) {
+				fprintf(stderr,
+					"Invalid rate limit: %s (expected "
+					"pps[:burst], pps 1-%u)\n",
+					optarg,
+					STAMP_RATE_MAX_PPS);
+				return 1;
+			}
+			break;
+		case 'g':
+			if (stamp_parse_u32_range(optarg,
+						  &opts->global_pps,
+						  STAMP_RATE_MAX_PPS) != 0) {
+				fprintf(stderr,
+					"Invalid global rate cap: %s (valid "
+					"range: 1-%u)\n",
+					optarg,
+					STAMP_RATE_MAX_PPS);
+				return 1;
+			}
+			break;
+		case 't':
+#ifdef __linux__
+			opts->t3_followup = true;
+#else
+			fprintf(stderr,
+				"Warning: -t option is only supported on "
+				"Linux\n");
+#endif
+			break;
+		case 'C':
+			if (stamp_clock_source_parse(optarg,
+						     &opts->clock_source) != 0) {
+				fprintf(stderr, "Invalid clock: %s\n", optarg);
+				return 1;
+			}
+			break;
 		default:
 			print_usage(argc > 0 ? argv[0] : "reflector");
 			return 1;
@@ -518,6 +1313,32 @@ parse_reflector_options(int argc, char *argv[], struct reflector_options *opts)
 		print_usage(argc > 0 ? argv[0] : "reflector");
 		return 1;
 	}
+#ifdef __linux__
+	if (opts->t3_followup && (opts->use_uring || opts->use_xdp)) {
+		// io_uring は送信順とキーの順が一致する保証が無く、AF_XDP の
+		// 応答はソケットを通らない
+		fprintf(stderr, "-t requires the socket engine (-E socket)\n");
+		return 1;
+	}
+	if (opts->use_uring && opts->batch_size > 1) {
+		fprintf(stderr,
+			"Warning: -b is ignored with -E uring (completions "
+			"are already batched)\n");
+		opts->batch_size = 1;
+	}
+	if (opts->use_xdp) {
+		if (g_ifname == NULL) {
+			fprintf(stderr, "-E xdp requires -i interface\n");
+			return 1;
+		}
+		if (opts->batch_size > 1) {
+			fprintf(stderr,
+				"Warning: -b is ignored with -E xdp (frames "
+				"are already batched)\n");
+			opts->batch_size = 1;
+		}
+	}
+#endif
 
 	if (remaining_args > 0 &&
 	    stamp_parse_port(argv[optind], &opts->port) != 0) {
@@ -531,7 +1352,15 @@ parse_reflector_options(int argc, char *argv[], struct reflector_options *opts)
 
 #ifndef _WIN32
 /**
- * シグナルハンドラの設定（SIGINT/SIGTERM/SIGABRT）
+ * SIGUSR1: 送信元別統計の出力を要求する（各ワーカーが次の受信ループで出力）
+ */
+static void request_client_dump(__attribute__((unused)) int signal)
+{
+	__atomic_fetch_add(&g_clients_dump_gen, 1U, __ATOMIC_RELAXED);
+}
+
+/**
+ * シグナルハンドラの設定（SIGINT/SIGTERM/SIGABRT、-S 指定時は SIGUSR1）
  */
 __attribute__((cold)) static void setup_signal_handlers(void)
 {
@@ -555,27 +1384,138 @@ __attribute__((cold)) static void setup_signal_handlers(void)
 			"Warning: sigaction(SIGABRT) failed: %s\n",
 			strerror(errno));
 	}
+	if (g_clients_fp != NULL) {
+		sa.sa_handler = request_client_dump;
+		sa.sa_flags = SA_RESTART;
+		if (sigaction(SIGUSR1, &sa, NULL) != 0) {
+			fprintf(stderr,
+				"Warning: sigaction(SIGUSR1) failed: %s\n",
+				strerror(errno));
+		}
+	}
 }
 #endif
 
-static void print_reflected_info(
+/**
+ * 反射したパケットのログ（-L の出力レベルで間引く）
+ * 書き出しスレッドの稼働中は生データをリングへ積むだけで、整形も stdio も
+ * 呼ばない（リングが満杯なら破棄）。
+ */
+__attribute__((hot)) static void print_reflected_info(
 	const uint8_t *buffer,
 	const struct sockaddr_storage *cliaddr,
 	uint8_t ttl)
 {
+	if (g_log_policy.mode == STAMP_LOG_SILENT) {
+		return;
+	}
+	uint64_t now_sec =
+		g_log_policy.mode == STAMP_LOG_RATE ? coarse_now_sec() : 0;
+	if (!stamp_log_should_emit(&g_log_policy, &g_log_limiter, now_sec)) {
+		return;
+	}
+
 	const struct stamp_reflector_packet *packet =
 		(const struct stamp_reflector_packet *)buffer;
+	struct stamp_log_record rec;
+	memcpy(&rec.addr, cliaddr, stamp_get_sockaddr_len(cliaddr->ss_family));
+	rec.kind = STAMP_LOG_REFLECTED;
+	rec.seq = (uint32_t)ntohl(packet->sender_seq_num);
+	rec.ttl = ttl;
+	emit_log_record(&rec);
+}
+
+/**
+ * 受信ペイロードの検証とパディング (RFC 8762 Section 4.2)
+ *
+ * 不正ペイロード・TTL 欠落時は破棄として統計に計上する。
+ * @param n 受信バイト数
+ * @param send_len 応答送信バイト数の格納先
+ * @return 応答すべき場合0、破棄した場合-1
+ */
+__attribute__((hot)) static int
+check_and_pad_request(uint8_t *buffer,
+		      int n,
+		      uint8_t ttl,
+		      const struct sockaddr_storage *cliaddr,
+		      int *send_len,
+		      struct reflector_stats *stats)
+{
+	enum stamp_reflector_input_check_result input_check =
+		stamp_check_reflector_input(buffer, n, ttl);
+
+	if (unlikely(input_check == STAMP_REFLECTOR_INPUT_INVALID_PAYLOAD)) {
+		report_bad_request(STAMP_LOG_INVALID, cliaddr, n);
+		stats->packets_dropped++;
+		count_client_drop(cliaddr, STAMP_CLIENT_DROP_INVALID);
+		return -1;
+	}
+
+	if (unlikely(input_check == STAMP_REFLECTOR_INPUT_MISSING_TTL)) {
+		if (!__atomic_exchange_n(&g_warned_ttl_unavailable,
+					 true,
+					 __ATOMIC_RELAXED)) {
+			fprintf(stderr,
+				"Warning: TTL/Hop Limit could not be obtained; "
+				"dropping packets to preserve RFC 8762 "
+				"Session-Sender TTL copy semantics\n");
+		}
+		stats->packets_dropped++;
+		count_client_drop(cliaddr, STAMP_CLIENT_DROP_TTL);
+		return -1;
+	}
+
+	/* 規定サイズ未満のパケットをゼロパディング */
+	bool was_padded;
+	stamp_pad_to_base_size(buffer, n, send_len, &was_padded);
+	if (was_padded) {
+		report_bad_request(STAMP_LOG_UNDERSIZED, cliaddr, n);
+	}
+	return 0;
+}
+
+#ifndef _WIN32
+/**
+ * 受信パケットのデバッグ出力
+ */
+__attribute__((cold)) static void
+debug_log_received(int n,
+		   const struct sockaddr_storage *cliaddr,
+		   socklen_t len,
+		   uint8_t ttl)
+{
 	char addr_port_str[STAMP_ADDR_PORT_BUFSIZE];
 	stamp_format_sockaddr_with_port(cliaddr,
 					addr_port_str,
 					sizeof(addr_port_str));
-	const char *ttl_label =
-		(cliaddr->ss_family == AF_INET6) ? "Hop Limit" : "TTL";
-	printf("Reflected packet Seq: %" PRIu32 " from %s (%s: %d)\n",
-	       (uint32_t)ntohl(packet->sender_seq_num),
-	       addr_port_str,
-	       ttl_label,
-	       ttl);
+	DEBUG_LOG("Received %d bytes from %s (family=%d, "
+		  "addrlen=%d, ttl=%d)",
+		  n,
+		  addr_port_str,
+		  cliaddr->ss_family,
+		  (int)len,
+		  ttl);
+}
+#endif
+
+/**
+ * 受信エラーの処理（停止要求・タイムアウトは無音で戻る）
+ */
+static void handle_recv_error(void)
+{
+	if (!__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+		return;
+	}
+	if (stamp_recv_timed_out()) {
+		return;
+	}
+#ifndef _WIN32
+	// SO_RCVTIMEO 付きの受信は SA_RESTART でも再開されない（SIGUSR1）
+	if (SOCKET_ERRNO == EINTR) {
+		return;
+	}
+#endif
+	PRINT_SOCKET_ERROR("recvfrom failed");
 }
 
 /**
@@ -588,7 +1528,8 @@ __attribute__((hot)) static void handle_one_packet(
 	uint8_t *buffer,
 	int buffer_size,
 	struct sockaddr_storage *cliaddr,
-	socklen_t *len)
+	socklen_t *len,
+	struct reflector_stats *stats)
 {
 	uint8_t ttl = 0;
 	uint32_t t2_sec = 0;
@@ -605,71 +1546,27 @@ __attribute__((hot)) static void handle_one_packet(
 					  &t2_frac,
 					  g_ptp_mode);
 	if (n < 0) {
-		if (!__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
-			return;
-		}
-		if (stamp_recv_timed_out()) {
-			return;
-		}
-		PRINT_SOCKET_ERROR("recvfrom failed");
+		handle_recv_error();
 		return;
 	}
 	if (n == 0) {
 		return;
 	}
+	if (!admit_packet(cliaddr, rate_now_ns(), stats)) {
+		return;
+	}
 
 #ifndef _WIN32
 	if (g_debug_mode) {
-		char addr_port_str[STAMP_ADDR_PORT_BUFSIZE];
-		stamp_format_sockaddr_with_port(cliaddr,
-						addr_port_str,
-						sizeof(addr_port_str));
-		DEBUG_LOG("Received %d bytes from %s (family=%d, "
-			  "addrlen=%d, ttl=%d)",
-			  n,
-			  addr_port_str,
-			  cliaddr->ss_family,
-			  (int)*len,
-			  ttl);
+		debug_log_received(n, cliaddr, *len, ttl);
 	}
 #endif
 
-	/* Step 2: 入力バリデーション（Error Estimate・パケット長・TTL） */
-	enum stamp_reflector_input_check_result input_check =
-		stamp_check_reflector_input(buffer, n, ttl);
-
-	if (unlikely(input_check == STAMP_REFLECTOR_INPUT_INVALID_PAYLOAD)) {
-		fprintf(stderr,
-			"Warning: invalid STAMP/TWAMP-Test payload received "
-			"(%d bytes, invalid Error Estimate or too short); "
-			"dropping\n",
-			n);
-		g_stats.packets_dropped++;
-		return;
-	}
-
-	if (unlikely(input_check == STAMP_REFLECTOR_INPUT_MISSING_TTL)) {
-		if (!g_warned_ttl_unavailable) {
-			fprintf(stderr,
-				"Warning: TTL/Hop Limit could not be obtained; "
-				"dropping packets to preserve RFC 8762 "
-				"Session-Sender TTL copy semantics\n");
-			g_warned_ttl_unavailable = true;
-		}
-		g_stats.packets_dropped++;
-		return;
-	}
-
-	/* Step 3: 規定サイズ未満のパケットをゼロパディング */
+	/* Step 2-3: 入力バリデーション（Error Estimate・パケット長・TTL）とパディング */
 	int send_len;
-	bool was_padded;
-	stamp_pad_to_base_size(buffer, n, &send_len, &was_padded);
-	if (was_padded) {
-		fprintf(stderr,
-			"Warning: undersized STAMP packet received (%d "
-			"bytes); will pad to %d bytes.\n",
-			n,
-			STAMP_BASE_PACKET_SIZE);
+	if (check_and_pad_request(buffer, n, ttl, cliaddr, &send_len, stats) !=
+	    0) {
+		return;
 	}
 
 	/* Step 4: 応答パケットを構築して送信元へ返送 */
@@ -680,17 +1577,129 @@ __attribute__((hot)) static void handle_one_packet(
 			   *len,
 			   ttl,
 			   t2_sec,
-			   t2_frac) == 0) {
+			   t2_frac,
+			   stats) == 0) {
 		print_reflected_info(buffer, cliaddr, ttl);
 	}
 }
 
+#ifdef __linux__
+/**
+ * 送信キューに積んだ応答を sendmmsg で一括返送
+ *
+ * 各応答の T3 は sendmmsg 直前に個別に打刻する。部分送信で残りを再送する
+ * 場合は、残りの応答の T3 を打ち直してから送る（T3 が実送信より過去に
+ * ずれるのを防ぐ）。先頭で失敗したパケットは破棄として計上し次へ進む。
+ */
+__attribute__((hot)) static void
+flush_reply_batch(SOCKET sockfd,
+		  struct stamp_mmsg_batch *batch,
+		  struct reflector_stats *stats)
+{
+	unsigned int off = 0;
+	while (off < batch->tx_count) {
+		for (unsigned int t = off; t < batch->tx_count; t++) {
+			if (unlikely(set_reply_t3(batch->tx_iov[t].iov_base) != 0)) {
+				stats->packets_dropped += batch->tx_count - off;
+				return;
+			}
+		}
+
+		int sent = stamp_mmsg_send(sockfd, batch, off);
+		if (unlikely(sent <= 0)) {
+			int err = SOCKET_ERRNO;
+			const struct msghdr *hdr = &batch->tx_msgs[off].msg_hdr;
+			report_send_failure(err,
+					    hdr->msg_name,
+					    hdr->msg_namelen,
+					    (int)batch->tx_iov[off].iov_len);
+			stats->packets_dropped++;
+			count_client_drop(hdr->msg_name, STAMP_CLIENT_DROP_SEND);
+			skip_t3_key(err);
+			off++;
+			continue;
+		}
+
+		for (unsigned int t = off; t < off + (unsigned int)sent; t++) {
+			const struct stamp_mmsg_slot *slot =
+				&batch->slots[batch->tx_slot[t]];
+			stats->packets_reflected++;
+			count_client_reflected(batch->tx_iov[t].iov_base,
+					       batch->tx_iov[t].iov_len,
+					       &slot->addr);
+			note_t3_sent(batch->tx_iov[t].iov_base, &slot->addr);
+			print_reflected_info(batch->tx_iov[t].iov_base,
+					     &slot->addr,
+					     slot->ttl);
+		}
+		off += (unsigned int)sent;
+	}
+}
+
+/**
+ * バッチ受信・反射処理（-b 指定時）
+ *
+ * recvmmsg で最大 N 本を受信し、各パケットの T2/TTL で応答を構築して
+ * 送信キューへ積み、最後に sendmmsg で一括返送する。
+ */
+__attribute__((hot)) static void
+handle_packet_batch(SOCKET sockfd,
+		    struct stamp_mmsg_batch *batch,
+		    struct reflector_stats *stats)
+{
+	int n = stamp_mmsg_recv(sockfd, batch, g_ptp_mode);
+	if (n < 0) {
+		handle_recv_error();
+		return;
+	}
+
+	uint64_t now_ns = rate_now_ns();
+	for (unsigned int i = 0; i < (unsigned int)n; i++) {
+		const struct stamp_mmsg_slot *slot = &batch->slots[i];
+		uint8_t *buf = stamp_mmsg_slot_buf(batch, i);
+		if (slot->len <= 0 || !admit_packet(&slot->addr, now_ns, stats)) {
+			continue;
+		}
+		if (g_debug_mode) {
+			debug_log_received(slot->len,
+					   &slot->addr,
+					   batch->rx_msgs[i].msg_hdr.msg_namelen,
+					   slot->ttl);
+		}
+
+		int send_len;
+		if (check_and_pad_request(buf,
+					  slot->len,
+					  slot->ttl,
+					  &slot->addr,
+					  &send_len,
+					  stats) != 0) {
+			continue;
+		}
+		if (build_reply_packet(buf,
+				       send_len,
+				       slot->ttl,
+				       slot->t2_sec,
+				       slot->t2_frac,
+				       &slot->addr) != 0) {
+			continue;
+		}
+		stamp_mmsg_queue_reply(batch, i, send_len);
+	}
+
+	flush_reply_batch(sockfd, batch, stats);
+}
+#endif
+
 /**
  * 開始メッセージの表示
  */
 __attribute__((cold)) static void
-print_reflector_start_message(uint16_t port, int af_hint, int socket_family)
+print_reflector_start_message(const struct reflector_options *opts,
+			      int socket_family)
 {
+	uint16_t port = opts->port;
+	int af_hint = opts->af_hint;
 	const char *mode_str;
 	if (af_hint == AF_UNSPEC) {
 		mode_str = (socket_family == AF_INET6)
@@ -707,7 +1716,41 @@ print_reflector_start_message(uint16_t port, int af_hint, int socket_family)
 	if (g_phc_enabled) {
 		printf(" [PHC]");
 	}
+	if (opts->batch_size > 1) {
+		printf(" [batch %u]", opts->batch_size);
+	}
+	if (opts->threads > 1) {
+		printf(" [%u workers]", opts->threads);
+	}
+	if (opts->use_uring) {
+		printf(" [io_uring]");
+	}
+	if (opts->use_xdp) {
+		printf(" [AF_XDP on %s]", g_ifname);
+	}
+#endif
+	if (opts->max_sessions > 0) {
+		printf(" [stateful, %u sessions]", opts->max_sessions);
+	}
+	if (opts->allow.count > 0) {
+		printf(" [allowlist %u prefixes]", opts->allow.count);
+	}
+	if (opts->rate_pps > 0) {
+		printf(" [rate %u/s burst %u per source]",
+		       opts->rate_pps,
+		       opts->rate_burst);
+	}
+	if (opts->global_pps > 0) {
+		printf(" [cap %u/s]", opts->global_pps);
+	}
+#ifdef __linux__
+	if (g_t3_followup) {
+		printf(" [T3 check: %s TX timestamps]", g_t3_hw ? "HW" : "SW");
+	}
 #endif
+	if (stamp_tsc_enabled(&g_tsc_clock)) {
+		printf(" [TSC %.0f MHz]", stamp_tsc_mhz(&g_tsc_clock));
+	}
 	printf("...\n");
 	printf("Press Ctrl+C to stop and show statistics\n");
 }
@@ -754,15 +1797,1163 @@ platform_post_init_reflector(SOCKET sockfd, uint16_t port, int socket_family)
 #endif
 }
 
-int main(int argc, char *argv[])
+/**
+ * ワーカーのセッション表・送信元別統計表・T3 の記録を確保する（-s / -S / -t
+ * 指定時）
+ * 同じ Sender は常に同じワーカーで受信されるため、表はワーカーごとに独立に
+ * 持ちロックを取らない。上限はワーカー数で等分する。
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((cold)) static int
+open_worker_tables(struct reflector_worker *worker,
+		   unsigned int count,
+		   const struct reflector_options *opts)
 {
-	AUTO_CLOSE_SOCKET SOCKET sockfd = INVALID_SOCKET;
+	uint64_t seed = 0;
+	uint32_t t_sec;
+	uint32_t t_frac;
+	if (stamp_get_timestamp(&t_sec, &t_frac, false) == 0) {
+		seed = ((uint64_t)t_sec << 32) ^ t_frac;
+	}
+	seed ^= (uint64_t)(uintptr_t)worker;
+
+	if (opts->max_sessions > 0) {
+		uint32_t per_worker = opts->max_sessions / count;
+		worker->sessions = malloc(sizeof(*worker->sessions));
+		if (worker->sessions == NULL ||
+		    stamp_session_table_init(worker->sessions,
+					     per_worker > 0 ? per_worker : 1,
+					     opts->idle_sec,
+					     seed,
+					     coarse_now_sec()) != 0) {
+			fprintf(stderr, "Failed to allocate session table\n");
+			free(worker->sessions);
+			worker->sessions = NULL;
+			return -1;
+		}
+	}
+	if (opts->clients_path != NULL) {
+		uint32_t per_worker = STAMP_CLIENTS_DEFAULT_MAX / count;
+		worker->clients = malloc(sizeof(*worker->clients));
+		if (worker->clients == NULL ||
+		    stamp_client_table_init(worker->clients,
+					    per_worker > 0 ? per_worker : 1,
+					    STAMP_CLIENTS_IDLE_SEC,
+					    seed ^ UINT64_C(0x5bd1e995),
+					    coarse_now_sec()) != 0) {
+			fprintf(stderr,
+				"Failed to allocate client statistics table\n");
+			free(worker->clients);
+			worker->clients = NULL;
+			return -1;
+		}
+	}
 #ifdef __linux__
-	AUTO_CLOSE_FD int phc_fd = -1;
+	if (opts->t3_followup) {
+		worker->t3 = malloc(sizeof(*worker->t3));
+		if (worker->t3 == NULL) {
+			fprintf(stderr, "Failed to allocate T3 check ring\n");
+			return -1;
+		}
+		stamp_t3_init(worker->t3);
+	}
+#endif
+	return 0;
+}
+
+/**
+ * ワーカーソケットの生成（-T 指定時は全ソケットに SO_REUSEPORT を設定）
+ *
+ * dual-stack が使えず IPv4 にフォールバックした場合、以降のワーカーも IPv4 に
+ * 揃える（同一ポートで IPv6 ソケットと混在させない）。
+ * @return 成功時0、エラー時-1（生成済みソケットは close_workers() で解放する）
+ */
+__attribute__((cold)) static int
+open_workers(struct reflector_worker *workers,
+	     unsigned int count,
+	     const struct reflector_options *opts,
+	     int *out_family)
+{
+	int af_hint = opts->af_hint;
+	for (unsigned int i = 0; i < count; i++) {
+		int family = AF_INET;
+		workers[i].sockfd = init_reflector_socket(opts->port,
+							  af_hint,
+							  &family,
+							  REFLECTOR_IFNAME,
+							  count > 1);
+		if (SOCKET_ERROR_CHECK(workers[i].sockfd)) {
+			return -1;
+		}
+		if (i == 0) {
+			*out_family = family;
+			if (family == AF_INET) {
+				af_hint = AF_INET;
+			}
+		}
+		workers[i].id = i;
+		if (open_worker_tables(&workers[i], count, opts) != 0) {
+			return -1;
+		}
+#ifdef __linux__
+		workers[i].cpu = -1;
+		workers[i].use_uring = opts->use_uring;
+		workers[i].use_xdp = opts->use_xdp;
+		if (opts->batch_size > 1 &&
+		    stamp_mmsg_batch_init(&workers[i].batch, opts->batch_size) !=
+			    0) {
+			fprintf(stderr, "Failed to allocate batch buffers\n");
+			return -1;
+		}
+#endif
+	}
+	return 0;
+}
+
+/**
+ * ワーカーソケット・バッチバッファの解放
+ */
+__attribute__((cold)) static void
+close_workers(struct reflector_worker *workers, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		if (!SOCKET_ERROR_CHECK(workers[i].sockfd)) {
+			CLOSE_SOCKET(workers[i].sockfd);
+			workers[i].sockfd = INVALID_SOCKET;
+		}
+		if (workers[i].sessions != NULL) {
+			stamp_session_table_free(workers[i].sessions);
+			free(workers[i].sessions);
+			workers[i].sessions = NULL;
+		}
+		if (workers[i].clients != NULL) {
+			stamp_client_table_free(workers[i].clients);
+			free(workers[i].clients);
+			workers[i].clients = NULL;
+		}
+#ifdef __linux__
+		stamp_mmsg_batch_free(&workers[i].batch);
+		free(workers[i].t3);
+		workers[i].t3 = NULL;
+#endif
+	}
+}
+
+/**
+ * T3 の誤差の集計を JSON オブジェクトで出力する
+ */
+__attribute__((cold)) static void write_t3_error_json(FILE *fp,
+						      const struct stamp_t3_error *e)
+{
+	fprintf(fp, "{\"count\":%" PRIu64, e->count);
+	if (e->count > 0) {
+		fprintf(fp,
+			",\"mean_ns\":%" PRId64 ",\"min_ns\":%" PRId64
+			",\"max_ns\":%" PRId64,
+			e->sum_ns / (int64_t)e->count,
+			e->min_ns,
+			e->max_ns);
+	}
+	fprintf(fp, ",\"negative\":%" PRIu64 ",\"abs_hist\":[", e->negative);
+	bool first = true;
+	for (uint32_t b = 0; b < STAMP_CLIENTS_HIST_BINS; b++) {
+		if (e->hist[b] == 0) {
+			continue;
+		}
+		fprintf(fp,
+			"%s{\"ge_ns\":%" PRIu64 ",\"count\":%" PRIu32 "}",
+			first ? "" : ",",
+			b == 0 ? UINT64_C(0) : UINT64_C(1) << b,
+			e->hist[b]);
+		first = false;
+	}
+	fputs("]}", fp);
+}
+
+/**
+ * 送信元 1 件分の計数を JSON オブジェクトで出力する
+ * @param with_source 送信元と初回／最終受信時刻を含める（退避済み合計では偽）
+ * @param wall_offset 単調クロック（秒）から UNIX 時刻への差
+ */
+__attribute__((cold)) static void write_client_json(FILE *fp,
+						    const struct stamp_client *c,
+						    bool with_source,
+						    int64_t wall_offset)
+{
+	fputc('{', fp);
+	if (with_source) {
+		struct sockaddr_storage addr;
+		char addr_str[INET6_ADDRSTRLEN];
+		stamp_session_key_addr(&c->entry.key, &addr);
+		stamp_sockaddr_to_string_safe(&addr, addr_str, sizeof(addr_str));
+		fprintf(fp,
+			"\"address\":\"%s\",\"port\":%u,"
+			"\"first_seen\":%" PRId64 ",\"last_seen\":%" PRId64 ",",
+			addr_str,
+			stamp_sockaddr_get_port(&addr),
+			(int64_t)c->first_seen_sec + wall_offset,
+			(int64_t)c->entry.last_seen_sec + wall_offset);
+	}
+	fprintf(fp,
+		"\"packets\":%" PRIu64 ",\"bytes\":%" PRIu64 ","
+		"\"drops\":{\"invalid_payload\":%" PRIu32
+		",\"missing_ttl\":%" PRIu32 ",\"send_failed\":%" PRIu32 "},"
+		"\"residence_hist\":[",
+		c->packets,
+		c->bytes,
+		c->drops[STAMP_CLIENT_DROP_INVALID],
+		c->drops[STAMP_CLIENT_DROP_TTL],
+		c->drops[STAMP_CLIENT_DROP_SEND]);
+	bool first = true;
+	for (uint32_t b = 0; b < STAMP_CLIENTS_HIST_BINS; b++) {
+		if (c->hist[b] == 0) {
+			continue;
+		}
+		fprintf(fp,
+			"%s{\"ge_ns\":%" PRIu64 ",\"count\":%" PRIu32 "}",
+			first ? "" : ",",
+			b == 0 ? UINT64_C(0) : UINT64_C(1) << b,
+			c->hist[b]);
+		first = false;
+	}
+	fputc(']', fp);
+	if (g_t3_followup) {
+		fputs(",\"t3_error\":", fp);
+		write_t3_error_json(fp, &c->t3_error);
+	}
+	fputc('}', fp);
+}
+
+/**
+ * ワーカー 1 本分の送信元別統計を JSON 1 行で出力する（-S）
+ * SIGUSR1 時は当該ワーカーのスレッド自身が呼ぶ（表を他スレッドから読まない）。
+ * @param reason "signal" または "exit"
+ */
+__attribute__((cold)) static void
+write_client_stats(const struct reflector_worker *worker, const char *reason)
+{
+	const struct stamp_client_table *tbl = worker->clients;
+	if (tbl == NULL || g_clients_fp == NULL) {
+		return;
+	}
+	char ts[STAMP_REPORT_TS_MAX];
+	time_t now = time(NULL);
+	int64_t wall_offset = (int64_t)now - (int64_t)coarse_now_sec();
+	if (stamp_report_iso8601_utc(ts, sizeof(ts)) != 0) {
+		ts[0] = '\0';
+	}
+
+	FILE *fp = g_clients_fp;
+#ifdef __linux__
+	pthread_mutex_lock(&g_clients_lock);
+#endif
+	fprintf(fp,
+		"{\"format_version\":\"1.0\",\"timestamp\":%s%s%s,"
+		"\"reason\":\"%s\",\"worker\":%u,\"active\":%" PRIu32
+		",\"evicted\":%" PRIu64 ",\"untracked\":%" PRIu64
+		",\"evicted_totals\":",
+		ts[0] != '\0' ? "\"" : "",
+		ts[0] != '\0' ? ts : "null",
+		ts[0] != '\0' ? "\"" : "",
+		reason,
+		worker->id,
+		tbl->pool.active,
+		tbl->pool.expired,
+		tbl->untracked);
+	write_client_json(fp, &tbl->retired, false, 0);
+#ifdef __linux__
+	if (worker->t3 != NULL) {
+		fprintf(fp,
+			",\"t3_missed\":%" PRIu64,
+			worker->t3->missed);
+	}
+#endif
+	fputs(",\"clients\":[", fp);
+	bool first = true;
+	for (uint32_t i = 0; i < tbl->pool.cap; i++) {
+		const struct stamp_client *c = stamp_client_at(tbl, i);
+		if (c->entry.key.family == 0) {
+			continue;
+		}
+		if (!first) {
+			fputc(',', fp);
+		}
+		write_client_json(fp, c, true, wall_offset);
+		first = false;
+	}
+	fputs("]}\n", fp);
+	fflush(fp);
+#ifdef __linux__
+	pthread_mutex_unlock(&g_clients_lock);
+#endif
+}
+
+/**
+ * SIGUSR1 による出力要求があれば、このワーカーの表を出力する
+ */
+static inline void poll_client_dump(struct reflector_worker *worker)
+{
+	if (worker->clients == NULL) {
+		return;
+	}
+	unsigned int gen =
+		__atomic_load_n(&g_clients_dump_gen, __ATOMIC_RELAXED);
+	if (likely(gen == worker->clients_dump_gen)) {
+		return;
+	}
+	worker->clients_dump_gen = gen;
+	write_client_stats(worker, "signal");
+}
+
+#ifdef __linux__
+/**
+ * 回収した TX タイムスタンプ 1 件を記録と突き合わせ、誤差を送信元別にも計上する
+ */
+static void on_t3_timestamp(const struct stamp_tx_timestamp *ts, void *ctx)
+{
+	struct stamp_t3_followup *f = ctx;
+	struct stamp_session_key key;
+	int64_t err;
+	uint64_t actual = stamp_timestamp_to_ns(ts->sec,
+						ts->frac,
+						ntohs(g_error_estimate_nbo));
+	if (!stamp_t3_resolve(f, ts->key, actual, &key, &err) ||
+	    g_client_table == NULL) {
+		return;
+	}
+	struct sockaddr_storage addr;
+	stamp_session_key_addr(&key, &addr);
+	struct stamp_client *c =
+		stamp_client_lookup(g_client_table, &addr, coarse_now_sec());
+	if (c != NULL) {
+		stamp_t3_error_add(&c->t3_error, err);
+	}
+}
+
+/**
+ * errqueue の TX タイムスタンプを回収する（-t）
+ * 送信ごとには読まず、回収待ちが STAMP_TX_TS_BATCH 件に達するか秒が
+ * 変わったときにまとめて読む。force なら回収待ちが無くても読む（終了時）。
+ */
+static inline void poll_t3_followup(struct reflector_worker *worker, bool force)
+{
+	struct stamp_t3_followup *f = worker->t3;
+	if (f == NULL) {
+		return;
+	}
+	uint64_t now_sec = coarse_now_sec();
+	if (!force && !stamp_t3_should_collect(f, STAMP_TX_TS_BATCH, now_sec)) {
+		return;
+	}
+	f->last_collect_sec = now_sec;
+	(void)stamp_collect_tx_timestamps(worker->sockfd,
+					  g_ptp_mode,
+					  g_t3_hw,
+					  on_t3_timestamp,
+					  f);
+}
+#endif
+
+#ifdef STAMP_HAVE_IO_URING
+/**
+ * io_uring の recvmsg 完了 1 件を処理し、応答すべきものを pending に積む
+ * 破棄したバッファはその場で返却する。
+ */
+__attribute__((hot)) static void
+handle_uring_recv(struct stamp_uring *ring,
+		  const struct io_uring_cqe *cqe,
+		  struct stamp_uring_recv *pending,
+		  unsigned int *pending_count,
+		  struct reflector_stats *stats)
+{
+	struct stamp_uring_recv rx;
+	if (!stamp_uring_parse_recv(ring, cqe, &rx)) {
+		return;
+	}
+	if (!admit_packet(rx.addr, rate_now_ns(), stats)) {
+		stamp_uring_recycle(ring, rx.bid);
+		return;
+	}
+
+	// T2: 当該パケット自身の制御メッセージから取得（無ければ SW 時刻）
+	uint32_t t2_sec;
+	uint32_t t2_frac;
+	if (!stamp_extract_kernel_timestamp_linux(&rx.msg,
+						  &t2_sec,
+						  &t2_frac,
+						  g_ptp_mode) &&
+	    unlikely(stamp_get_timestamp(&t2_sec, &t2_frac, g_ptp_mode) != 0)) {
+		fprintf(stderr,
+			"Warning: Failed to get fallback receive timestamp\n");
+		stamp_uring_recycle(ring, rx.bid);
+		return;
+	}
+	uint8_t ttl = 0;
+	stamp_extract_ttl_from_cmsg(&rx.msg, &ttl);
+
+	if (g_debug_mode) {
+		debug_log_received(rx.len, rx.addr, rx.addrlen, ttl);
+	}
+	if (unlikely(rx.truncated)) {
+		fprintf(stderr,
+			"Warning: packet larger than %d bytes truncated by "
+			"io_uring engine; dropping\n",
+			STAMP_URING_PAYLOAD_MAX);
+		stats->packets_dropped++;
+		count_client_drop(rx.addr, STAMP_CLIENT_DROP_INVALID);
+		stamp_uring_recycle(ring, rx.bid);
+		return;
+	}
+
+	int send_len;
+	if (check_and_pad_request(rx.payload,
+				  rx.len,
+				  ttl,
+				  rx.addr,
+				  &send_len,
+				  stats) != 0 ||
+	    build_reply_packet(rx.payload,
+			       send_len,
+			       ttl,
+			       t2_sec,
+			       t2_frac,
+			       rx.addr) != 0) {
+		stamp_uring_recycle(ring, rx.bid);
+		return;
+	}
+
+	// TTL は応答パケット（sender_ttl）に格納済み。送信完了時の表示用に保持する
+	ring->tx[rx.bid].ttl = ttl;
+	rx.len = send_len;
+	pending[(*pending_count)++] = rx;
+}
+
+/**
+ * io_uring の sendmsg 完了 1 件を処理し、バッファを返却する
+ */
+__attribute__((hot)) static void
+handle_uring_send(struct stamp_uring *ring,
+		  const struct io_uring_cqe *cqe,
+		  struct reflector_stats *stats)
+{
+	uint16_t bid = STAMP_URING_UD_BID(cqe->user_data);
+	const struct stamp_uring_tx *tx = &ring->tx[bid];
+	if (unlikely(cqe->res < 0)) {
+		report_send_failure(-cqe->res,
+				    tx->msg.msg_name,
+				    tx->msg.msg_namelen,
+				    (int)tx->iov.iov_len);
+		stats->packets_dropped++;
+		count_client_drop(tx->msg.msg_name, STAMP_CLIENT_DROP_SEND);
+	} else {
+		stats->packets_reflected++;
+		count_client_reflected(tx->iov.iov_base,
+				       tx->iov.iov_len,
+				       tx->msg.msg_name);
+		print_reflected_info(tx->iov.iov_base, tx->msg.msg_name, tx->ttl);
+	}
+	stamp_uring_recycle(ring, bid);
+}
+
+/**
+ * io_uring エンジンの受信ループ（-E uring）
+ *
+ * multishot recvmsg を常時 armed に保ち、完了した受信から応答を構築して
+ * pending に積む。次の io_uring_enter の直前に pending の各応答へ T3 を
+ * 打刻して sendmsg SQE を積むため、応答の投入と次の完了待ちは 1 回の
+ * システムコールで済む（非 SQPOLL のため送信は enter 内で実行され、
+ * T3 は実送信より前に打刻される）。
+ * @return 停止要求で終了した場合0、エンジンが使えない場合-1
+ */
+__attribute__((hot)) static int run_uring_loop(struct reflector_worker *worker,
+					       struct stamp_uring *ring)
+{
+	struct stamp_uring_recv pending[STAMP_URING_BUF_COUNT];
+	unsigned int pending_count = 0;
+	bool recv_ok = false;
+
+	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+		poll_client_dump(worker);
+		for (unsigned int i = 0; i < pending_count; i++) {
+			if (unlikely(set_reply_t3(pending[i].payload) != 0)) {
+				worker->stats.packets_dropped++;
+				stamp_uring_recycle(ring, pending[i].bid);
+				continue;
+			}
+			// SQ は送信中バッファ数より大きいため満杯にならない
+			(void)stamp_uring_queue_send(ring,
+						     worker->sockfd,
+						     &pending[i],
+						     pending[i].len,
+						     ring->tx[pending[i].bid].ttl);
+		}
+		pending_count = 0;
+
+		if (!ring->recv_armed) {
+			(void)stamp_uring_arm_recv(ring, worker->sockfd);
+		}
+
+		if (stamp_uring_submit_and_wait(ring, STAMP_REFLECTOR_TIMEOUT_MS) !=
+		    0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PRINT_SOCKET_ERROR("io_uring_enter failed");
+			return recv_ok ? 0 : -1;
+		}
+
+		struct io_uring_cqe *cqe;
+		while ((cqe = stamp_uring_peek_cqe(ring)) != NULL) {
+			if (STAMP_URING_UD_KIND(cqe->user_data) ==
+			    STAMP_URING_UD_SEND) {
+				handle_uring_send(ring, cqe, &worker->stats);
+				stamp_uring_cqe_seen(ring);
+				continue;
+			}
+
+			if (!(cqe->flags & IORING_CQE_F_MORE)) {
+				ring->recv_armed = false;
+			}
+			if (cqe->res < 0) {
+				// ENOBUFS: 全バッファ使用中。送信完了で返却後に再 arm する
+				if (cqe->res == -EINVAL && !recv_ok) {
+					fprintf(stderr,
+						"Warning: multishot recvmsg "
+						"not supported by this "
+						"kernel\n");
+					stamp_uring_cqe_seen(ring);
+					return -1;
+				}
+				if (cqe->res != -ENOBUFS) {
+					fprintf(stderr,
+						"io_uring recvmsg failed: %s\n",
+						strerror(-cqe->res));
+				}
+			} else {
+				recv_ok = true;
+				handle_uring_recv(ring,
+						  cqe,
+						  pending,
+						  &pending_count,
+						  &worker->stats);
+			}
+			stamp_uring_cqe_seen(ring);
+		}
+	}
+	return 0;
+}
+
+/**
+ * io_uring エンジンの実行（ワーカースレッド上でリングを生成する）
+ * SINGLE_ISSUER のリングは生成したスレッドからしか投入できないため。
+ * @return 停止要求で終了した場合0、エンジンが使えない場合-1
+ */
+__attribute__((cold)) static int run_uring_worker(struct reflector_worker *worker)
+{
+	static bool warned = false;
+	struct stamp_uring *ring = malloc(sizeof(*ring));
+	if (ring == NULL || stamp_uring_init(ring) != 0) {
+		if (!__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED)) {
+			fprintf(stderr,
+				"Warning: io_uring unavailable (%s); falling "
+				"back to socket engine\n",
+				strerror(ring == NULL ? ENOMEM : errno));
+		}
+		free(ring);
+		return -1;
+	}
+	int rc = run_uring_loop(worker, ring);
+	if (rc != 0 && !__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED)) {
+		fprintf(stderr, "Warning: falling back to socket engine\n");
+	}
+	stamp_uring_free(ring);
+	free(ring);
+	return rc;
+}
+#endif
+
+#ifdef STAMP_HAVE_AF_XDP
+/**
+ * AF_XDP で送信を待つ応答フレーム 1 本
+ */
+struct xdp_reply {
+	struct stamp_xdp_frame frame;
+	uint64_t addr; // UMEM 上のフレームの位置
+	struct sockaddr_storage cliaddr;
+};
+
+/**
+ * AF_XDP で受信したフレームの T2
+ * XDP プログラムが RX メタデータの HW タイムスタンプを置いていればそれを、
+ * 無ければ T3 と同じクロック（PHC 有効時は PHC）の現在時刻を使う。
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((hot)) static int
+get_xdp_t2(uint8_t *data, uint64_t addr, uint32_t *t2_sec, uint32_t *t2_frac)
+{
+	uint64_t ns;
+	if (stamp_xdp_rx_timestamp(data, addr, &ns)) {
+		struct timespec ts = {(time_t)(ns / NSEC_PER_SEC),
+				      (long)(ns % NSEC_PER_SEC)};
+		stamp_timespec_to_stamp(&ts, t2_sec, t2_frac, g_ptp_mode);
+		return 0;
+	}
+	if (g_phc_enabled) {
+		return stamp_get_phc_timestamp(g_phc_clockid,
+					       t2_sec,
+					       t2_frac,
+					       g_ptp_mode);
+	}
+	return stamp_get_timestamp(t2_sec, t2_frac, g_ptp_mode);
+}
+
+/**
+ * AF_XDP の受信フレーム 1 本を UMEM 上でそのまま応答に書き換え、pending に積む
+ * 破棄したフレームはその場でフィルリングへ返す。
+ */
+__attribute__((hot)) static void
+handle_xdp_frame(struct stamp_xdp_socket *xsk,
+		 const struct xdp_desc *desc,
+		 struct xdp_reply *pending,
+		 unsigned int *pending_count,
+		 uint64_t now_ns,
+		 struct reflector_stats *stats)
+{
+	struct xdp_reply *r = &pending[*pending_count];
+	uint8_t *data = stamp_xdp_frame_data(xsk, desc->addr);
+	if (!stamp_xdp_parse(data, desc->len, g_xdp_port, &r->frame)) {
+		stamp_xdp_fill(xsk, desc->addr);
+		return;
+	}
+	stamp_xdp_source(&r->frame, &r->cliaddr);
+	if (!stamp_allowlist_match(g_allowlist, &r->cliaddr) ||
+	    !admit_packet(&r->cliaddr, now_ns, stats)) {
+		stamp_xdp_fill(xsk, desc->addr);
+		return;
+	}
+	uint32_t t2_sec;
+	uint32_t t2_frac;
+	if (unlikely(get_xdp_t2(data, desc->addr, &t2_sec, &t2_frac) != 0)) {
+		fprintf(stderr, "Warning: Failed to get receive timestamp\n");
+		stamp_xdp_fill(xsk, desc->addr);
+		return;
+	}
+
+	uint8_t *payload = data + r->frame.l4_off + 8U;
+	uint8_t ttl = r->frame.ttl;
+	if (g_debug_mode) {
+		debug_log_received((int)r->frame.payload_len,
+				   &r->cliaddr,
+				   stamp_get_sockaddr_len(r->cliaddr.ss_family),
+				   ttl);
+	}
+	// 最小長へのパディングはフレーム内で行う
+	if (unlikely(stamp_xdp_frame_room(desc->addr) <
+		     r->frame.l4_off + 8U + STAMP_BASE_PACKET_SIZE)) {
+		stats->packets_dropped++;
+		count_client_drop(&r->cliaddr, STAMP_CLIENT_DROP_INVALID);
+		stamp_xdp_fill(xsk, desc->addr);
+		return;
+	}
+	int send_len;
+	if (check_and_pad_request(payload,
+				  (int)r->frame.payload_len,
+				  ttl,
+				  &r->cliaddr,
+				  &send_len,
+				  stats) != 0 ||
+	    build_reply_packet(payload,
+			       send_len,
+			       ttl,
+			       t2_sec,
+			       t2_frac,
+			       &r->cliaddr) != 0) {
+		stamp_xdp_fill(xsk, desc->addr);
+		return;
+	}
+	stamp_xdp_build_reply_headers(&r->frame, (uint32_t)send_len);
+	r->addr = desc->addr;
+	(*pending_count)++;
+}
+
+/**
+ * pending の応答へ T3 を打刻してチェックサムを計算し、受信したフレームの
+ * まま TX リングへ積んで送る
+ * TX リングに空きが無い分は送信失敗として破棄する。
+ */
+__attribute__((hot)) static void
+flush_xdp_replies(struct stamp_xdp_socket *xsk,
+		  struct xdp_reply *pending,
+		  unsigned int count,
+		  struct reflector_stats *stats)
+{
+	unsigned int ready = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		uint8_t *payload = pending[i].frame.data + pending[i].frame.l4_off + 8U;
+		if (unlikely(set_reply_t3(payload) != 0)) {
+			stats->packets_dropped++;
+			stamp_xdp_fill(xsk, pending[i].addr);
+			continue;
+		}
+		stamp_xdp_finish_reply(&pending[i].frame);
+		if (ready != i) {
+			pending[ready] = pending[i];
+		}
+		ready++;
+	}
+
+	uint32_t idx;
+	uint32_t n = stamp_xdp_ring_reserve(&xsk->tx, ready, &idx);
+	if (unlikely(n < ready)) {
+		// 送信済みのフレームを回収してから 1 度だけ空きを取り直す
+		uint32_t more;
+		stamp_xdp_kick_tx(xsk);
+		stamp_xdp_recycle_completions(xsk);
+		n += stamp_xdp_ring_reserve(&xsk->tx, ready - n, &more);
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		struct xdp_desc *tx = stamp_xdp_desc_at(&xsk->tx, idx + i);
+		tx->addr = pending[i].addr;
+		tx->len = pending[i].frame.len;
+		tx->options = 0;
+	}
+	if (n > 0) {
+		stamp_xdp_ring_submit(&xsk->tx);
+		stamp_xdp_kick_tx(xsk);
+	}
+
+	for (unsigned int i = 0; i < ready; i++) {
+		const struct xdp_reply *r = &pending[i];
+		const uint8_t *payload = r->frame.data + r->frame.l4_off + 8U;
+		if (unlikely(i >= n)) {
+			report_send_failure(ENOBUFS,
+					    &r->cliaddr,
+					    stamp_get_sockaddr_len(r->cliaddr.ss_family),
+					    (int)r->frame.payload_len);
+			stats->packets_dropped++;
+			count_client_drop(&r->cliaddr, STAMP_CLIENT_DROP_SEND);
+			stamp_xdp_fill(xsk, r->addr);
+			continue;
+		}
+		stats->packets_reflected++;
+		count_client_reflected(payload, r->frame.payload_len, &r->cliaddr);
+		print_reflected_info(payload, &r->cliaddr, r->frame.ttl);
+	}
+}
+
+/**
+ * AF_XDP エンジンの受信ループ（-E xdp）
+ *
+ * 完了リングの送信済みフレームをフィルリングへ戻し、RX リングから最大
+ * STAMP_XDP_BATCH 本を取り出して応答に書き換え、まとめて TX リングへ積む。
+ * RX リングが空の間は AF_XDP ソケットと UDP ソケットを poll で待つ。
+ * UDP ソケットには XDP プログラムがスタックへ渡したフレーム（AF_XDP
+ * ソケットの無いキュー・IP オプション付き・断片）が届くため、
+ * RX リングが空のときに通常の経路で反射する。
+ * @return 停止要求で終了した場合0、エラー時-1
+ */
+__attribute__((hot)) static int run_xdp_loop(struct reflector_worker *worker,
+					     struct stamp_xdp_socket *xsk)
+{
+	struct xdp_reply pending[STAMP_XDP_BATCH];
+	struct pollfd pfds[2] = {
+		{.fd = xsk->fd, .events = POLLIN, .revents = 0},
+		{.fd = worker->sockfd, .events = POLLIN, .revents = 0},
+	};
+	struct sockaddr_storage cliaddr;
+	uint8_t buffer[STAMP_MAX_PACKET_SIZE];
+
+	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+		poll_client_dump(worker);
+		stamp_xdp_recycle_completions(xsk);
+
+		uint32_t idx;
+		uint32_t n = stamp_xdp_ring_peek(&xsk->rx, STAMP_XDP_BATCH, &idx);
+		if (n == 0) {
+			if (poll(pfds, 2, STAMP_REFLECTOR_TIMEOUT_MS) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				PRINT_SOCKET_ERROR("poll failed");
+				return -1;
+			}
+			if (pfds[1].revents & POLLIN) {
+				socklen_t len = sizeof(cliaddr);
+				handle_one_packet(worker->sockfd,
+						  buffer,
+						  sizeof(buffer),
+						  &cliaddr,
+						  &len,
+						  &worker->stats);
+			}
+			continue;
+		}
+
+		unsigned int pending_count = 0;
+		uint64_t now_ns = rate_now_ns();
+		for (uint32_t i = 0; i < n; i++) {
+			handle_xdp_frame(xsk,
+					 stamp_xdp_desc_at(&xsk->rx, idx + i),
+					 pending,
+					 &pending_count,
+					 now_ns,
+					 &worker->stats);
+		}
+		stamp_xdp_ring_release(&xsk->rx);
+		flush_xdp_replies(xsk, pending, pending_count, &worker->stats);
+		stamp_xdp_ring_submit(&xsk->fill);
+	}
+	return 0;
+}
+
+/**
+ * AF_XDP エンジンの実行（キュー worker->id のソケットをワーカースレッド上で生成する）
+ * @return 停止要求で終了した場合0、エンジンが使えない場合-1
+ */
+__attribute__((cold)) static int run_xdp_worker(struct reflector_worker *worker)
+{
+	static bool warned = false;
+	struct stamp_xdp_socket *xsk = malloc(sizeof(*xsk));
+	if (xsk == NULL ||
+	    stamp_xdp_socket_init(xsk, &g_xdp_prog, g_xdp_ifindex, worker->id) !=
+		    0) {
+		if (!__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED)) {
+			fprintf(stderr,
+				"Warning: AF_XDP socket on %s queue %u "
+				"unavailable (%s); falling back to socket "
+				"engine\n",
+				g_ifname,
+				worker->id,
+				strerror(xsk == NULL ? ENOMEM : errno));
+		}
+		free(xsk);
+		return -1;
+	}
+	printf("AF_XDP queue %u: %s mode, %s XDP%s\n",
+	       worker->id,
+	       xsk->zerocopy ? "zero-copy" : "copy",
+	       g_xdp_prog.native ? "native" : "generic",
+	       g_xdp_prog.rx_meta ? ", RX metadata timestamps" : "");
+	fflush(stdout);
+	int rc = run_xdp_loop(worker, xsk);
+	stamp_xdp_socket_free(xsk);
+	free(xsk);
+	return rc;
+}
+#endif
+
+/**
+ * ワーカー 1 本分の受信ループ（停止要求まで）
+ */
+__attribute__((hot)) static void run_worker_loop(struct reflector_worker *worker)
+{
+	g_session_table = worker->sessions;
+	g_client_table = worker->clients;
+#ifdef __linux__
+	g_t3 = worker->t3;
+#endif
+#ifdef STAMP_HAVE_IO_URING
+	if (worker->use_uring && run_uring_worker(worker) == 0) {
+		return;
+	}
+#endif
+#ifdef STAMP_HAVE_AF_XDP
+	if (worker->use_xdp && run_xdp_worker(worker) == 0) {
+		return;
+	}
+#endif
+#ifdef __linux__
+	if (worker->batch.cap > 0) {
+		while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+			handle_packet_batch(worker->sockfd,
+					    &worker->batch,
+					    &worker->stats);
+			poll_t3_followup(worker, false);
+			poll_client_dump(worker);
+		}
+		poll_t3_followup(worker, true);
+		return;
+	}
 #endif
 	struct sockaddr_storage cliaddr;
 	uint8_t buffer[STAMP_MAX_PACKET_SIZE];
 	socklen_t len;
+
+	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+		len = sizeof(cliaddr);
+		handle_one_packet(worker->sockfd,
+				  buffer,
+				  sizeof(buffer),
+				  &cliaddr,
+				  &len,
+				  &worker->stats);
+#ifdef __linux__
+		poll_t3_followup(worker, false);
+#endif
+		poll_client_dump(worker);
+	}
+#ifdef __linux__
+	poll_t3_followup(worker, true);
+#endif
+}
+
+#ifdef __linux__
+/**
+ * 起動時の許可 CPU 集合から各ワーカーの固定先 CPU を巡回で割り当てる
+ * 集合の取得は main スレッドを固定する前に一度だけ行う。
+ */
+__attribute__((cold)) static void
+assign_worker_cpus(struct reflector_worker *workers, unsigned int count)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		fprintf(stderr,
+			"Warning: sched_getaffinity failed: %s; workers will "
+			"not be pinned\n",
+			strerror(errno));
+		return;
+	}
+
+	int cpus[CPU_SETSIZE];
+	unsigned int ncpus = 0;
+	for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed)) {
+			cpus[ncpus++] = (int)cpu;
+		}
+	}
+	if (ncpus == 0) {
+		return;
+	}
+	if (count > ncpus) {
+		fprintf(stderr,
+			"Warning: %u workers on %u CPUs; some CPUs will run "
+			"more than one worker\n",
+			count,
+			ncpus);
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		workers[i].cpu = cpus[i % ncpus];
+	}
+}
+
+/**
+ * 呼び出し元スレッドを指定 CPU に固定する（失敗時は警告のみ）
+ */
+__attribute__((cold)) static void pin_current_thread(int cpu)
+{
+	if (cpu < 0) {
+		return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET((size_t)cpu, &set);
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (rc != 0) {
+		fprintf(stderr,
+			"Warning: failed to pin worker to CPU %d: %s\n",
+			cpu,
+			strerror(rc));
+	}
+}
+
+static void *reflector_worker_thread(void *arg)
+{
+	struct reflector_worker *worker = arg;
+	pin_current_thread(worker->cpu);
+	run_worker_loop(worker);
+	return NULL;
+}
+
+// ログの書き出しスレッド（停止要求は g_log_stop、リングが空なら 1 ms 休む）
+static pthread_t g_log_thread;
+static bool g_log_stop = false;
+
+static void *log_writer_thread(__attribute__((unused)) void *arg)
+{
+	const struct timespec idle = {0, 1000000L};
+	struct stamp_log_record rec;
+	for (;;) {
+		// 停止要求を読んでから排出するので、要求前に積まれた行は全て出る
+		bool stop = __atomic_load_n(&g_log_stop, __ATOMIC_ACQUIRE);
+		bool wrote = false;
+		while (stamp_logring_pop(&g_logring, &rec)) {
+			print_log_record(&rec);
+			wrote = true;
+		}
+		if (wrote) {
+			fflush(stdout);
+		}
+		if (stop) {
+			break;
+		}
+		if (!wrote) {
+			(void)nanosleep(&idle, NULL);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * ログの書き出しスレッドを起動する
+ * -L silent でも警告（不正パケット・送信失敗）を書き出すため起動する。
+ * 起動できなければ同期出力で続行する。シグナルは main スレッドで受けるため
+ * スレッド側ではブロックする。
+ */
+__attribute__((cold)) static void start_log_writer(void)
+{
+	if (stamp_logring_init(&g_logring, STAMP_LOGRING_CAP) != 0) {
+		fprintf(stderr,
+			"Warning: failed to allocate log ring; logging "
+			"synchronously\n");
+		return;
+	}
+	sigset_t block;
+	sigset_t prev;
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGABRT);
+	(void)pthread_sigmask(SIG_BLOCK, &block, &prev);
+	int rc = pthread_create(&g_log_thread, NULL, log_writer_thread, NULL);
+	(void)pthread_sigmask(SIG_SETMASK, &prev, NULL);
+	if (rc != 0) {
+		fprintf(stderr,
+			"Warning: failed to start log writer: %s; logging "
+			"synchronously\n",
+			strerror(rc));
+		stamp_logring_free(&g_logring);
+		return;
+	}
+	g_log_async = true;
+}
+
+/**
+ * 書き出しスレッドに残りのログを排出させて停止する（全ワーカー停止後に呼ぶ）
+ */
+__attribute__((cold)) static void stop_log_writer(void)
+{
+	if (!g_log_async) {
+		return;
+	}
+	__atomic_store_n(&g_log_stop, true, __ATOMIC_RELEASE);
+	(void)pthread_join(g_log_thread, NULL);
+	g_log_async = false;
+	stamp_logring_free(&g_logring);
+}
+#endif
+
+/**
+ * 全ワーカーの実行（停止要求まで戻らない）
+ *
+ * ワーカー 0 は main スレッドで動かし、残りは専用スレッドで動かす。
+ * シグナルは main スレッドのみで受けるよう、ワーカースレッドでは
+ * SIGINT/SIGTERM/SIGABRT/SIGUSR1 をブロックする。各ワーカーは SO_RCVTIMEO
+ * 以内に g_running を再確認してループを抜ける。
+ */
+__attribute__((cold)) static void
+run_workers(struct reflector_worker *workers, unsigned int count)
+{
+#ifdef __linux__
+	if (count > 1) {
+		assign_worker_cpus(workers, count);
+
+		sigset_t block;
+		sigset_t prev;
+		sigemptyset(&block);
+		sigaddset(&block, SIGINT);
+		sigaddset(&block, SIGTERM);
+		sigaddset(&block, SIGABRT);
+		sigaddset(&block, SIGUSR1);
+		(void)pthread_sigmask(SIG_BLOCK, &block, &prev);
+		for (unsigned int i = 1; i < count; i++) {
+			int rc = pthread_create(&workers[i].thread,
+						NULL,
+						reflector_worker_thread,
+						&workers[i]);
+			if (rc != 0) {
+				// 読み手のいないソケットに振り分けられた
+				// パケットが失われるため、reuseport グループから外す
+				fprintf(stderr,
+					"Warning: failed to start worker %u: "
+					"%s\n",
+					i,
+					strerror(rc));
+				CLOSE_SOCKET(workers[i].sockfd);
+				workers[i].sockfd = INVALID_SOCKET;
+				continue;
+			}
+			workers[i].thread_started = true;
+		}
+		(void)pthread_sigmask(SIG_SETMASK, &prev, NULL);
+		pin_current_thread(workers[0].cpu);
+	}
+#endif
+
+	run_worker_loop(&workers[0]);
+
+#ifdef __linux__
+	for (unsigned int i = 1; i < count; i++) {
+		if (workers[i].thread_started) {
+			(void)pthread_join(workers[i].thread, NULL);
+			workers[i].thread_started = false;
+		}
+	}
+#endif
+}
+
+#ifdef __linux__
+/**
+ * AF_XDP エンジンの準備（-E xdp）: -i のインターフェースへ XDP プログラムを付ける
+ * ワーカー i は受信キュー i を受け持つ。付けられなければ警告してソケット
+ * エンジンで動かす。
+ */
+__attribute__((cold)) static void
+setup_xdp_engine(struct reflector_worker *workers,
+		 unsigned int count,
+		 struct reflector_options *opts)
+{
+#ifdef STAMP_HAVE_AF_XDP
+	g_xdp_ifindex = if_nametoindex(g_ifname);
+	g_xdp_port = opts->port;
+	g_allowlist = &opts->allow;
+	if (g_xdp_ifindex == 0) {
+		fprintf(stderr,
+			"Warning: unknown interface %s; falling back to "
+			"socket engine\n",
+			g_ifname);
+	} else if (stamp_xdp_prog_attach(&g_xdp_prog,
+					 g_xdp_ifindex,
+					 opts->port,
+					 count) != 0) {
+		fprintf(stderr,
+			"Warning: cannot attach XDP program to %s (%s); "
+			"falling back to socket engine\n",
+			g_ifname,
+			strerror(errno));
+	} else {
+		return;
+	}
+#else
+	fprintf(stderr,
+		"Warning: AF_XDP is not available in this build; using "
+		"socket engine\n");
+#endif
+	opts->use_xdp = false;
+	for (unsigned int i = 0; i < count; i++) {
+		workers[i].use_xdp = false;
+	}
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+#ifdef __linux__
+	AUTO_CLOSE_FD int phc_fd = -1;
+#endif
+	// スレッドから参照されるため main のスタックではなく静的領域に置く
+	static struct reflector_worker workers[REFLECTOR_MAX_WORKERS];
+	unsigned int worker_count = 0;
 	int socket_family = AF_INET;
 	int exit_code = 0;
 
@@ -777,7 +2968,38 @@ int main(int argc, char *argv[])
 	}
 
 	g_ptp_mode = opts.ptp_mode;
+	g_log_policy = opts.log_policy;
+	g_t3_followup = opts.t3_followup;
+#ifdef __linux__
+	g_t3_hw = opts.t3_followup && opts.phc_requested;
+#endif
+	if (opts.clients_path != NULL) {
+		g_clients_fp = strcmp(opts.clients_path, "-") == 0
+				       ? stdout
+				       : fopen(opts.clients_path, "a");
+		if (g_clients_fp == NULL) {
+			fprintf(stderr,
+				"Failed to open %s: %s\n",
+				opts.clients_path,
+				strerror(errno));
+			exit_code = 1;
+			goto cleanup;
+		}
+	}
 	g_error_estimate_nbo = stamp_default_error_estimate_nbo(g_ptp_mode);
+	if (opts.rate_pps > 0 || opts.global_pps > 0) {
+		uint64_t seed = (uint64_t)(uintptr_t)&g_rate_limiter;
+		uint32_t t_sec;
+		uint32_t t_frac;
+		if (stamp_get_timestamp(&t_sec, &t_frac, false) == 0) {
+			seed ^= ((uint64_t)t_sec << 32) ^ t_frac;
+		}
+		stamp_rate_init(&g_rate_limiter,
+				opts.rate_pps,
+				opts.rate_burst,
+				opts.global_pps,
+				seed);
+	}
 #ifndef _WIN32
 	g_debug_mode = opts.debug_mode;
 	if (opts.port < 1024 && geteuid() != 0) {
@@ -788,16 +3010,22 @@ int main(int argc, char *argv[])
 	}
 #endif
 
-	sockfd = init_reflector_socket(opts.port,
-				       opts.af_hint,
-				       &socket_family,
-				       REFLECTOR_IFNAME);
-	if (SOCKET_ERROR_CHECK(sockfd)) {
+#ifdef __linux__
+	stamp_bpf_build(&g_input_filter, &opts.allow);
+	g_input_filter_required = opts.allow.count > 0;
+	worker_count = opts.threads;
+#else
+	worker_count = 1;
+#endif
+	for (unsigned int i = 0; i < worker_count; i++) {
+		workers[i].sockfd = INVALID_SOCKET;
+	}
+	if (open_workers(workers, worker_count, &opts, &socket_family) != 0) {
 		exit_code = 1;
 		goto cleanup;
 	}
 #ifdef __linux__
-	if (!stamp_setup_phc_from_options(sockfd,
+	if (!stamp_setup_phc_from_options(workers[0].sockfd,
 					  opts.phc_requested,
 					  g_ifname,
 					  &phc_fd,
@@ -806,30 +3034,42 @@ int main(int argc, char *argv[])
 		exit_code = 1;
 		goto cleanup;
 	}
+	if (opts.use_xdp) {
+		setup_xdp_engine(workers, worker_count, &opts);
+	}
+	stamp_tsc_setup_from_options(&g_tsc_clock, opts.clock_source, g_phc_enabled);
+#else
+	stamp_tsc_setup_from_options(&g_tsc_clock, opts.clock_source, false);
 #endif
-	platform_post_init_reflector(sockfd, opts.port, socket_family);
-	print_reflector_start_message(opts.port, opts.af_hint, socket_family);
+	platform_post_init_reflector(workers[0].sockfd, opts.port, socket_family);
+	print_reflector_start_message(&opts, socket_family);
 
-	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
-		len = sizeof(cliaddr);
-		handle_one_packet(sockfd,
-				  buffer,
-				  sizeof(buffer),
-				  &cliaddr,
-				  &len);
-	}
+#ifdef __linux__
+	start_log_writer();
+#endif
+	run_workers(workers, worker_count);
+#ifdef __linux__
+	stop_log_writer();
+#endif
 
-	print_statistics();
+	print_statistics(workers, worker_count);
+	for (unsigned int i = 0; i < worker_count; i++) {
+		write_client_stats(&workers[i], "exit");
+	}
 
 cleanup:
+	stamp_tsc_stop(&g_tsc_clock);
+	if (g_clients_fp != NULL && g_clients_fp != stdout) {
+		fclose(g_clients_fp);
+	}
+	g_clients_fp = NULL;
 	// PHC fd は AUTO_CLOSE_FD により main() スコープ離脱時に自動 close される
+	// Windows では WSACleanup 前にソケットを閉じる必要がある
+	close_workers(workers, worker_count);
+#ifdef STAMP_HAVE_AF_XDP
+	stamp_xdp_prog_free(&g_xdp_prog);
+#endif
 #ifdef _WIN32
-	// WSACleanup 前にソケットを閉じ AUTO_CLOSE_SOCKET の二重解放を防止
-	if (!SOCKET_ERROR_CHECK(sockfd)) {
-		CLOSE_SOCKET(sockfd);
-		// NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
-		sockfd = INVALID_SOCKET; // cppcheck-suppress unreadVariable
-	}
 	WSACleanup();
 #endif
 	return exit_code;
@@ -5,15 +5,27 @@
 #include <math.h>
 #ifdef _WIN32
 #include <mswsock.h>
+#else
+#include <poll.h>
+#include <pthread.h> // 区間レポートの書き出しスレッド
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>	 // epoll_create1（複数ターゲット）
+#include <sys/prctl.h>	 // PR_SET_TIMERSLACK
+#include <sys/timerfd.h> // timerfd_create, TFD_TIMER_ABSTIME
 #endif
 
 #define SERVER_IP	  "127.0.0.1" // デフォルトのサーバーIPアドレス（ローカルホスト）
-#define SEND_INTERVAL_SEC 1	      // 送信間隔（秒）
+#define SEND_INTERVAL_USEC 1000000U  // 既定の送信間隔（マイクロ秒、-I で変更）
 
 // ソケットタイムアウト（stamp_protocol.h から移設、sender 専用の運用定数）
 #define SOCKET_TIMEOUT_SEC  5
 #define SOCKET_TIMEOUT_USEC 0
 
+// 応答待ちタイムアウト: 送信からこの時間内に応答が無いプローブを loss とする。
+// 送信スケジュールは応答を待たずに進むため、応答待ち中も後続の送信は止まらない。
+#define REPLY_TIMEOUT_NS ((uint64_t)SOCKET_TIMEOUT_SEC * NSEC_PER_SEC)
+
 // 統計・表示用定数（stamp_protocol.h から移設、sender 専用の運用定数）
 #define STAMP_ASYMMETRY_WARN_THRESHOLD_MS 10.0
 
@@ -23,10 +35,21 @@
 
 // 連続送信失敗の上限。-n は実送信本数で数えるため、宛先到達不能（連続 send 失敗）
 // かつ -w 未指定だと -n の停止条件に到達できず無限ループに陥る。その救済として、
-// この回数だけ連続で send が失敗したら測定を打ち切る（送信間隔 1 秒なので概ね
-// この秒数で諦める）。成功すればカウンタはリセットされ、一過性の失敗では発火しない。
+// この回数だけ連続で send が失敗したら測定を打ち切る（既定の送信間隔 1 秒なら
+// 概ねこの秒数で諦める）。成功すればカウンタはリセットされ、一過性の失敗では発火しない。
 #define STAMP_MAX_CONSECUTIVE_SEND_FAILURES 10U
 
+// 複数ターゲット（-t/-f）の上限と、ホスト名の最大長
+#define SENDER_MAX_TARGETS 1024U
+// -J 未指定（開始オフセット上限 = -I）
+#define SENDER_OFFSET_DEFAULT UINT32_MAX
+#define SENDER_HOST_MAX	   256U
+
+// 複数ターゲット時のタイマーホイールの tick（1024 スロットで約 1 秒を覆う）
+#define SENDER_WHEEL_TICK_NS 1000000U
+// 複数ターゲット時に 1 回の epoll_wait で受け取るイベント数
+#define SENDER_EPOLL_EVENTS 64
+
 #ifdef __linux__
 #define SENDER_IFNAME(opts) ((opts).ifname)
 #else
@@ -37,6 +60,8 @@ static bool g_negative_delay_seen = false;
 static bool g_oneway_mode = false;
 // 出力形式（human/json/csv）。main() が CLI から設定
 static enum output_format g_output_format = OUTPUT_HUMAN;
+// 送信間隔の分布（統計表示用）。main() が CLI から設定
+static enum stamp_sched_mode g_sched_mode = STAMP_SCHED_PERIODIC;
 // タイムスタンプ形式フラグ（true: PTP/Z=1, false: NTP）。main() が CLI から設定
 static bool g_ptp_mode = false;
 static uint16_t
@@ -48,32 +73,57 @@ static bool g_phc_enabled = false;
 // PHC fd は main() の AUTO_CLOSE_FD ローカルで管理（プロセス終了時に自動 close）
 static clockid_t g_phc_clockid = CLOCK_REALTIME;
 #endif
+// T1 を打刻する TSC 時計（-C tsc。開始できなければ無効のまま）
+static struct stamp_tsc_clock g_tsc_clock;
 
 // 統計情報構造体
 struct sender_stats {
 	uint32_t sent;
-	uint32_t received;
-	uint32_t timeouts;
+	uint32_t received; // 期限内に受信した応答（遅着・重複は含まない）
+	uint32_t timeouts; // 期限内に応答が無かったプローブ
+	uint32_t late;	   // タイムアウト後に到着した応答（timeouts の内数）
+	uint32_t reordered; // 期限内だが後続プローブの応答より後に到着した応答
+	uint32_t duplicates;
 	// Welford アキュムレータ（min/avg/max/stddev を数値安定に集計）
 	struct stamp_welford rtt;
 	struct stamp_welford fwd;    // 往路遅延（one-way モード時）
 	struct stamp_welford bwd;    // 復路遅延（one-way モード時）
 	struct stamp_welford offset; // クロックオフセット（常時集計）
-	// IPDV (RFC 3393): |D(i)-D(i-1)| のストリーミング集計（隣接パケットのみ）
+	// IPDV (RFC 3393): seq が隣接する 2 本の |D(i)-D(i-1)| のストリーミング集計
 	struct stamp_welford ipdv_rtt;
 	struct stamp_welford ipdv_fwd;
 	struct stamp_welford ipdv_bwd;
-	double prev_rtt; // 直前に受信したパケットの各遅延（IPDV 用）
-	double prev_fwd;
-	double prev_bwd;
-	uint32_t prev_seq; // 直前に受信したパケットの seq（連続性判定用）
-	bool has_prev;	   // prev_* が有効か
+	// 送信スケジュール誤差（実送信時刻 − 予定時刻、マイクロ秒）
+	struct stamp_welford sched_err;
+	uint32_t sched_missed; // 送信が 1 間隔以上遅れて読み飛ばした予定数
+	// 実際の送信間隔（直前の送信からの経過、マイクロ秒）
+	struct stamp_welford send_gap;
 };
 
-// count==0 が Welford の未初期化マーカーなので全 0 初期化で十分
-static struct sender_stats g_stats = {0};
+// 列車送信（-B）か。true のとき各セッションが列車の集計表を持つ
+static bool g_train_mode = false;
+
+/**
+ * 毎パケット記録（-r）の状態
+ * 計測ループは stamp_pktlog_push() で積むだけで、整形と書き出しは書き出し
+ * スレッドが行う。スレッドを使えない場合は積むたびに計測ループが整形する。
+ */
+struct packet_recorder {
+	struct stamp_pktlog log;
+	FILE *fp;
+	char (*targets)[STAMP_REPORT_STR_MAX * 6U]; // 形式に合わせた target
+	const char **target_ptrs;		    // log に渡す target の表
+	bool enabled;
+#ifndef _WIN32
+	pthread_t thread;
+	bool stop;    // 停止要求（atomic）
+	bool started; // 書き出しスレッドを起動済み
+#endif
+};
+static struct packet_recorder g_recorder;
 
-// percentile/PDV 用の全サンプル（-n/-w 指定時のみ確保）。g_stats とは分離。
+// 正確な percentile/PDV 用の全サンプル（-A 指定時のみ確保）。統計とは分離。
+// 既定ではストリーミングスケッチ（stamp_sketch.h）で分位点を推定する。
 // IPDV はストリーミング集計するため seq は保持しない（rtt/fwd/bwd のみ）。
 struct stamp_sample_buffer {
 	double *rtt;
@@ -82,17 +132,72 @@ struct stamp_sample_buffer {
 	size_t count;
 	size_t cap;
 };
-static struct stamp_sample_buffer g_samples = {0};
-static bool g_collect_samples = false; // (-n || -w) のとき true
-static bool g_sample_oom_warned = false;
+static bool g_collect_samples = false; // -A のとき true
+
+/**
+ * 送信スケジュールの状態（送信と受信を分離したイベントループ用）
+ */
+struct send_schedule {
+	struct stamp_sched plan; // 送信予定時刻（単調クロックの絶対時刻）のリング
+	uint64_t prev_send_ns;	 // 直前の実送信時刻（0=未送信）
+	uint64_t spin_ns;  // 予定時刻直前のビジーウェイト幅（0=無効）
+	uint64_t end_ns;   // -w 締切（0=なし）
+	uint64_t train_spacing_ns; // 列車内の送信間隔（-G、0=連続送出）
+	uint64_t train_next_ns; // 間隔送信中の列車の次の送信予定（0=送信中でない）
+	uint32_t train_seq;	 // 間隔送信中の列車の先頭 seq
+	uint32_t train_sent;	 // 間隔送信中の列車の送信済み本数
+	uint32_t train_len;	 // 間隔送信中の列車の送信予定本数
+	uint32_t seq;	   // 次に送る seq（uint32_t ラップは意図的、RFC 8762 準拠）
+	uint32_t sent_count; // 実送信できた本数（-n の対象）
+	uint32_t consecutive_failures; // 連続 send 失敗数（成功でリセット）
+	bool sending_done; // -n 到達（以降は応答待ちの回収のみ）
+#ifdef __linux__
+	int timerfd; // 絶対時刻タイマー（-1 なら poll のミリ秒タイムアウトで代替）
+#endif
+};
+
+/**
+ * 1 ターゲット分の計測状態（-t/-f で複数ターゲットを指定した場合は
+ * ターゲットごとに 1 つ持ち、単一のイベントループから駆動する）
+ * count==0 が Welford の未初期化マーカーなので統計は全 0 初期化で十分。
+ */
+struct sender_session {
+	struct sender_stats stats;
+	struct stamp_inflight inflight; // 応答待ちプローブ表（seq → T1・送信時刻）
+	struct stamp_reorder reorder;	// 順序逆転の集計と IPDV の相手（seq → 遅延）
+	struct stamp_loss_pattern loss; // 喪失区間と Gilbert-Elliott の計数（seq 順）
+	// 区間レポート（-R）の集計面。加算中の面と、書き出し待ちまたは空きの面
+	struct stamp_interval_stats iv_faces[2];
+	struct stamp_interval_stats *iv_cur; // -R 無効時は NULL
+	struct stamp_interval_stats *iv_done;
+	struct stamp_sample_buffer samples;
+	bool sample_oom_warned;
+	// 分位点スケッチ（rtt は常に、fwd/bwd は one-way モード時のみ確保）
+	struct stamp_sketch *sketch_rtt;
+	struct stamp_sketch *sketch_fwd;
+	struct stamp_sketch *sketch_bwd;
+	struct stamp_train_table *trains; // 列車の集計表（g_train_mode 時のみ確保）
+	struct send_schedule sched;
+	struct stamp_wheel_node timer; // 次の起床時刻（複数ターゲット時）
+	SOCKET sockfd;
+	struct sockaddr_storage servaddr;
+	char target[STAMP_ADDR_PORT_BUFSIZE];	   // "addr:port"（レポートのキー）
+	char log_prefix[STAMP_ADDR_PORT_BUFSIZE + 2]; // stderr 行頭（単一時は空）
+	bool finished; // 送信終了かつ応答待ちなし（複数ターゲット時）
+};
+
+// 全セッション（main() が確保）と、処理中のセッション
+static struct sender_session *g_sessions = NULL;
+static size_t g_session_count = 0;
+static struct sender_session *g_sess = NULL;
 
 /**
  * サンプルバッファを new_cap 要素へ拡張し、既存 count 件をコピーして原子的に
  * 差し替える。rtt（one-way 時は fwd/bwd も）のいずれかの確保に失敗した場合は
- * g_samples を一切変更せず（旧バッファ・旧データを保持して）false を返す。
+ * セッションのサンプルを一切変更せず（旧バッファ・旧データを保持して）false を返す。
  * realloc を使わず malloc→memcpy→swap とすることで、片側だけ成長して系列長が
  * 食い違う（または無駄に確保したまま蓄積停止する）不整合を防ぐ。
- * @param new_cap 目標容量（g_samples.cap より大きいこと）
+ * @param new_cap 目標容量（現在の容量より大きいこと）
  * @param oneway one-way モード（fwd/bwd も確保するか）
  * @return 成功時 true
  */
@@ -112,23 +217,23 @@ static bool stamp_sample_buffer_grow_to(size_t new_cap, bool oneway)
 		return false;
 	}
 
-	size_t n = g_samples.count;
+	size_t n = g_sess->samples.count;
 	if (n > 0) {
-		memcpy(new_rtt, g_samples.rtt, n * sizeof(*new_rtt));
+		memcpy(new_rtt, g_sess->samples.rtt, n * sizeof(*new_rtt));
 		if (oneway) {
-			memcpy(new_fwd, g_samples.fwd, n * sizeof(*new_fwd));
-			memcpy(new_bwd, g_samples.bwd, n * sizeof(*new_bwd));
+			memcpy(new_fwd, g_sess->samples.fwd, n * sizeof(*new_fwd));
+			memcpy(new_bwd, g_sess->samples.bwd, n * sizeof(*new_bwd));
 		}
 	}
-	free(g_samples.rtt);
-	g_samples.rtt = new_rtt;
+	free(g_sess->samples.rtt);
+	g_sess->samples.rtt = new_rtt;
 	if (oneway) {
-		free(g_samples.fwd);
-		g_samples.fwd = new_fwd;
-		free(g_samples.bwd);
-		g_samples.bwd = new_bwd;
+		free(g_sess->samples.fwd);
+		g_sess->samples.fwd = new_fwd;
+		free(g_sess->samples.bwd);
+		g_sess->samples.bwd = new_bwd;
 	}
-	g_samples.cap = new_cap;
+	g_sess->samples.cap = new_cap;
 	return true;
 }
 
@@ -140,23 +245,23 @@ static bool stamp_sample_buffer_grow_to(size_t new_cap, bool oneway)
  */
 static bool stamp_sample_buffer_reserve(bool oneway)
 {
-	if (g_samples.count < g_samples.cap) {
+	if (g_sess->samples.count < g_sess->samples.cap) {
 		return true;
 	}
-	if (g_sample_oom_warned) {
+	if (g_sess->sample_oom_warned) {
 		return false; // 既に上限到達/確保失敗済み
 	}
-	if (g_samples.cap >= STAMP_SAMPLE_MAX_CAP) {
+	if (g_sess->samples.cap >= STAMP_SAMPLE_MAX_CAP) {
 		fprintf(stderr,
 			"Warning: sample buffer reached %zu entries; "
 			"percentiles use a truncated sample set\n",
 			STAMP_SAMPLE_MAX_CAP);
-		g_sample_oom_warned = true;
+		g_sess->sample_oom_warned = true;
 		return false;
 	}
 
-	size_t new_cap = g_samples.cap == 0 ? STAMP_SAMPLE_INITIAL_CAP
-					    : g_samples.cap * 2;
+	size_t new_cap = g_sess->samples.cap == 0 ? STAMP_SAMPLE_INITIAL_CAP
+					    : g_sess->samples.cap * 2;
 	if (new_cap > STAMP_SAMPLE_MAX_CAP) {
 		new_cap = STAMP_SAMPLE_MAX_CAP;
 	}
@@ -165,7 +270,7 @@ static bool stamp_sample_buffer_reserve(bool oneway)
 		fprintf(stderr,
 			"Warning: failed to grow sample buffer; "
 			"percentiles use a truncated sample set\n");
-		g_sample_oom_warned = true;
+		g_sess->sample_oom_warned = true;
 		return false;
 	}
 	return true;
@@ -183,7 +288,7 @@ static void stamp_sample_buffer_prereserve(size_t want, bool oneway)
 	if (want > STAMP_SAMPLE_MAX_CAP) {
 		want = STAMP_SAMPLE_MAX_CAP;
 	}
-	if (want <= g_samples.cap) {
+	if (want <= g_sess->samples.cap) {
 		return; // 既に十分（want==0 を含む）
 	}
 	(void)stamp_sample_buffer_grow_to(want, oneway);
@@ -200,13 +305,13 @@ static void stamp_sample_buffer_push(double rtt,
 	if (!stamp_sample_buffer_reserve(oneway)) {
 		return;
 	}
-	size_t i = g_samples.count;
-	g_samples.rtt[i] = rtt;
+	size_t i = g_sess->samples.count;
+	g_sess->samples.rtt[i] = rtt;
 	if (oneway) {
-		g_samples.fwd[i] = fwd;
-		g_samples.bwd[i] = bwd;
+		g_sess->samples.fwd[i] = fwd;
+		g_sess->samples.bwd[i] = bwd;
 	}
-	g_samples.count++;
+	g_sess->samples.count++;
 }
 
 /**
@@ -214,14 +319,14 @@ static void stamp_sample_buffer_push(double rtt,
  */
 static void stamp_sample_buffer_free(void)
 {
-	free(g_samples.rtt);
-	free(g_samples.fwd);
-	free(g_samples.bwd);
-	g_samples.rtt = NULL;
-	g_samples.fwd = NULL;
-	g_samples.bwd = NULL;
-	g_samples.count = 0;
-	g_samples.cap = 0;
+	free(g_sess->samples.rtt);
+	free(g_sess->samples.fwd);
+	free(g_sess->samples.bwd);
+	g_sess->samples.rtt = NULL;
+	g_sess->samples.fwd = NULL;
+	g_sess->samples.bwd = NULL;
+	g_sess->samples.count = 0;
+	g_sess->samples.cap = 0;
 }
 
 // 系列ごとの分布指標（human / machine 出力で共用）
@@ -233,8 +338,10 @@ struct series_dist {
 };
 
 /**
- * 系列のパーセンタイル・PDV をまとめて算出する（配列を破壊的にソート）。
+ * 系列のパーセンタイル・PDV をまとめて算出する（配列を破壊的に並べ替える）。
  * human / machine 両出力でこの 1 箇所を共用し、指標定義の二重実装を避ける。
+ * 必要な順位（min・p50・p95・p99）だけを選択アルゴリズムで確定するため、
+ * 全体のソートは行わない。
  */
 __attribute__((nonnull(1))) static struct series_dist
 compute_series_dist(double *arr, size_t n)
@@ -243,34 +350,80 @@ compute_series_dist(double *arr, size_t n)
 	if (n == 0) {
 		return d;
 	}
-	qsort(arr, n, sizeof(*arr), stamp_double_cmp);
-	d.p50 = stamp_percentile_sorted(arr, n, 50.0);
-	d.p95 = stamp_percentile_sorted(arr, n, 95.0);
-	d.p99 = stamp_percentile_sorted(arr, n, 99.0);
-	// PDV (RFC 5481) は正典ヘルパーへ委譲し、指標定義を 1 箇所へ集約する
-	// （sender 側のインライン再実装による定義の乖離・無テスト化を防ぐ）。
-	d.pdv = stamp_pdv_from_sorted(arr, n);
+	static const double ps[] = {0.0, 50.0, 95.0, 99.0};
+	double q[sizeof(ps) / sizeof(ps[0])];
+	stamp_percentiles_select(arr, n, ps, q, sizeof(ps) / sizeof(ps[0]));
+	d.p50 = q[1];
+	d.p95 = q[2];
+	d.p99 = q[3];
+	// PDV (RFC 5481) = p95 − min（stamp_pdv_from_sorted と同じ定義）
+	d.pdv = q[2] - q[0];
 	return d;
 }
 
 /**
- * 分布サマリ行を表示（配列を破壊的に昇順ソートし、percentile と PDV を出力）
- * @param label 系列名（"RTT" 等）
- * @param arr サンプル配列（ソートされる）
- * @param n 要素数
+ * スケッチから系列のパーセンタイル・PDV を推定する（空なら全て NAN）
+ */
+static struct series_dist sketch_series_dist(const struct stamp_sketch *sk)
+{
+	struct series_dist d = {NAN, NAN, NAN, NAN};
+	if (sk == NULL || sk->count == 0) {
+		return d;
+	}
+	d.p50 = stamp_sketch_quantile(sk, 50.0);
+	d.p95 = stamp_sketch_quantile(sk, 95.0);
+	d.p99 = stamp_sketch_quantile(sk, 99.0);
+	d.pdv = stamp_sketch_pdv(sk);
+	return d;
+}
+
+/**
+ * 処理中のセッションの分布指標を求める（human / machine 出力で共用）。
+ * -A 指定時は全サンプルから正確に（配列は並べ替えられる）、それ以外は
+ * スケッチから推定する。one-way モードでなければ fwd/bwd は NAN のまま。
  */
-static void print_distribution(const char *label, double *arr, size_t n)
+__attribute__((nonnull(1, 2, 3))) static void
+compute_session_dists(struct series_dist *rtt,
+		      struct series_dist *fwd,
+		      struct series_dist *bwd)
 {
+	*rtt = *fwd = *bwd = (struct series_dist){NAN, NAN, NAN, NAN};
+	if (!g_collect_samples) {
+		*rtt = sketch_series_dist(g_sess->sketch_rtt);
+		if (g_oneway_mode) {
+			*fwd = sketch_series_dist(g_sess->sketch_fwd);
+			*bwd = sketch_series_dist(g_sess->sketch_bwd);
+		}
+		return;
+	}
+	size_t n = g_sess->samples.count;
 	if (n == 0) {
 		return;
 	}
-	struct series_dist d = compute_series_dist(arr, n);
+	*rtt = compute_series_dist(g_sess->samples.rtt, n);
+	if (g_oneway_mode) {
+		*fwd = compute_series_dist(g_sess->samples.fwd, n);
+		*bwd = compute_series_dist(g_sess->samples.bwd, n);
+	}
+}
+
+/**
+ * 分布サマリ行を表示（percentile と PDV。未算出なら何もしない）
+ * @param label 系列名（"RTT" 等）
+ * @param d 分布指標
+ */
+__attribute__((nonnull(1, 2))) static void
+print_distribution(const char *label, const struct series_dist *d)
+{
+	if (isnan(d->p50)) {
+		return;
+	}
 	printf("%s p50/p95/p99 = %.3f/%.3f/%.3f ms\n",
 	       label,
-	       d.p50,
-	       d.p95,
-	       d.p99);
-	printf("%s PDV (p95-min) = %.3f ms\n", label, d.pdv);
+	       d->p50,
+	       d->p95,
+	       d->p99);
+	printf("%s PDV (p95-min) = %.3f ms\n", label, d->pdv);
 }
 
 /**
@@ -308,66 +461,189 @@ fmt_stddev_human(char *buf, size_t buflen, const struct stamp_welford *w)
 	return buf;
 }
 
+/**
+ * 送信スケジュール行を表示（実送信間隔と、実送信時刻 − 予定時刻の誤差）
+ */
+static void print_schedule_error(void)
+{
+	char sd[STAMP_REPORT_NUM_MAX];
+	if (stamp_welford_count(&g_sess->stats.send_gap) > 0) {
+		printf("Inter-departure min/avg/max/stddev = "
+		       "%.3f/%.3f/%.3f/%s us (%s)\n",
+		       stamp_welford_min(&g_sess->stats.send_gap),
+		       stamp_welford_mean(&g_sess->stats.send_gap),
+		       stamp_welford_max(&g_sess->stats.send_gap),
+		       fmt_stddev_human(sd, sizeof(sd), &g_sess->stats.send_gap),
+		       stamp_sched_mode_str(g_sched_mode));
+	}
+	if (stamp_welford_count(&g_sess->stats.sched_err) == 0) {
+		return;
+	}
+	printf("Send schedule error avg/max/stddev = %.3f/%.3f/%s us "
+	       "(missed slots: %u)\n",
+	       stamp_welford_mean(&g_sess->stats.sched_err),
+	       stamp_welford_max(&g_sess->stats.sched_err),
+	       fmt_stddev_human(sd, sizeof(sd), &g_sess->stats.sched_err),
+	       g_sess->stats.sched_missed);
+}
+
+/**
+ * 列車送信（-B）の集計行を表示
+ */
+static void print_train_statistics(void)
+{
+	if (!g_train_mode || g_sess->trains->sum.trains == 0) {
+		return;
+	}
+	const struct stamp_train_summary *sum = &g_sess->trains->sum;
+	char sd[STAMP_REPORT_NUM_MAX];
+	printf("Trains: %u sent, %u complete, intra-train loss "
+	       "%" PRIu64 "/%" PRIu64 " (%.2f%%)\n",
+	       sum->trains,
+	       sum->complete,
+	       sum->lost,
+	       sum->packets,
+	       sum->packets > 0
+		       ? (double)sum->lost * 100.0 / (double)sum->packets
+		       : 0.0);
+	if (stamp_welford_count(&sum->dispersion_us) == 0) {
+		return;
+	}
+	printf("Train dispersion min/avg/max/stddev = %.3f/%.3f/%.3f/%s us\n",
+	       stamp_welford_min(&sum->dispersion_us),
+	       stamp_welford_mean(&sum->dispersion_us),
+	       stamp_welford_max(&sum->dispersion_us),
+	       fmt_stddev_human(sd, sizeof(sd), &sum->dispersion_us));
+	printf("Intra-train delay increase min/avg/max/stddev = "
+	       "%.3f/%.3f/%.3f/%s ms\n",
+	       stamp_welford_min(&sum->delay_increase_ms),
+	       stamp_welford_mean(&sum->delay_increase_ms),
+	       stamp_welford_max(&sum->delay_increase_ms),
+	       fmt_stddev_human(sd, sizeof(sd), &sum->delay_increase_ms));
+}
+
+/**
+ * 順序逆転（RFC 4737）と重複（RFC 5560）の指標を表示（どちらも無ければ省略）
+ */
+__attribute__((cold)) static void print_reorder_statistics(void)
+{
+	const struct stamp_reorder *r = &g_sess->reorder;
+	uint32_t received = g_sess->stats.received;
+	if (r->reordered > 0) {
+		printf("Reordering: ratio %.2f%%, extent avg/max = %.2f/%u, "
+		       "n-reordering n=1/2/3 = %.2f/%.2f/%.2f%%\n",
+		       100.0 * (double)r->reordered / (double)received,
+		       stamp_reorder_extent_avg(r),
+		       r->extent_max,
+		       100.0 * stamp_reorder_n_ratio(r, 1, received),
+		       100.0 * stamp_reorder_n_ratio(r, 2, received),
+		       100.0 * stamp_reorder_n_ratio(r, 3, received));
+	}
+	if (g_sess->stats.duplicates > 0) {
+		printf("Duplication: ratio %.2f%%\n",
+		       100.0 * (double)g_sess->stats.duplicates /
+			       (double)g_sess->stats.sent);
+	}
+}
+
+/**
+ * 喪失区間（RFC 3357）と Gilbert-Elliott モデルの推定を表示（喪失が無ければ省略）
+ */
+__attribute__((cold)) static void print_loss_pattern(void)
+{
+	const struct stamp_loss_pattern *lp = &g_sess->loss;
+	if (lp->lost == 0) {
+		return;
+	}
+	printf("Loss periods: %" PRIu64 ", length avg/max = %.2f/%.0f",
+	       stamp_loss_periods(lp),
+	       stamp_welford_mean(&lp->period_len),
+	       stamp_welford_max(&lp->period_len));
+	if (stamp_welford_count(&lp->period_gap) > 0) {
+		printf(", gap avg/min = %.2f/%.0f",
+		       stamp_welford_mean(&lp->period_gap),
+		       stamp_welford_min(&lp->period_gap));
+	}
+	printf("\n");
+	// 全損・喪失が末尾のみ等で遷移確率が定まらない場合は省略
+	struct stamp_ge_fit ge;
+	stamp_loss_ge_fit(lp, &ge);
+	if (!isnan(ge.p) && !isnan(ge.r)) {
+		printf("Gilbert-Elliott p/r/loss_bad = %.4f/%.4f/%.4f\n",
+		       ge.p,
+		       ge.r,
+		       ge.loss_bad);
+	}
+}
+
 /**
  * 統計情報の表示（人間可読テキスト）
  */
 __attribute__((cold)) static void print_statistics_human(void)
 {
-	printf("\n--- STAMP Statistics ---\n");
-	printf("Packets sent: %u\n", g_stats.sent);
-	printf("Packets received: %u\n", g_stats.received);
+	if (g_session_count > 1) {
+		printf("\n--- STAMP Statistics (%s) ---\n", g_sess->target);
+	} else {
+		printf("\n--- STAMP Statistics ---\n");
+	}
+	printf("Packets sent: %u\n", g_sess->stats.sent);
+	printf("Packets received: %u\n", g_sess->stats.received);
 	printf("Packet loss: %.2f%%\n",
-	       stamp_packet_loss(g_stats.sent, g_stats.received));
-	printf("Timeouts: %u\n", g_stats.timeouts);
-	if (g_stats.received > 0) {
+	       stamp_packet_loss(g_sess->stats.sent, g_sess->stats.received));
+	printf("Timeouts: %u\n", g_sess->stats.timeouts);
+	printf("Late/reordered/duplicate responses: %u/%u/%u\n",
+	       g_sess->stats.late,
+	       g_sess->stats.reordered,
+	       g_sess->stats.duplicates);
+	print_reorder_statistics();
+	print_loss_pattern();
+	print_schedule_error();
+	print_train_statistics();
+	if (g_sess->stats.received > 0) {
 		char sd[STAMP_REPORT_NUM_MAX];
 		printf("RTT min/avg/max/stddev = %.3f/%.3f/%.3f/%s ms\n",
-		       stamp_welford_min(&g_stats.rtt),
-		       stamp_welford_mean(&g_stats.rtt),
-		       stamp_welford_max(&g_stats.rtt),
-		       fmt_stddev_human(sd, sizeof(sd), &g_stats.rtt));
+		       stamp_welford_min(&g_sess->stats.rtt),
+		       stamp_welford_mean(&g_sess->stats.rtt),
+		       stamp_welford_max(&g_sess->stats.rtt),
+		       fmt_stddev_human(sd, sizeof(sd), &g_sess->stats.rtt));
 		printf("Clock offset min/avg/max/stddev = "
 		       "%.3f/%.3f/%.3f/%s ms\n",
-		       stamp_welford_min(&g_stats.offset),
-		       stamp_welford_mean(&g_stats.offset),
-		       stamp_welford_max(&g_stats.offset),
-		       fmt_stddev_human(sd, sizeof(sd), &g_stats.offset));
-		print_ipdv("RTT     ", &g_stats.ipdv_rtt);
+		       stamp_welford_min(&g_sess->stats.offset),
+		       stamp_welford_mean(&g_sess->stats.offset),
+		       stamp_welford_max(&g_sess->stats.offset),
+		       fmt_stddev_human(sd, sizeof(sd), &g_sess->stats.offset));
+		print_ipdv("RTT     ", &g_sess->stats.ipdv_rtt);
 		if (g_oneway_mode) {
 			printf("Forward  min/avg/max/jitter = "
 			       "%.3f/%.3f/%.3f/%s ms\n",
-			       stamp_welford_min(&g_stats.fwd),
-			       stamp_welford_mean(&g_stats.fwd),
-			       stamp_welford_max(&g_stats.fwd),
-			       fmt_stddev_human(sd, sizeof(sd), &g_stats.fwd));
+			       stamp_welford_min(&g_sess->stats.fwd),
+			       stamp_welford_mean(&g_sess->stats.fwd),
+			       stamp_welford_max(&g_sess->stats.fwd),
+			       fmt_stddev_human(sd, sizeof(sd), &g_sess->stats.fwd));
 			printf("Backward min/avg/max/jitter = "
 			       "%.3f/%.3f/%.3f/%s ms\n",
-			       stamp_welford_min(&g_stats.bwd),
-			       stamp_welford_mean(&g_stats.bwd),
-			       stamp_welford_max(&g_stats.bwd),
-			       fmt_stddev_human(sd, sizeof(sd), &g_stats.bwd));
-			print_ipdv("Forward ", &g_stats.ipdv_fwd);
-			print_ipdv("Backward", &g_stats.ipdv_bwd);
-		}
-		if (g_collect_samples && g_sample_oom_warned) {
+			       stamp_welford_min(&g_sess->stats.bwd),
+			       stamp_welford_mean(&g_sess->stats.bwd),
+			       stamp_welford_max(&g_sess->stats.bwd),
+			       fmt_stddev_human(sd, sizeof(sd), &g_sess->stats.bwd));
+			print_ipdv("Forward ", &g_sess->stats.ipdv_fwd);
+			print_ipdv("Backward", &g_sess->stats.ipdv_bwd);
+		}
+		if (g_collect_samples && g_sess->sample_oom_warned) {
 			// 上限到達/確保失敗でサンプルが欠落。count==0 のときは
 			// percentile/PDV 自体が出ないため、その旨も含め注記する
 			// （machine 出力の samples_truncated と意味を揃える）。
 			printf("Note: sample set truncated (limit reached); "
 			       "percentiles/PDV are partial or omitted\n");
 		}
-		if (g_collect_samples && g_samples.count > 0) {
-			print_distribution("RTT     ",
-					   g_samples.rtt,
-					   g_samples.count);
-			if (g_oneway_mode) {
-				print_distribution("Forward ",
-						   g_samples.fwd,
-						   g_samples.count);
-				print_distribution("Backward",
-						   g_samples.bwd,
-						   g_samples.count);
-			}
+		struct series_dist drtt;
+		struct series_dist dfwd;
+		struct series_dist dbwd;
+		compute_session_dists(&drtt, &dfwd, &dbwd);
+		print_distribution("RTT     ", &drtt);
+		if (g_oneway_mode) {
+			print_distribution("Forward ", &dfwd);
+			print_distribution("Backward", &dbwd);
 		}
 	}
 }
@@ -396,100 +672,252 @@ wf_std(const struct stamp_welford *w)
 	return stamp_welford_count(w) < 2 ? (double)NAN : stamp_welford_stddev(w);
 }
 
+// machine 出力のメトリクス列数（全セッションで同じ並び）
+#define SENDER_REPORT_FIELDS 63
+
 /**
- * 統計情報を機械可読形式（JSON/CSV）で出力する。
- * @param servaddr ターゲットアドレス（target/family 整形用）
+ * 処理中のセッションの統計を機械可読レポートへまとめる。
+ * -A 指定時は分布指標の算出でサンプル配列が並べ替えられる。
+ * @param report 出力先（target は g_sess が所有する文字列を指す）
+ * @param fields メトリクス列の格納先
  */
-__attribute__((cold, nonnull(1))) static void
-print_statistics_machine(const struct sockaddr_storage *servaddr)
-{
-	char target[STAMP_ADDR_PORT_BUFSIZE];
-	stamp_format_sockaddr_with_port(servaddr, target, sizeof(target));
-
-	size_t n = g_samples.count;
-	bool have_samples = g_collect_samples && n > 0;
-	struct series_dist drtt = {NAN, NAN, NAN, NAN};
-	struct series_dist dfwd = {NAN, NAN, NAN, NAN};
-	struct series_dist dbwd = {NAN, NAN, NAN, NAN};
-	if (have_samples) {
-		drtt = compute_series_dist(g_samples.rtt, n);
-		if (g_oneway_mode) {
-			dfwd = compute_series_dist(g_samples.fwd, n);
-			dbwd = compute_series_dist(g_samples.bwd, n);
-		}
-	}
+__attribute__((cold, nonnull(1, 2))) static void
+build_session_report(struct stamp_report *report,
+		     struct stamp_report_field fields_out[SENDER_REPORT_FIELDS])
+{
+	static const struct stamp_train_summary no_trains;
+	const struct stamp_train_summary *tsum =
+		g_sess->trains != NULL ? &g_sess->trains->sum : &no_trains;
+	struct series_dist drtt;
+	struct series_dist dfwd;
+	struct series_dist dbwd;
+	double train_loss_ratio = (double)NAN;
+	const struct stamp_reorder *r = &g_sess->reorder;
+	uint32_t received = g_sess->stats.received;
+	double reorder_ratio = (double)NAN;
+	double duplicate_ratio = (double)NAN;
+	if (received > 0) {
+		reorder_ratio = (double)r->reordered / (double)received;
+	}
+	if (g_sess->stats.sent > 0) {
+		duplicate_ratio = (double)g_sess->stats.duplicates /
+				  (double)g_sess->stats.sent;
+	}
+	const struct stamp_loss_pattern *lp = &g_sess->loss;
+	uint64_t loss_periods = stamp_loss_periods(lp);
+	struct stamp_ge_fit ge;
+	stamp_loss_ge_fit(lp, &ge);
+	if (g_train_mode && tsum->packets > 0) {
+		train_loss_ratio = (double)tsum->lost / (double)tsum->packets;
+	}
+	compute_session_dists(&drtt, &dfwd, &dbwd);
 
 	const struct stamp_report_field fields[] = {
-		{"rtt_min_ms", wf_min(&g_stats.rtt)},
-		{"rtt_avg_ms", wf_avg(&g_stats.rtt)},
-		{"rtt_max_ms", wf_max(&g_stats.rtt)},
-		{"rtt_stddev_ms", wf_std(&g_stats.rtt)},
-		{"offset_min_ms", wf_min(&g_stats.offset)},
-		{"offset_avg_ms", wf_avg(&g_stats.offset)},
-		{"offset_max_ms", wf_max(&g_stats.offset)},
-		{"offset_stddev_ms", wf_std(&g_stats.offset)},
-		{"fwd_min_ms", wf_min(&g_stats.fwd)},
-		{"fwd_avg_ms", wf_avg(&g_stats.fwd)},
-		{"fwd_max_ms", wf_max(&g_stats.fwd)},
-		{"fwd_stddev_ms", wf_std(&g_stats.fwd)},
-		{"bwd_min_ms", wf_min(&g_stats.bwd)},
-		{"bwd_avg_ms", wf_avg(&g_stats.bwd)},
-		{"bwd_max_ms", wf_max(&g_stats.bwd)},
-		{"bwd_stddev_ms", wf_std(&g_stats.bwd)},
-		{"rtt_ipdv_avg_ms", wf_avg(&g_stats.ipdv_rtt)},
-		{"rtt_ipdv_max_ms", wf_max(&g_stats.ipdv_rtt)},
-		{"fwd_ipdv_avg_ms", wf_avg(&g_stats.ipdv_fwd)},
-		{"fwd_ipdv_max_ms", wf_max(&g_stats.ipdv_fwd)},
-		{"bwd_ipdv_avg_ms", wf_avg(&g_stats.ipdv_bwd)},
-		{"bwd_ipdv_max_ms", wf_max(&g_stats.ipdv_bwd)},
-		{"rtt_p50_ms", drtt.p50},
-		{"rtt_p95_ms", drtt.p95},
-		{"rtt_p99_ms", drtt.p99},
-		{"rtt_pdv_ms", drtt.pdv},
-		{"fwd_p50_ms", dfwd.p50},
-		{"fwd_p95_ms", dfwd.p95},
-		{"fwd_p99_ms", dfwd.p99},
-		{"fwd_pdv_ms", dfwd.pdv},
-		{"bwd_p50_ms", dbwd.p50},
-		{"bwd_p95_ms", dbwd.p95},
-		{"bwd_p99_ms", dbwd.p99},
-		{"bwd_pdv_ms", dbwd.pdv},
+		{"rtt_min_ms", wf_min(&g_sess->stats.rtt), STAMP_REPORT_VALUE},
+		{"rtt_avg_ms", wf_avg(&g_sess->stats.rtt), STAMP_REPORT_VALUE},
+		{"rtt_max_ms", wf_max(&g_sess->stats.rtt), STAMP_REPORT_VALUE},
+		{"rtt_stddev_ms", wf_std(&g_sess->stats.rtt), STAMP_REPORT_VALUE},
+		{"offset_min_ms", wf_min(&g_sess->stats.offset), STAMP_REPORT_VALUE},
+		{"offset_avg_ms", wf_avg(&g_sess->stats.offset), STAMP_REPORT_VALUE},
+		{"offset_max_ms", wf_max(&g_sess->stats.offset), STAMP_REPORT_VALUE},
+		{"offset_stddev_ms", wf_std(&g_sess->stats.offset), STAMP_REPORT_VALUE},
+		{"fwd_min_ms", wf_min(&g_sess->stats.fwd), STAMP_REPORT_VALUE},
+		{"fwd_avg_ms", wf_avg(&g_sess->stats.fwd), STAMP_REPORT_VALUE},
+		{"fwd_max_ms", wf_max(&g_sess->stats.fwd), STAMP_REPORT_VALUE},
+		{"fwd_stddev_ms", wf_std(&g_sess->stats.fwd), STAMP_REPORT_VALUE},
+		{"bwd_min_ms", wf_min(&g_sess->stats.bwd), STAMP_REPORT_VALUE},
+		{"bwd_avg_ms", wf_avg(&g_sess->stats.bwd), STAMP_REPORT_VALUE},
+		{"bwd_max_ms", wf_max(&g_sess->stats.bwd), STAMP_REPORT_VALUE},
+		{"bwd_stddev_ms", wf_std(&g_sess->stats.bwd), STAMP_REPORT_VALUE},
+		{"rtt_ipdv_avg_ms", wf_avg(&g_sess->stats.ipdv_rtt), STAMP_REPORT_VALUE},
+		{"rtt_ipdv_max_ms", wf_max(&g_sess->stats.ipdv_rtt), STAMP_REPORT_VALUE},
+		{"fwd_ipdv_avg_ms", wf_avg(&g_sess->stats.ipdv_fwd), STAMP_REPORT_VALUE},
+		{"fwd_ipdv_max_ms", wf_max(&g_sess->stats.ipdv_fwd), STAMP_REPORT_VALUE},
+		{"bwd_ipdv_avg_ms", wf_avg(&g_sess->stats.ipdv_bwd), STAMP_REPORT_VALUE},
+		{"bwd_ipdv_max_ms", wf_max(&g_sess->stats.ipdv_bwd), STAMP_REPORT_VALUE},
+		{"rtt_p50_ms", drtt.p50, STAMP_REPORT_VALUE},
+		{"rtt_p95_ms", drtt.p95, STAMP_REPORT_VALUE},
+		{"rtt_p99_ms", drtt.p99, STAMP_REPORT_VALUE},
+		{"rtt_pdv_ms", drtt.pdv, STAMP_REPORT_VALUE},
+		{"fwd_p50_ms", dfwd.p50, STAMP_REPORT_VALUE},
+		{"fwd_p95_ms", dfwd.p95, STAMP_REPORT_VALUE},
+		{"fwd_p99_ms", dfwd.p99, STAMP_REPORT_VALUE},
+		{"fwd_pdv_ms", dfwd.pdv, STAMP_REPORT_VALUE},
+		{"bwd_p50_ms", dbwd.p50, STAMP_REPORT_VALUE},
+		{"bwd_p95_ms", dbwd.p95, STAMP_REPORT_VALUE},
+		{"bwd_p99_ms", dbwd.p99, STAMP_REPORT_VALUE},
+		{"bwd_pdv_ms", dbwd.pdv, STAMP_REPORT_VALUE},
+		{"sched_err_avg_us", wf_avg(&g_sess->stats.sched_err), STAMP_REPORT_VALUE},
+		{"sched_err_max_us", wf_max(&g_sess->stats.sched_err), STAMP_REPORT_VALUE},
+		{"sched_err_stddev_us", wf_std(&g_sess->stats.sched_err), STAMP_REPORT_VALUE},
+		{"send_gap_min_us", wf_min(&g_sess->stats.send_gap), STAMP_REPORT_VALUE},
+		{"send_gap_avg_us", wf_avg(&g_sess->stats.send_gap), STAMP_REPORT_VALUE},
+		{"send_gap_max_us", wf_max(&g_sess->stats.send_gap), STAMP_REPORT_VALUE},
+		{"send_gap_stddev_us", wf_std(&g_sess->stats.send_gap), STAMP_REPORT_VALUE},
+		{"train_loss_ratio", train_loss_ratio, STAMP_REPORT_RATIO},
+		{"train_dispersion_min_us", wf_min(&tsum->dispersion_us), STAMP_REPORT_VALUE},
+		{"train_dispersion_avg_us", wf_avg(&tsum->dispersion_us), STAMP_REPORT_VALUE},
+		{"train_dispersion_max_us", wf_max(&tsum->dispersion_us), STAMP_REPORT_VALUE},
+		{"train_dispersion_stddev_us",
+		 wf_std(&tsum->dispersion_us), STAMP_REPORT_VALUE},
+		{"train_delay_increase_avg_ms",
+		 wf_avg(&tsum->delay_increase_ms), STAMP_REPORT_VALUE},
+		{"train_delay_increase_max_ms",
+		 wf_max(&tsum->delay_increase_ms), STAMP_REPORT_VALUE},
+		{"reorder_ratio", reorder_ratio, STAMP_REPORT_RATIO},
+		{"reorder_extent_avg", stamp_reorder_extent_avg(r), STAMP_REPORT_VALUE},
+		{"reorder_extent_max",
+		 r->reordered > 0 ? (double)r->extent_max : (double)NAN, STAMP_REPORT_COUNT},
+		{"reorder_n1_ratio", stamp_reorder_n_ratio(r, 1, received), STAMP_REPORT_RATIO},
+		{"reorder_n2_ratio", stamp_reorder_n_ratio(r, 2, received), STAMP_REPORT_RATIO},
+		{"reorder_n3_ratio", stamp_reorder_n_ratio(r, 3, received), STAMP_REPORT_RATIO},
+		{"duplicate_ratio", duplicate_ratio, STAMP_REPORT_RATIO},
+		{"loss_periods", (double)loss_periods, STAMP_REPORT_COUNT},
+		{"loss_period_len_avg", wf_avg(&lp->period_len), STAMP_REPORT_VALUE},
+		{"loss_period_len_max", wf_max(&lp->period_len), STAMP_REPORT_COUNT},
+		{"loss_period_gap_avg", wf_avg(&lp->period_gap), STAMP_REPORT_VALUE},
+		{"loss_period_gap_min", wf_min(&lp->period_gap), STAMP_REPORT_COUNT},
+		{"ge_p", ge.p, STAMP_REPORT_RATIO},
+		{"ge_r", ge.r, STAMP_REPORT_RATIO},
+		{"ge_loss_bad", ge.loss_bad, STAMP_REPORT_RATIO},
 	};
+	_Static_assert(sizeof(fields) / sizeof(fields[0]) == SENDER_REPORT_FIELDS,
+		       "SENDER_REPORT_FIELDS must match the field list");
+	memcpy(fields_out, fields, sizeof(fields));
 
-	struct stamp_report report = {
-		.target = target,
-		.family = stamp_family_str(servaddr->ss_family),
+	*report = (struct stamp_report){
+		.target = g_sess->target,
+		.family = stamp_family_str(g_sess->servaddr.ss_family),
 		.ptp = g_ptp_mode,
 		.oneway = g_oneway_mode,
-		.samples_truncated = g_sample_oom_warned,
-		.packets_tx = g_stats.sent,
-		.packets_rx = g_stats.received,
-		.timeouts = g_stats.timeouts,
-		.loss_ratio =
-			stamp_packet_loss(g_stats.sent, g_stats.received) /
-			100.0,
-		.fields = fields,
-		.field_count = sizeof(fields) / sizeof(fields[0]),
+		.samples_truncated = g_sess->sample_oom_warned,
+		.packets_tx = g_sess->stats.sent,
+		.packets_rx = g_sess->stats.received,
+		.timeouts = g_sess->stats.timeouts,
+		.late = g_sess->stats.late,
+		.reordered = g_sess->stats.reordered,
+		.duplicates = g_sess->stats.duplicates,
+		.loss_ratio = stamp_packet_loss(g_sess->stats.sent,
+						g_sess->stats.received) /
+			      100.0,
+		.fields = fields_out,
+		.field_count = SENDER_REPORT_FIELDS,
 	};
+}
+
+// 区間レポートのメトリクス列数
+#define SENDER_INTERVAL_FIELDS 36
+// -o csv の区間レポートの列数（区間の位置と長さ + 累積サマリの全列）
+#define SENDER_INTERVAL_CSV_FIELDS (2 + SENDER_REPORT_FIELDS)
+
+/**
+ * 区間レポート（-R）の状態
+ * 面の入れ替えは計測ループ、整形・出力と空き面の初期化は書き出しスレッド
+ * （スレッドを使えない場合は計測ループ自身）が行う。busy が立っている間は
+ * 各セッションの iv_done を書き出し側が所有する。
+ */
+struct interval_reporter {
+	uint64_t period_ns; // 区間の長さ（0=無効）
+	uint64_t origin_ns; // 計測開始（interval_start_s の起点）
+	uint64_t next_ns;   // 次の境界（単調クロック）
+	uint64_t end_ns;    // 計測終了（区間レポートを終えた時刻）
+	bool busy;	    // 書き出し待ちの面がある（atomic）
+	// -o csv: 区間の行と終了時の累積サマリを同じ列に並べ、ヘッダ 1 行の
+	// CSV として読めるようにする（csv_columns は累積サマリの列の並び）
+	bool csv_wide;
+	bool csv_header_done;
+	struct stamp_report_field csv_columns[SENDER_REPORT_FIELDS];
+	struct stamp_report *reports;
+	struct stamp_report_field (*fields)[SENDER_INTERVAL_CSV_FIELDS];
+#ifndef _WIN32
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool stop;    // 停止要求（lock で保護）
+	bool started; // 書き出しスレッドを起動済み
+#endif
+};
+static struct interval_reporter g_interval;
+
+/**
+ * -R -o csv の累積サマリを区間レポートと同じ列の行として出力する。
+ * 計測全体を 1 区間とみなし、interval_start_s = 0、interval_len_s = 計測全体
+ * の長さとする（区間の行では空だった累積サマリだけの列にも値が入る）。
+ */
+__attribute__((cold, nonnull(1, 2))) static void
+write_summary_interval_csv(const struct stamp_report *reports,
+			   struct stamp_report_field (*fields)[SENDER_REPORT_FIELDS])
+{
+	struct stamp_report_field row[SENDER_INTERVAL_CSV_FIELDS];
+	char ts[STAMP_REPORT_TS_MAX];
+	(void)stamp_report_iso8601_utc(ts, sizeof(ts));
+	row[0] = (struct stamp_report_field){"interval_start_s", 0.0, STAMP_REPORT_VALUE};
+	row[1] = (struct stamp_report_field){
+		"interval_len_s",
+		(double)(g_interval.end_ns - g_interval.origin_ns) / (double)NSEC_PER_SEC,
+		STAMP_REPORT_VALUE};
+	for (size_t i = 0; i < g_session_count; i++) {
+		struct stamp_report r = reports[i];
+		memcpy(&row[2], fields[i], sizeof(fields[i]));
+		r.fields = row;
+		r.field_count = SENDER_INTERVAL_CSV_FIELDS;
+		if (!g_interval.csv_header_done) {
+			stamp_report_write_csv_header(stdout, &r);
+			g_interval.csv_header_done = true;
+		}
+		stamp_report_write_csv_row(stdout, &r, ts);
+	}
+}
+
+/**
+ * 統計情報を機械可読形式（JSON/CSV）で出力する。
+ * 複数ターゲット時はターゲットをキーとした 1 つのレポートにまとめる。
+ */
+__attribute__((cold)) static void print_statistics_machine(void)
+{
+	struct stamp_report *reports = calloc(g_session_count, sizeof(*reports));
+	struct stamp_report_field(*fields)[SENDER_REPORT_FIELDS] =
+		calloc(g_session_count, sizeof(*fields));
+	if (reports == NULL || fields == NULL) {
+		fprintf(stderr, "Failed to allocate report buffers\n");
+		free(reports);
+		free(fields);
+		return;
+	}
+	for (size_t i = 0; i < g_session_count; i++) {
+		g_sess = &g_sessions[i];
+		build_session_report(&reports[i], fields[i]);
+	}
 
-	if (g_output_format == OUTPUT_JSON) {
-		stamp_report_write_json(stdout, &report);
+	if (g_interval.csv_wide) {
+		write_summary_interval_csv(reports, fields);
+	} else if (g_session_count == 1) {
+		if (g_output_format == OUTPUT_JSON) {
+			stamp_report_write_json(stdout, &reports[0]);
+		} else {
+			stamp_report_write_csv(stdout, &reports[0]);
+		}
+	} else if (g_output_format == OUTPUT_JSON) {
+		stamp_report_write_json_multi(stdout, reports, g_session_count);
 	} else {
-		stamp_report_write_csv(stdout, &report);
+		stamp_report_write_csv_multi(stdout, reports, g_session_count);
 	}
+	free(reports);
+	free(fields);
 }
 
 /**
  * 統計情報の表示（出力形式に応じて分岐）
- * @param servaddr ターゲットアドレス
  */
-__attribute__((cold, nonnull(1))) static void
-print_statistics(const struct sockaddr_storage *servaddr)
+__attribute__((cold)) static void print_statistics(void)
 {
 	if (g_output_format == OUTPUT_HUMAN) {
-		print_statistics_human();
+		for (size_t i = 0; i < g_session_count; i++) {
+			g_sess = &g_sessions[i];
+			print_statistics_human();
+		}
 	} else {
-		print_statistics_machine(servaddr);
+		print_statistics_machine();
 	}
 	// クロックスキュー警告は全モードで stderr に出す
 	if (g_negative_delay_seen) {
@@ -512,8 +940,13 @@ print_statistics(const struct sockaddr_storage *servaddr)
 __attribute__((cold)) static void print_usage(const char *prog)
 {
 	fprintf(stderr,
-		"Usage: %s [-4|-6] [-P] [-c] [-O] [-n count] [-w sec] "
-		"[-o fmt] [-i iface] [server_ip|hostname] [port]\n",
+		"Usage: %s [-4|-6] [-P] [-c] [-O] [-A] [-n count] [-w sec] "
+		"[-I usec] [-S usec] [-s sched] [-J usec] [-B len] [-G usec] "
+		"[-o fmt] [-R sec] [-r file] [-C clock] [-i iface] "
+		"[server_ip|hostname] [port]\n"
+		"       %s [options] -t host[:port] [-t host[:port] ...] "
+		"[-f file]\n",
+		prog ? prog : "sender",
 		prog ? prog : "sender");
 	fprintf(stderr, "Options:\n");
 	fprintf(stderr, "  -4    Force IPv4\n");
@@ -527,15 +960,47 @@ __attribute__((cold)) static void print_usage(const char *prog)
 		"  -c    Use PHC (PTP Hardware Clock) "
 		"(requires -i)\n");
 #endif
+	fprintf(stderr,
+		"  -C    T1 clock: system (default) or tsc (calibrated "
+		"invariant TSC)\n");
 	fprintf(stderr, "  -O    One-way delay measurement mode\n");
 	fprintf(stderr,
-		"  -n    Number of packets to send, then stop "
-		"(enables percentiles)\n");
+		"  -A    Keep every sample for exact percentiles "
+		"(default: streaming estimate)\n");
+	fprintf(stderr, "  -n    Number of packets to send, then stop\n");
+	fprintf(stderr, "  -w    Measurement duration in seconds, then stop\n");
+	fprintf(stderr,
+		"  -I    Send interval in microseconds (default: 1000000)\n");
+	fprintf(stderr,
+		"  -S    Busy-wait the last N microseconds before each send "
+		"(default: off)\n");
 	fprintf(stderr,
-		"  -w    Measurement duration in seconds, then stop "
-		"(enables percentiles)\n");
+		"  -s    Send schedule: periodic (default), poisson "
+		"(exponential gaps, mean -I), or offset (periodic with a "
+		"random start offset)\n");
+	fprintf(stderr,
+		"  -J    Max random start offset for -s offset, in "
+		"microseconds; 0 = none (default: -I)\n");
+	fprintf(stderr,
+		"  -B    Send trains of N back-to-back packets (2-64) every "
+		"-I\n");
+	fprintf(stderr,
+		"  -G    Spacing between packets within a train, in "
+		"microseconds; (-B - 1) x -G < -I (default: 0)\n");
+	fprintf(stderr,
+		"  -t    Target host[:port] ([v6addr]:port); repeat to probe "
+		"several reflectors\n");
+	fprintf(stderr,
+		"  -f    Read targets from a file (one host[:port] per "
+		"line)\n");
 	fprintf(stderr,
 		"  -o    Output format: human (default), json, or csv\n");
+	fprintf(stderr,
+		"  -R    Also report every N seconds, covering that interval "
+		"only\n");
+	fprintf(stderr,
+		"  -r    Write one record per reply to file (NDJSON, or CSV "
+		"with -o csv)\n");
 	fprintf(stderr, "  (default: auto-detect from address format)\n");
 }
 
@@ -598,6 +1063,7 @@ __attribute__((cold)) static int configure_sender_socket_unix(
 	struct stamp_so_timestamping_opts ts_opts = {
 		.ifname = ifname,
 		.want_tx_hw = true,
+		.tx_keyed = false,
 		.require_rx_hw = false,
 		.hw_kind = "HW",
 		.rx_label = "RX (T4)",
@@ -743,17 +1209,13 @@ __attribute__((cold)) static SOCKET init_socket(
 }
 
 /**
- * STAMPパケットの送信 (RFC 8762 Section 4.2.1)
- * @param sockfd ソケットディスクリプタ
+ * 送信パケットの構築と T1 の打刻 (RFC 8762 Section 4.2.1)
  * @param seq シーケンス番号
  * @param tx_packet 送信パケットのポインタ
  * @return 成功時0、エラー時-1
  */
-static int send_stamp_packet(SOCKET sockfd,
-			     uint32_t seq,
-			     struct stamp_sender_packet *tx_packet,
-			     uint32_t *real_t1_sec,
-			     uint32_t *real_t1_frac)
+static int prepare_stamp_packet(uint32_t seq,
+				struct stamp_sender_packet *tx_packet)
 {
 	uint32_t t1_sec;
 	uint32_t t1_frac;
@@ -774,42 +1236,68 @@ static int send_stamp_packet(SOCKET sockfd,
 		}
 	} else
 #endif
-		if (unlikely(stamp_get_timestamp(&t1_sec,
-						 &t1_frac,
-						 g_ptp_mode) != 0)) {
+		if (stamp_tsc_enabled(&g_tsc_clock)) {
+		stamp_tsc_get_timestamp(&g_tsc_clock, &t1_sec, &t1_frac, g_ptp_mode);
+	} else if (unlikely(stamp_get_timestamp(&t1_sec,
+						&t1_frac,
+						g_ptp_mode) != 0)) {
 		fprintf(stderr, "Failed to get T1 timestamp\n");
 		return -1;
 	}
 	tx_packet->timestamp_sec = t1_sec;
 	tx_packet->timestamp_frac = t1_frac;
+	return 0;
+}
+
+#ifdef __linux__
+/**
+ * 送信失敗でもカーネルが OPT_ID のキーを払い出し済みの場合（datagram を
+ * 組み立てた後の送信バッファ不足）、キーを 1 つ進めて seq との対応を保つ
+ */
+static void skip_failed_tx_key(int err)
+{
+	if (IS_WOULDBLOCK(err) || err == ENOBUFS) {
+		stamp_inflight_skip_tx_key(&g_sess->inflight);
+	}
+}
+#endif
 
-	*real_t1_sec = t1_sec;
-	*real_t1_frac = t1_frac;
+/**
+ * STAMPパケットの送信 (RFC 8762 Section 4.2.1)
+ * @param sockfd ソケットディスクリプタ
+ * @param seq シーケンス番号
+ * @param tx_packet 送信パケットのポインタ
+ * @return 成功時0、エラー時-1
+ */
+static int send_stamp_packet(SOCKET sockfd,
+			     uint32_t seq,
+			     struct stamp_sender_packet *tx_packet,
+			     uint32_t *real_t1_sec,
+			     uint32_t *real_t1_frac)
+{
+	if (prepare_stamp_packet(seq, tx_packet) != 0) {
+		return -1;
+	}
+	*real_t1_sec = tx_packet->timestamp_sec;
+	*real_t1_frac = tx_packet->timestamp_frac;
 
 	if (unlikely(send(sockfd,
 			  (const char *)tx_packet,
 			  (int)sizeof(*tx_packet),
 			  0) < 0)) {
+#ifdef __linux__
+		skip_failed_tx_key(errno);
+#endif
 		PRINT_SOCKET_ERROR("send failed");
 		return -1;
 	}
+	// TX HW タイムスタンプ（Linux）は送信を待たずに後から回収し、応答待ち表の
+	// T1 を差し替える（collect_tx_timestamps）
 
-#ifdef __linux__
-	// TX HW タイムスタンプ: MSG_ERRQUEUE から取得
-	if (g_tx_hw_timestamp_enabled) {
-		uint32_t hw_sec;
-		uint32_t hw_frac;
-		if (stamp_retrieve_tx_hw_timestamp(sockfd,
-						   &hw_sec,
-						   &hw_frac,
-						   g_ptp_mode)) {
-			*real_t1_sec = hw_sec;
-			*real_t1_frac = hw_frac;
-		}
+	g_sess->stats.sent++;
+	if (g_sess->iv_cur != NULL) {
+		g_sess->iv_cur->sent++;
 	}
-#endif
-
-	g_stats.sent++;
 	return 0;
 }
 
@@ -818,8 +1306,8 @@ static int send_stamp_packet(SOCKET sockfd,
  */
 static inline void update_rtt_stats(double rtt)
 {
-	g_stats.received++;
-	stamp_welford_update(&g_stats.rtt, rtt);
+	g_sess->stats.received++;
+	stamp_welford_update(&g_sess->stats.rtt, rtt);
 }
 
 /**
@@ -828,8 +1316,8 @@ static inline void update_rtt_stats(double rtt)
 static inline void update_oneway_stats(double forward_delay,
 				       double backward_delay)
 {
-	stamp_welford_update(&g_stats.fwd, forward_delay);
-	stamp_welford_update(&g_stats.bwd, backward_delay);
+	stamp_welford_update(&g_sess->stats.fwd, forward_delay);
+	stamp_welford_update(&g_sess->stats.bwd, backward_delay);
 
 	if (forward_delay < 0 || backward_delay < 0) {
 		fprintf(stderr,
@@ -854,8 +1342,8 @@ static inline void print_measurement_result(uint32_t seq_nbo,
 					    double rtt,
 					    double offset)
 {
-	if (g_output_format != OUTPUT_HUMAN) {
-		return; // 機械可読モードでは毎パケット行を抑制
+	if (g_output_format != OUTPUT_HUMAN || g_session_count > 1) {
+		return; // 機械可読モード・複数ターゲット時は毎パケット行を抑制
 	}
 	if (g_oneway_mode) {
 		printf("%" PRIu32 "\t%.3f\t\t%.3f\t\t%.3f\n",
@@ -874,33 +1362,71 @@ static inline void print_measurement_result(uint32_t seq_nbo,
 }
 
 /**
- * IPDV (RFC 3393) 統計の更新。
- * 直前に受信したパケットと seq が連続する場合のみ |D(i)-D(i-1)| を集計する。
- * パケットロス等で seq が飛んだ場合は隣接性が崩れるため集計しない。
+ * 順序逆転の集計と IPDV (RFC 3393) 統計の更新。
+ * seq が隣接する応答（seq − 1 / seq + 1）を受信済みなら |D(i)-D(i-1)| を集計する。
+ * 到着順は問わないため、順序逆転した応答も両隣との組で 1 回ずつ数える。
+ * パケットロス等で隣の seq が欠けた場合は組にならないため集計しない。
  */
 static inline void update_ipdv_stats(double rtt,
 				     double forward_delay,
 				     double backward_delay,
 				     uint32_t seq)
 {
-	if (g_stats.has_prev &&
-	    stamp_seq_is_consecutive(g_stats.prev_seq, seq)) {
-		stamp_welford_update(&g_stats.ipdv_rtt,
-				     fabs(rtt - g_stats.prev_rtt));
+	const struct stamp_reorder_slot *pairs[2];
+	uint32_t count = stamp_reorder_record(&g_sess->reorder,
+					      seq,
+					      rtt,
+					      forward_delay,
+					      backward_delay,
+					      pairs);
+	for (uint32_t i = 0; i < count; i++) {
+		double d_rtt = fabs(rtt - pairs[i]->rtt);
+		double d_fwd = fabs(forward_delay - pairs[i]->fwd);
+		double d_bwd = fabs(backward_delay - pairs[i]->bwd);
+		stamp_welford_update(&g_sess->stats.ipdv_rtt, d_rtt);
 		if (g_oneway_mode) {
-			stamp_welford_update(
-				&g_stats.ipdv_fwd,
-				fabs(forward_delay - g_stats.prev_fwd));
-			stamp_welford_update(
-				&g_stats.ipdv_bwd,
-				fabs(backward_delay - g_stats.prev_bwd));
+			stamp_welford_update(&g_sess->stats.ipdv_fwd, d_fwd);
+			stamp_welford_update(&g_sess->stats.ipdv_bwd, d_bwd);
 		}
+		if (g_sess->iv_cur != NULL) {
+			stamp_interval_on_ipdv(g_sess->iv_cur, d_rtt, d_fwd, d_bwd);
+		}
+	}
+}
+
+/**
+ * 応答 1 本を毎パケット記録へ積む（-r 指定時のみ呼ぶ）
+ * 書き出しが追いつかずリングが満杯なら捨てる（計測ループは待たない）。
+ */
+static inline void record_reply(const struct stamp_reflector_packet *rx_packet,
+				const struct stamp_wire_ts ts[4],
+				const struct stamp_delays_ns *d,
+				uint16_t sender_ee,
+				uint16_t reflector_ee)
+{
+	struct stamp_pkt_record rec;
+	stamp_pkt_record_fill(&rec,
+			      &ts[0],
+			      &ts[1],
+			      &ts[2],
+			      &ts[3],
+			      d,
+			      sender_ee,
+			      reflector_ee);
+	rec.seq = (uint32_t)ntohl(rx_packet->sender_seq_num);
+	rec.session = (uint16_t)(g_sess - g_sessions);
+	rec.ttl = rx_packet->sender_ttl;
+	(void)stamp_pktlog_push(&g_recorder.log, &rec);
+#ifndef _WIN32
+	if (g_recorder.started) {
+		return;
 	}
-	g_stats.prev_rtt = rtt;
-	g_stats.prev_fwd = forward_delay;
-	g_stats.prev_bwd = backward_delay;
-	g_stats.prev_seq = seq;
-	g_stats.has_prev = true;
+#endif
+	// 書き出しスレッドが無い場合はその場で整形し、バッファが埋まったら書く
+	(void)stamp_pktlog_drain(&g_recorder.log,
+				 g_recorder.target_ptrs,
+				 0,
+				 false);
 }
 
 /**
@@ -923,43 +1449,63 @@ static void compute_and_report_delays(
 			reflector_ee);
 	}
 
-	double t1 =
-		stamp_timestamp_to_double(real_t1_sec, real_t1_frac, sender_ee);
-	double t2 = stamp_timestamp_to_double(rx_packet->rx_sec,
-					      rx_packet->rx_frac,
-					      reflector_ee);
-	double t3 = stamp_timestamp_to_double(rx_packet->timestamp_sec,
-					      rx_packet->timestamp_frac,
-					      reflector_ee);
-	double t4 = stamp_timestamp_to_double(t4_sec, t4_frac, sender_ee);
-
-	if (t1 > t4) {
+	// 差は整数ナノ秒で取り、遅延ごとに 1 回だけ double（ms）へ変換する
+	struct stamp_wire_ts t1 =
+		stamp_wire_ts(real_t1_sec, real_t1_frac, sender_ee);
+	struct stamp_wire_ts t2 =
+		stamp_wire_ts(rx_packet->rx_sec, rx_packet->rx_frac, reflector_ee);
+	struct stamp_wire_ts t3 = stamp_wire_ts(rx_packet->timestamp_sec,
+						rx_packet->timestamp_frac,
+						reflector_ee);
+	struct stamp_wire_ts t4 = stamp_wire_ts(t4_sec, t4_frac, sender_ee);
+	struct stamp_delays_ns d;
+	stamp_compute_delays_ns(&t1, &t2, &t3, &t4, &d);
+	if (g_recorder.enabled) {
+		const struct stamp_wire_ts ts[4] = {t1, t2, t3, t4};
+		record_reply(rx_packet, ts, &d, sender_ee, reflector_ee);
+	}
+
+	int64_t t1_to_t4 = stamp_ts_diff_ns(t1, t4);
+	if (unlikely(t1_to_t4 < 0)) {
 		fprintf(stderr,
 			"Warning: T1 > T4 detected. Severe clock skew or "
 			"timestamp error.\n");
 		fprintf(stderr,
 			"  T1=%.9f, T2=%.9f, T3=%.9f, T4=%.9f\n",
-			t1,
-			t2,
-			t3,
-			t4);
+			stamp_timestamp_to_double(real_t1_sec,
+						  real_t1_frac,
+						  sender_ee),
+			stamp_timestamp_to_double(rx_packet->rx_sec,
+						  rx_packet->rx_frac,
+						  reflector_ee),
+			stamp_timestamp_to_double(rx_packet->timestamp_sec,
+						  rx_packet->timestamp_frac,
+						  reflector_ee),
+			stamp_timestamp_to_double(t4_sec, t4_frac, sender_ee));
 		fprintf(stderr,
 			"  Difference: %.6f ms\n",
-			(t1 - t4) * MSEC_PER_SEC);
+			stamp_ns_to_ms(-t1_to_t4));
 		g_negative_delay_seen = true;
 	}
 
-	double forward_delay = stamp_forward_delay(t1, t2);
-	double backward_delay = stamp_backward_delay(t3, t4);
-	double rtt = stamp_rtt(forward_delay, backward_delay);
-	double offset = stamp_clock_offset(t1, t2, t3, t4);
+	double forward_delay = stamp_ns_to_ms(d.forward);
+	double backward_delay = stamp_ns_to_ms(d.backward);
+	double rtt = stamp_ns_to_ms(d.rtt);
+	double offset = stamp_ns_to_ms(d.offset_x2) * 0.5;
 
-	if (forward_delay < 0 || backward_delay < 0) {
+	if (d.forward < 0 || d.backward < 0) {
 		g_negative_delay_seen = true;
 	}
 
 	update_rtt_stats(rtt);
-	stamp_welford_update(&g_stats.offset, offset);
+	stamp_welford_update(&g_sess->stats.offset, offset);
+	if (g_sess->iv_cur != NULL) {
+		stamp_interval_on_reply(g_sess->iv_cur,
+					rtt,
+					forward_delay,
+					backward_delay,
+					offset);
+	}
 	if (g_oneway_mode) {
 		update_oneway_stats(forward_delay, backward_delay);
 	}
@@ -967,6 +1513,20 @@ static void compute_and_report_delays(
 			  forward_delay,
 			  backward_delay,
 			  (uint32_t)ntohl(rx_packet->sender_seq_num));
+	if (g_train_mode) {
+		// 列車内の到着間隔は µs 未満になりうるため T2 は整数ナノ秒で扱う
+		stamp_train_on_reply(g_sess->trains,
+				     (uint32_t)ntohl(rx_packet->sender_seq_num),
+				     stamp_timestamp_to_ns(rx_packet->rx_sec,
+							   rx_packet->rx_frac,
+							   reflector_ee),
+				     rtt);
+	}
+	stamp_sketch_add(g_sess->sketch_rtt, rtt);
+	if (g_oneway_mode) {
+		stamp_sketch_add(g_sess->sketch_fwd, forward_delay);
+		stamp_sketch_add(g_sess->sketch_bwd, backward_delay);
+	}
 	if (g_collect_samples) {
 		stamp_sample_buffer_push(rtt,
 					 forward_delay,
@@ -981,17 +1541,104 @@ static void compute_and_report_delays(
 				 offset);
 }
 
+/**
+ * 結果の確定したプローブを喪失パターンへ加える（stamp_inflight_settle のコールバック）
+ */
+static void on_probe_settled(__attribute__((unused)) uint32_t seq,
+			     bool lost,
+			     void *ctx)
+{
+	struct sender_session *sess = ctx;
+	stamp_loss_add(&sess->loss, lost);
+	if (sess->iv_cur != NULL) {
+		sess->iv_cur->settled++;
+		sess->iv_cur->lost += lost ? 1U : 0U;
+	}
+}
+
+/**
+ * 計測終了時点の応答待ちを喪失として確定させ、喪失区間を閉じる（統計出力前）
+ */
+__attribute__((cold)) static void settle_all_sessions(void)
+{
+	for (size_t i = 0; i < g_session_count; i++) {
+		struct sender_session *sess = &g_sessions[i];
+		stamp_inflight_settle(&sess->inflight,
+				      sess->inflight.next_seq,
+				      on_probe_settled,
+				      sess);
+		stamp_loss_close(&sess->loss);
+	}
+}
+
+/**
+ * -w 締切の時点で応答待ちのプローブを timeout（= loss）として計上する
+ * （全体の統計と進行中のインターバルの両方。結果の確定は settle_all_sessions）
+ */
+__attribute__((cold, nonnull(1))) static void
+timeout_pending_probes(struct sender_session *sess)
+{
+	sess->stats.timeouts += sess->inflight.pending;
+	if (sess->iv_cur != NULL) {
+		sess->iv_cur->timeouts += sess->inflight.pending;
+	}
+}
+
+/**
+ * 応答待ちタイムアウトの通知（stamp_inflight_expire のコールバック）
+ */
+static void on_probe_expired(const struct stamp_inflight_entry *e,
+			     __attribute__((unused)) void *ctx)
+{
+	fprintf(stderr,
+		"%sTimeout waiting for response (seq %" PRIu32 ")\n",
+		g_sess->log_prefix,
+		e->seq);
+	g_sess->stats.timeouts++;
+	if (g_sess->iv_cur != NULL) {
+		g_sess->iv_cur->timeouts++;
+	}
+	if (g_train_mode) {
+		stamp_train_on_loss(g_sess->trains, e->seq);
+	}
+}
+
+#ifdef __linux__
+static void on_tx_hw_timestamp(const struct stamp_tx_timestamp *ts, void *ctx)
+{
+	struct sender_session *sess = ctx;
+	(void)stamp_inflight_set_tx_t1(&sess->inflight, ts->key, ts->sec, ts->frac);
+}
+
+/**
+ * errqueue に溜まった TX HW タイムスタンプをまとめて回収し、応答待ち
+ * プローブの T1 を HW の送信時刻へ差し替える（TX HW 無効時は読み捨てる）
+ * POLLERR/EPOLLERR の通知時と、未回収のキーが残る状態での応答照合の直前に
+ * 呼ぶ。送信ごとに到着を待たないため、送信スケジュールを止めない。
+ */
+static void collect_tx_timestamps(SOCKET sockfd)
+{
+	if (g_sess->inflight.tx_key_seq == NULL) {
+		(void)stamp_drain_errqueue(sockfd);
+		return;
+	}
+	(void)stamp_collect_tx_timestamps(sockfd,
+					  g_ptp_mode,
+					  true,
+					  on_tx_hw_timestamp,
+					  g_sess);
+}
+#endif
+
 /**
  * STAMPパケットの受信と処理
+ * 応答の sender_seq_num を応答待ち表と照合し、期限内の応答のみ遅延統計へ
+ * 反映する。遅着・重複・未知の seq は統計へ混ぜずに個別に計上する。
  * @return 成功時0、エラー時-1
  */
-static int receive_and_process_packet(
-	SOCKET sockfd,
-	const struct stamp_sender_packet *tx_packet,
-	uint32_t real_t1_sec,
-	uint32_t real_t1_frac,
-	uint8_t *buffer,
-	size_t buffer_len)
+static int receive_and_process_packet(SOCKET sockfd,
+				      uint8_t *buffer,
+				      size_t buffer_len)
 {
 	struct stamp_reflector_packet rx_packet;
 	struct sockaddr_storage recvaddr;
@@ -1009,10 +1656,8 @@ static int receive_and_process_packet(
 					  &t4_frac,
 					  g_ptp_mode);
 	if (unlikely(n < 0)) {
-		if (stamp_recv_timed_out()) {
-			fprintf(stderr, "Timeout waiting for response\n");
-			g_stats.timeouts++;
-		} else {
+		// 受信可能通知後のタイムアウトは空振り（次の待機へ戻る）
+		if (!stamp_recv_timed_out()) {
 			PRINT_SOCKET_ERROR("recvfrom failed");
 		}
 		return -1;
@@ -1025,23 +1670,72 @@ static int receive_and_process_packet(
 
 	memcpy(&rx_packet, buffer, sizeof(rx_packet));
 
-	if (unlikely(rx_packet.sender_seq_num != tx_packet->seq_num)) {
+	uint32_t seq = ntohl(rx_packet.sender_seq_num);
+#ifdef __linux__
+	// 未回収の HW T1 があれば照合前に反映する
+	if (stamp_inflight_tx_t1_outstanding(&g_sess->inflight)) {
+		collect_tx_timestamps(sockfd);
+	}
+#endif
+	const struct stamp_inflight_entry *entry;
+	switch (stamp_inflight_match(&g_sess->inflight, seq, &entry)) {
+	case STAMP_INFLIGHT_MATCH_REORDERED:
+		g_sess->stats.reordered++;
+		if (g_sess->iv_cur != NULL) {
+			g_sess->iv_cur->reordered++;
+		}
+		compute_and_report_delays(&rx_packet,
+					  entry->t1_sec,
+					  entry->t1_frac,
+					  t4_sec,
+					  t4_frac);
+		return 0;
+	case STAMP_INFLIGHT_MATCH_IN_ORDER:
+		compute_and_report_delays(&rx_packet,
+					  entry->t1_sec,
+					  entry->t1_frac,
+					  t4_sec,
+					  t4_frac);
+		return 0;
+	case STAMP_INFLIGHT_MATCH_LATE:
+		g_sess->stats.late++;
+		if (g_sess->iv_cur != NULL) {
+			g_sess->iv_cur->late++;
+		}
+		fprintf(stderr,
+			"%sLate response for seq %" PRIu32
+			" (arrived after timeout)\n",
+			g_sess->log_prefix,
+			seq);
+		return 0;
+	case STAMP_INFLIGHT_MATCH_DUPLICATE:
+		g_sess->stats.duplicates++;
+		if (g_sess->iv_cur != NULL) {
+			g_sess->iv_cur->duplicates++;
+		}
+		fprintf(stderr,
+			"%sDuplicate response for seq %" PRIu32 "\n",
+			g_sess->log_prefix,
+			seq);
+		return 0;
+	case STAMP_INFLIGHT_MATCH_UNKNOWN:
+	default:
 		fprintf(stderr,
-			"Sequence number mismatch: expected %" PRIu32
-			", got %" PRIu32 "\n",
-			(uint32_t)ntohl(tx_packet->seq_num),
-			(uint32_t)ntohl(rx_packet.sender_seq_num));
+			"%sUnexpected sequence number: %" PRIu32 "\n",
+			g_sess->log_prefix,
+			seq);
 		return -1;
 	}
-
-	compute_and_report_delays(&rx_packet,
-				  real_t1_sec,
-				  real_t1_frac,
-				  t4_sec,
-				  t4_frac);
-	return 0;
 }
 
+/**
+ * -t/-f で指定したターゲット 1 件
+ */
+struct sender_target {
+	char host[SENDER_HOST_MAX];
+	uint16_t port;
+};
+
 /**
  * sender のコマンドラインオプション
  */
@@ -1051,9 +1745,22 @@ struct sender_options {
 	const char *host;
 	bool ptp_mode;
 	bool oneway_mode;
+	bool exact_samples;	   // -A: 全サンプルを保持して正確な分位点を求める
 	uint32_t count;		   // -n: 送信本数上限（0=無制限）
 	uint32_t duration_sec;	   // -w: 計測秒数上限（0=無制限）
 	enum output_format format; // -o: 出力形式（既定 human）
+	uint32_t interval_us;	   // -I: 送信間隔（マイクロ秒）
+	uint32_t spin_us;	   // -S: 予定時刻直前のビジーウェイト幅（0=無効）
+	enum stamp_sched_mode sched_mode; // -s: 送信間隔の分布
+	uint32_t offset_us; // -J: offset モードの開始オフセット上限（未指定=間隔と同じ）
+	uint32_t burst_len;	   // -B: 列車長（0=列車送信しない）
+	uint32_t burst_spacing_us; // -G: 列車内の送信間隔（0=連続送出）
+	enum stamp_clock_source clock_source; // -C: T1 を打刻する時計
+	uint32_t report_interval_sec; // -R: 区間レポートの間隔（0=無効）
+	const char *record_path; // -r: 毎パケット記録の出力先（NULL=無効）
+	struct sender_target *targets; // -t/-f のターゲット（NULL=位置引数）
+	size_t target_count;
+	size_t target_cap;
 #ifdef __linux__
 	const char *ifname;
 	bool phc_requested;
@@ -1082,21 +1789,96 @@ parse_output_format(const char *arg, enum output_format *out)
 }
 
 /**
- * 単一の getopt オプション文字を処理する。
- * @param opt オプション文字
- * @param opts 設定を格納する構造体
- * @return 継続可なら 0、エラー（呼び出し側で usage 表示）なら 1
+ * ターゲット文字列を解析して opts->targets に追加する
+ * @return 成功時 0、不正な指定・上限超過・確保失敗時 -1
  */
-__attribute__((nonnull(2), cold)) static int
-handle_sender_option(int opt, struct sender_options *opts)
+__attribute__((nonnull(1, 2), cold)) static int
+add_sender_target(struct sender_options *opts, const char *arg)
 {
-	switch (opt) {
-	case '4':
-		opts->af_hint = AF_INET;
-		return 0;
-	case '6':
-		opts->af_hint = AF_INET6;
-		return 0;
+	struct sender_target target;
+	if (stamp_parse_target(arg,
+			       target.host,
+			       sizeof(target.host),
+			       &target.port,
+			       STAMP_PORT) != 0) {
+		fprintf(stderr, "Invalid target: %s\n", arg);
+		return -1;
+	}
+	if (opts->target_count >= SENDER_MAX_TARGETS) {
+		fprintf(stderr, "Too many targets (max %u)\n", SENDER_MAX_TARGETS);
+		return -1;
+	}
+	if (opts->target_count == opts->target_cap) {
+		size_t cap = opts->target_cap == 0 ? 8 : opts->target_cap * 2;
+		struct sender_target *grown =
+			realloc(opts->targets, cap * sizeof(*grown));
+		if (grown == NULL) {
+			fprintf(stderr, "Failed to allocate target list\n");
+			return -1;
+		}
+		opts->targets = grown;
+		opts->target_cap = cap;
+	}
+	opts->targets[opts->target_count++] = target;
+	return 0;
+}
+
+/**
+ * ターゲット一覧ファイル（1 行 1 ターゲット、空行と # 以降は無視）を読む
+ * @return 成功時 0、エラー時 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static int
+load_sender_targets(struct sender_options *opts, const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr,
+			"Failed to open target file %s: %s\n",
+			path,
+			strerror(errno));
+		return -1;
+	}
+	char line[SENDER_HOST_MAX + 16];
+	int rc = 0;
+	while (rc == 0 && fgets(line, sizeof(line), fp) != NULL) {
+		if (strchr(line, '\n') == NULL && !feof(fp)) {
+			fprintf(stderr, "Target line too long in %s\n", path);
+			rc = -1;
+			break;
+		}
+		line[strcspn(line, "#\r\n")] = '\0';
+		char *begin = line;
+		while (*begin == ' ' || *begin == '\t') {
+			begin++;
+		}
+		size_t len = strlen(begin);
+		while (len > 0 && (begin[len - 1] == ' ' || begin[len - 1] == '\t')) {
+			begin[--len] = '\0';
+		}
+		if (len > 0) {
+			rc = add_sender_target(opts, begin);
+		}
+	}
+	fclose(fp);
+	return rc;
+}
+
+/**
+ * 単一の getopt オプション文字を処理する。
+ * @param opt オプション文字
+ * @param opts 設定を格納する構造体
+ * @return 継続可なら 0、エラー（呼び出し側で usage 表示）なら 1
+ */
+__attribute__((nonnull(2), cold)) static int
+handle_sender_option(int opt, struct sender_options *opts)
+{
+	switch (opt) {
+	case '4':
+		opts->af_hint = AF_INET;
+		return 0;
+	case '6':
+		opts->af_hint = AF_INET6;
+		return 0;
 	case 'i':
 #ifdef __linux__
 		opts->ifname = optarg;
@@ -1116,9 +1898,29 @@ handle_sender_option(int opt, struct sender_options *opts)
 			"Warning: -c option is only supported on Linux\n");
 #endif
 		return 0;
+	case 'C':
+		if (stamp_clock_source_parse(optarg, &opts->clock_source) != 0) {
+			fprintf(stderr, "Invalid clock: %s\n", optarg);
+			return 1;
+		}
+		return 0;
+	case 'R':
+		if (stamp_parse_u32_range(optarg,
+					  &opts->report_interval_sec,
+					  STAMP_INTERVAL_MAX_SEC) != 0) {
+			fprintf(stderr,
+				"Invalid report interval: %s (1-%u)\n",
+				optarg,
+				STAMP_INTERVAL_MAX_SEC);
+			return 1;
+		}
+		return 0;
 	case 'O':
 		opts->oneway_mode = true;
 		return 0;
+	case 'A':
+		opts->exact_samples = true;
+		return 0;
 	case 'n':
 		if (stamp_parse_u32_range(optarg, &opts->count, UINT32_MAX) !=
 		    0) {
@@ -1134,6 +1936,66 @@ handle_sender_option(int opt, struct sender_options *opts)
 			return 1;
 		}
 		return 0;
+	case 'I':
+		if (stamp_parse_u32_range(optarg,
+					  &opts->interval_us,
+					  UINT32_MAX) != 0) {
+			fprintf(stderr, "Invalid interval: %s\n", optarg);
+			return 1;
+		}
+		return 0;
+	case 'S':
+		if (stamp_parse_u32_range(optarg,
+					  &opts->spin_us,
+					  STAMP_SCHED_SPIN_USEC_MAX) != 0) {
+			fprintf(stderr,
+				"Invalid spin time: %s (1-%u)\n",
+				optarg,
+				STAMP_SCHED_SPIN_USEC_MAX);
+			return 1;
+		}
+		return 0;
+	case 's':
+		if (stamp_sched_parse_mode(optarg, &opts->sched_mode) != 0) {
+			fprintf(stderr, "Invalid schedule: %s\n", optarg);
+			return 1;
+		}
+		return 0;
+	case 'J':
+		if (stamp_parse_u32_or_zero(optarg,
+					    &opts->offset_us,
+					    UINT32_MAX) != 0) {
+			fprintf(stderr, "Invalid start offset: %s\n", optarg);
+			return 1;
+		}
+		return 0;
+	case 'B':
+		if (stamp_parse_u32_range(optarg,
+					  &opts->burst_len,
+					  STAMP_TRAIN_MAX_LEN) != 0 ||
+		    opts->burst_len < 2) {
+			fprintf(stderr,
+				"Invalid train length: %s (2-%u)\n",
+				optarg,
+				STAMP_TRAIN_MAX_LEN);
+			return 1;
+		}
+		return 0;
+	case 'G':
+		if (stamp_parse_u32_or_zero(optarg,
+					    &opts->burst_spacing_us,
+					    UINT32_MAX) != 0) {
+			fprintf(stderr, "Invalid train spacing: %s\n", optarg);
+			return 1;
+		}
+		return 0;
+	case 't':
+		return add_sender_target(opts, optarg) != 0 ? 1 : 0;
+	case 'f':
+		return load_sender_targets(opts, optarg) != 0 ? 1 : 0;
+	case 'r':
+		opts->record_path = optarg;
+		return 0;
 	case 'o':
 		if (parse_output_format(optarg, &opts->format) != 0) {
 			fprintf(stderr, "Invalid output format: %s\n", optarg);
@@ -1160,13 +2022,24 @@ parse_sender_options(int argc, char *argv[], struct sender_options *opts)
 	opts->count = 0;
 	opts->duration_sec = 0;
 	opts->format = OUTPUT_HUMAN;
+	opts->interval_us = SEND_INTERVAL_USEC;
+	opts->spin_us = 0;
+	opts->sched_mode = STAMP_SCHED_PERIODIC;
+	opts->offset_us = SENDER_OFFSET_DEFAULT;
+	opts->burst_len = 0;
+	opts->burst_spacing_us = 0;
+	opts->clock_source = STAMP_CLOCK_SYSTEM;
+	opts->report_interval_sec = 0;
+	opts->targets = NULL;
+	opts->target_count = 0;
+	opts->target_cap = 0;
 #ifdef __linux__
 	opts->ifname = NULL;
 	opts->phc_requested = false;
 #endif
 
 	int opt;
-	while ((opt = getopt(argc, argv, "46i:PcOn:w:o:")) != -1) {
+	while ((opt = getopt(argc, argv, "46i:PcC:OAn:w:I:S:s:J:B:G:t:f:o:R:r:")) != -1) {
 		if (handle_sender_option(opt, opts) != 0) {
 			print_usage(argc > 0 ? argv[0] : "sender");
 			return 1;
@@ -1174,10 +2047,32 @@ parse_sender_options(int argc, char *argv[], struct sender_options *opts)
 	}
 
 	int remaining_args = argc - optind;
-	if (remaining_args > 2) {
+	if (remaining_args > 2 ||
+	    (remaining_args > 0 && opts->target_count > 0)) {
+		if (opts->target_count > 0) {
+			fprintf(stderr,
+				"-t/-f cannot be combined with a positional "
+				"server address\n");
+		}
 		print_usage(argc > 0 ? argv[0] : "sender");
 		return 1;
 	}
+	if (opts->target_count > 1 && opts->spin_us != 0) {
+		fprintf(stderr, "-S is not supported with multiple targets\n");
+		return 1;
+	}
+	// 列車の送信が次の列車の予定時刻を越えないこと
+	if (opts->burst_len != 0 &&
+	    (uint64_t)(opts->burst_len - 1U) * opts->burst_spacing_us >=
+		    opts->interval_us) {
+		fprintf(stderr,
+			"Train span (-B - 1) x -G (%llu us) must be shorter "
+			"than -I (%u us)\n",
+			(unsigned long long)(opts->burst_len - 1U) *
+				opts->burst_spacing_us,
+			opts->interval_us);
+		return 1;
+	}
 
 	if (remaining_args > 0) {
 		opts->host = argv[optind];
@@ -1195,18 +2090,19 @@ parse_sender_options(int argc, char *argv[], struct sender_options *opts)
 /**
  * 測定開始メッセージの表示
  */
-__attribute__((cold)) static void print_sender_start_message(
-	const struct sockaddr_storage *servaddr)
+__attribute__((cold)) static void
+print_sender_start_message(const struct sender_options *opts)
 {
 	if (g_output_format != OUTPUT_HUMAN) {
 		return; // 機械可読モードでは人間向けバナーを抑制
 	}
-	char addr_port_str[STAMP_ADDR_PORT_BUFSIZE];
-	const char *family_str = stamp_family_str(servaddr->ss_family);
-	stamp_format_sockaddr_with_port(servaddr,
-					addr_port_str,
-					sizeof(addr_port_str));
-	printf("STAMP Sender targeting %s (%s)", addr_port_str, family_str);
+	if (g_session_count > 1) {
+		printf("STAMP Sender targeting %zu reflectors", g_session_count);
+	} else {
+		printf("STAMP Sender targeting %s (%s)",
+		       g_sessions[0].target,
+		       stamp_family_str(g_sessions[0].servaddr.ss_family));
+	}
 	if (g_ptp_mode) {
 		printf(" [PTP]");
 	}
@@ -1215,10 +2111,31 @@ __attribute__((cold)) static void print_sender_start_message(
 		printf(" [PHC]");
 	}
 #endif
+	if (stamp_tsc_enabled(&g_tsc_clock)) {
+		printf(" [TSC %.0f MHz]", stamp_tsc_mhz(&g_tsc_clock));
+	}
 	if (g_oneway_mode) {
 		printf(" [One-way]");
 	}
+	if (opts->interval_us != SEND_INTERVAL_USEC) {
+		printf(" [interval %u us]", opts->interval_us);
+	}
+	if (opts->sched_mode != STAMP_SCHED_PERIODIC) {
+		printf(" [%s]", stamp_sched_mode_str(opts->sched_mode));
+	}
+	if (opts->burst_len != 0) {
+		printf(" [train %u]", opts->burst_len);
+	}
 	printf("\n");
+	if (g_session_count > 1) {
+		for (size_t i = 0; i < g_session_count; i++) {
+			printf("  %s (%s)\n",
+			       g_sessions[i].target,
+			       stamp_family_str(g_sessions[i].servaddr.ss_family));
+		}
+		printf("Press Ctrl+C to stop and show per-target statistics\n");
+		return;
+	}
 	printf("Press Ctrl+C to stop and show statistics\n");
 	if (g_oneway_mode) {
 		printf("Seq\tFwd(ms)\t\tBwd(ms)\t\tOffset(ms)\n");
@@ -1231,40 +2148,6 @@ __attribute__((cold)) static void print_sender_start_message(
 	}
 }
 
-/**
- * g_running チェック付きインターバルスリープ
- */
-static inline void sleep_with_interrupt_check(void)
-{
-#ifdef _WIN32
-	int total_ms = SEND_INTERVAL_SEC * 1000;
-	int sleep_interval_ms = SLEEP_CHECK_INTERVAL_MS;
-	for (int elapsed = 0; elapsed < total_ms &&
-			      __atomic_load_n(&g_running, __ATOMIC_SEQ_CST);
-	     elapsed += sleep_interval_ms) {
-		int remaining = total_ms - elapsed;
-		int sleep_time = remaining < sleep_interval_ms
-					 ? remaining
-					 : sleep_interval_ms;
-		Sleep((DWORD)sleep_time);
-	}
-#else
-	long total_ns = SEND_INTERVAL_SEC * (long)NSEC_PER_SEC;
-	long interval_ns = SLEEP_CHECK_INTERVAL_MS * 1000000L;
-	struct timespec req;
-	for (long elapsed = 0; elapsed < total_ns &&
-			       __atomic_load_n(&g_running, __ATOMIC_SEQ_CST);
-	     elapsed += interval_ns) {
-		long remaining = total_ns - elapsed;
-		long sleep_ns = remaining < interval_ns ? remaining
-							: interval_ns;
-		req.tv_sec = sleep_ns / (long)NSEC_PER_SEC;
-		req.tv_nsec = sleep_ns % (long)NSEC_PER_SEC;
-		nanosleep(&req, NULL);
-	}
-#endif
-}
-
 /**
  * プラットフォーム初期化（WSAStartup / シグナルハンドラ）
  * @return 成功時0、エラー時-1
@@ -1299,232 +2182,1580 @@ __attribute__((cold)) static int platform_init_sender(void)
 }
 
 /**
- * 単調増加クロックのミリ秒値を取得する（-w の経過時間計測用）。
+ * 単調増加クロックのナノ秒値を取得する（送信スケジュール・応答待ち・-w 用）。
  * 壁時計（time()）と異なり NTP/手動のクロックステップに影響されない。
- * @param out_ms 取得したミリ秒値（非 NULL）
+ * @param out_ns 取得したナノ秒値（非 NULL）
  * @return 成功時 true、取得失敗時 false
  */
-__attribute__((nonnull(1))) static bool monotonic_now_ms(uint64_t *out_ms)
+__attribute__((nonnull(1))) static bool monotonic_now_ns(uint64_t *out_ns)
 {
 #ifdef _WIN32
-	*out_ms = (uint64_t)GetTickCount64();
+	LARGE_INTEGER freq;
+	LARGE_INTEGER counter;
+	if (!QueryPerformanceFrequency(&freq) ||
+	    !QueryPerformanceCounter(&counter) || freq.QuadPart <= 0) {
+		return false;
+	}
+	uint64_t f = (uint64_t)freq.QuadPart;
+	uint64_t c = (uint64_t)counter.QuadPart;
+	// c * 1e9 のオーバーフローを避けるため秒部と端数部に分けて換算
+	*out_ns = (c / f) * NSEC_PER_SEC + (c % f) * NSEC_PER_SEC / f;
 	return true;
 #else
 	struct timespec ts;
 	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
 		return false;
 	}
-	*out_ms = (uint64_t)ts.tv_sec * 1000U + (uint64_t)ts.tv_nsec / 1000000U;
+	*out_ns = (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
 	return true;
 #endif
 }
 
 /**
- * 受信タイムアウトを設定する（-w の残り時間に合わせて短縮するため毎回呼ぶ）。
- * 設定失敗は致命としない（既定タイムアウトのまま継続）。SO_RCVTIMEO=0 は
- * 「無制限」を意味するため、呼び出し側は 0 を渡さないこと。
- * @param sockfd 対象ソケット
- * @param sec 秒
- * @param usec マイクロ秒
+ * 1 区間分の集計面を機械可読レポートへまとめる（書き出し側で呼ぶ）
+ * 累積レポートと同じ列名を使い、区間の位置と長さの列を先頭に加える。
  */
-static void set_recv_timeout(SOCKET sockfd, long sec, long usec)
+__attribute__((cold, nonnull(1, 2, 3, 4))) static void
+build_interval_report(const struct sender_session *sess,
+		      const struct stamp_interval_stats *iv,
+		      struct stamp_report *report,
+		      struct stamp_report_field fields_out[SENDER_INTERVAL_FIELDS])
 {
-#ifdef _WIN32
-	DWORD timeout_ms = (DWORD)(sec * 1000 + usec / 1000);
-	(void)setsockopt(sockfd,
-			 SOL_SOCKET,
-			 SO_RCVTIMEO,
-			 (const char *)&timeout_ms,
-			 sizeof(timeout_ms));
-#else
-	(void)stamp_set_socket_timeouts(sockfd, sec, usec, false);
-#endif
+	struct series_dist drtt = sketch_series_dist(iv->sketch_rtt);
+	struct series_dist dfwd = sketch_series_dist(iv->sketch_fwd);
+	struct series_dist dbwd = sketch_series_dist(iv->sketch_bwd);
+	const struct stamp_report_field fields[] = {
+		{"interval_start_s",
+		 (double)(iv->start_ns - g_interval.origin_ns) /
+			 (double)NSEC_PER_SEC, STAMP_REPORT_VALUE},
+		{"interval_len_s",
+		 (double)(iv->end_ns - iv->start_ns) / (double)NSEC_PER_SEC, STAMP_REPORT_VALUE},
+		{"rtt_min_ms", wf_min(&iv->rtt), STAMP_REPORT_VALUE},
+		{"rtt_avg_ms", wf_avg(&iv->rtt), STAMP_REPORT_VALUE},
+		{"rtt_max_ms", wf_max(&iv->rtt), STAMP_REPORT_VALUE},
+		{"rtt_stddev_ms", wf_std(&iv->rtt), STAMP_REPORT_VALUE},
+		{"offset_min_ms", wf_min(&iv->offset), STAMP_REPORT_VALUE},
+		{"offset_avg_ms", wf_avg(&iv->offset), STAMP_REPORT_VALUE},
+		{"offset_max_ms", wf_max(&iv->offset), STAMP_REPORT_VALUE},
+		{"offset_stddev_ms", wf_std(&iv->offset), STAMP_REPORT_VALUE},
+		{"fwd_min_ms", wf_min(&iv->fwd), STAMP_REPORT_VALUE},
+		{"fwd_avg_ms", wf_avg(&iv->fwd), STAMP_REPORT_VALUE},
+		{"fwd_max_ms", wf_max(&iv->fwd), STAMP_REPORT_VALUE},
+		{"fwd_stddev_ms", wf_std(&iv->fwd), STAMP_REPORT_VALUE},
+		{"bwd_min_ms", wf_min(&iv->bwd), STAMP_REPORT_VALUE},
+		{"bwd_avg_ms", wf_avg(&iv->bwd), STAMP_REPORT_VALUE},
+		{"bwd_max_ms", wf_max(&iv->bwd), STAMP_REPORT_VALUE},
+		{"bwd_stddev_ms", wf_std(&iv->bwd), STAMP_REPORT_VALUE},
+		{"rtt_ipdv_avg_ms", wf_avg(&iv->ipdv_rtt), STAMP_REPORT_VALUE},
+		{"rtt_ipdv_max_ms", wf_max(&iv->ipdv_rtt), STAMP_REPORT_VALUE},
+		{"fwd_ipdv_avg_ms", wf_avg(&iv->ipdv_fwd), STAMP_REPORT_VALUE},
+		{"fwd_ipdv_max_ms", wf_max(&iv->ipdv_fwd), STAMP_REPORT_VALUE},
+		{"bwd_ipdv_avg_ms", wf_avg(&iv->ipdv_bwd), STAMP_REPORT_VALUE},
+		{"bwd_ipdv_max_ms", wf_max(&iv->ipdv_bwd), STAMP_REPORT_VALUE},
+		{"rtt_p50_ms", drtt.p50, STAMP_REPORT_VALUE},
+		{"rtt_p95_ms", drtt.p95, STAMP_REPORT_VALUE},
+		{"rtt_p99_ms", drtt.p99, STAMP_REPORT_VALUE},
+		{"rtt_pdv_ms", drtt.pdv, STAMP_REPORT_VALUE},
+		{"fwd_p50_ms", dfwd.p50, STAMP_REPORT_VALUE},
+		{"fwd_p95_ms", dfwd.p95, STAMP_REPORT_VALUE},
+		{"fwd_p99_ms", dfwd.p99, STAMP_REPORT_VALUE},
+		{"fwd_pdv_ms", dfwd.pdv, STAMP_REPORT_VALUE},
+		{"bwd_p50_ms", dbwd.p50, STAMP_REPORT_VALUE},
+		{"bwd_p95_ms", dbwd.p95, STAMP_REPORT_VALUE},
+		{"bwd_p99_ms", dbwd.p99, STAMP_REPORT_VALUE},
+		{"bwd_pdv_ms", dbwd.pdv, STAMP_REPORT_VALUE},
+	};
+	_Static_assert(sizeof(fields) / sizeof(fields[0]) == SENDER_INTERVAL_FIELDS,
+		       "SENDER_INTERVAL_FIELDS must match the field list");
+	memcpy(fields_out, fields, sizeof(fields));
+
+	*report = (struct stamp_report){
+		.target = sess->target,
+		.family = stamp_family_str(sess->servaddr.ss_family),
+		.ptp = g_ptp_mode,
+		.oneway = g_oneway_mode,
+		.packets_tx = iv->sent,
+		.packets_rx = iv->received,
+		.timeouts = iv->timeouts,
+		.late = iv->late,
+		.reordered = iv->reordered,
+		.duplicates = iv->duplicates,
+		.loss_ratio = stamp_interval_loss_ratio(iv),
+		.fields = fields_out,
+		.field_count = SENDER_INTERVAL_FIELDS,
+	};
 }
 
 /**
- * -w 締切に達したか判定する純粋述語。締切未達なら締切までの残りミリ秒を
- * *remain_ms_out へ返す。ソケット状態は変更しない（recv タイムアウトの短縮は
- * 呼び出し側が remain_ms に基づき明示的に行う）。単調クロックを用いる。
- * 単調クロックの取得に失敗した場合は締切未達として扱い（次回再試行）、残りには
- * 既定タイムアウト相当を返して recv の短縮を抑止する（残り時間が不明なため）。
- * @param duration_ms 計測上限（ミリ秒）
- * @param start_ms 計測開始時刻（単調クロックのミリ秒値）
- * @param remain_ms_out 締切までの残り（ミリ秒）。締切到達時は未設定
- * @return 締切到達で true
+ * -o csv の区間の行を累積サマリと同じ列に並べ直す（区間の位置と長さの後に
+ * 累積サマリの全列。区間レポートに無い列は空）
+ * @param fields build_interval_report の出力（SENDER_INTERVAL_CSV_FIELDS 列に広げる）
  */
-__attribute__((nonnull(3))) static bool
-sender_deadline_reached(uint64_t duration_ms,
-			uint64_t start_ms,
-			uint64_t *remain_ms_out)
+__attribute__((cold, nonnull(1, 2))) static void
+widen_interval_csv_fields(struct stamp_report *report,
+			  struct stamp_report_field fields[SENDER_INTERVAL_CSV_FIELDS])
 {
-	uint64_t now_ms;
-	if (!monotonic_now_ms(&now_ms)) {
-		*remain_ms_out = (uint64_t)SOCKET_TIMEOUT_SEC * 1000U;
-		return false;
-	}
-	uint64_t elapsed = now_ms - start_ms;
-	if (elapsed >= duration_ms) {
-		return true;
+	struct stamp_report_field narrow[SENDER_INTERVAL_FIELDS];
+	memcpy(narrow, fields, sizeof(narrow));
+	for (size_t j = 0; j < SENDER_REPORT_FIELDS; j++) {
+		struct stamp_report_field *f = &fields[2 + j];
+		*f = g_interval.csv_columns[j];
+		f->value = (double)NAN;
+		for (size_t k = 2; k < SENDER_INTERVAL_FIELDS; k++) {
+			if (strcmp(narrow[k].key, f->key) == 0) {
+				f->value = narrow[k].value;
+				break;
+			}
+		}
 	}
-	*remain_ms_out = duration_ms - elapsed;
-	return false;
+	report->fields = fields;
+	report->field_count = SENDER_INTERVAL_CSV_FIELDS;
 }
 
 /**
- * 測定ループ本体（送信→受信→統計更新）。
- * -n/-w 指定時は所定の本数・秒数で停止し、g_collect_samples を設定する。
- * @param sockfd 送信ソケット
- * @param opts CLI オプション
- * @return 成功時 0、開始時刻取得失敗時 -1
+ * 1 区間分の集計面を人間可読の 1 行で表示する（書き出し側で呼ぶ）
  */
-__attribute__((nonnull(2))) static int
-run_measurement_loop(SOCKET sockfd, const struct sender_options *opts)
+__attribute__((cold, nonnull(1, 2))) static void
+print_interval_human(const struct sender_session *sess,
+		     const struct stamp_interval_stats *iv)
 {
-	struct stamp_sender_packet tx_packet;
-	uint32_t seq = 0;
-	uint32_t sent_count = 0;	   // 実送信できた本数（seq は uint32_t ラップのため別管理）
-	uint32_t consecutive_failures = 0; // 連続 send 失敗数（成功でリセット）
-	uint64_t start_ms = 0;
-	uint64_t duration_ms = (uint64_t)opts->duration_sec * 1000U;
-
-	// -n/-w 指定時は有限計測し、終了時にパーセンタイルを算出する
-	g_collect_samples = (opts->count != 0 || opts->duration_sec != 0);
-	if (opts->duration_sec != 0) {
-		if (!monotonic_now_ms(&start_ms)) {
-			fprintf(stderr, "Failed to get start time\n");
-			return -1;
-		}
-	}
-	// -n 指定時は最終サイズが既知なので一括確保（毎回の成長コピーを回避）
-	if (opts->count != 0) {
-		stamp_sample_buffer_prereserve(opts->count, opts->oneway_mode);
+	printf("%s[%.1f-%.1f s] sent %u, received %u",
+	       sess->log_prefix,
+	       (double)(iv->start_ns - g_interval.origin_ns) /
+		       (double)NSEC_PER_SEC,
+	       (double)(iv->end_ns - g_interval.origin_ns) / (double)NSEC_PER_SEC,
+	       iv->sent,
+	       iv->received);
+	if (iv->settled > 0) {
+		printf(", loss %.2f%%", 100.0 * stamp_interval_loss_ratio(iv));
+	}
+	if (iv->received > 0) {
+		printf(", RTT min/avg/max/p99 = %.3f/%.3f/%.3f/%.3f ms",
+		       stamp_welford_min(&iv->rtt),
+		       stamp_welford_mean(&iv->rtt),
+		       stamp_welford_max(&iv->rtt),
+		       stamp_sketch_quantile(iv->sketch_rtt, 99.0));
+	}
+	if (stamp_welford_count(&iv->ipdv_rtt) > 0) {
+		printf(", IPDV avg/max = %.3f/%.3f ms",
+		       stamp_welford_mean(&iv->ipdv_rtt),
+		       stamp_welford_max(&iv->ipdv_rtt));
 	}
+	printf("\n");
+}
 
-	uint8_t recv_buffer[STAMP_MAX_PACKET_SIZE];
-	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
-		// -w 締切判定（ブロッキング受信の前に判定し、recv タイムアウトを
-		// 残り時間へ詰める）
-		if (opts->duration_sec != 0) {
-			uint64_t remain_ms;
-			if (sender_deadline_reached(duration_ms,
-						    start_ms,
-						    &remain_ms)) {
-				break;
+/**
+ * 書き出し待ちの面（各セッションの iv_done）を出力し、空にして返す
+ * 書き出しスレッド、またはスレッドを使わない場合は計測ループから呼ぶ。
+ */
+__attribute__((cold)) static void flush_interval_faces(void)
+{
+#ifndef _WIN32
+	// 人間可読の毎パケット行（計測ループ）と行の途中で混ざらないように
+	flockfile(stdout);
+#endif
+	if (g_output_format == OUTPUT_HUMAN) {
+		for (size_t i = 0; i < g_session_count; i++) {
+			print_interval_human(&g_sessions[i], g_sessions[i].iv_done);
+		}
+	} else {
+		for (size_t i = 0; i < g_session_count; i++) {
+			build_interval_report(&g_sessions[i],
+					      g_sessions[i].iv_done,
+					      &g_interval.reports[i],
+					      g_interval.fields[i]);
+			if (g_interval.csv_wide) {
+				widen_interval_csv_fields(&g_interval.reports[i],
+							  g_interval.fields[i]);
+			}
+		}
+		if (g_output_format == OUTPUT_JSON) {
+			if (g_session_count == 1) {
+				stamp_report_write_json(stdout, &g_interval.reports[0]);
+			} else {
+				stamp_report_write_json_multi(stdout,
+							      g_interval.reports,
+							      g_session_count);
 			}
-			// 締切までの残りが既定タイムアウト未満なら recv を残り時間へ
-			// 短縮する。-w は ping -w と同様のハード締切のため、締切後に
-			// 到着した応答は受信されず timeout（= loss）として計上される。
-			// 送信間隔(1s)より RTT が大きい高遅延経路では、最終ウィンドウ内の
-			// 複数本がこの境界効果を受けうる（影響本数は概ね RTT/送信間隔に
-			// 比例。計測長が伸びるほど全体に占める割合は小さくなる）。
-			if (remain_ms < (uint64_t)SOCKET_TIMEOUT_SEC * 1000U) {
-				set_recv_timeout(sockfd,
-						 (long)(remain_ms / 1000U),
-						 (long)(remain_ms % 1000U) *
-							 1000L);
+		} else {
+			char ts[STAMP_REPORT_TS_MAX];
+			(void)stamp_report_iso8601_utc(ts, sizeof(ts));
+			if (!g_interval.csv_header_done) {
+				stamp_report_write_csv_header(stdout,
+							      &g_interval.reports[0]);
+				g_interval.csv_header_done = true;
+			}
+			for (size_t i = 0; i < g_session_count; i++) {
+				stamp_report_write_csv_row(stdout,
+							   &g_interval.reports[i],
+							   ts);
 			}
 		}
+	}
+	fflush(stdout);
+#ifndef _WIN32
+	funlockfile(stdout);
+#endif
+	for (size_t i = 0; i < g_session_count; i++) {
+		stamp_interval_reset(g_sessions[i].iv_done, 0);
+	}
+	__atomic_store_n(&g_interval.busy, false, __ATOMIC_RELEASE);
+}
 
-		uint32_t real_t1_sec = 0;
-		uint32_t real_t1_frac = 0;
-		if (send_stamp_packet(sockfd,
-				      seq,
-				      &tx_packet,
-				      &real_t1_sec,
-				      &real_t1_frac) == 0) {
-			receive_and_process_packet(sockfd,
-						   &tx_packet,
-						   real_t1_sec,
-						   real_t1_frac,
-						   recv_buffer,
-						   sizeof(recv_buffer));
-			sent_count++; // 実送信できたパケットのみ -n の対象
-			consecutive_failures = 0;
-		} else if (++consecutive_failures >=
-			   STAMP_MAX_CONSECUTIVE_SEND_FAILURES) {
-			// 宛先到達不能等で送信が連続失敗。-w 未指定でも無限ループに
-			// ならないよう打ち切る（ここまでの結果は出力する）
-			fprintf(stderr,
-				"Aborting: %u consecutive send failures "
-				"(target unreachable?)\n",
-				consecutive_failures);
-			break;
+#ifndef _WIN32
+/**
+ * 区間レポートの書き出しスレッド
+ * 計測ループが面を渡すたびに起こされる。停止要求の後も、渡された面は書き切る。
+ */
+static void *interval_writer_thread(__attribute__((unused)) void *arg)
+{
+	pthread_mutex_lock(&g_interval.lock);
+	for (;;) {
+		if (__atomic_load_n(&g_interval.busy, __ATOMIC_ACQUIRE)) {
+			pthread_mutex_unlock(&g_interval.lock);
+			flush_interval_faces();
+			pthread_mutex_lock(&g_interval.lock);
+			continue;
 		}
-		seq++; // uint32_t ラップは意図的（RFC 8762 準拠）
-		// -n 到達で停止（スリープ前に脱出）
-		if (opts->count != 0 && sent_count >= opts->count) {
+		if (g_interval.stop) {
 			break;
 		}
-		sleep_with_interrupt_check();
+		pthread_cond_wait(&g_interval.wake, &g_interval.lock);
 	}
-	return 0;
+	pthread_mutex_unlock(&g_interval.lock);
+	return NULL;
 }
+#endif
 
-int main(int argc, char *argv[])
+/**
+ * 区間レポートを開始する（計測ループの直前に呼ぶ）
+ * 書き出しスレッドを起動できない場合は計測ループ内で書き出す。
+ * @return 成功時 0、確保失敗・単調クロック取得失敗時 -1
+ */
+__attribute__((cold)) static int interval_reporter_start(uint32_t period_sec)
 {
-	AUTO_CLOSE_SOCKET SOCKET sockfd = INVALID_SOCKET;
-#ifdef __linux__
-	AUTO_CLOSE_FD int phc_fd = -1;
+	uint64_t now_ns;
+	g_interval.reports = calloc(g_session_count, sizeof(*g_interval.reports));
+	g_interval.fields = calloc(g_session_count, sizeof(*g_interval.fields));
+	if (g_interval.reports == NULL || g_interval.fields == NULL) {
+		fprintf(stderr, "Failed to allocate report buffers\n");
+		return -1;
+	}
+	if (!monotonic_now_ns(&now_ns)) {
+		fprintf(stderr, "Failed to read monotonic clock\n");
+		return -1;
+	}
+	if (g_output_format == OUTPUT_CSV) {
+		// 累積サマリの列の並びだけを控える（値は計測前の未集計のまま）
+		struct stamp_report columns;
+		g_sess = &g_sessions[0];
+		build_session_report(&columns, g_interval.csv_columns);
+		g_interval.csv_wide = true;
+	}
+	g_interval.period_ns = (uint64_t)period_sec * NSEC_PER_SEC;
+	g_interval.origin_ns = now_ns;
+	g_interval.next_ns = now_ns + g_interval.period_ns;
+	for (size_t i = 0; i < g_session_count; i++) {
+		g_sessions[i].iv_cur->start_ns = now_ns;
+	}
+#ifndef _WIN32
+	pthread_mutex_init(&g_interval.lock, NULL);
+	pthread_cond_init(&g_interval.wake, NULL);
+	// シグナルは計測ループのスレッドで受け、待機を中断させる
+	sigset_t all;
+	sigset_t saved;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+	int rc = pthread_create(&g_interval.thread,
+				NULL,
+				interval_writer_thread,
+				NULL);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (rc != 0) {
+		fprintf(stderr,
+			"Warning: interval report thread not started (%s); "
+			"writing from the measurement loop\n",
+			strerror(rc));
+		pthread_cond_destroy(&g_interval.wake);
+		pthread_mutex_destroy(&g_interval.lock);
+		return 0;
+	}
+	g_interval.started = true;
 #endif
-	struct sockaddr_storage servaddr;
-	socklen_t servaddr_len;
-	int exit_code = 0;
+	return 0;
+}
 
-	if (platform_init_sender() != 0) {
-		return 1;
+/**
+ * 加算中の面と空き面を入れ替え、書き出し側へ渡す（ポインタの付け替えのみ）
+ */
+static void interval_hand_off(uint64_t now_ns)
+{
+	for (size_t i = 0; i < g_session_count; i++) {
+		struct sender_session *sess = &g_sessions[i];
+		struct stamp_interval_stats *done = sess->iv_cur;
+		done->end_ns = now_ns;
+		sess->iv_cur = sess->iv_done;
+		sess->iv_cur->start_ns = now_ns;
+		sess->iv_done = done;
+	}
+	__atomic_store_n(&g_interval.busy, true, __ATOMIC_RELEASE);
+#ifndef _WIN32
+	if (g_interval.started) {
+		pthread_mutex_lock(&g_interval.lock);
+		pthread_cond_signal(&g_interval.wake);
+		pthread_mutex_unlock(&g_interval.lock);
+		return;
 	}
+#endif
+	flush_interval_faces();
+}
 
-	struct sender_options opts;
-	if (parse_sender_options(argc, argv, &opts) != 0) {
-		exit_code = 1;
-		goto cleanup;
+/**
+ * 区間の境界に達していれば面を書き出し側へ渡す（計測ループの 1 周ごとに呼ぶ）
+ * 書き出しが前の区間をまだ終えていなければ入れ替えを見送り、現在の区間を
+ * 次の境界まで延長する（interval_len_s に実際の長さが出る）。
+ */
+static inline void interval_tick(uint64_t now_ns)
+{
+	if (g_interval.period_ns == 0 || now_ns < g_interval.next_ns) {
+		return;
 	}
+	do {
+		g_interval.next_ns += g_interval.period_ns;
+	} while (g_interval.next_ns <= now_ns);
+	if (__atomic_load_n(&g_interval.busy, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	interval_hand_off(now_ns);
+}
 
-	g_ptp_mode = opts.ptp_mode;
-	g_oneway_mode = opts.oneway_mode;
-	g_output_format = opts.format;
-	g_error_estimate_nbo = stamp_default_error_estimate_nbo(g_ptp_mode);
-
-	sockfd = init_socket(opts.host,
-			     opts.port,
-			     &servaddr,
-			     &servaddr_len,
-			     opts.af_hint,
-			     SENDER_IFNAME(opts));
-	if (SOCKET_ERROR_CHECK(sockfd)) {
-		exit_code = 1;
-		goto cleanup;
+/**
+ * 起床時刻を次の区間の境界までに切り詰める
+ */
+static inline uint64_t interval_clamp_wake(uint64_t wake_ns)
+{
+	if (g_interval.period_ns != 0 && g_interval.next_ns < wake_ns) {
+		return g_interval.next_ns;
 	}
-#ifdef __linux__
-	if (!stamp_setup_phc_from_options(sockfd,
-					  opts.phc_requested,
-					  opts.ifname,
-					  &phc_fd,
-					  &g_phc_clockid,
-					  &g_phc_enabled)) {
-		exit_code = 1;
-		goto cleanup;
+	return wake_ns;
+}
+
+/**
+ * 書き出しスレッドを止める（渡し済みの面は書き切る。二重呼び出しでも安全）
+ */
+__attribute__((cold)) static void interval_reporter_stop(void)
+{
+#ifndef _WIN32
+	if (!g_interval.started) {
+		return;
 	}
+	pthread_mutex_lock(&g_interval.lock);
+	g_interval.stop = true;
+	pthread_cond_signal(&g_interval.wake);
+	pthread_mutex_unlock(&g_interval.lock);
+	pthread_join(g_interval.thread, NULL);
+	pthread_cond_destroy(&g_interval.wake);
+	pthread_mutex_destroy(&g_interval.lock);
+	g_interval.started = false;
 #endif
-	print_sender_start_message(&servaddr);
+}
 
-	if (run_measurement_loop(sockfd, &opts) != 0) {
-		exit_code = 1;
-		goto cleanup;
+#ifndef _WIN32
+/**
+ * 毎パケット記録の書き出しスレッド
+ * リングが空なら STAMP_PKTLOG_IDLE_NS 休む。停止要求を読んでから排出するので、
+ * 要求前に積まれた行は全て出る。
+ */
+static void *packet_writer_thread(__attribute__((unused)) void *arg)
+{
+	const struct timespec idle = {0, STAMP_PKTLOG_IDLE_NS};
+	for (;;) {
+		bool stop = __atomic_load_n(&g_recorder.stop, __ATOMIC_ACQUIRE);
+		uint64_t now_ns = 0;
+		(void)monotonic_now_ns(&now_ns);
+		uint32_t n = stamp_pktlog_drain(&g_recorder.log,
+						g_recorder.target_ptrs,
+						now_ns,
+						stop);
+		if (stop) {
+			break;
+		}
+		if (n == 0) {
+			(void)nanosleep(&idle, NULL);
+		}
 	}
+	return NULL;
+}
+#endif
 
-	print_statistics(&servaddr);
+/**
+ * 毎パケット記録を開始する（セッションの初期化後、計測ループの前に呼ぶ）
+ * 形式は -o csv なら CSV、それ以外は NDJSON。書き出しスレッドを起動できない
+ * 場合は計測ループ内で整形する。
+ * @return 成功時 0、ファイルを開けない・確保失敗時 -1
+ */
+__attribute__((cold, nonnull(1))) static int
+packet_recorder_start(const char *path)
+{
+	enum stamp_pktlog_format format = g_output_format == OUTPUT_CSV
+						  ? STAMP_PKTLOG_CSV
+						  : STAMP_PKTLOG_NDJSON;
+	g_recorder.fp = fopen(path, "wb");
+	if (g_recorder.fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	// 行はこちらの出力バッファでまとめるので stdio では二重にためない
+	(void)setvbuf(g_recorder.fp, NULL, _IONBF, 0);
+	g_recorder.targets =
+		calloc(g_session_count, sizeof(*g_recorder.targets));
+	g_recorder.target_ptrs =
+		calloc(g_session_count, sizeof(*g_recorder.target_ptrs));
+	if (g_recorder.targets == NULL || g_recorder.target_ptrs == NULL ||
+	    stamp_pktlog_init(&g_recorder.log, g_recorder.fp, format) != 0) {
+		fprintf(stderr, "Failed to allocate packet record buffers\n");
+		return -1;
+	}
+	for (size_t i = 0; i < g_session_count; i++) {
+		if (format == STAMP_PKTLOG_NDJSON) {
+			stamp_report_json_escape(g_sessions[i].target,
+						 g_recorder.targets[i],
+						 sizeof(g_recorder.targets[i]));
+		} else {
+			snprintf(g_recorder.targets[i],
+				 sizeof(g_recorder.targets[i]),
+				 "%s",
+				 g_sessions[i].target);
+		}
+		g_recorder.target_ptrs[i] = g_recorder.targets[i];
+	}
+	stamp_pktlog_begin(&g_recorder.log);
+	g_recorder.enabled = true;
+#ifndef _WIN32
+	// シグナルは計測ループのスレッドで受ける
+	sigset_t all;
+	sigset_t saved;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+	int rc = pthread_create(&g_recorder.thread,
+				NULL,
+				packet_writer_thread,
+				NULL);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (rc != 0) {
+		fprintf(stderr,
+			"Warning: packet record thread not started (%s); "
+			"formatting in the measurement loop\n",
+			strerror(rc));
+		return 0;
+	}
+	g_recorder.started = true;
+#endif
+	return 0;
+}
 
-cleanup:
-	stamp_sample_buffer_free();
-	// PHC fd は AUTO_CLOSE_FD により main() スコープ離脱時に自動 close される
-#ifdef _WIN32
-	// WSACleanup 前にソケットを閉じ AUTO_CLOSE_SOCKET の二重解放を防止
-	if (!SOCKET_ERROR_CHECK(sockfd)) {
-		CLOSE_SOCKET(sockfd);
-		// NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
-		sockfd = INVALID_SOCKET; // cppcheck-suppress unreadVariable
+/**
+ * 残りの記録を書き出して毎パケット記録を終える（二重呼び出しでも安全）
+ * 書き出しが追いつかず捨てた行や書き込みエラーは stderr に報告する。
+ */
+__attribute__((cold)) static void packet_recorder_finish(void)
+{
+	if (g_recorder.enabled) {
+#ifndef _WIN32
+		if (g_recorder.started) {
+			__atomic_store_n(&g_recorder.stop, true, __ATOMIC_RELEASE);
+			pthread_join(g_recorder.thread, NULL);
+			g_recorder.started = false;
+		}
+#endif
+		(void)stamp_pktlog_drain(&g_recorder.log,
+					 g_recorder.target_ptrs,
+					 0,
+					 true);
+		uint64_t dropped =
+			__atomic_load_n(&g_recorder.log.dropped, __ATOMIC_RELAXED);
+		if (dropped > 0) {
+			fprintf(stderr,
+				"Warning: %" PRIu64 " packet records dropped "
+				"(writer fell behind)\n",
+				dropped);
+		}
+		if (g_recorder.log.write_failed) {
+			fprintf(stderr, "Warning: failed to write packet records\n");
+		}
+		g_recorder.enabled = false;
+	}
+	stamp_pktlog_free(&g_recorder.log);
+	if (g_recorder.fp != NULL && fclose(g_recorder.fp) != 0) {
+		fprintf(stderr, "Warning: failed to write packet records\n");
 	}
+	g_recorder.fp = NULL;
+	free(g_recorder.targets);
+	free(g_recorder.target_ptrs);
+	g_recorder.targets = NULL;
+	g_recorder.target_ptrs = NULL;
+}
+
+/**
+ * 計測終了時に途中の区間を書き出して区間レポートを終える（累積の統計の前）
+ * 終了の直前に境界を越えた場合など、何も起きていない途中の区間は出さない。
+ */
+__attribute__((cold)) static void interval_reporter_finish(void)
+{
+	uint64_t now_ns;
+	if (g_interval.period_ns == 0) {
+		return;
+	}
+	interval_reporter_stop();
+	bool active = false;
+	for (size_t i = 0; i < g_session_count; i++) {
+		const struct stamp_interval_stats *iv = g_sessions[i].iv_cur;
+		active = active || iv->sent > 0 || iv->settled > 0 ||
+			 iv->received > 0 || iv->late > 0 || iv->duplicates > 0;
+	}
+	if (!monotonic_now_ns(&now_ns)) {
+		now_ns = g_interval.origin_ns;
+	}
+	g_interval.end_ns = now_ns;
+	if (active) {
+		interval_hand_off(now_ns);
+	}
+	g_interval.period_ns = 0;
+}
+
+/**
+ * 受信可能通知を伴わないソケットエラー（POLLERR）を回収する。
+ * Linux では SO_TIMESTAMPING の TX タイムスタンプが errqueue に溜まると
+ * POLLERR が立ち続けるため、HW の T1 を回収して残りは読み捨てる。
+ * ICMP 到達不能等の保留エラーは SO_ERROR で取り出して表示する（従来の
+ * recv 失敗表示と同等）。
+ */
+static void handle_socket_error_event(SOCKET sockfd)
+{
+#ifdef __linux__
+	collect_tx_timestamps(sockfd);
+#endif
+	int err = 0;
+	socklen_t errlen = (socklen_t)sizeof(err);
+	if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, (char *)&err, &errlen) ==
+		    0 &&
+	    err != 0) {
+		fprintf(stderr, "recvfrom failed: error %d\n", err);
+	}
+}
+
+/**
+ * スピンループ用の CPU ヒント（SMT の相方へ実行資源を譲る）
+ */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+/**
+ * 単調クロックが deadline_ns に達するまでビジーウェイトする
+ */
+static void spin_until_ns(uint64_t deadline_ns)
+{
+	uint64_t now_ns;
+	while (monotonic_now_ns(&now_ns) && now_ns < deadline_ns) {
+		cpu_relax();
+	}
+}
+
+/**
+ * ソケットの受信可能通知または絶対時刻 deadline_ns まで poll する。
+ * Linux では timerfd（TFD_TIMER_ABSTIME）をソケットと同時に待ち、マイクロ秒
+ * 精度で起床する。それ以外は poll のミリ秒タイムアウトを切り捨てで使い、
+ * 1 ms 未満の残りはソケットを見ずに眠る（Windows はスピン）。
+ * Ctrl+C（Windows はコンソールハンドラスレッドから g_running を落とす）を
+ * 取りこぼさないよう、1 回の待機は SLEEP_CHECK_INTERVAL_MS で打ち切る。
+ * deadline_ns <= now_ns の場合は待たずにソケットの状態だけを確認する。
+ * @return 受信可能なら 1、タイムアウト・シグナル割り込みなら 0、エラー時 -1
+ */
+static int poll_socket_until(SOCKET sockfd,
+			     const struct send_schedule *sched,
+			     uint64_t now_ns,
+			     uint64_t deadline_ns)
+{
+	bool probe_only = (deadline_ns <= now_ns);
+	uint64_t remain_ns = probe_only ? 0 : deadline_ns - now_ns;
+	uint64_t ms = remain_ns / 1000000U;
+	if (ms > SLEEP_CHECK_INTERVAL_MS) {
+		ms = SLEEP_CHECK_INTERVAL_MS;
+	}
+#ifdef _WIN32
+	if (ms == 0 && !probe_only) {
+		// Sleep/WSAPoll はミリ秒未満を表現できない
+		spin_until_ns(deadline_ns);
+		return 0;
+	}
+	WSAPOLLFD pfd[1] = {{.fd = sockfd, .events = POLLRDNORM, .revents = 0}};
+	int rc = WSAPoll(pfd, 1, (INT)ms);
+	const SHORT readable = POLLRDNORM;
+#else
+	struct pollfd pfd[2] = {
+		{.fd = sockfd, .events = POLLIN, .revents = 0},
+		{.fd = -1, .events = POLLIN, .revents = 0},
+	};
+	nfds_t nfds = 1;
+#ifdef __linux__
+	if (sched->timerfd >= 0 && !probe_only) {
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = (time_t)(deadline_ns / NSEC_PER_SEC);
+		its.it_value.tv_nsec = (long)(deadline_ns % NSEC_PER_SEC);
+		// 再設定で期限到達カウントはリセットされるため read は不要
+		if (timerfd_settime(sched->timerfd,
+				    TFD_TIMER_ABSTIME,
+				    &its,
+				    NULL) == 0) {
+			pfd[1].fd = sched->timerfd;
+			nfds = 2;
+			ms = SLEEP_CHECK_INTERVAL_MS;
+		}
+	}
+#else
+	(void)sched;
+#endif
+	if (nfds == 1 && ms == 0 && !probe_only) {
+		struct timespec req = {
+			.tv_sec = 0,
+			.tv_nsec = (long)remain_ns,
+		};
+		nanosleep(&req, NULL);
+		return 0;
+	}
+	int rc = poll(pfd, nfds, (int)ms);
+	if (rc < 0 && errno == EINTR) {
+		return 0;
+	}
+	const short readable = POLLIN;
+#endif
+	if (rc <= 0) {
+		return rc;
+	}
+	if ((pfd[0].revents & readable) != 0) {
+		return 1;
+	}
+	if ((pfd[0].revents & POLLERR) != 0) {
+		handle_socket_error_event(sockfd);
+	}
+	return 0;
+}
+
+/**
+ * ソケットの受信可能通知または起床時刻 wake_ns まで待つ。
+ * 起床時刻は絶対時刻で扱うため、ループ 1 周ごとの処理時間が送信タイムライン
+ * に累積しない。spin_ns > 0 の場合は spin_ns だけ早く起床し、残りをビジー
+ * ウェイトしてタイマー起床のレイテンシとばらつきを吸収する。
+ * @return 受信可能なら 1、起床時刻到達・割り込みなら 0、エラー時 -1
+ */
+static int wait_for_event(SOCKET sockfd,
+			  const struct send_schedule *sched,
+			  uint64_t now_ns,
+			  uint64_t wake_ns)
+{
+	if (wake_ns <= now_ns) {
+		return 0;
+	}
+	if (wake_ns - now_ns <= sched->spin_ns) {
+		// スピン区間でも到着済みの応答は先に回収する（送信間隔がスピン幅
+		// より短い場合に受信が止まらないように）
+		if (poll_socket_until(sockfd, sched, now_ns, now_ns) > 0) {
+			return 1;
+		}
+		spin_until_ns(wake_ns);
+		return 0;
+	}
+	return poll_socket_until(sockfd, sched, now_ns, wake_ns - sched->spin_ns);
+}
+
+/**
+ * 送信したプローブを応答待ち表へ登録する
+ * @param now_ns 送信時刻（単調クロック、タイムアウト判定用）
+ */
+static void register_probe(uint32_t seq,
+			   uint32_t t1_sec,
+			   uint32_t t1_frac,
+			   uint64_t now_ns)
+{
+	// 再利用するスロットの結果を先に確定させる
+	stamp_inflight_settle(&g_sess->inflight,
+			      seq - g_sess->inflight.mask,
+			      on_probe_settled,
+			      g_sess);
+	if (stamp_inflight_insert(&g_sess->inflight, seq, t1_sec, t1_frac, now_ns)) {
+		// 応答待ちが表の容量を超え、最古のプローブを追い出した
+		fprintf(stderr,
+			"%sTimeout waiting for response "
+			"(in-flight window full)\n",
+			g_sess->log_prefix);
+		g_sess->stats.timeouts++;
+		if (g_sess->iv_cur != NULL) {
+			g_sess->iv_cur->timeouts++;
+		}
+	}
+}
+
+/**
+ * seq のプローブを 1 本送信し、応答待ち表へ登録する
+ * @param now_ns 送信時刻（単調クロック）
+ * @return 送信できた本数（0 または 1）
+ */
+static uint32_t send_single_probe(SOCKET sockfd, uint32_t seq, uint64_t now_ns)
+{
+	struct stamp_sender_packet tx_packet;
+	uint32_t real_t1_sec = 0;
+	uint32_t real_t1_frac = 0;
+	if (send_stamp_packet(sockfd,
+			      seq,
+			      &tx_packet,
+			      &real_t1_sec,
+			      &real_t1_frac) != 0) {
+		return 0;
+	}
+	register_probe(seq, real_t1_sec, real_t1_frac, now_ns);
+	return 1;
+}
+
+/**
+ * 連続 seq の len 本を列車として間隔を空けずに送信し、応答待ち表へ登録する。
+ * 全パケットに T1 を打刻してから 1 回の sendmmsg で送り出し、ホストを出る
+ * 間隔を最小にする（Linux 以外は send の連続呼び出し）。
+ * 途中で送信に失敗した場合は残りを送らない（列車は先頭から連続した本数）。
+ * -G 指定時の列車は send_train_member で 1 本ずつ送る。
+ * @return 送信できた本数
+ */
+static uint32_t send_probe_train(SOCKET sockfd,
+				 uint32_t first_seq,
+				 uint32_t len,
+				 uint64_t now_ns)
+{
+	struct stamp_sender_packet pkts[STAMP_TRAIN_MAX_LEN];
+	uint32_t sent = 0;
+	uint32_t prepared = 0;
+	while (prepared < len &&
+	       prepare_stamp_packet(first_seq + prepared, &pkts[prepared]) == 0) {
+		prepared++;
+	}
+#ifdef __linux__
+	struct mmsghdr msgs[STAMP_TRAIN_MAX_LEN];
+	struct iovec iov[STAMP_TRAIN_MAX_LEN];
+	memset(msgs, 0, sizeof(msgs));
+	for (uint32_t i = 0; i < prepared; i++) {
+		iov[i].iov_base = &pkts[i];
+		iov[i].iov_len = sizeof(pkts[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	// sendmmsg は途中で失敗するとそれまでの本数を返すため、残りを再送する
+	int send_err = 0;
+	while (sent < prepared) {
+		int n = sendmmsg(sockfd, &msgs[sent], prepared - sent, 0);
+		if (unlikely(n <= 0)) {
+			send_err = errno;
+			PRINT_SOCKET_ERROR("sendmmsg failed");
+			break;
+		}
+		sent += (uint32_t)n;
+	}
+#else
+	for (; sent < prepared; sent++) {
+		if (unlikely(send(sockfd,
+				  (const char *)&pkts[sent],
+				  (int)sizeof(pkts[sent]),
+				  0) < 0)) {
+			PRINT_SOCKET_ERROR("send failed");
+			break;
+		}
+	}
+#endif
+	for (uint32_t i = 0; i < sent; i++) {
+		register_probe(first_seq + i,
+			       pkts[i].timestamp_sec,
+			       pkts[i].timestamp_frac,
+			       now_ns);
+	}
+#ifdef __linux__
+	if (send_err != 0) {
+		skip_failed_tx_key(send_err);
+	}
+#endif
+	g_sess->stats.sent += sent;
+	if (g_sess->iv_cur != NULL) {
+		g_sess->iv_cur->sent += sent;
+	}
+	return sent;
+}
+
+/**
+ * 間隔送信中の列車の次の 1 本を送信する（-G 指定時）。
+ * 列車内の送信時刻は先頭からの絶対時刻で進め、待機は通常の送信予定と同じ
+ * イベントループの起床（timerfd）で行う。送信に失敗した場合や予定本数を
+ * 送り終えた場合は列車を閉じる。
+ * @param now_ns 現在時刻（単調クロック。送信時刻として記録）
+ */
+__attribute__((nonnull(2, 3))) static void
+send_train_member(SOCKET sockfd,
+		  const struct sender_options *opts,
+		  struct send_schedule *sched,
+		  uint64_t now_ns)
+{
+	if (send_single_probe(sockfd,
+			      sched->train_seq + sched->train_sent,
+			      now_ns) != 0) {
+		stamp_train_add_sent(g_sess->trains, sched->train_seq);
+		sched->train_sent++;
+		sched->sent_count++;
+		sched->consecutive_failures = 0;
+		if (sched->train_sent < sched->train_len) {
+			sched->train_next_ns += sched->train_spacing_ns;
+			return;
+		}
+	}
+	// 送信に失敗した場合は残りを送らない（列車は先頭から連続した本数）
+	stamp_train_close(g_sess->trains, sched->train_seq);
+	sched->train_next_ns = 0;
+	if (opts->count != 0 && sched->sent_count >= opts->count) {
+		sched->sending_done = true;
+	}
+}
+
+/**
+ * 次の送信時刻（間隔送信中の列車があればその次の 1 本、なければ送信予定）
+ */
+__attribute__((nonnull(1))) static uint64_t
+next_send_ns(const struct send_schedule *sched)
+{
+	if (sched->train_next_ns != 0) {
+		return sched->train_next_ns;
+	}
+	return stamp_sched_peek(&sched->plan);
+}
+
+/**
+ * 予定時刻に達したプローブ（-B 指定時は列車）を送信し、応答待ち表へ登録する。
+ * 送信予定は事前計算済みの絶対時刻で進め、処理遅延で 1 間隔以上遅れた分は
+ * 詰めて送らずに読み飛ばす（バースト送信で測定対象を乱さない）。
+ * -G 指定時は列車の先頭 1 本だけを送り、残りは send_train_member で送る。
+ * @param now_ns 現在時刻（単調クロック。送信時刻として記録）
+ * @return 継続可なら 0、連続送信失敗で打ち切る場合 -1
+ */
+__attribute__((nonnull(2, 3))) static int
+send_scheduled_probe(SOCKET sockfd,
+		     const struct sender_options *opts,
+		     struct send_schedule *sched,
+		     uint64_t now_ns)
+{
+	uint32_t sent = 0;
+
+	if (sched->train_next_ns != 0) {
+		send_train_member(sockfd, opts, sched, now_ns);
+		return 0;
+	}
+
+	stamp_welford_update(&g_sess->stats.sched_err,
+			     stamp_sched_error_us(&sched->plan, now_ns));
+	if (sched->prev_send_ns != 0) {
+		stamp_welford_update(&g_sess->stats.send_gap,
+				     (double)(now_ns - sched->prev_send_ns) /
+					     1000.0);
+	}
+	sched->prev_send_ns = now_ns;
+
+	if (g_train_mode) {
+		// -n の残りが列車長に満たない場合は最後の列車を短くする。
+		// seq は送信本数によらず列車長ずつ進める（列車番号の索引用）
+		uint32_t len = opts->burst_len;
+		if (opts->count != 0 && opts->count - sched->sent_count < len) {
+			len = opts->count - sched->sent_count;
+		}
+		if (sched->train_spacing_ns == 0) {
+			sent = send_probe_train(sockfd, sched->seq, len, now_ns);
+			stamp_train_begin(g_sess->trains, sched->seq, sent);
+		} else {
+			sent = send_single_probe(sockfd, sched->seq, now_ns);
+			if (sent > 0 && len > 1) {
+				stamp_train_open(g_sess->trains, sched->seq);
+				sched->train_seq = sched->seq;
+				sched->train_sent = 1;
+				sched->train_len = len;
+				sched->train_next_ns = now_ns + sched->train_spacing_ns;
+			} else {
+				stamp_train_begin(g_sess->trains, sched->seq, sent);
+			}
+		}
+		sched->seq += opts->burst_len;
+	} else {
+		sent = send_single_probe(sockfd, sched->seq, now_ns);
+		sched->seq++;
+	}
+
+	if (sent > 0) {
+		sched->sent_count += sent;
+		sched->consecutive_failures = 0;
+	} else if (++sched->consecutive_failures >=
+		   STAMP_MAX_CONSECUTIVE_SEND_FAILURES) {
+		// 宛先到達不能等で送信が連続失敗。-w 未指定でも無限ループに
+		// ならないよう打ち切る（ここまでの結果は出力する）
+		fprintf(stderr,
+			"%sAborting: %u consecutive send failures "
+			"(target unreachable?)\n",
+			g_sess->log_prefix,
+			sched->consecutive_failures);
+		return -1;
+	}
+
+	// -n 到達で送信を終了し、以降は応答待ちの回収のみ行う
+	if (opts->count != 0 && sched->sent_count >= opts->count) {
+		sched->sending_done = true;
+	}
+	g_sess->stats.sched_missed += stamp_sched_advance(&sched->plan, now_ns);
+	return 0;
+}
+
+/**
+ * 次に起床すべき時刻（送信予定・最古の応答待ちの期限・-w 締切の最小値）
+ */
+__attribute__((nonnull(1))) static uint64_t
+next_wakeup_ns(const struct send_schedule *sched)
+{
+	uint64_t wake = UINT64_MAX;
+	uint64_t expiry;
+	if (!sched->sending_done) {
+		wake = next_send_ns(sched);
+	}
+	if (stamp_inflight_next_expiry(&g_sess->inflight, REPLY_TIMEOUT_NS, &expiry) &&
+	    expiry < wake) {
+		wake = expiry;
+	}
+	if (sched->end_ns != 0 && sched->end_ns < wake) {
+		wake = sched->end_ns;
+	}
+	return wake;
+}
+
+/**
+ * 送信スケジュールの初期化（送信予定・-w 締切）。
+ * 送信予定の乱数シードは起動ごとに変わる値（単調クロック・構造体の位置）から
+ * 作る（複数の Sender やセッションが同じ乱数列で位相を揃えないように）。
+ * @param start_ns 最初の送信予定の基準時刻（単調クロック）
+ * @param end_ns -w 締切（0=なし）
+ */
+__attribute__((nonnull(1, 2), cold)) static void
+init_send_schedule(struct send_schedule *sched,
+		   const struct sender_options *opts,
+		   uint64_t start_ns,
+		   uint64_t end_ns)
+{
+	memset(sched, 0, sizeof(*sched));
+	uint64_t interval_ns = (uint64_t)opts->interval_us * 1000U;
+	uint64_t offset_ns = opts->offset_us != SENDER_OFFSET_DEFAULT
+				     ? (uint64_t)opts->offset_us * 1000U
+				     : interval_ns;
+	stamp_sched_init(&sched->plan,
+			 opts->sched_mode,
+			 start_ns,
+			 interval_ns,
+			 offset_ns,
+			 start_ns ^ (uint64_t)(uintptr_t)sched);
+	sched->spin_ns = (uint64_t)opts->spin_us * 1000U;
+	sched->train_spacing_ns = (uint64_t)opts->burst_spacing_us * 1000U;
+	sched->end_ns = end_ns;
+#ifdef __linux__
+	sched->timerfd = -1;
+#endif
+}
+
+/**
+ * 計測開始時刻と -w 締切を求める
+ * @return 成功時 0、単調クロック取得失敗時 -1
+ */
+__attribute__((nonnull(1, 2, 3), cold)) static int
+measurement_start_ns(const struct sender_options *opts,
+		     uint64_t *start_ns,
+		     uint64_t *end_ns)
+{
+	if (!monotonic_now_ns(start_ns)) {
+		fprintf(stderr, "Failed to get start time\n");
+		return -1;
+	}
+	if (g_interval.period_ns != 0) {
+		// -w 締切を区間の境界に揃える（締切直前に空の区間を始めない）
+		*start_ns = g_interval.origin_ns;
+	}
+	*end_ns = 0;
+	if (opts->duration_sec != 0) {
+		*end_ns = *start_ns + (uint64_t)opts->duration_sec * NSEC_PER_SEC;
+	}
+	return 0;
+}
+
+#ifdef __linux__
+/**
+ * 起床用の絶対時刻 timerfd を作成する。短い送信間隔ではタイマースラック
+ * （既定 50 µs の起床遅延許容幅）を最小化する。timerfd が使えない場合は
+ * ミリ秒タイムアウトで代替する（精度は落ちるが計測は継続）。
+ * @return timerfd、作成失敗時 -1
+ */
+__attribute__((nonnull(1), cold)) static int
+open_wakeup_timer(const struct sender_options *opts)
+{
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr,
+			"Warning: timerfd_create failed (%s); send timing "
+			"falls back to millisecond resolution\n",
+			strerror(errno));
+	}
+	if (opts->interval_us < SEND_INTERVAL_USEC || opts->burst_spacing_us != 0) {
+		(void)prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+	}
+	return fd;
+}
+#endif
+
+/**
+ * 測定ループ本体（送信スケジュールと応答受信を分離したイベントループ）。
+ * 送信は応答を待たずに予定時刻どおり進み、応答は sender_seq_num で応答待ち
+ * 表と照合する。応答の欠落が後続の送信を止めることはない。
+ * -n/-w 指定時は所定の本数・秒数で停止する。
+ * -n 到達後は残りの応答待ちが揃うかタイムアウトするまで受信を続ける。
+ * 単一ターゲット（g_sessions[0]）を扱う。
+ * @param opts CLI オプション
+ * @return 成功時 0、単調クロック取得失敗時 -1
+ */
+__attribute__((nonnull(1))) static int
+run_measurement_loop(const struct sender_options *opts)
+{
+	struct sender_session *sess = &g_sessions[0];
+	struct send_schedule *sched = &sess->sched;
+	SOCKET sockfd = sess->sockfd;
+	uint64_t now_ns;
+	uint64_t end_ns;
+
+	g_sess = sess;
+	if (measurement_start_ns(opts, &now_ns, &end_ns) != 0) {
+		return -1;
+	}
+	init_send_schedule(sched, opts, now_ns, end_ns);
+#ifdef __linux__
+	// timerfd はこのスコープ離脱時に自動 close
+	AUTO_CLOSE_FD int timerfd = open_wakeup_timer(opts);
+	sched->timerfd = timerfd;
+#endif
+	// -A -n 指定時は最終サイズが既知なので一括確保（毎回の成長コピーを回避）
+	if (g_collect_samples && opts->count != 0) {
+		stamp_sample_buffer_prereserve(opts->count, opts->oneway_mode);
+	}
+
+	uint8_t recv_buffer[STAMP_MAX_PACKET_SIZE];
+	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+		if (!monotonic_now_ns(&now_ns)) {
+			fprintf(stderr, "Failed to read monotonic clock\n");
+			return -1;
+		}
+		// -w は ping -w と同様のハード締切。締切時点で応答待ちのプローブは
+		// 受信されず timeout（= loss）として計上する。送信間隔より RTT が
+		// 大きい高遅延経路では、最終ウィンドウ内の複数本がこの境界効果を
+		// 受けうる（影響本数は概ね RTT/送信間隔に比例。計測長が伸びるほど
+		// 全体に占める割合は小さくなる）。区間の境界と締切が重なっても
+		// 計上先が最後の区間になるよう、区間を進める前に判定する。
+		if (sched->end_ns != 0 && now_ns >= sched->end_ns) {
+			timeout_pending_probes(sess);
+			break;
+		}
+		interval_tick(now_ns);
+		if (!sched->sending_done && now_ns >= next_send_ns(sched)) {
+			if (send_scheduled_probe(sockfd, opts, sched, now_ns) != 0) {
+				break;
+			}
+			continue;
+		}
+		stamp_inflight_expire(&sess->inflight,
+				      now_ns,
+				      REPLY_TIMEOUT_NS,
+				      on_probe_expired,
+				      NULL);
+		stamp_inflight_settle(&sess->inflight,
+				      sess->inflight.settled,
+				      on_probe_settled,
+				      sess);
+		if (sched->sending_done && sess->inflight.pending == 0) {
+			break; // -n 到達後、全応答を回収済み
+		}
+
+		uint64_t wake_ns = interval_clamp_wake(next_wakeup_ns(sched));
+		int rc = wait_for_event(sockfd, sched, now_ns, wake_ns);
+		if (rc > 0) {
+			(void)receive_and_process_packet(sockfd,
+							 recv_buffer,
+							 sizeof(recv_buffer));
+		} else if (rc < 0) {
+			PRINT_SOCKET_ERROR("poll failed");
+			break;
+		}
+	}
+	if (g_train_mode) {
+		stamp_train_flush(sess->trains); // 締切・中断時の未解決分はロス扱い
+	}
+	return 0;
+}
+
+#ifdef __linux__
+/**
+ * 複数ターゲットのイベントループで共有する状態
+ */
+struct multi_loop {
+	const struct sender_options *opts;
+	struct stamp_wheel wheel; // セッションごとの次の起床時刻
+	uint64_t now_ns;	  // 期限処理中の現在時刻
+	size_t active;		  // 未終了のセッション数
+};
+
+/**
+ * セッションの次の起床時刻を登録し直す。送信を終えて応答待ちも無くなった
+ * セッションは終了とし、以後タイマーに載せない。
+ */
+__attribute__((nonnull(1, 2))) static void
+rearm_session(struct multi_loop *loop, struct sender_session *sess)
+{
+	if (sess->finished) {
+		return;
+	}
+	if (sess->sched.sending_done && sess->inflight.pending == 0) {
+		stamp_wheel_cancel(&loop->wheel, &sess->timer);
+		sess->finished = true;
+		loop->active--;
+		return;
+	}
+	uint64_t wake_ns = next_wakeup_ns(&sess->sched);
+	if (wake_ns != UINT64_MAX) {
+		stamp_wheel_arm(&loop->wheel, &sess->timer, wake_ns);
+	}
+}
+
+/**
+ * セッションの起床時刻到達（stamp_wheel_expire のコールバック）
+ * 予定時刻に達した送信と応答待ちの期限切れ判定を行い、次の起床時刻を登録する。
+ * 連続送信失敗のセッションは送信のみ打ち切る（他のターゲットは継続）。
+ */
+static void on_session_timer(struct stamp_wheel_node *node, void *ctx)
+{
+	struct multi_loop *loop = ctx;
+	struct sender_session *sess = node->data;
+	struct send_schedule *sched = &sess->sched;
+
+	g_sess = sess;
+	while (!sched->sending_done &&
+	       loop->now_ns >= next_send_ns(sched)) {
+		if (send_scheduled_probe(sess->sockfd,
+					 loop->opts,
+					 sched,
+					 loop->now_ns) != 0) {
+			sched->sending_done = true;
+		}
+	}
+	stamp_inflight_expire(&sess->inflight,
+			      loop->now_ns,
+			      REPLY_TIMEOUT_NS,
+			      on_probe_expired,
+			      NULL);
+	stamp_inflight_settle(&sess->inflight,
+			      sess->inflight.settled,
+			      on_probe_settled,
+			      sess);
+	rearm_session(loop, sess);
+}
+
+/**
+ * 複数ターゲットの測定ループ（Linux）。
+ * 全セッションのソケットと 1 本の絶対時刻 timerfd を epoll で待ち、各セッション
+ * の次の起床時刻（送信予定・応答待ちの期限）はタイマーホイールで管理する。
+ * 送信開始時刻は送信間隔をセッション数で割った幅ずつずらし、同時送出を避ける。
+ * 統計・応答待ち表・サンプルはセッションごとに持つ。
+ * @param opts CLI オプション
+ * @return 成功時 0、初期化失敗・単調クロック取得失敗時 -1
+ */
+__attribute__((nonnull(1))) static int
+run_multi_measurement_loop(const struct sender_options *opts)
+{
+	static struct multi_loop loop;
+	uint64_t now_ns;
+	uint64_t end_ns;
+
+	AUTO_CLOSE_FD int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		fprintf(stderr, "epoll_create1 failed: %s\n", strerror(errno));
+		return -1;
+	}
+	AUTO_CLOSE_FD int timerfd = open_wakeup_timer(opts);
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	for (size_t i = 0; i < g_session_count; i++) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = &g_sessions[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_sessions[i].sockfd, &ev) != 0) {
+			fprintf(stderr, "epoll_ctl failed: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	if (timerfd >= 0) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev) != 0) {
+			fprintf(stderr, "epoll_ctl failed: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	if (measurement_start_ns(opts, &now_ns, &end_ns) != 0) {
+		return -1;
+	}
+	loop.opts = opts;
+	loop.active = g_session_count;
+	stamp_wheel_init(&loop.wheel, SENDER_WHEEL_TICK_NS, now_ns);
+	uint64_t stagger_ns =
+		(uint64_t)opts->interval_us * 1000U / g_session_count;
+	for (size_t i = 0; i < g_session_count; i++) {
+		struct sender_session *sess = &g_sessions[i];
+		uint64_t start_ns = now_ns + stagger_ns * i;
+		g_sess = sess;
+		init_send_schedule(&sess->sched, opts, start_ns, end_ns);
+		if (g_collect_samples && opts->count != 0) {
+			stamp_sample_buffer_prereserve(opts->count,
+						       opts->oneway_mode);
+		}
+		sess->timer.data = sess;
+		stamp_wheel_arm(&loop.wheel, &sess->timer, start_ns);
+	}
+
+	uint8_t recv_buffer[STAMP_MAX_PACKET_SIZE];
+	struct epoll_event events[SENDER_EPOLL_EVENTS];
+	while (__atomic_load_n(&g_running, __ATOMIC_SEQ_CST)) {
+		if (!monotonic_now_ns(&now_ns)) {
+			fprintf(stderr, "Failed to read monotonic clock\n");
+			return -1;
+		}
+		// -w の締切は全セッション共通（単一ターゲット時と同じく応答待ちは loss）
+		if (end_ns != 0 && now_ns >= end_ns) {
+			for (size_t i = 0; i < g_session_count; i++) {
+				timeout_pending_probes(&g_sessions[i]);
+			}
+			break;
+		}
+		interval_tick(now_ns);
+		loop.now_ns = now_ns;
+		stamp_wheel_expire(&loop.wheel, now_ns, on_session_timer, &loop);
+		if (loop.active == 0) {
+			break; // -n 到達後、全セッションの応答を回収済み
+		}
+
+		uint64_t wake_ns = UINT64_MAX;
+		(void)stamp_wheel_next_deadline(&loop.wheel, &wake_ns);
+		if (end_ns != 0 && end_ns < wake_ns) {
+			wake_ns = end_ns;
+		}
+		wake_ns = interval_clamp_wake(wake_ns);
+		int timeout_ms = SLEEP_CHECK_INTERVAL_MS;
+		if (wake_ns <= now_ns) {
+			timeout_ms = 0;
+		} else if (timerfd >= 0) {
+			struct itimerspec its;
+			memset(&its, 0, sizeof(its));
+			its.it_value.tv_sec = (time_t)(wake_ns / NSEC_PER_SEC);
+			its.it_value.tv_nsec = (long)(wake_ns % NSEC_PER_SEC);
+			(void)timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+		} else if ((wake_ns - now_ns) / 1000000U < SLEEP_CHECK_INTERVAL_MS) {
+			timeout_ms = (int)((wake_ns - now_ns) / 1000000U);
+		}
+
+		int n = epoll_wait(epfd, events, SENDER_EPOLL_EVENTS, timeout_ms);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+			break;
+		}
+		for (int i = 0; i < n; i++) {
+			struct sender_session *sess = events[i].data.ptr;
+			if (sess == NULL) {
+				uint64_t expirations;
+				// 期限到達カウントを読み捨てて通知を解除する
+				(void)!read(timerfd, &expirations, sizeof(expirations));
+				continue;
+			}
+			g_sess = sess;
+			if ((events[i].events & EPOLLIN) != 0) {
+				(void)receive_and_process_packet(sess->sockfd,
+								 recv_buffer,
+								 sizeof(recv_buffer));
+			} else if ((events[i].events & EPOLLERR) != 0) {
+				handle_socket_error_event(sess->sockfd);
+			}
+			// 最後の応答を回収したセッションは次の期限を待たずに終了
+			if (sess->sched.sending_done && sess->inflight.pending == 0) {
+				rearm_session(&loop, sess);
+			}
+		}
+	}
+	for (size_t i = 0; i < g_session_count; i++) {
+		if (g_sessions[i].trains != NULL) {
+			stamp_train_flush(g_sessions[i].trains);
+		}
+	}
+	return 0;
+}
+#endif // __linux__
+
+/**
+ * ターゲット 1 件分のセッションを初期化する（接続・応答待ち表・列車集計表・
+ * 分位点スケッチ）
+ * 応答待ち表の容量は応答待ちタイムアウトの間に送る本数から選ぶ（多数の
+ * ターゲットを扱っても低レートのセッションは小さな表で済むように）。
+ * @return 成功時 0、エラー時 -1
+ */
+__attribute__((nonnull(1, 2, 4), cold)) static int
+init_session(struct sender_session *sess,
+	     const char *host,
+	     uint16_t port,
+	     const struct sender_options *opts)
+{
+	socklen_t servaddr_len;
+
+	sess->sockfd = init_socket(host,
+				   port,
+				   &sess->servaddr,
+				   &servaddr_len,
+				   opts->af_hint,
+				   SENDER_IFNAME(*opts));
+	if (SOCKET_ERROR_CHECK(sess->sockfd)) {
+		return -1;
+	}
+	stamp_format_sockaddr_with_port(&sess->servaddr,
+					sess->target,
+					sizeof(sess->target));
+
+	uint32_t cap = stamp_inflight_cap_for(REPLY_TIMEOUT_NS,
+					      (uint64_t)opts->interval_us * 1000U,
+					      opts->burst_len);
+	if (stamp_inflight_init(&sess->inflight, cap) != 0 ||
+	    stamp_reorder_init(&sess->reorder, cap, sess->sched.seq) != 0) {
+		fprintf(stderr, "Failed to allocate in-flight table\n");
+		return -1;
+	}
+#ifdef __linux__
+	// TX HW タイムスタンプの OPT_ID キーはソケットごとに 0 から数える
+	if (g_tx_hw_timestamp_enabled &&
+	    stamp_inflight_track_tx_keys(&sess->inflight) != 0) {
+		fprintf(stderr, "Failed to allocate in-flight table\n");
+		return -1;
+	}
+#endif
+	if (g_train_mode) {
+		sess->trains = malloc(sizeof(*sess->trains));
+		if (sess->trains == NULL) {
+			fprintf(stderr, "Failed to allocate train table\n");
+			return -1;
+		}
+		stamp_train_table_init(sess->trains, 0, opts->burst_len);
+	}
+	sess->sketch_rtt = calloc(1, sizeof(*sess->sketch_rtt));
+	if (sess->sketch_rtt == NULL) {
+		fprintf(stderr, "Failed to allocate quantile sketch\n");
+		return -1;
+	}
+	if (g_oneway_mode) {
+		sess->sketch_fwd = calloc(1, sizeof(*sess->sketch_fwd));
+		sess->sketch_bwd = calloc(1, sizeof(*sess->sketch_bwd));
+		if (sess->sketch_fwd == NULL || sess->sketch_bwd == NULL) {
+			fprintf(stderr, "Failed to allocate quantile sketch\n");
+			return -1;
+		}
+	}
+	if (opts->report_interval_sec != 0) {
+		if (stamp_interval_init(&sess->iv_faces[0], g_oneway_mode) != 0 ||
+		    stamp_interval_init(&sess->iv_faces[1], g_oneway_mode) != 0) {
+			fprintf(stderr, "Failed to allocate interval report\n");
+			return -1;
+		}
+		sess->iv_cur = &sess->iv_faces[0];
+		sess->iv_done = &sess->iv_faces[1];
+	}
+	return 0;
+}
+
+/**
+ * CLI のターゲット（-t/-f、無ければ位置引数）ごとにセッションを確保・初期化する。
+ * 名前解決後に同じアドレス:ポートとなるターゲットの重複は拒否する。
+ * @return 成功時 0、エラー時 -1（確保済みのセッションは free_sessions() で解放）
+ */
+__attribute__((nonnull(1), cold)) static int
+init_sessions(const struct sender_options *opts)
+{
+	size_t count = opts->target_count > 0 ? opts->target_count : 1;
+#ifndef __linux__
+	if (count > 1) {
+		fprintf(stderr, "Multiple targets are only supported on Linux\n");
+		return -1;
+	}
+#endif
+	g_sessions = calloc(count, sizeof(*g_sessions));
+	if (g_sessions == NULL) {
+		fprintf(stderr, "Failed to allocate sessions\n");
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++) {
+		g_sessions[i].sockfd = INVALID_SOCKET;
+	}
+	g_session_count = count;
+
+	for (size_t i = 0; i < count; i++) {
+		struct sender_session *sess = &g_sessions[i];
+		const char *host = opts->host;
+		uint16_t port = opts->port;
+		if (opts->target_count > 0) {
+			host = opts->targets[i].host;
+			port = opts->targets[i].port;
+		}
+		if (init_session(sess, host, port, opts) != 0) {
+			return -1;
+		}
+		for (size_t j = 0; j < i; j++) {
+			if (strcmp(g_sessions[j].target, sess->target) == 0) {
+				fprintf(stderr, "Duplicate target: %s\n", sess->target);
+				return -1;
+			}
+		}
+		if (count > 1) {
+			snprintf(sess->log_prefix,
+				 sizeof(sess->log_prefix),
+				 "%s: ",
+				 sess->target);
+		}
+	}
+	g_sess = &g_sessions[0];
+	return 0;
+}
+
+/**
+ * 全セッションの解放（ソケット・応答待ち表・順序逆転の集計・区間レポート・サンプル・列車集計表・スケッチ）
+ */
+__attribute__((cold)) static void free_sessions(void)
+{
+	for (size_t i = 0; i < g_session_count; i++) {
+		struct sender_session *sess = &g_sessions[i];
+		g_sess = sess;
+		stamp_sample_buffer_free();
+		stamp_inflight_free(&sess->inflight);
+		stamp_reorder_free(&sess->reorder);
+		stamp_interval_free(&sess->iv_faces[0]);
+		stamp_interval_free(&sess->iv_faces[1]);
+		free(sess->trains);
+		free(sess->sketch_rtt);
+		free(sess->sketch_fwd);
+		free(sess->sketch_bwd);
+		if (!SOCKET_ERROR_CHECK(sess->sockfd)) {
+			CLOSE_SOCKET(sess->sockfd);
+		}
+	}
+	free(g_sessions);
+	g_sessions = NULL;
+	g_session_count = 0;
+	g_sess = NULL;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef __linux__
+	AUTO_CLOSE_FD int phc_fd = -1;
+#endif
+	int exit_code = 0;
+
+	if (platform_init_sender() != 0) {
+		return 1;
+	}
+
+	struct sender_options opts;
+	if (parse_sender_options(argc, argv, &opts) != 0) {
+		exit_code = 1;
+		goto cleanup;
+	}
+
+	g_ptp_mode = opts.ptp_mode;
+	g_oneway_mode = opts.oneway_mode;
+	g_output_format = opts.format;
+	g_sched_mode = opts.sched_mode;
+	g_train_mode = (opts.burst_len != 0);
+	g_collect_samples = opts.exact_samples;
+	g_error_estimate_nbo = stamp_default_error_estimate_nbo(g_ptp_mode);
+
+	if (init_sessions(&opts) != 0) {
+		exit_code = 1;
+		goto cleanup;
+	}
+#ifdef __linux__
+	if (!stamp_setup_phc_from_options(g_sessions[0].sockfd,
+					  opts.phc_requested,
+					  opts.ifname,
+					  &phc_fd,
+					  &g_phc_clockid,
+					  &g_phc_enabled)) {
+		exit_code = 1;
+		goto cleanup;
+	}
+	stamp_tsc_setup_from_options(&g_tsc_clock, opts.clock_source, g_phc_enabled);
+#else
+	stamp_tsc_setup_from_options(&g_tsc_clock, opts.clock_source, false);
+#endif
+	print_sender_start_message(&opts);
+	if (opts.record_path != NULL &&
+	    packet_recorder_start(opts.record_path) != 0) {
+		exit_code = 1;
+		goto cleanup;
+	}
+	if (opts.report_interval_sec != 0 &&
+	    interval_reporter_start(opts.report_interval_sec) != 0) {
+		exit_code = 1;
+		goto cleanup;
+	}
+
+	int rc;
+#ifdef __linux__
+	if (g_session_count > 1) {
+		rc = run_multi_measurement_loop(&opts);
+	} else
+#endif
+	{
+		rc = run_measurement_loop(&opts);
+	}
+	if (rc != 0) {
+		exit_code = 1;
+		goto cleanup;
+	}
+
+	packet_recorder_finish();
+	settle_all_sessions();
+	interval_reporter_finish();
+	print_statistics();
+
+cleanup:
+	packet_recorder_finish();
+	interval_reporter_stop();
+	free(g_interval.reports);
+	free(g_interval.fields);
+	stamp_tsc_stop(&g_tsc_clock);
+	// ソケットは WSACleanup より前に閉じる
+	free_sessions();
+	free(opts.targets);
+	// PHC fd は AUTO_CLOSE_FD により main() スコープ離脱時に自動 close される
+#ifdef _WIN32
 	WSACleanup();
 #endif
 	return exit_code;
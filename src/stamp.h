@@ -4,15 +4,35 @@
 #ifndef STAMP_H
 #define STAMP_H
 
+#include "stamp_bpf.h"
 #include "stamp_calc.h"
+#include "stamp_clients.h"
+#include "stamp_inflight.h"
+#include "stamp_interval.h"
 #include "stamp_kernel_ts.h"
+#include "stamp_logring.h"
+#include "stamp_loss.h"
+#include "stamp_mmsg.h"
 #include "stamp_net.h"
+#include "stamp_pktlog.h"
 #include "stamp_platform.h"
 #include "stamp_protocol.h"
+#include "stamp_ratelimit.h"
 #include "stamp_recv.h"
+#include "stamp_reorder.h"
 #include "stamp_report.h"
+#include "stamp_schedule.h"
+#include "stamp_session.h"
+#include "stamp_select.h"
 #include "stamp_signal.h"
+#include "stamp_sketch.h"
+#include "stamp_t3follow.h"
 #include "stamp_time.h"
+#include "stamp_train.h"
+#include "stamp_tsc.h"
+#include "stamp_uring.h"
 #include "stamp_validation.h"
+#include "stamp_wheel.h"
+#include "stamp_xdp.h"
 
 #endif // STAMP_H
@@ -0,0 +1,298 @@
+// RFC 8762 STAMP - Reflector 受信ソケットのカーネル内入力フィルタ（cBPF）
+// stamp_check_reflector_input() と同じ長さ・Error Estimate の multiplier の
+// 検査を SO_ATTACH_FILTER の classic BPF で受信キューへ積む前に行い、
+// 任意で送信元プレフィックスの許可リストも適用する。不正なパケットや
+// スキャンはユーザー空間へコピーされず、反射スレッドを起こさない。
+// UDP ソケットのフィルタは UDP ヘッダ先頭を offset 0 として評価される。
+// プレフィックスの解析は全プラットフォーム共通、フィルタは Linux のみ。
+
+#ifndef STAMP_BPF_H
+#define STAMP_BPF_H
+
+#include "stamp_net.h"
+
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+// 許可リストに登録できるプレフィックス数の上限（-a）
+#define STAMP_ALLOW_MAX 64U
+
+/**
+ * 送信元プレフィックス（addr のプレフィックス長より後ろのビットは 0）
+ */
+struct stamp_prefix {
+	uint8_t family; // AF_INET / AF_INET6
+	uint8_t len;	// プレフィックス長（ビット）
+	uint8_t addr[16];
+};
+
+/**
+ * 送信元プレフィックスの許可リスト（count == 0 なら全て許可）
+ */
+struct stamp_allowlist {
+	struct stamp_prefix prefixes[STAMP_ALLOW_MAX];
+	uint32_t count;
+};
+
+/**
+ * "addr/len" または "addr"（ホスト 1 個）を解析する
+ * @return 成功時 0、不正な形式・長さの場合 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_prefix_parse(const char *arg, struct stamp_prefix *out)
+{
+	char host[INET6_ADDRSTRLEN];
+	const char *slash = strchr(arg, '/');
+	size_t host_len = slash != NULL ? (size_t)(slash - arg) : strlen(arg);
+	if (host_len == 0 || host_len >= sizeof(host)) {
+		return -1;
+	}
+	memcpy(host, arg, host_len);
+	host[host_len] = '\0';
+
+	memset(out, 0, sizeof(*out));
+	uint32_t max_len;
+	if (inet_pton(AF_INET, host, out->addr) == 1) {
+		out->family = AF_INET;
+		max_len = 32;
+	} else if (inet_pton(AF_INET6, host, out->addr) == 1) {
+		out->family = AF_INET6;
+		max_len = 128;
+	} else {
+		return -1;
+	}
+
+	uint32_t len = max_len;
+	if (slash != NULL) {
+		// "/0" を許すため stamp_parse_u32_range（0 を拒否）は使えない
+		if (slash[1] == '0' && slash[2] == '\0') {
+			len = 0;
+		} else if (stamp_parse_u32_range(slash + 1, &len, max_len) != 0) {
+			return -1;
+		}
+	}
+	out->len = (uint8_t)len;
+	for (uint32_t bit = len; bit < max_len; bit++) {
+		out->addr[bit / 8U] &= (uint8_t)~(0x80U >> (bit % 8U));
+	}
+	return 0;
+}
+
+/**
+ * カンマ区切りのプレフィックスを許可リストへ追加する
+ * @return 成功時 0、不正な形式・上限超過の場合 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_allowlist_add(struct stamp_allowlist *list, const char *arg)
+{
+	char item[INET6_ADDRSTRLEN + 8];
+	const char *p = arg;
+	for (;;) {
+		const char *comma = strchr(p, ',');
+		size_t n = comma != NULL ? (size_t)(comma - p) : strlen(p);
+		if (n == 0 || n >= sizeof(item) || list->count >= STAMP_ALLOW_MAX) {
+			return -1;
+		}
+		memcpy(item, p, n);
+		item[n] = '\0';
+		if (stamp_prefix_parse(item, &list->prefixes[list->count]) != 0) {
+			return -1;
+		}
+		list->count++;
+		if (comma == NULL) {
+			return 0;
+		}
+		p = comma + 1;
+	}
+}
+
+/**
+ * 送信元が許可リストのいずれかのプレフィックスに一致するか判定する
+ * ソケットのフィルタを通らない経路（-E xdp）でユーザー空間から使う。
+ * @return 一致した場合、またはリストが空の場合 true
+ */
+__attribute__((pure, nonnull(1, 2))) static inline bool
+stamp_allowlist_match(const struct stamp_allowlist *list,
+		      const struct sockaddr_storage *addr)
+{
+	if (list->count == 0) {
+		return true;
+	}
+	const uint8_t *bytes;
+	if (addr->ss_family == AF_INET) {
+		bytes = (const uint8_t *)&((const struct sockaddr_in *)addr)->sin_addr;
+	} else if (addr->ss_family == AF_INET6) {
+		bytes = (const uint8_t *)&((const struct sockaddr_in6 *)addr)->sin6_addr;
+	} else {
+		return false;
+	}
+	for (uint32_t i = 0; i < list->count; i++) {
+		const struct stamp_prefix *prefix = &list->prefixes[i];
+		if (prefix->family != addr->ss_family) {
+			continue;
+		}
+		uint32_t full = prefix->len / 8U;
+		uint32_t rest = prefix->len % 8U;
+		if (memcmp(bytes, prefix->addr, full) == 0 &&
+		    (rest == 0 ||
+		     (bytes[full] & (uint8_t)(0xFF00U >> rest)) == prefix->addr[full])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef __linux__
+
+// skb->protocol（SKF_AD_PROTOCOL はホストバイトオーダーで返す）
+#define STAMP_BPF_ETH_P_IP   0x0800U
+#define STAMP_BPF_ETH_P_IPV6 0x86DDU
+// UDP ヘッダ長。ペイロードはこの位置から始まる
+#define STAMP_BPF_UDP_HLEN 8U
+// 最長の命令列: 固定部 + IPv6 プレフィックス 1 個あたり最大 13 命令
+#define STAMP_BPF_MAX_INSNS (16U + STAMP_ALLOW_MAX * 13U)
+
+/**
+ * フィルタの命令列
+ */
+struct stamp_bpf_prog {
+	struct sock_filter insns[STAMP_BPF_MAX_INSNS];
+	uint16_t len;
+};
+
+static inline void stamp_bpf_emit(struct stamp_bpf_prog *prog,
+				  uint16_t code,
+				  uint8_t jt,
+				  uint8_t jf,
+				  uint32_t k)
+{
+	prog->insns[prog->len++] = (struct sock_filter){code, jt, jf, k};
+}
+
+/**
+ * 送信元アドレスがプレフィックスに一致すれば受理する命令列を追加する
+ * 一致しなければ命令列の直後（次のプレフィックス）へ進む。
+ * @param src_off ネットワークヘッダ上の送信元アドレスの位置
+ */
+__attribute__((nonnull(1, 2), cold)) static inline void
+stamp_bpf_emit_prefix(struct stamp_bpf_prog *prog,
+		      const struct stamp_prefix *prefix,
+		      uint32_t src_off)
+{
+	uint16_t jumps[4];
+	uint32_t njumps = 0;
+	for (uint32_t w = 0; w * 32U < prefix->len; w++) {
+		uint32_t bits = prefix->len - w * 32U;
+		uint32_t mask = bits >= 32U ? UINT32_MAX : ~(UINT32_MAX >> bits);
+		uint32_t word;
+		memcpy(&word, prefix->addr + w * 4U, sizeof(word));
+		stamp_bpf_emit(prog,
+			       BPF_LD | BPF_W | BPF_ABS,
+			       0,
+			       0,
+			       (uint32_t)SKF_NET_OFF + src_off + w * 4U);
+		if (mask != UINT32_MAX) {
+			stamp_bpf_emit(prog, BPF_ALU | BPF_AND | BPF_K, 0, 0, mask);
+		}
+		jumps[njumps++] = prog->len;
+		stamp_bpf_emit(prog,
+			       BPF_JMP | BPF_JEQ | BPF_K,
+			       0,
+			       0,
+			       ntohl(word) & mask);
+	}
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, UINT32_MAX);
+	// 不一致は受理命令の次へ
+	for (uint32_t i = 0; i < njumps; i++) {
+		prog->insns[jumps[i]].jf =
+			(uint8_t)((uint32_t)prog->len - jumps[i] - 1U);
+	}
+}
+
+/**
+ * 入力検査フィルタを組み立てる
+ * ペイロード長が 14 バイト以上 STAMP_MAX_PACKET_SIZE 以下で、Error Estimate
+ * の multiplier が 0 でなく、許可リストが空でなければ送信元がいずれかの
+ * プレフィックスに一致するパケットだけを受理する。
+ */
+__attribute__((nonnull(1, 2), cold)) static inline void
+stamp_bpf_build(struct stamp_bpf_prog *prog, const struct stamp_allowlist *allow)
+{
+	prog->len = 0;
+	// UDP ヘッダ + ペイロードの長さ
+	stamp_bpf_emit(prog, BPF_LD | BPF_W | BPF_LEN, 0, 0, 0);
+	stamp_bpf_emit(prog,
+		       BPF_JMP | BPF_JGE | BPF_K,
+		       1,
+		       0,
+		       STAMP_BPF_UDP_HLEN + 14U);
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+	stamp_bpf_emit(prog,
+		       BPF_JMP | BPF_JGT | BPF_K,
+		       0,
+		       1,
+		       STAMP_BPF_UDP_HLEN + STAMP_MAX_PACKET_SIZE);
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+	// Error Estimate の下位バイト（multiplier、ペイロード offset 13）
+	stamp_bpf_emit(prog,
+		       BPF_LD | BPF_B | BPF_ABS,
+		       0,
+		       0,
+		       STAMP_BPF_UDP_HLEN + 13U);
+	stamp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0);
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+	if (allow->count == 0) {
+		stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, UINT32_MAX);
+		return;
+	}
+
+	// IPv4 パケット（dual-stack ソケットの IPv4 も含む）は IPv4 プレフィックス、
+	// IPv6 パケットは IPv6 プレフィックスとだけ照合する
+	stamp_bpf_emit(prog,
+		       BPF_LD | BPF_W | BPF_ABS,
+		       0,
+		       0,
+		       (uint32_t)SKF_AD_OFF + SKF_AD_PROTOCOL);
+	stamp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, STAMP_BPF_ETH_P_IP);
+	uint16_t to_v6 = prog->len;
+	stamp_bpf_emit(prog, BPF_JMP | BPF_JA, 0, 0, 0);
+	for (uint32_t i = 0; i < allow->count; i++) {
+		if (allow->prefixes[i].family == AF_INET) {
+			stamp_bpf_emit_prefix(prog, &allow->prefixes[i], 12U);
+		}
+	}
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+	prog->insns[to_v6].k = (uint32_t)prog->len - to_v6 - 1U;
+
+	stamp_bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, STAMP_BPF_ETH_P_IPV6);
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+	for (uint32_t i = 0; i < allow->count; i++) {
+		if (allow->prefixes[i].family == AF_INET6) {
+			stamp_bpf_emit_prefix(prog, &allow->prefixes[i], 8U);
+		}
+	}
+	stamp_bpf_emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+}
+
+/**
+ * ソケットへフィルタを付ける（カーネルは命令列を複製する）
+ * @return setsockopt の戻り値（0=成功, <0=失敗）
+ */
+__attribute__((nonnull(2), cold)) static inline int
+stamp_bpf_attach(int sockfd, struct stamp_bpf_prog *prog)
+{
+	struct sock_fprog fprog = {
+		.len = prog->len,
+		.filter = prog->insns,
+	};
+	return setsockopt(sockfd,
+			  SOL_SOCKET,
+			  SO_ATTACH_FILTER,
+			  &fprog,
+			  sizeof(fprog));
+}
+
+#endif // __linux__
+
+#endif // STAMP_BPF_H
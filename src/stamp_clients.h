@@ -0,0 +1,243 @@
+// RFC 8762 STAMP - Reflector の送信元別統計表
+// 送信元（アドレス, ポート）ごとに反射数・バイト数・理由別の破棄数・初回／
+// 最終受信時刻と、滞留時間（T3 − T2）の log2 ヒストグラムを数える。
+// -t 指定時は T3 の誤差（stamp_t3follow.h）も送信元ごとに集計する。
+// 索引・事前確保プール・期限処理はセッション表（stamp_session.h）と共通の
+// キー付きプール（struct stamp_pool）で持ち、上限数を超えて確保しない。
+// 一定時間受信の無い送信元はプールの期限処理で表から外し、その計数は
+// 退避済みの合計へ加算する（全体の合計は失われない）。
+// スレッド間で共有しない（Reflector はワーカーごとに表を持つ）。
+
+#ifndef STAMP_CLIENTS_H
+#define STAMP_CLIENTS_H
+
+#include "stamp_session.h"
+
+// 送信元数の既定上限（全ワーカーの合計）と、無受信で表から外すまでの秒数
+#define STAMP_CLIENTS_DEFAULT_MAX 4096U
+#define STAMP_CLIENTS_IDLE_SEC	  300U
+// 滞留時間ヒストグラムのビン数。ビン b は [2^b, 2^(b+1)) ns（ビン 0 は 0–1 ns、
+// 最後のビンはそれ以上を全て含む）
+#define STAMP_CLIENTS_HIST_BINS 32U
+
+/**
+ * 破棄の理由
+ */
+enum stamp_client_drop {
+	STAMP_CLIENT_DROP_INVALID = 0, // 不正なペイロード
+	STAMP_CLIENT_DROP_TTL,	       // TTL/Hop Limit を取得できない
+	STAMP_CLIENT_DROP_SEND,	       // 応答の送信失敗
+	STAMP_CLIENT_DROP_REASONS,
+};
+
+/**
+ * T3 の誤差（実際の送信時刻 − 応答に埋め込んだ T3）の集計
+ * ヒストグラムは誤差の絶対値を滞留時間と同じ log2 ビンで数える。
+ */
+struct stamp_t3_error {
+	uint64_t count;
+	uint64_t negative; // 実際の送信時刻が埋め込んだ T3 より前だった数
+	int64_t sum_ns;
+	int64_t min_ns; // count == 0 の間は未定義
+	int64_t max_ns;
+	uint32_t hist[STAMP_CLIENTS_HIST_BINS];
+};
+
+/**
+ * 送信元 1 件の計数（entry.key.family == 0 なら未使用。key.ssid は常に 0）
+ */
+struct stamp_client {
+	struct stamp_pool_entry entry; // 最終受信時刻を含む
+	uint32_t first_seen_sec;       // 単調クロック（秒）
+	uint64_t packets;	       // 反射した数
+	uint64_t bytes;		       // 反射した応答のバイト数
+	uint32_t drops[STAMP_CLIENT_DROP_REASONS];
+	uint32_t hist[STAMP_CLIENTS_HIST_BINS];
+	struct stamp_t3_error t3_error; // -t 指定時のみ計上
+};
+
+/**
+ * 送信元別統計表（無受信で外した送信元数は pool.expired）
+ */
+struct stamp_client_table {
+	struct stamp_pool pool;
+	uint64_t untracked; // 表が満杯で計上できなかった事象数
+	struct stamp_client retired; // 表から外した送信元の計数の合計
+};
+
+/**
+ * 滞留時間のヒストグラムのビン番号
+ */
+__attribute__((const)) static inline uint32_t
+stamp_client_hist_bin(uint64_t residence_ns)
+{
+	uint32_t bin = 63U - (uint32_t)__builtin_clzll(residence_ns | 1U);
+	return bin < STAMP_CLIENTS_HIST_BINS ? bin : STAMP_CLIENTS_HIST_BINS - 1U;
+}
+
+/**
+ * T3 の誤差を 1 件加える
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_t3_error_add(struct stamp_t3_error *e, int64_t err_ns)
+{
+	if (e->count == 0 || err_ns < e->min_ns) {
+		e->min_ns = err_ns;
+	}
+	if (e->count == 0 || err_ns > e->max_ns) {
+		e->max_ns = err_ns;
+	}
+	e->count++;
+	e->sum_ns += err_ns;
+	uint64_t mag = (uint64_t)err_ns;
+	if (err_ns < 0) {
+		e->negative++;
+		mag = 0U - mag;
+	}
+	e->hist[stamp_client_hist_bin(mag)]++;
+}
+
+/**
+ * T3 の誤差の集計を合算する
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_t3_error_merge(struct stamp_t3_error *dst, const struct stamp_t3_error *src)
+{
+	if (src->count == 0) {
+		return;
+	}
+	if (dst->count == 0 || src->min_ns < dst->min_ns) {
+		dst->min_ns = src->min_ns;
+	}
+	if (dst->count == 0 || src->max_ns > dst->max_ns) {
+		dst->max_ns = src->max_ns;
+	}
+	dst->count += src->count;
+	dst->negative += src->negative;
+	dst->sum_ns += src->sum_ns;
+	for (uint32_t i = 0; i < STAMP_CLIENTS_HIST_BINS; i++) {
+		dst->hist[i] += src->hist[i];
+	}
+}
+
+/**
+ * 表を確保する
+ * @param max_clients 送信元数の上限（1..STAMP_SESSION_MAX）
+ * @param idle_sec 無受信で表から外すまでの秒数（1 以上）
+ * @param seed ハッシュの種
+ * @param now_sec 現在時刻（秒、単調クロック）
+ * @return 成功時 0、引数不正・確保失敗時 -1（確保済みの領域は解放する）
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_client_table_init(struct stamp_client_table *tbl,
+			uint32_t max_clients,
+			uint32_t idle_sec,
+			uint64_t seed,
+			uint64_t now_sec)
+{
+	memset(tbl, 0, sizeof(*tbl));
+	return stamp_pool_init(&tbl->pool,
+			       max_clients,
+			       sizeof(struct stamp_client),
+			       idle_sec,
+			       seed,
+			       now_sec);
+}
+
+/**
+ * 表の解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_client_table_free(struct stamp_client_table *tbl)
+{
+	stamp_pool_free(&tbl->pool);
+}
+
+/**
+ * 番号 idx の送信元（entry.key.family == 0 なら未使用）
+ */
+__attribute__((nonnull(1), pure)) static inline struct stamp_client *
+stamp_client_at(const struct stamp_client_table *tbl, uint32_t idx)
+{
+	// エントリは stamp_client を先頭から entry_size 刻みで並べたもの
+	return (struct stamp_client *)(void *)stamp_pool_at(&tbl->pool, idx);
+}
+
+/**
+ * 計数を合計へ加える（送信元を表から外すとき）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_client_accumulate(struct stamp_client *dst, const struct stamp_client *src)
+{
+	dst->packets += src->packets;
+	dst->bytes += src->bytes;
+	for (uint32_t i = 0; i < STAMP_CLIENT_DROP_REASONS; i++) {
+		dst->drops[i] += src->drops[i];
+	}
+	for (uint32_t i = 0; i < STAMP_CLIENTS_HIST_BINS; i++) {
+		dst->hist[i] += src->hist[i];
+	}
+	stamp_t3_error_merge(&dst->t3_error, &src->t3_error);
+}
+
+static inline void stamp_client_retire(void *ctx, struct stamp_pool_entry *e)
+{
+	struct stamp_client_table *tbl = ctx;
+	stamp_client_accumulate(&tbl->retired,
+				(const struct stamp_client *)(const void *)e);
+}
+
+/**
+ * 無受信のまま idle_sec 経過した送信元を表から外す（計数は retired へ退避）
+ * @return 外した件数
+ */
+__attribute__((nonnull(1))) static inline uint32_t
+stamp_client_expire(struct stamp_client_table *tbl, uint64_t now_sec)
+{
+	return stamp_pool_expire(&tbl->pool, now_sec, stamp_client_retire, tbl);
+}
+
+/**
+ * 送信元のエントリを引く（無ければ作る）。最終受信時刻を更新する。
+ * 1 秒に 1 回、無受信の送信元を外す処理も行う。
+ * @return エントリ。表が満杯で作れない場合 NULL（untracked に計上する）
+ */
+__attribute__((nonnull(1, 2), hot)) static inline struct stamp_client *
+stamp_client_lookup(struct stamp_client_table *tbl,
+		    const struct sockaddr_storage *addr,
+		    uint64_t now_sec)
+{
+	if (now_sec != tbl->pool.last_expire_sec) {
+		stamp_client_expire(tbl, now_sec);
+	}
+
+	struct stamp_session_key key;
+	bool created;
+	stamp_session_key_from(&key, addr, 0);
+	struct stamp_client *c = (struct stamp_client *)(void *)
+		stamp_pool_acquire(&tbl->pool, &key, now_sec, &created);
+	if (c == NULL) {
+		tbl->untracked++;
+		return NULL;
+	}
+	if (created) {
+		c->first_seen_sec = (uint32_t)now_sec;
+	}
+	return c;
+}
+
+/**
+ * 反射 1 本を計上する
+ * @param residence_ns 滞留時間 T3 − T2（ナノ秒）
+ */
+__attribute__((nonnull(1), hot)) static inline void
+stamp_client_count_reflected(struct stamp_client *c,
+			     uint32_t bytes,
+			     uint64_t residence_ns)
+{
+	c->packets++;
+	c->bytes += bytes;
+	c->hist[stamp_client_hist_bin(residence_ns)]++;
+}
+
+#endif // STAMP_CLIENTS_H
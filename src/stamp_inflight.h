@@ -0,0 +1,365 @@
+// RFC 8762 STAMP - Sender の応答待ち（in-flight）プローブ表
+// sender_seq_num をキーに T1 と送信時刻（単調クロック）を保持し、応答の照合、
+// タイムアウト判定、遅着・重複・順序逆転の分類を行う。送信と受信を分離した
+// パイプライン送信で、複数プローブを同時に応答待ちにするための plumbing。
+// 統計への加算・ログ出力のポリシーは呼び出し元（sender）に委ねる。
+// TX HW タイムスタンプを使う場合は、送信した datagram の番号（OPT_ID のキー）
+// から seq を引く表も持ち、後から届いた HW の T1 を応答待ちのエントリへ反映する。
+
+#ifndef STAMP_INFLIGHT_H
+#define STAMP_INFLIGHT_H
+
+#include "stamp_platform.h"
+
+// 表の容量の上限と下限（2 の冪）。容量は同時に応答待ちにできるプローブ数の
+// 上限であり、タイムアウト後もこの本数ぶん後続を送るまでは遅着応答を識別
+// できる。上限は 100 kpps（-I 10）でも約 0.65 秒分の応答待ちを保持できる大きさ。
+#define STAMP_INFLIGHT_CAP     65536U
+#define STAMP_INFLIGHT_MIN_CAP 256U
+
+// スロット状態
+enum stamp_inflight_state {
+	STAMP_INFLIGHT_EMPTY = 0,
+	STAMP_INFLIGHT_PENDING,	 // 応答待ち
+	STAMP_INFLIGHT_ANSWERED, // 応答受信済み
+	STAMP_INFLIGHT_EXPIRED,	 // タイムアウト（loss として計上済み）
+	STAMP_INFLIGHT_LATE_ANSWERED, // タイムアウト後に応答受信（loss のまま）
+};
+
+// 応答の照合結果
+enum stamp_inflight_match {
+	STAMP_INFLIGHT_MATCH_IN_ORDER = 0, // 期限内・到着順どおり
+	STAMP_INFLIGHT_MATCH_REORDERED,	   // 期限内だが後続 seq の応答より後に到着
+	STAMP_INFLIGHT_MATCH_LATE,	   // タイムアウト後に到着
+	STAMP_INFLIGHT_MATCH_DUPLICATE,	   // 同じ seq の応答を受信済み
+	STAMP_INFLIGHT_MATCH_UNKNOWN,	   // 未送信 seq、または表から追い出し済み
+};
+
+struct stamp_inflight_entry {
+	uint64_t sent_ns; // 送信時刻（単調クロック、タイムアウト判定用）
+	uint32_t seq;
+	uint32_t t1_sec; // 実 T1（HW TX タイムスタンプ取得時はその値）
+	uint32_t t1_frac;
+	uint8_t state; // enum stamp_inflight_state
+};
+
+/**
+ * 応答待ちプローブ表（seq & mask で直接索引するリング）
+ * seq は送信順に単調増加（uint32_t ラップ込み）する前提。送信失敗で欠番が
+ * 生じてもよい。stamp_inflight_init() で確保し stamp_inflight_free() で解放する。
+ * 多数のセッションを 1 プロセスで扱えるよう、容量は送信レートに合わせて選ぶ。
+ */
+struct stamp_inflight {
+	struct stamp_inflight_entry *slots;
+	uint32_t mask;	     // 容量 - 1
+	uint32_t oldest;     // 期限切れ走査の起点（これより前に応答待ちは無い）
+	uint32_t next_seq;   // 最後に登録した seq + 1
+	uint32_t pending;    // 応答待ち本数
+	uint32_t highest_rx; // 期限内に受信した最大 seq（順序逆転判定）
+	uint32_t settled;    // 結果をまだ報告していない最古の seq
+	bool has_rx;	     // highest_rx が有効か
+	bool has_tx;	     // 1 本以上登録済みか
+	uint32_t *tx_key_seq;  // OPT_ID のキー & mask → seq（NULL=追跡しない）
+	uint32_t tx_key_next;  // 次に登録する datagram のキー
+	uint32_t tx_key_acked; // 最後に HW の T1 を受け取ったキー + 1
+};
+
+/**
+ * 表を空の状態で確保する
+ * @param cap 容量（STAMP_INFLIGHT_MIN_CAP..STAMP_INFLIGHT_CAP の 2 の冪）
+ * @return 成功時 0、容量が不正または確保失敗時 -1
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_inflight_init(struct stamp_inflight *tbl, uint32_t cap)
+{
+	memset(tbl, 0, sizeof(*tbl));
+	if (cap < STAMP_INFLIGHT_MIN_CAP || cap > STAMP_INFLIGHT_CAP ||
+	    (cap & (cap - 1U)) != 0) {
+		return -1;
+	}
+	tbl->slots = calloc(cap, sizeof(*tbl->slots));
+	if (tbl->slots == NULL) {
+		return -1;
+	}
+	tbl->mask = cap - 1U;
+	return 0;
+}
+
+/**
+ * 表の解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_inflight_free(struct stamp_inflight *tbl)
+{
+	free(tbl->slots);
+	free(tbl->tx_key_seq);
+	memset(tbl, 0, sizeof(*tbl));
+}
+
+/**
+ * TX タイムスタンプのキー（SOF_TIMESTAMPING_OPT_ID）から seq を引く表を確保する
+ * 以降の stamp_inflight_insert() は登録順にキーを 0 から払い出す。登録は
+ * 送信に成功した datagram ごとに送信順で行うこと（カーネルのキーと揃える）。
+ * @return 成功時 0、確保失敗時 -1
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_inflight_track_tx_keys(struct stamp_inflight *tbl)
+{
+	tbl->tx_key_seq = calloc((size_t)tbl->mask + 1U, sizeof(*tbl->tx_key_seq));
+	return tbl->tx_key_seq != NULL ? 0 : -1;
+}
+
+/**
+ * 応答待ちが timeout_ns の間に溜まりうる本数から表の容量を選ぶ
+ * 平均送信間隔 interval_ns ごとに burst 本を送る場合の 2 倍を、
+ * STAMP_INFLIGHT_MIN_CAP..STAMP_INFLIGHT_CAP の 2 の冪に切り上げる。
+ */
+__attribute__((const)) static inline uint32_t
+stamp_inflight_cap_for(uint64_t timeout_ns, uint64_t interval_ns, uint32_t burst)
+{
+	uint64_t want = (timeout_ns / (interval_ns > 0 ? interval_ns : 1U) + 1U) *
+			(burst > 0 ? burst : 1U) * 2U;
+	uint32_t cap = STAMP_INFLIGHT_MIN_CAP;
+	while (cap < STAMP_INFLIGHT_CAP && cap < want) {
+		cap <<= 1;
+	}
+	return cap;
+}
+
+/**
+ * 送信したプローブを登録する
+ * 同じスロットに応答待ちの古いプローブが残っていた場合（応答待ちが容量を
+ * 超えた場合）、そのプローブは追い出されタイムアウト扱いとなる。
+ * @param seq 送信 seq（前回登録より後であること）
+ * @param sent_ns 送信時刻（単調クロック）
+ * @return 追い出した応答待ちプローブがあれば true（呼び出し元で loss 計上）
+ */
+__attribute__((nonnull(1))) static inline bool
+stamp_inflight_insert(struct stamp_inflight *tbl,
+		      uint32_t seq,
+		      uint32_t t1_sec,
+		      uint32_t t1_frac,
+		      uint64_t sent_ns)
+{
+	struct stamp_inflight_entry *e = &tbl->slots[seq & tbl->mask];
+	bool evicted = (e->state == STAMP_INFLIGHT_PENDING);
+	if (evicted) {
+		tbl->pending--;
+	}
+
+	if (!tbl->has_tx) {
+		tbl->oldest = seq;
+		tbl->settled = seq;
+		tbl->has_tx = true;
+	} else if ((uint32_t)(seq - tbl->oldest) > tbl->mask) {
+		// 追い出しにより走査起点が表の範囲外になった
+		tbl->oldest = seq - tbl->mask;
+	}
+
+	e->sent_ns = sent_ns;
+	e->seq = seq;
+	e->t1_sec = t1_sec;
+	e->t1_frac = t1_frac;
+	e->state = STAMP_INFLIGHT_PENDING;
+	tbl->next_seq = seq + 1U;
+	tbl->pending++;
+	if (tbl->tx_key_seq != NULL) {
+		tbl->tx_key_seq[tbl->tx_key_next++ & tbl->mask] = seq;
+	}
+	return evicted;
+}
+
+/**
+ * 後から届いた TX HW タイムスタンプで、キーに対応するプローブの T1 を差し替える
+ * 応答待ちのプローブにのみ反映する（応答を照合済み・期限切れ・追い出し済み、
+ * 未送信または表の範囲より古いキーは無視する）。
+ * @param key OPT_ID のキー
+ * @return T1 を差し替えた場合 true
+ */
+__attribute__((nonnull(1))) static inline bool
+stamp_inflight_set_tx_t1(struct stamp_inflight *tbl,
+			 uint32_t key,
+			 uint32_t t1_sec,
+			 uint32_t t1_frac)
+{
+	if (tbl->tx_key_seq == NULL ||
+	    (uint32_t)(tbl->tx_key_next - key - 1U) > tbl->mask) {
+		return false;
+	}
+	if ((int32_t)(key - tbl->tx_key_acked) >= 0) {
+		tbl->tx_key_acked = key + 1U;
+	}
+	uint32_t seq = tbl->tx_key_seq[key & tbl->mask];
+	struct stamp_inflight_entry *e = &tbl->slots[seq & tbl->mask];
+	if (e->seq != seq || e->state != STAMP_INFLIGHT_PENDING) {
+		return false;
+	}
+	e->t1_sec = t1_sec;
+	e->t1_frac = t1_frac;
+	return true;
+}
+
+/**
+ * 送信に失敗したがカーネルがキーを払い出し済みの datagram の分、キーを進める
+ * （以降のキーと seq の対応をずらさないため）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_inflight_skip_tx_key(struct stamp_inflight *tbl)
+{
+	if (tbl->tx_key_seq != NULL) {
+		// 届かないキー。誤って一致しないよう未送信の seq を入れておく
+		tbl->tx_key_seq[tbl->tx_key_next++ & tbl->mask] = tbl->next_seq;
+	}
+}
+
+/**
+ * HW の T1 をまだ受け取っていない送信済み datagram があるか
+ * （応答の照合前に errqueue を回収すべきかの判定）
+ */
+__attribute__((nonnull(1), pure)) static inline bool
+stamp_inflight_tx_t1_outstanding(const struct stamp_inflight *tbl)
+{
+	return tbl->tx_key_seq != NULL && tbl->tx_key_acked != tbl->tx_key_next;
+}
+
+/**
+ * 送信時刻から timeout_ns 経過した応答待ちプローブを期限切れにする
+ * 送信時刻は seq 順に単調なので、最古の応答待ちから順に走査し、期限内の
+ * プローブに当たった時点で打ち切る（1 回あたりの走査量は新たに確定した本数）。
+ * @param now_ns 現在時刻（単調クロック）
+ * @param timeout_ns 応答待ちタイムアウト
+ * @param on_expire 期限切れ 1 本ごとに呼ぶコールバック（NULL 可）
+ * @param ctx コールバックへ渡す文脈
+ * @return 今回期限切れにした本数
+ */
+__attribute__((nonnull(1))) static inline uint32_t stamp_inflight_expire(
+	struct stamp_inflight *tbl,
+	uint64_t now_ns,
+	uint64_t timeout_ns,
+	void (*on_expire)(const struct stamp_inflight_entry *e, void *ctx),
+	void *ctx)
+{
+	uint32_t expired = 0;
+	while (tbl->pending > 0 && tbl->oldest != tbl->next_seq) {
+		struct stamp_inflight_entry *e =
+			&tbl->slots[tbl->oldest & tbl->mask];
+		if (e->seq == tbl->oldest && e->state == STAMP_INFLIGHT_PENDING) {
+			if (now_ns < e->sent_ns ||
+			    now_ns - e->sent_ns < timeout_ns) {
+				break;
+			}
+			e->state = STAMP_INFLIGHT_EXPIRED;
+			tbl->pending--;
+			expired++;
+			if (on_expire != NULL) {
+				on_expire(e, ctx);
+			}
+		}
+		tbl->oldest++;
+	}
+	return expired;
+}
+
+/**
+ * 次に期限切れとなる時刻を返す（stamp_inflight_expire() 直後に呼ぶこと）
+ * @param deadline_ns 期限時刻の格納先
+ * @return 応答待ちが無ければ false
+ */
+__attribute__((nonnull(1, 3))) static inline bool
+stamp_inflight_next_expiry(const struct stamp_inflight *tbl,
+			   uint64_t timeout_ns,
+			   uint64_t *deadline_ns)
+{
+	if (tbl->pending == 0) {
+		return false;
+	}
+	const struct stamp_inflight_entry *e =
+		&tbl->slots[tbl->oldest & tbl->mask];
+	*deadline_ns = e->sent_ns + timeout_ns;
+	return true;
+}
+
+/**
+ * 結果の確定したプローブを seq 順に報告する
+ * 未報告の最古の seq から、期限内に応答済み（受信）または期限切れ・遅着
+ * （喪失）のプローブを順に on_settle へ渡し、応答待ちに当たった時点で
+ * 打ち切る（1 回あたりの走査量は新たに確定した本数）。force_before より前の
+ * 応答待ちは喪失として報告する。stamp_inflight_insert() でスロットを再利用
+ * する前に seq − mask を、計測終了時に next_seq を渡して未報告を残さない。
+ * 送信に失敗して登録されなかった seq は報告しない。
+ * @param force_before この seq より前は応答待ちでも確定させる
+ * @param on_settle 1 本ごとに呼ぶコールバック（lost=喪失なら true）
+ */
+__attribute__((nonnull(1, 3))) static inline void stamp_inflight_settle(
+	struct stamp_inflight *tbl,
+	uint32_t force_before,
+	void (*on_settle)(uint32_t seq, bool lost, void *ctx),
+	void *ctx)
+{
+	while (tbl->has_tx && tbl->settled != tbl->next_seq) {
+		const struct stamp_inflight_entry *e =
+			&tbl->slots[tbl->settled & tbl->mask];
+		if (e->seq == tbl->settled && e->state != STAMP_INFLIGHT_EMPTY) {
+			if (e->state == STAMP_INFLIGHT_PENDING &&
+			    (int32_t)(tbl->settled - force_before) >= 0) {
+				break;
+			}
+			on_settle(tbl->settled,
+				  e->state != STAMP_INFLIGHT_ANSWERED,
+				  ctx);
+		}
+		tbl->settled++;
+	}
+}
+
+/**
+ * 受信した応答を seq で照合して分類する
+ * 期限内の応答（IN_ORDER / REORDERED）のみスロットを応答済みに更新し、
+ * *entry に T1 を含むエントリを返す。LATE も *entry を返す（遅着分の
+ * 遅延を参考表示したい呼び出し元向け）が、再度 LATE を返さないよう遅着の
+ * 応答済み扱いにする（以降の同 seq は DUPLICATE）。
+ * 順序逆転は RFC 4737 に倣い「期限内に受信済みの最大 seq より小さい」で判定する。
+ * @param seq 応答の sender_seq_num（ホストバイトオーダー）
+ * @param entry 照合したエントリの格納先（UNKNOWN/DUPLICATE 時は NULL）
+ * @return 照合結果
+ */
+__attribute__((nonnull(1, 3))) static inline enum stamp_inflight_match
+stamp_inflight_match(struct stamp_inflight *tbl,
+		     uint32_t seq,
+		     const struct stamp_inflight_entry **entry)
+{
+	*entry = NULL;
+	struct stamp_inflight_entry *e = &tbl->slots[seq & tbl->mask];
+	// 未来の seq（未送信）はスロットが古い周回の値でも一致しうるため先に除外
+	if (!tbl->has_tx || (int32_t)(seq - tbl->next_seq) >= 0 ||
+	    e->seq != seq || e->state == STAMP_INFLIGHT_EMPTY) {
+		return STAMP_INFLIGHT_MATCH_UNKNOWN;
+	}
+
+	switch ((enum stamp_inflight_state)e->state) {
+	case STAMP_INFLIGHT_ANSWERED:
+	case STAMP_INFLIGHT_LATE_ANSWERED:
+		return STAMP_INFLIGHT_MATCH_DUPLICATE;
+	case STAMP_INFLIGHT_EXPIRED:
+		e->state = STAMP_INFLIGHT_LATE_ANSWERED;
+		*entry = e;
+		return STAMP_INFLIGHT_MATCH_LATE;
+	case STAMP_INFLIGHT_PENDING:
+		break;
+	case STAMP_INFLIGHT_EMPTY:
+	default:
+		return STAMP_INFLIGHT_MATCH_UNKNOWN;
+	}
+
+	e->state = STAMP_INFLIGHT_ANSWERED;
+	tbl->pending--;
+	*entry = e;
+	if (tbl->has_rx && (int32_t)(seq - tbl->highest_rx) < 0) {
+		return STAMP_INFLIGHT_MATCH_REORDERED;
+	}
+	tbl->highest_rx = seq;
+	tbl->has_rx = true;
+	return STAMP_INFLIGHT_MATCH_IN_ORDER;
+}
+
+#endif // STAMP_INFLIGHT_H
@@ -0,0 +1,150 @@
+// RFC 8762 STAMP - Sender の区間レポート（-R）の集計面
+// 長時間の計測では終了時の 1 レポートが途中の障害を平均に埋もれさせるため、
+// 一定時間ごとに遅延・IPDV・分位点・喪失をその区間だけで集計する。
+// セッションごとに同じ形の集計面を 2 面持ち、計測ループは使用中の面へ加算し、
+// 区間の境界でポインタの付け替えだけで空き面と入れ替える。書き終えた面の
+// 整形・出力と初期化（スケッチのクリアを含む）は書き出し側が行う。
+// 累積の統計（終了時のレポート）はこれとは別に持つ。
+
+#ifndef STAMP_INTERVAL_H
+#define STAMP_INTERVAL_H
+
+#include "stamp_sketch.h"
+#include "stamp_time.h" // stamp_welford
+
+// -R に指定できる区間の上限（秒、1 日）
+#define STAMP_INTERVAL_MAX_SEC 86400U
+
+/**
+ * 1 区間分の集計
+ */
+struct stamp_interval_stats {
+	uint64_t start_ns; // 区間の開始（単調クロック）
+	uint64_t end_ns;   // 区間の終了（入れ替え時に設定）
+	uint32_t sent;
+	uint32_t received; // 期限内に受信した応答
+	uint32_t timeouts;
+	uint32_t late;
+	uint32_t reordered;
+	uint32_t duplicates;
+	uint32_t settled; // 結果の確定したプローブ（喪失率の分母）
+	uint32_t lost;	  // うち喪失
+	struct stamp_welford rtt;
+	struct stamp_welford fwd;
+	struct stamp_welford bwd;
+	struct stamp_welford offset;
+	struct stamp_welford ipdv_rtt;
+	struct stamp_welford ipdv_fwd;
+	struct stamp_welford ipdv_bwd;
+	// 分位点スケッチ（fwd/bwd は one-way モード時のみ確保）
+	struct stamp_sketch *sketch_rtt;
+	struct stamp_sketch *sketch_fwd;
+	struct stamp_sketch *sketch_bwd;
+};
+
+/**
+ * 集計面を確保する
+ * @param oneway one-way モード（fwd/bwd のスケッチも確保するか）
+ * @return 成功時 0、確保失敗時 -1（確保済みの分は stamp_interval_free で解放）
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_interval_init(struct stamp_interval_stats *iv, bool oneway)
+{
+	memset(iv, 0, sizeof(*iv));
+	iv->sketch_rtt = calloc(1, sizeof(*iv->sketch_rtt));
+	if (oneway) {
+		iv->sketch_fwd = calloc(1, sizeof(*iv->sketch_fwd));
+		iv->sketch_bwd = calloc(1, sizeof(*iv->sketch_bwd));
+		if (iv->sketch_fwd == NULL || iv->sketch_bwd == NULL) {
+			return -1;
+		}
+	}
+	return iv->sketch_rtt != NULL ? 0 : -1;
+}
+
+/**
+ * 集計面の解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_interval_free(struct stamp_interval_stats *iv)
+{
+	free(iv->sketch_rtt);
+	free(iv->sketch_fwd);
+	free(iv->sketch_bwd);
+	memset(iv, 0, sizeof(*iv));
+}
+
+/**
+ * 集計を空にする（スケッチの確保は保つ）
+ * @param start_ns 次の区間の開始
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_interval_reset(struct stamp_interval_stats *iv, uint64_t start_ns)
+{
+	struct stamp_sketch *rtt = iv->sketch_rtt;
+	struct stamp_sketch *fwd = iv->sketch_fwd;
+	struct stamp_sketch *bwd = iv->sketch_bwd;
+	memset(iv, 0, sizeof(*iv));
+	iv->start_ns = start_ns;
+	iv->sketch_rtt = rtt;
+	iv->sketch_fwd = fwd;
+	iv->sketch_bwd = bwd;
+	memset(rtt, 0, sizeof(*rtt));
+	if (fwd != NULL) {
+		memset(fwd, 0, sizeof(*fwd));
+		memset(bwd, 0, sizeof(*bwd));
+	}
+}
+
+/**
+ * 期限内の応答 1 本の遅延を加える
+ * @param fwd,bwd 片方向遅延（fwd/bwd のスケッチを確保した面でのみ集計）
+ */
+__attribute__((nonnull(1), hot)) static inline void
+stamp_interval_on_reply(struct stamp_interval_stats *iv,
+			double rtt,
+			double fwd,
+			double bwd,
+			double offset)
+{
+	iv->received++;
+	stamp_welford_update(&iv->rtt, rtt);
+	stamp_welford_update(&iv->offset, offset);
+	stamp_sketch_add(iv->sketch_rtt, rtt);
+	if (iv->sketch_fwd != NULL) {
+		stamp_welford_update(&iv->fwd, fwd);
+		stamp_welford_update(&iv->bwd, bwd);
+		stamp_sketch_add(iv->sketch_fwd, fwd);
+		stamp_sketch_add(iv->sketch_bwd, bwd);
+	}
+}
+
+/**
+ * seq が隣接する 2 本の遅延差 |D(i)-D(i-1)| を加える
+ */
+__attribute__((nonnull(1), hot)) static inline void
+stamp_interval_on_ipdv(struct stamp_interval_stats *iv,
+		       double rtt,
+		       double fwd,
+		       double bwd)
+{
+	stamp_welford_update(&iv->ipdv_rtt, rtt);
+	if (iv->sketch_fwd != NULL) {
+		stamp_welford_update(&iv->ipdv_fwd, fwd);
+		stamp_welford_update(&iv->ipdv_bwd, bwd);
+	}
+}
+
+/**
+ * 区間の喪失率（結果の確定したプローブに対する喪失、確定 0 本なら NAN）
+ * プローブの結果は応答待ちタイムアウトで確定するため、区間の境界付近で
+ * 失われたプローブは次の区間に数えられる。
+ */
+__attribute__((nonnull(1), pure)) static inline double
+stamp_interval_loss_ratio(const struct stamp_interval_stats *iv)
+{
+	return iv->settled > 0 ? (double)iv->lost / (double)iv->settled
+			       : (double)NAN;
+}
+
+#endif // STAMP_INTERVAL_H
@@ -7,7 +7,6 @@
 
 // Linux: SO_TIMESTAMPINGフラグ（カーネルタイムスタンプ用）
 #ifdef __linux__
-#include <poll.h> // poll()
 #include <linux/errqueue.h>
 #include <linux/ethtool.h> // ETHTOOL_GET_TS_INFO, struct ethtool_ts_info
 #include <linux/net_tstamp.h>
@@ -487,103 +486,154 @@ static inline int stamp_configure_hwtstamp_filter(int sockfd,
 	return 0;
 }
 
+// MSG_ERRQUEUE を 1 回の recvmmsg で読む件数
+#define STAMP_TX_TS_BATCH 16U
+
 /**
- * CMSG からTXタイムスタンプを抽出（SCM_TIMESTAMPING: ts[2]>ts[0] 優先）
- * @return 抽出成功時 true
+ * TX タイムスタンプ 1 件
+ * key は SOF_TIMESTAMPING_OPT_ID のキー（ソケットで送った datagram を 0 から
+ * 数えた番号）。OPT_TSONLY のためペイロードは返らず、seq との対応はキーで取る。
  */
-__attribute__((nonnull(1, 2, 3))) static inline bool
-extract_tx_timestamp_from_cmsg(struct msghdr *msg,
-			       uint32_t *ntp_sec,
-			       uint32_t *ntp_frac,
-			       bool ptp_mode)
+struct stamp_tx_timestamp {
+	uint32_t key;
+	uint32_t sec;
+	uint32_t frac;
+};
+
+/**
+ * errqueue のメッセージ 1 件から OPT_ID のキーと TX タイムスタンプを取り出す
+ * @param hw true なら HW（ts[2]）、false なら SW（ts[0]）の時刻を取り出す
+ * @return 両方そろった場合 true（指定した側の時刻が無いメッセージは false）
+ */
+__attribute__((nonnull(1, 2))) static inline bool
+stamp_parse_tx_timestamp(struct msghdr *msg,
+			 struct stamp_tx_timestamp *out,
+			 bool ptp_mode,
+			 bool hw)
 {
-	struct cmsghdr *cmsg;
-	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+	const unsigned int idx = hw ? 2U : 0U;
+	bool have_key = false;
+	bool have_ts = false;
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
 	     cmsg = CMSG_NXTHDR(msg, cmsg)) {
 		if (cmsg->cmsg_level == SOL_SOCKET &&
-		    cmsg->cmsg_type == SCM_TIMESTAMPING) {
-			size_t required_len =
-				CMSG_LEN(3 * sizeof(struct timespec));
-			if ((size_t)cmsg->cmsg_len < required_len) {
-				continue;
-			}
+		    cmsg->cmsg_type == SCM_TIMESTAMPING &&
+		    (size_t)cmsg->cmsg_len >=
+			    CMSG_LEN(3 * sizeof(struct timespec))) {
 			struct timespec ts[3];
-			memcpy(ts,
-			       CMSG_DATA(cmsg),
-			       3 * sizeof(struct timespec));
-
-			if ((ts[2].tv_sec != 0 || ts[2].tv_nsec != 0) &&
-			    ts[2].tv_nsec >= 0 &&
-			    ts[2].tv_nsec < (long)NSEC_PER_SEC) {
-				stamp_timespec_to_stamp(&ts[2],
-							ntp_sec,
-							ntp_frac,
+			memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+			if ((ts[idx].tv_sec != 0 || ts[idx].tv_nsec != 0) &&
+			    ts[idx].tv_nsec >= 0 &&
+			    ts[idx].tv_nsec < (long)NSEC_PER_SEC) {
+				stamp_timespec_to_stamp(&ts[idx],
+							&out->sec,
+							&out->frac,
 							ptp_mode);
-				return true;
+				have_ts = true;
 			}
-			if ((ts[0].tv_sec != 0 || ts[0].tv_nsec != 0) &&
-			    ts[0].tv_nsec >= 0 &&
-			    ts[0].tv_nsec < (long)NSEC_PER_SEC) {
-				stamp_timespec_to_stamp(&ts[0],
-							ntp_sec,
-							ntp_frac,
-							ptp_mode);
-				return true;
+		} else if (((cmsg->cmsg_level == SOL_IP &&
+			     cmsg->cmsg_type == IP_RECVERR) ||
+			    (cmsg->cmsg_level == SOL_IPV6 &&
+			     cmsg->cmsg_type == IPV6_RECVERR)) &&
+			   (size_t)cmsg->cmsg_len >=
+				   CMSG_LEN(sizeof(struct sock_extended_err))) {
+			struct sock_extended_err ee;
+			memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+			if (ee.ee_errno == ENOMSG &&
+			    ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+				out->key = ee.ee_data;
+				have_key = true;
 			}
 		}
 	}
-	return false;
+	return have_key && have_ts;
 }
 
 /**
- * TX ハードウェアタイムスタンプを MSG_ERRQUEUE から取得
- * @param sockfd ソケットディスクリプタ
- * @param ntp_sec NTP秒部分を格納するポインタ
- * @param ntp_frac NTP小数部分を格納するポインタ
- * @return 取得成功時 true、失敗時 false
+ * MSG_ERRQUEUE に溜まった TX タイムスタンプを待たずにまとめて回収する
+ * recvmmsg で STAMP_TX_TS_BATCH 件ずつ errqueue が空になるまで読み、OPT_ID の
+ * キー付きの HW（hw=true）または SW（hw=false）タイムスタンプごとに on_ts を
+ * 呼ぶ。それ以外のメッセージは読み捨てる（errqueue を空にして POLLERR を止める）。
+ * 送信直後に到着を待つことはしない（呼び出し元のイベントループが POLLERR
+ * または応答の照合時に呼ぶ）。
+ * @return 読んだメッセージ数
+ */
+__attribute__((nonnull(4))) static inline unsigned int
+stamp_collect_tx_timestamps(int sockfd,
+			    bool ptp_mode,
+			    bool hw,
+			    void (*on_ts)(const struct stamp_tx_timestamp *ts,
+					  void *ctx),
+			    void *ctx)
+{
+	// SCM_TIMESTAMPING と送信元アドレス付きの IP(V6)_RECVERR が入る大きさ
+	char control[STAMP_TX_TS_BATCH][STAMP_CMSG_BUFSIZE * 2];
+	char data[STAMP_TX_TS_BATCH];
+	struct iovec iov[STAMP_TX_TS_BATCH];
+	struct mmsghdr msgs[STAMP_TX_TS_BATCH];
+	unsigned int total = 0;
+
+	for (;;) {
+		memset(msgs, 0, sizeof(msgs));
+		for (unsigned int i = 0; i < STAMP_TX_TS_BATCH; i++) {
+			iov[i].iov_base = &data[i];
+			iov[i].iov_len = 1;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = control[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+		}
+		int n = recvmmsg(sockfd,
+				 msgs,
+				 STAMP_TX_TS_BATCH,
+				 MSG_ERRQUEUE | MSG_DONTWAIT,
+				 NULL);
+		if (n <= 0) {
+			return total;
+		}
+		for (unsigned int i = 0; i < (unsigned int)n; i++) {
+			struct stamp_tx_timestamp ts;
+			if (stamp_parse_tx_timestamp(&msgs[i].msg_hdr,
+						     &ts,
+						     ptp_mode,
+						     hw)) {
+				on_ts(&ts, ctx);
+			}
+		}
+		total += (unsigned int)n;
+		if ((unsigned int)n < STAMP_TX_TS_BATCH) {
+			return total;
+		}
+	}
+}
+
+/**
+ * MSG_ERRQUEUE に溜まった未読メッセージ（TX タイムスタンプ等）を読み捨てる
+ * poll() は errqueue が空でない間 POLLERR を返し続けるため、送受信を
+ * poll で多重化する呼び出し元が空回りしないよう回収する。
+ * @return 読み捨てた件数
  */
-__attribute__((nonnull(2, 3))) static inline bool
-stamp_retrieve_tx_hw_timestamp(int sockfd,
-			       uint32_t *ntp_sec,
-			       uint32_t *ntp_frac,
-			       bool ptp_mode)
+static inline unsigned int stamp_drain_errqueue(int sockfd)
 {
 	char control[STAMP_CMSG_BUFSIZE];
 	char data;
 	struct msghdr msg;
 	struct iovec iov;
-
-	memset(&msg, 0, sizeof(msg));
-	iov.iov_base = &data;
-	iov.iov_len = sizeof(data);
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
-
-	for (int retry = 0; retry < STAMP_TX_TS_MAX_RETRIES; retry++) {
-		ssize_t n = recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
-		if (n < 0) {
-			if (IS_WOULDBLOCK(errno)) {
-				struct pollfd pfd = {
-					.fd = sockfd,
-					.events = POLLERR,
-				};
-				// poll() の最小タイムアウト 1ms で TX TS の到着を待機
-				(void)poll(&pfd, 1, 1);
-				msg.msg_controllen = sizeof(control);
-				continue;
-			}
-			return false;
+	unsigned int drained = 0;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		iov.iov_base = &data;
+		iov.iov_len = sizeof(data);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			return drained;
 		}
-
-		return extract_tx_timestamp_from_cmsg(&msg,
-						      ntp_sec,
-						      ntp_frac,
-						      ptp_mode);
+		drained++;
 	}
-
-	return false;
 }
 
 // =============================================================================
@@ -751,11 +801,12 @@ static inline int stamp_enable_busy_poll(int sockfd)
  */
 struct stamp_so_timestamping_opts {
 	const char *ifname;   // インターフェース名（NULL なら HW 検出をスキップ）
-	bool want_tx_hw;      // TX HW タイムスタンプを要求（sender=true, reflector=false）
+	bool want_tx_hw;      // TX HW タイムスタンプを要求（sender=true, reflector=-t -c 時のみ）
+	bool tx_keyed;	      // キー付きの SW TX タイムスタンプを要求（reflector の -t）
 	bool require_rx_hw;   // RX HW 非対応時に警告（reflector=true, sender=false）
 	const char *hw_kind;  // 非対応警告の種別文言（"HW" / "RX HW"）
 	const char *rx_label; // RX 有効化メッセージのラベル（"RX (T4)" / "RX (T2)"）
-	const char *tx_label; // TX 有効化メッセージのラベル（"TX (T1)"、reflector は NULL）
+	const char *tx_label; // TX 有効化メッセージのラベル（"TX (T1)" / "TX (T3)"）
 };
 
 /**
@@ -770,9 +821,14 @@ stamp_build_so_timestamping_flags(const struct stamp_hwts_caps *caps,
 				  bool want_tx_hw,
 				  bool *out_tx_hw)
 {
-	int flags = SOF_TIMESTAMPING_RX_SOFTWARE |
-		    SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
 	*out_tx_hw = false;
+	// TX タイムスタンプは MSG_ERRQUEUE を読む側（sender）だけが要求する。
+	// 読まれない errqueue は受信バッファの割り当てを消費し続け、やがて
+	// 連続して届いたパケットが RcvbufErrors で落ちるようになる。
+	if (want_tx_hw) {
+		flags |= SOF_TIMESTAMPING_TX_SOFTWARE;
+	}
 	if (caps != NULL) {
 		if (caps->rx_hw) {
 			flags |= SOF_TIMESTAMPING_RX_HARDWARE |
@@ -836,6 +892,10 @@ stamp_setup_so_timestamping(SOCKET sockfd,
 	int flags = stamp_build_so_timestamping_flags(hw_active ? &caps : NULL,
 						      opts->want_tx_hw,
 						      &tx_enabled);
+	if (opts->tx_keyed) {
+		flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+			 SOF_TIMESTAMPING_OPT_TSONLY;
+	}
 	if (hw_active) {
 		if (caps.rx_hw) {
 			fprintf(stderr,
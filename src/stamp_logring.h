@@ -0,0 +1,239 @@
+// RFC 8762 STAMP - Reflector のパケット単位ログ（出力レベルとロックフリーリング）
+// 反射 1 本ごとのログ行は、出力レベル（無出力・N 本に 1 本・毎秒 N 行まで）で
+// 間引いたうえで、整形前の生データ（seq・送信元・TTL）を複数生産者・単一
+// 消費者のリングへ積む。不正・規定サイズ未満のパケットや応答の送信失敗の警告
+// も同じリングへ積む。整形と stdout / stderr への書き出しは消費者（書き出し
+// スレッド）が行うため、受信ワーカーは stdio のロックやパイプの書き込み待ちで
+// 止まらない。
+// リングが満杯の行は待たずに破棄し、破棄数を数える。
+
+#ifndef STAMP_LOGRING_H
+#define STAMP_LOGRING_H
+
+#include "stamp_net.h" // stamp_parse_u32_range
+
+// リングの既定容量（2 の冪）
+#define STAMP_LOGRING_CAP 4096U
+
+/**
+ * パケット単位ログの出力レベル
+ */
+enum stamp_log_mode {
+	STAMP_LOG_ALL = 0, // 全パケット
+	STAMP_LOG_SILENT,  // 出力しない
+	STAMP_LOG_SAMPLE,  // N 本に 1 本
+	STAMP_LOG_RATE,	   // 毎秒 N 行まで
+};
+
+/**
+ * 出力レベルと引数 N
+ */
+struct stamp_log_policy {
+	enum stamp_log_mode mode;
+	uint32_t n;
+};
+
+/**
+ * 間引きの状態（ワーカーごとに持ち、スレッド間で共有しない）
+ */
+struct stamp_log_limiter {
+	uint64_t seen;	      // STAMP_LOG_SAMPLE: 判定したパケット数
+	uint64_t window_sec;  // STAMP_LOG_RATE: 計数中の秒
+	uint32_t window_used; // STAMP_LOG_RATE: その秒に出力した行数
+};
+
+/**
+ * -L の引数 "all" / "silent" / "sample:N" / "rate:N" を解析する
+ * @return 成功時 0、不正な形式・N が 0 の場合 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_log_policy_parse(const char *arg, struct stamp_log_policy *out)
+{
+	const char *num = NULL;
+	if (strcmp(arg, "all") == 0) {
+		*out = (struct stamp_log_policy){STAMP_LOG_ALL, 0};
+		return 0;
+	}
+	if (strcmp(arg, "silent") == 0) {
+		*out = (struct stamp_log_policy){STAMP_LOG_SILENT, 0};
+		return 0;
+	}
+	if (strncmp(arg, "sample:", 7) == 0) {
+		out->mode = STAMP_LOG_SAMPLE;
+		num = arg + 7;
+	} else if (strncmp(arg, "rate:", 5) == 0) {
+		out->mode = STAMP_LOG_RATE;
+		num = arg + 5;
+	} else {
+		return -1;
+	}
+	uint32_t n;
+	if (stamp_parse_u32_range(num, &n, UINT32_MAX) != 0) {
+		return -1;
+	}
+	out->n = n;
+	return 0;
+}
+
+/**
+ * このパケットのログ行を出力するか判定する
+ * @param now_sec 現在時刻（秒。STAMP_LOG_RATE のときのみ参照）
+ */
+__attribute__((nonnull(1, 2), hot)) static inline bool
+stamp_log_should_emit(const struct stamp_log_policy *policy,
+		      struct stamp_log_limiter *lim,
+		      uint64_t now_sec)
+{
+	switch (policy->mode) {
+	case STAMP_LOG_ALL:
+		return true;
+	case STAMP_LOG_SILENT:
+		return false;
+	case STAMP_LOG_SAMPLE:
+		return lim->seen++ % policy->n == 0;
+	case STAMP_LOG_RATE:
+		if (now_sec != lim->window_sec) {
+			lim->window_sec = now_sec;
+			lim->window_used = 0;
+		}
+		if (lim->window_used >= policy->n) {
+			return false;
+		}
+		lim->window_used++;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * ログ行の種類
+ */
+enum stamp_log_kind {
+	STAMP_LOG_REFLECTED = 0, // 反射したパケット（stdout、-L で間引く）
+	STAMP_LOG_INVALID,	 // 不正ペイロードで破棄（stderr）
+	STAMP_LOG_UNDERSIZED,	 // 規定サイズ未満をパディング（stderr）
+	STAMP_LOG_SEND_FAILED,	 // 応答の送信失敗（stderr）
+};
+
+/**
+ * ログ 1 行分の生データ（整形は消費者側で行う）
+ */
+struct stamp_log_record {
+	struct sockaddr_storage addr; // 送信元（SEND_FAILED では宛先）
+	enum stamp_log_kind kind;
+	uint32_t seq;	  // REFLECTED: sender_seq_num（ホストバイトオーダー）
+	int32_t len;	  // 受信バイト数（SEND_FAILED では送信バイト数）
+	int32_t err;	  // SEND_FAILED: エラー番号
+	uint32_t addrlen; // SEND_FAILED: 宛先アドレス長
+	uint8_t ttl;	  // REFLECTED: TTL / Hop Limit
+};
+
+struct stamp_logring_slot {
+	uint64_t turn; // このスロットに次に書ける/読める位置（Vyukov 方式）
+	struct stamp_log_record rec;
+};
+
+/**
+ * 有界の複数生産者・単一消費者リング
+ * 各スロットの turn が pos なら空き（生産者が書ける）、pos + 1 なら書き込み
+ * 済み（消費者が読める）。生産者は head を CAS で進めて位置を確保する。
+ */
+struct stamp_logring {
+	struct stamp_logring_slot *slots;
+	uint32_t mask;
+	uint64_t head __attribute__((aligned(64))); // 生産者が共有
+	uint64_t tail __attribute__((aligned(64))); // 消費者のみ
+	uint64_t dropped;			    // 満杯で破棄した行数
+};
+
+/**
+ * リングを確保する
+ * @param cap 容量（2 の冪）
+ * @return 成功時 0、容量が不正または確保失敗時 -1
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_logring_init(struct stamp_logring *ring, uint32_t cap)
+{
+	memset(ring, 0, sizeof(*ring));
+	if (cap == 0 || (cap & (cap - 1U)) != 0) {
+		return -1;
+	}
+	ring->slots = calloc(cap, sizeof(*ring->slots));
+	if (ring->slots == NULL) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < cap; i++) {
+		ring->slots[i].turn = i;
+	}
+	ring->mask = cap - 1U;
+	return 0;
+}
+
+/**
+ * リングの解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_logring_free(struct stamp_logring *ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+	ring->mask = 0;
+}
+
+/**
+ * 1 行を積む（複数スレッドから同時に呼んでよい。待たない）
+ * @return 積めた場合 true、満杯で破棄した場合 false
+ */
+__attribute__((nonnull(1, 2), hot)) static inline bool
+stamp_logring_push(struct stamp_logring *ring, const struct stamp_log_record *rec)
+{
+	uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	struct stamp_logring_slot *slot;
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		uint64_t turn = __atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE);
+		int64_t diff = (int64_t)(turn - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head,
+							&pos,
+							pos + 1U,
+							true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// 消費者が 1 周前の行をまだ読んでいない
+			__atomic_fetch_add(&ring->dropped, 1U, __ATOMIC_RELAXED);
+			return false;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+	slot->rec = *rec;
+	__atomic_store_n(&slot->turn, pos + 1U, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * 1 行を取り出す（単一の消費者スレッドからのみ呼ぶ）
+ * @return 取り出せた場合 true、空の場合 false
+ */
+__attribute__((nonnull(1, 2))) static inline bool
+stamp_logring_pop(struct stamp_logring *ring, struct stamp_log_record *out)
+{
+	struct stamp_logring_slot *slot = &ring->slots[ring->tail & ring->mask];
+	uint64_t turn = __atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE);
+	if (turn != ring->tail + 1U) {
+		return false;
+	}
+	*out = slot->rec;
+	__atomic_store_n(&slot->turn,
+			 ring->tail + (uint64_t)ring->mask + 1U,
+			 __ATOMIC_RELEASE);
+	ring->tail++;
+	return true;
+}
+
+#endif // STAMP_LOGRING_H
@@ -0,0 +1,161 @@
+// RFC 8762 STAMP - Sender の喪失区間の指標（RFC 3357）と Gilbert-Elliott モデル
+// 結果の確定したプローブ（期限内に受信 / 喪失）を seq 順に 1 本ずつ受け取り、
+// 喪失区間（連続して失われたプローブの列）の数と長さ、区間の間に受信した
+// 本数、Gilbert-Elliott モデルの推定に使う遷移・連続の計数を更新する。
+// 状態は固定長（セッションあたり数十バイト）で、1 本あたり O(1)。プローブ
+// ごとの結果は保持しないため、何日続く計測でもメモリは増えない。
+// seq 順への並べ替えと結果の確定は応答待ち表（stamp_inflight_settle()）が行う。
+
+#ifndef STAMP_LOSS_H
+#define STAMP_LOSS_H
+
+#include "stamp_time.h" // stamp_welford
+
+/**
+ * 喪失パターンの集計（セッションごと、ゼロ初期化で使える）
+ */
+struct stamp_loss_pattern {
+	uint64_t packets;      // 結果の確定したプローブ数
+	uint64_t lost;	       // うち喪失
+	uint64_t lost_pairs;   // 連続する 2 本がともに喪失
+	uint64_t lost_ends;    // 1 本おいた 2 本がともに喪失（間は問わない）
+	uint64_t lost_triples; // 連続する 3 本がすべて喪失
+	uint64_t bad_to_good;  // 喪失 → 受信の遷移
+	uint64_t good_to_bad;  // 受信 → 喪失の遷移
+	uint64_t cur_len;      // 継続中の喪失区間の長さ（0=区間外）
+	uint64_t cur_gap;      // 直前の喪失区間の後に受信した本数
+	bool has_period;       // 喪失区間を 1 つ以上観測したか
+	uint8_t history;       // 直近 2 本（bit0=直前、bit1=2 本前、1=喪失）
+	struct stamp_welford period_len; // 終了した喪失区間の長さ
+	struct stamp_welford period_gap; // 喪失区間の間に受信した本数
+};
+
+/**
+ * Gilbert-Elliott モデルの推定値
+ * 良状態では失われず、悪状態では loss_bad の確率で失われる（Gilbert モデル）。
+ */
+struct stamp_ge_fit {
+	double p;	 // 良 → 悪の遷移確率
+	double r;	 // 悪 → 良の遷移確率
+	double loss_bad; // 悪状態での喪失確率（1 − h）
+};
+
+/**
+ * 結果の確定したプローブ 1 本を seq 順に加える
+ * @param lost 喪失（タイムアウト・追い出し・遅着）なら true
+ */
+__attribute__((nonnull(1), hot)) static inline void
+stamp_loss_add(struct stamp_loss_pattern *lp, bool lost)
+{
+	bool prev = lp->packets >= 1 && (lp->history & 1U) != 0;
+	bool prev2 = lp->packets >= 2 && (lp->history & 2U) != 0;
+	if (lost) {
+		lp->lost++;
+		if (prev) {
+			lp->lost_pairs++;
+		}
+		if (prev2) {
+			lp->lost_ends++;
+			if (prev) {
+				lp->lost_triples++;
+			}
+		}
+		if (lp->cur_len == 0) {
+			if (lp->packets >= 1) {
+				lp->good_to_bad++;
+			}
+			if (lp->has_period) {
+				stamp_welford_update(&lp->period_gap,
+						     (double)lp->cur_gap);
+			}
+			lp->has_period = true;
+		}
+		lp->cur_len++;
+	} else {
+		if (lp->cur_len > 0) {
+			lp->bad_to_good++;
+			stamp_welford_update(&lp->period_len, (double)lp->cur_len);
+			lp->cur_len = 0;
+			lp->cur_gap = 0;
+		}
+		lp->cur_gap++;
+	}
+	uint32_t bit = lost ? 1U : 0U;
+	lp->history = (uint8_t)((((uint32_t)lp->history << 1) | bit) & 3U);
+	lp->packets++;
+}
+
+/**
+ * 継続中の喪失区間を終了した区間として数える（計測終了時）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_loss_close(struct stamp_loss_pattern *lp)
+{
+	if (lp->cur_len > 0) {
+		stamp_welford_update(&lp->period_len, (double)lp->cur_len);
+		lp->cur_len = 0;
+		lp->cur_gap = 0;
+	}
+}
+
+/**
+ * 喪失区間の数（継続中の区間を含む）
+ */
+__attribute__((nonnull(1), pure)) static inline uint64_t
+stamp_loss_periods(const struct stamp_loss_pattern *lp)
+{
+	return stamp_welford_count(&lp->period_len) + (lp->cur_len > 0 ? 1U : 0U);
+}
+
+/**
+ * Gilbert-Elliott モデルを当てはめる
+ * a = P(喪失)、b = P(喪失 | 直前が喪失)、c = P(間が喪失 | 両端が喪失) から
+ * 3 パラメータの Gilbert モデルをモーメント法で解く（Hasslinger & Hohlfeld）。
+ * 解が確率として成り立たない（標本が少ない・喪失が独立に近い）場合は、
+ * 悪状態で必ず失われる単純 Gilbert モデル（遷移の頻度）に落とす。
+ * 喪失が無い場合は p = 0 で r・loss_bad は NAN、確定 2 本未満は全て NAN。
+ * 喪失が最後の 1 本だけの場合など、遷移の起点が無い確率も NAN。
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_loss_ge_fit(const struct stamp_loss_pattern *lp, struct stamp_ge_fit *out)
+{
+	out->p = (double)NAN;
+	out->r = (double)NAN;
+	out->loss_bad = (double)NAN;
+	if (lp->packets < 2) {
+		return;
+	}
+	// 後続のある喪失（遷移の起点）と受信の本数
+	uint64_t from_bad = lp->lost_pairs + lp->bad_to_good;
+	uint64_t from_good = lp->packets - 1U - from_bad;
+	if (lp->lost == 0) {
+		out->p = 0.0;
+		return;
+	}
+
+	double a = (double)lp->lost / (double)lp->packets;
+	double b = from_bad > 0 ? (double)lp->lost_pairs / (double)from_bad : 0.0;
+	if (lp->lost_ends > 0) {
+		double c = (double)lp->lost_triples / (double)lp->lost_ends;
+		double den = 2.0 * a * c - b * (a + c);
+		double q = den != 0.0 ? (a * c - b * b) / den : 0.0;
+		if (q > a && q <= 1.0) {
+			double r = 1.0 - b / q;
+			double p = a * r / (q - a);
+			if (r > 0.0 && r <= 1.0 && p > 0.0 && p <= 1.0) {
+				out->p = p;
+				out->r = r;
+				out->loss_bad = q;
+				return;
+			}
+		}
+	}
+
+	out->p = from_good > 0 ? (double)lp->good_to_bad / (double)from_good
+			       : (double)NAN;
+	out->r = from_bad > 0 ? (double)lp->bad_to_good / (double)from_bad
+			      : (double)NAN;
+	out->loss_bad = 1.0;
+}
+
+#endif // STAMP_LOSS_H
@@ -0,0 +1,229 @@
+// RFC 8762 STAMP - recvmmsg/sendmmsg によるバッチ送受信 plumbing（Linux 専用）
+// 1 回の recvmmsg で最大 N 本を受信し、各パケット固有の制御メッセージ
+// バッファから T2（SCM_TIMESTAMPING 等）と TTL/Hop Limit を個別に抽出する。
+// 応答は送信キューへ積み、sendmmsg でまとめて返送する。
+// T3 の打刻と部分送信時の再送ポリシーは呼び出し元（reflector）に委ねる。
+
+#ifndef STAMP_MMSG_H
+#define STAMP_MMSG_H
+
+#include "stamp_recv.h" // stamp_extract_ttl_from_cmsg, stamp_extract_kernel_timestamp_linux
+
+#ifdef __linux__
+
+// 1 バッチあたりの最大パケット数（-b の上限）
+#define STAMP_MMSG_MAX_BATCH 64
+
+/**
+ * バッチ内 1 パケット分の受信メタデータ
+ * control は CMSG_FIRSTHDR が返す cmsghdr の境界に整列させる。
+ */
+struct stamp_mmsg_slot {
+	struct sockaddr_storage addr;
+	char control[STAMP_CMSG_BUFSIZE]
+		__attribute__((aligned(__alignof__(struct cmsghdr))));
+	uint32_t t2_sec;
+	uint32_t t2_frac;
+	int len;
+	uint8_t ttl;
+};
+
+/**
+ * recvmmsg/sendmmsg 用の事前確保バッファ群
+ * ホットパスで確保を行わないよう、起動時に stamp_mmsg_batch_init() で一括確保する。
+ */
+struct stamp_mmsg_batch {
+	unsigned int cap;
+	unsigned int rx_count;
+	unsigned int tx_count;
+	uint8_t *bufs; // cap * STAMP_MAX_PACKET_SIZE（スロット i のペイロード）
+	struct stamp_mmsg_slot *slots;
+	struct mmsghdr *rx_msgs;
+	struct iovec *rx_iov;
+	struct mmsghdr *tx_msgs;
+	struct iovec *tx_iov;
+	unsigned int *tx_slot; // 送信キュー位置 → スロット番号
+};
+
+/**
+ * バッチバッファの解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((cold)) static inline void
+stamp_mmsg_batch_free(struct stamp_mmsg_batch *batch)
+{
+	free(batch->bufs);
+	free(batch->slots);
+	free(batch->rx_msgs);
+	free(batch->rx_iov);
+	free(batch->tx_msgs);
+	free(batch->tx_iov);
+	free(batch->tx_slot);
+	memset(batch, 0, sizeof(*batch));
+}
+
+/**
+ * バッチバッファの確保と受信用 mmsghdr の固定部分の設定
+ * @param cap バッチサイズ（1..STAMP_MMSG_MAX_BATCH）
+ * @return 成功時0、エラー時-1
+ */
+__attribute__((cold)) static inline int
+stamp_mmsg_batch_init(struct stamp_mmsg_batch *batch, unsigned int cap)
+{
+	memset(batch, 0, sizeof(*batch));
+	if (cap == 0 || cap > STAMP_MMSG_MAX_BATCH) {
+		return -1;
+	}
+
+	batch->bufs = calloc(cap, STAMP_MAX_PACKET_SIZE);
+	batch->slots = calloc(cap, sizeof(*batch->slots));
+	batch->rx_msgs = calloc(cap, sizeof(*batch->rx_msgs));
+	batch->rx_iov = calloc(cap, sizeof(*batch->rx_iov));
+	batch->tx_msgs = calloc(cap, sizeof(*batch->tx_msgs));
+	batch->tx_iov = calloc(cap, sizeof(*batch->tx_iov));
+	batch->tx_slot = calloc(cap, sizeof(*batch->tx_slot));
+	if (!batch->bufs || !batch->slots || !batch->rx_msgs ||
+	    !batch->rx_iov || !batch->tx_msgs || !batch->tx_iov ||
+	    !batch->tx_slot) {
+		stamp_mmsg_batch_free(batch);
+		return -1;
+	}
+	batch->cap = cap;
+
+	for (unsigned int i = 0; i < cap; i++) {
+		struct msghdr *hdr = &batch->rx_msgs[i].msg_hdr;
+		batch->rx_iov[i].iov_base =
+			batch->bufs + (size_t)i * STAMP_MAX_PACKET_SIZE;
+		batch->rx_iov[i].iov_len = STAMP_MAX_PACKET_SIZE;
+		hdr->msg_name = &batch->slots[i].addr;
+		hdr->msg_iov = &batch->rx_iov[i];
+		hdr->msg_iovlen = 1;
+		hdr->msg_control = batch->slots[i].control;
+	}
+	return 0;
+}
+
+/**
+ * スロット i のペイロードバッファ
+ */
+__attribute__((pure)) static inline uint8_t *
+stamp_mmsg_slot_buf(const struct stamp_mmsg_batch *batch, unsigned int i)
+{
+	return batch->bufs + (size_t)i * STAMP_MAX_PACKET_SIZE;
+}
+
+/**
+ * recvmmsg によるバッチ受信（送信キューはリセットされる）
+ *
+ * MSG_WAITFORONE により 1 本目はソケットの SO_RCVTIMEO に従ってブロックし、
+ * 以降は受信キューに溜まっている分だけを非ブロッキングで回収する。
+ * 各スロットの T2 はそのパケット自身の制御メッセージから抽出し、カーネル
+ * タイムスタンプが無い場合のみ受信直後のソフトウェア時刻で代替する。
+ * @param ptp_mode true=PTP形式, false=NTP形式
+ * @return 受信本数、エラー時 -1（errno はそのまま残る）
+ */
+__attribute__((hot)) static inline int stamp_mmsg_recv(
+	SOCKET sockfd,
+	struct stamp_mmsg_batch *batch,
+	bool ptp_mode)
+{
+	batch->rx_count = 0;
+	batch->tx_count = 0;
+
+	// カーネルが namelen/controllen を書き換えるため毎回再設定する
+	for (unsigned int i = 0; i < batch->cap; i++) {
+		struct msghdr *hdr = &batch->rx_msgs[i].msg_hdr;
+		hdr->msg_namelen = sizeof(batch->slots[i].addr);
+		hdr->msg_controllen = sizeof(batch->slots[i].control);
+		hdr->msg_flags = 0;
+	}
+
+	int n = recvmmsg(sockfd, batch->rx_msgs, batch->cap, MSG_WAITFORONE, NULL);
+	if (unlikely(n < 0)) {
+		return -1;
+	}
+
+	bool have_fallback = false;
+	uint32_t fb_sec = 0;
+	uint32_t fb_frac = 0;
+	for (int i = 0; i < n; i++) {
+		struct stamp_mmsg_slot *slot = &batch->slots[i];
+		struct msghdr *hdr = &batch->rx_msgs[i].msg_hdr;
+
+		slot->len = (int)batch->rx_msgs[i].msg_len;
+		slot->ttl = 0;
+		stamp_extract_ttl_from_cmsg(hdr, &slot->ttl);
+
+		if (stamp_extract_kernel_timestamp_linux(hdr,
+							 &slot->t2_sec,
+							 &slot->t2_frac,
+							 ptp_mode)) {
+			continue;
+		}
+		if (!have_fallback) {
+			if (unlikely(stamp_get_timestamp(&fb_sec,
+							 &fb_frac,
+							 ptp_mode) != 0)) {
+				fprintf(stderr,
+					"Warning: Failed to get fallback "
+					"receive timestamp\n");
+				return -1;
+			}
+			have_fallback = true;
+		}
+		slot->t2_sec = fb_sec;
+		slot->t2_frac = fb_frac;
+	}
+
+	batch->rx_count = (unsigned int)n;
+	return n;
+}
+
+/**
+ * スロット i のペイロード（応答パケット構築済み）を送信キューへ積む
+ * 宛先は受信時の送信元アドレス。
+ * @param send_len 送信バイト数
+ */
+__attribute__((hot)) static inline void stamp_mmsg_queue_reply(
+	struct stamp_mmsg_batch *batch,
+	unsigned int slot_index,
+	int send_len)
+{
+	unsigned int t = batch->tx_count;
+	struct msghdr *hdr = &batch->tx_msgs[t].msg_hdr;
+
+	batch->tx_iov[t].iov_base = stamp_mmsg_slot_buf(batch, slot_index);
+	batch->tx_iov[t].iov_len = (size_t)send_len;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->msg_name = &batch->slots[slot_index].addr;
+	hdr->msg_namelen = batch->rx_msgs[slot_index].msg_hdr.msg_namelen;
+	hdr->msg_iov = &batch->tx_iov[t];
+	hdr->msg_iovlen = 1;
+	batch->tx_slot[t] = slot_index;
+	batch->tx_count = t + 1;
+}
+
+/**
+ * 送信キューの first 番目以降を sendmmsg で送信
+ *
+ * sendmmsg は途中のパケットで失敗すると、それまでに送れた本数を返す。
+ * 失敗したパケットは次の呼び出しで -1 として報告されるため、呼び出し元は
+ * 戻り値に応じて first を進めて再呼び出しする。
+ * @return 送信できた本数、先頭パケットで失敗した場合 -1
+ */
+__attribute__((hot)) static inline int stamp_mmsg_send(
+	SOCKET sockfd,
+	struct stamp_mmsg_batch *batch,
+	unsigned int first)
+{
+	if (first >= batch->tx_count) {
+		return 0;
+	}
+	return sendmmsg(sockfd,
+			&batch->tx_msgs[first],
+			batch->tx_count - first,
+			0);
+}
+
+#endif // __linux__
+
+#endif // STAMP_MMSG_H
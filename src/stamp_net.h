@@ -10,16 +10,16 @@
 #define STAMP_ADDR_PORT_BUFSIZE (INET6_ADDRSTRLEN + 16)
 
 /**
- * 正の整数文字列を uint32_t に解析（1..max）。
- * 0・範囲外・非数・余分な文字を拒否する。先頭の空白・符号も拒否するため、
+ * 非負の整数文字列を uint32_t に解析（0..max）。
+ * 範囲外・非数・余分な文字を拒否する。先頭の空白・符号も拒否するため、
  * 先頭文字が 10 進数字であることを明示的に検査する（strtoull は空白・'+' を
- * 黙って読み飛ばすため）。
+ * 黙って読み飛ばすため）。0 が「無効」を意味するオプション向け。
  * @param arg 数値文字列
  * @param out パース結果
  * @param max 許容する最大値（含む）
  * @return 成功時 0、エラー時 -1
  */
-__attribute__((nonnull(1, 2), cold)) static inline int stamp_parse_u32_range(
+__attribute__((nonnull(1, 2), cold)) static inline int stamp_parse_u32_or_zero(
 	const char *restrict arg,
 	uint32_t *restrict out,
 	uint32_t max)
@@ -33,8 +33,7 @@ __attribute__((nonnull(1, 2), cold)) static inline int stamp_parse_u32_range(
 	errno = 0;
 	unsigned long long value = strtoull(arg, &end, 10);
 
-	if (errno == ERANGE || (end && *end != '\0') || value == 0 ||
-	    value > max) {
+	if (errno == ERANGE || (end && *end != '\0') || value > max) {
 		return -1;
 	}
 
@@ -42,6 +41,27 @@ __attribute__((nonnull(1, 2), cold)) static inline int stamp_parse_u32_range(
 	return 0;
 }
 
+/**
+ * 正の整数文字列を uint32_t に解析（1..max）。
+ * 0 を拒否する以外は stamp_parse_u32_or_zero() と同じ。
+ * @param arg 数値文字列
+ * @param out パース結果
+ * @param max 許容する最大値（含む）
+ * @return 成功時 0、エラー時 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int stamp_parse_u32_range(
+	const char *restrict arg,
+	uint32_t *restrict out,
+	uint32_t max)
+{
+	uint32_t value;
+	if (stamp_parse_u32_or_zero(arg, &value, max) != 0 || value == 0) {
+		return -1;
+	}
+	*out = value;
+	return 0;
+}
+
 /**
  * ポート番号のパース
  * @param arg ポート番号文字列
@@ -60,6 +80,62 @@ __attribute__((nonnull(1, 2), cold)) static inline int stamp_parse_port(
 	return 0;
 }
 
+/**
+ * ターゲット指定 "host"、"host:port"、"[IPv6]:port"、"IPv6" を解析する。
+ * コロンを 2 つ以上含み角括弧で囲まれていない文字列は IPv6 リテラルとみなし、
+ * ポートは default_port とする。
+ * @param arg ターゲット文字列
+ * @param host ホスト部の格納先
+ * @param hostlen host のバッファ長
+ * @param port ポートの格納先（省略時は default_port）
+ * @return 成功時 0、空のホスト・不正なポート・長すぎるホストは -1
+ */
+__attribute__((nonnull(1, 2, 4), cold)) static inline int
+stamp_parse_target(const char *arg,
+		   char *host,
+		   size_t hostlen,
+		   uint16_t *port,
+		   uint16_t default_port)
+{
+	const char *begin = arg;
+	const char *end;
+	const char *port_str = NULL;
+
+	if (arg[0] == '[') {
+		begin = arg + 1;
+		end = strchr(begin, ']');
+		if (end == NULL) {
+			return -1;
+		}
+		if (end[1] == ':') {
+			port_str = end + 2;
+		} else if (end[1] != '\0') {
+			return -1;
+		}
+	} else {
+		const char *colon = strchr(arg, ':');
+		if (colon != NULL && strchr(colon + 1, ':') == NULL) {
+			end = colon;
+			port_str = colon + 1;
+		} else {
+			end = arg + strlen(arg);
+		}
+	}
+
+	size_t len = (size_t)(end - begin);
+	if (len == 0 || len >= hostlen) {
+		return -1;
+	}
+	memcpy(host, begin, len);
+	host[len] = '\0';
+
+	*port = default_port;
+	if (port_str != NULL && stamp_parse_port(port_str, port) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
 /**
  * アドレスファミリを表示用文字列に変換する。
  * @param family AF_INET / AF_INET6
@@ -0,0 +1,337 @@
+// RFC 8762 STAMP - Sender の毎パケット記録（-r）
+// 期限内に受信した応答ごとに T1〜T4・遅延・TTL・Error Estimate を NDJSON
+// または CSV の 1 行として記録する。計測ループは整形前の生データを単一
+// 生産者・単一消費者のリングへ積むだけで、整形はまとめて大きな出力バッファへ
+// 行い、バッファ単位で書き出す（書き出し側が 1 フィールドずつ stdio を呼ばない）。
+// リングが満杯の行は待たずに破棄し、破棄数を数える（送信のタイミングを乱さない）。
+// 書き出し側はスレッド（POSIX）または計測ループ自身（Windows）。
+
+#ifndef STAMP_PKTLOG_H
+#define STAMP_PKTLOG_H
+
+#include "stamp_report.h" // STAMP_REPORT_STR_MAX
+#include "stamp_time.h"
+
+// リングの容量（行数、2 の冪）。10 万行/秒で約 160 ms 分
+#define STAMP_PKTLOG_CAP 16384U
+// 出力バッファの大きさと、これ以上たまったら書き出す量
+#define STAMP_PKTLOG_BUF_SIZE (1U << 20)
+#define STAMP_PKTLOG_FLUSH    (256U * 1024U)
+// 1 行の最大長（JSON エスケープした target を含む）
+#define STAMP_PKTLOG_LINE_MAX (STAMP_REPORT_STR_MAX * 6U + 512U)
+// 書き出し側がリングを見に行く間隔（ns）と、少量でも書き出す間隔（ns）
+#define STAMP_PKTLOG_IDLE_NS  1000000L
+#define STAMP_PKTLOG_LAZY_NS  100000000ULL
+
+/**
+ * 記録の形式
+ */
+enum stamp_pktlog_format {
+	STAMP_PKTLOG_NDJSON = 0, // 1 行 1 オブジェクト
+	STAMP_PKTLOG_CSV,	 // ヘッダ 1 行 + 1 行 1 応答
+};
+
+/**
+ * 応答 1 本分の生データ（整形は書き出し側で行う）
+ */
+struct stamp_pkt_record {
+	uint64_t t_ns[4];  // T1〜T4（UNIX 時刻、ns）
+	int64_t fwd_ns;	   // T2 − T1
+	int64_t bwd_ns;	   // T4 − T3
+	int64_t rtt_ns;	   // fwd + bwd
+	int64_t offset_x2; // (T2 − T1) + (T3 − T4)
+	uint32_t seq;	   // sender_seq_num（ホストバイトオーダー）
+	uint16_t sender_ee;
+	uint16_t reflector_ee;
+	uint16_t session; // セッションの番号（target の索引）
+	uint8_t ttl;	  // Reflector が観測した Session-Sender TTL
+};
+
+/**
+ * 単一生産者・単一消費者のリングと出力バッファ
+ * stamp_pktlog_init() で確保し stamp_pktlog_free() で解放する。
+ */
+struct stamp_pktlog {
+	struct stamp_pkt_record *slots;
+	uint32_t mask;
+	uint64_t head __attribute__((aligned(64))); // 生産者のみが書く
+	uint64_t tail __attribute__((aligned(64))); // 消費者のみが書く
+	uint64_t dropped;			    // 満杯で破棄した行数
+	// 以下は消費者のみが触る
+	FILE *fp;
+	enum stamp_pktlog_format format;
+	char *buf;
+	size_t len;
+	uint64_t written;  // 整形した行数
+	bool write_failed; // 書き込みエラーが起きた（以降は捨てる）
+	uint64_t last_flush_ns;
+};
+
+/**
+ * リングと出力バッファを確保する（fp の所有権は呼び出し元に残る）
+ * @return 成功時 0、確保失敗時 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_pktlog_init(struct stamp_pktlog *pl,
+		  FILE *fp,
+		  enum stamp_pktlog_format format)
+{
+	memset(pl, 0, sizeof(*pl));
+	pl->slots = calloc(STAMP_PKTLOG_CAP, sizeof(*pl->slots));
+	pl->buf = malloc(STAMP_PKTLOG_BUF_SIZE);
+	if (pl->slots == NULL || pl->buf == NULL) {
+		free(pl->slots);
+		free(pl->buf);
+		memset(pl, 0, sizeof(*pl));
+		return -1;
+	}
+	pl->mask = STAMP_PKTLOG_CAP - 1U;
+	pl->fp = fp;
+	pl->format = format;
+	return 0;
+}
+
+/**
+ * 解放する（未確保・二重呼び出しでも安全。書き出し残りは捨てる）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_pktlog_free(struct stamp_pktlog *pl)
+{
+	free(pl->slots);
+	free(pl->buf);
+	pl->slots = NULL;
+	pl->buf = NULL;
+	pl->len = 0;
+}
+
+/**
+ * 1 行を積む（生産者のみ。待たない）
+ * @return 積めた場合 true、満杯で破棄した場合 false
+ */
+__attribute__((nonnull(1, 2), hot)) static inline bool
+stamp_pktlog_push(struct stamp_pktlog *pl, const struct stamp_pkt_record *rec)
+{
+	uint64_t head = pl->head;
+	if (head - __atomic_load_n(&pl->tail, __ATOMIC_ACQUIRE) > pl->mask) {
+		__atomic_fetch_add(&pl->dropped, 1U, __ATOMIC_RELAXED);
+		return false;
+	}
+	pl->slots[head & pl->mask] = *rec;
+	__atomic_store_n(&pl->head, head + 1U, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * 1 行を取り出す（消費者のみ）
+ * @return 取り出せた場合 true、空の場合 false
+ */
+__attribute__((nonnull(1, 2))) static inline bool
+stamp_pktlog_pop(struct stamp_pktlog *pl, struct stamp_pkt_record *out)
+{
+	uint64_t tail = pl->tail;
+	if (tail == __atomic_load_n(&pl->head, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+	*out = pl->slots[tail & pl->mask];
+	__atomic_store_n(&pl->tail, tail + 1U, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Error Estimate が表す誤差（ns、RFC 4656 Section 4.1.2）
+ * Multiplier × 2^(Scale − 32) 秒。u64 に収まらない場合は UINT64_MAX。
+ */
+__attribute__((const)) static inline uint64_t
+stamp_error_estimate_ns(uint16_t ee)
+{
+	uint64_t mult = ee & ERROR_ESTIMATE_MULT_MASK;
+	uint32_t scale = (uint32_t)(ee & ERROR_ESTIMATE_SCALE_MASK) >> 8;
+	if (mult != 0 && scale > 0 &&
+	    mult > (UINT64_MAX / NSEC_PER_SEC) >> scale) {
+		return UINT64_MAX;
+	}
+	// 2^-32 秒単位の誤差を ns へ（切り上げ、誤差を小さく見せない）
+	uint64_t units = (mult * NSEC_PER_SEC) << scale;
+	return (units >> 32) + ((units & 0xFFFFFFFFU) != 0 ? 1U : 0U);
+}
+
+/**
+ * タイムスタンプを UNIX 時刻（ns）へ変換する（NTP・PTP とも 1900 年起点の秒）
+ */
+__attribute__((const)) static inline uint64_t
+stamp_wire_ts_unix_ns(struct stamp_wire_ts ts)
+{
+	uint64_t frac_ns = ts.ptp ? ts.frac : stamp_ntp_frac_to_nsec(ts.frac);
+	return ((uint64_t)ts.sec - NTP_OFFSET) * NSEC_PER_SEC + frac_ns;
+}
+
+/**
+ * 応答 1 本の T1〜T4 と遅延から記録を組み立てる（seq・session・ttl は呼び出し元）
+ */
+__attribute__((nonnull(1, 2, 3, 4, 5, 6), hot)) static inline void
+stamp_pkt_record_fill(struct stamp_pkt_record *rec,
+		      const struct stamp_wire_ts *t1,
+		      const struct stamp_wire_ts *t2,
+		      const struct stamp_wire_ts *t3,
+		      const struct stamp_wire_ts *t4,
+		      const struct stamp_delays_ns *d,
+		      uint16_t sender_ee,
+		      uint16_t reflector_ee)
+{
+	rec->t_ns[0] = stamp_wire_ts_unix_ns(*t1);
+	rec->t_ns[1] = stamp_wire_ts_unix_ns(*t2);
+	rec->t_ns[2] = stamp_wire_ts_unix_ns(*t3);
+	rec->t_ns[3] = stamp_wire_ts_unix_ns(*t4);
+	rec->fwd_ns = d->forward;
+	rec->bwd_ns = d->backward;
+	rec->rtt_ns = d->rtt;
+	rec->offset_x2 = d->offset_x2;
+	rec->sender_ee = sender_ee;
+	rec->reflector_ee = reflector_ee;
+}
+
+/**
+ * CSV のヘッダ行
+ */
+#define STAMP_PKTLOG_CSV_HEADER                                               \
+	"seq,target,t1_ns,t2_ns,t3_ns,t4_ns,fwd_ns,bwd_ns,rtt_ns,offset_ns,"  \
+	"ttl,sender_ee,reflector_ee,sender_err_ns,reflector_err_ns\n"
+
+/**
+ * 記録 1 行を整形する
+ * offset_ns はオフセットの 2 倍を 0 方向へ丸めて半分にした値。
+ * @param target 計測対象 "addr:port"（NDJSON では JSON エスケープ済み）
+ * @param out 出力先（STAMP_PKTLOG_LINE_MAX 以上）
+ * @return 書いたバイト数（終端の NUL を除く）
+ */
+__attribute__((nonnull(1, 2, 3))) static inline size_t
+stamp_pktlog_format_line(const struct stamp_pkt_record *rec,
+			 const char *target,
+			 char *out,
+			 enum stamp_pktlog_format format)
+{
+	int n;
+	if (format == STAMP_PKTLOG_CSV) {
+		n = snprintf(out,
+			     STAMP_PKTLOG_LINE_MAX,
+			     "%" PRIu32 ",%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+			     ",%" PRIu64 ",%" PRId64 ",%" PRId64 ",%" PRId64
+			     ",%" PRId64 ",%u,%u,%u,%" PRIu64 ",%" PRIu64 "\n",
+			     rec->seq,
+			     target,
+			     rec->t_ns[0],
+			     rec->t_ns[1],
+			     rec->t_ns[2],
+			     rec->t_ns[3],
+			     rec->fwd_ns,
+			     rec->bwd_ns,
+			     rec->rtt_ns,
+			     rec->offset_x2 / 2,
+			     (unsigned int)rec->ttl,
+			     (unsigned int)rec->sender_ee,
+			     (unsigned int)rec->reflector_ee,
+			     stamp_error_estimate_ns(rec->sender_ee),
+			     stamp_error_estimate_ns(rec->reflector_ee));
+	} else {
+		n = snprintf(out,
+			     STAMP_PKTLOG_LINE_MAX,
+			     "{\"seq\":%" PRIu32 ",\"target\":\"%s\""
+			     ",\"t1_ns\":%" PRIu64 ",\"t2_ns\":%" PRIu64
+			     ",\"t3_ns\":%" PRIu64 ",\"t4_ns\":%" PRIu64
+			     ",\"fwd_ns\":%" PRId64 ",\"bwd_ns\":%" PRId64
+			     ",\"rtt_ns\":%" PRId64 ",\"offset_ns\":%" PRId64
+			     ",\"ttl\":%u,\"sender_ee\":%u,\"reflector_ee\":%u"
+			     ",\"sender_err_ns\":%" PRIu64
+			     ",\"reflector_err_ns\":%" PRIu64 "}\n",
+			     rec->seq,
+			     target,
+			     rec->t_ns[0],
+			     rec->t_ns[1],
+			     rec->t_ns[2],
+			     rec->t_ns[3],
+			     rec->fwd_ns,
+			     rec->bwd_ns,
+			     rec->rtt_ns,
+			     rec->offset_x2 / 2,
+			     (unsigned int)rec->ttl,
+			     (unsigned int)rec->sender_ee,
+			     (unsigned int)rec->reflector_ee,
+			     stamp_error_estimate_ns(rec->sender_ee),
+			     stamp_error_estimate_ns(rec->reflector_ee));
+	}
+	if (n < 0) {
+		return 0;
+	}
+	return (size_t)n < STAMP_PKTLOG_LINE_MAX ? (size_t)n
+						 : STAMP_PKTLOG_LINE_MAX - 1U;
+}
+
+/**
+ * 出力バッファを書き出す（消費者のみ）
+ * 書き込みに失敗した後は以降の行を捨てる（計測は続ける）。
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_pktlog_flush(struct stamp_pktlog *pl, uint64_t now_ns)
+{
+	pl->last_flush_ns = now_ns;
+	if (pl->len == 0) {
+		return;
+	}
+	if (!pl->write_failed &&
+	    fwrite(pl->buf, 1, pl->len, pl->fp) != pl->len) {
+		pl->write_failed = true;
+	}
+	pl->len = 0;
+}
+
+/**
+ * CSV のヘッダ行を出力バッファへ置く（消費者が最初に 1 回呼ぶ）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_pktlog_begin(struct stamp_pktlog *pl)
+{
+	if (pl->format == STAMP_PKTLOG_CSV) {
+		size_t n = sizeof(STAMP_PKTLOG_CSV_HEADER) - 1U;
+		memcpy(pl->buf + pl->len, STAMP_PKTLOG_CSV_HEADER, n);
+		pl->len += n;
+	}
+}
+
+/**
+ * リングに積まれた行をすべて整形して出力バッファへ移す（消費者のみ）
+ * バッファが STAMP_PKTLOG_FLUSH を超えたとき、または前回の書き出しから
+ * STAMP_PKTLOG_LAZY_NS 経ったときだけ書き出す。
+ * @param targets セッションの番号から target を引く表（形式に合わせてエスケープ済み）
+ * @param force 残りを必ず書き出す（終了時）
+ * @return 取り出した行数
+ */
+__attribute__((nonnull(1, 2))) static inline uint32_t
+stamp_pktlog_drain(struct stamp_pktlog *pl,
+		   const char *const *targets,
+		   uint64_t now_ns,
+		   bool force)
+{
+	struct stamp_pkt_record rec;
+	uint32_t count = 0;
+	while (stamp_pktlog_pop(pl, &rec)) {
+		if (STAMP_PKTLOG_BUF_SIZE - pl->len < STAMP_PKTLOG_LINE_MAX) {
+			stamp_pktlog_flush(pl, now_ns);
+		}
+		pl->len += stamp_pktlog_format_line(&rec,
+						    targets[rec.session],
+						    pl->buf + pl->len,
+						    pl->format);
+		count++;
+	}
+	pl->written += count;
+	if (force || pl->len >= STAMP_PKTLOG_FLUSH ||
+	    now_ns - pl->last_flush_ns >= STAMP_PKTLOG_LAZY_NS) {
+		stamp_pktlog_flush(pl, now_ns);
+		if (force) {
+			(void)fflush(pl->fp);
+		}
+	}
+	return count;
+}
+
+#endif // STAMP_PKTLOG_H
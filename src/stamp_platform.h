@@ -16,6 +16,10 @@ typedef long long ssize_t;
 #if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
 #define _DEFAULT_SOURCE
 #endif
+// Linux: recvmmsg/sendmmsg 等の GNU 拡張 API を有効化
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 
 #include <inttypes.h>
 #include <math.h>
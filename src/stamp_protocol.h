@@ -23,9 +23,6 @@
 // TTL/HopLimit用int、および制御メッセージヘッダを格納するのに十分なサイズ。
 #define STAMP_CMSG_BUFSIZE 128
 
-// TX HWタイムスタンプ取得用定数
-#define STAMP_TX_TS_MAX_RETRIES 10 // MSG_ERRQUEUE ポーリング最大回数
-
 // 時間単位変換定数
 #define NSEC_PER_SEC   1000000000ULL
 #define NSEC_PER_SEC_D 1000000000.0
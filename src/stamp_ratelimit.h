@@ -0,0 +1,221 @@
+// RFC 8762 STAMP - Reflector の送信元別レート制限と全体の受信上限
+// 送信元アドレスごとのトークンバケットを GCRA（理論到着時刻 1 個で表す）で
+// 持ち、4 ウェイのセット連想表に置く。1 セットはキャッシュライン 1 本に
+// 収まり、表は固定長で実行中に確保しない。新しい送信元はセット内で理論
+// 到着時刻が最も古い（バケットが満ちている）エントリを置き換える。追い出された
+// 送信元は満杯のバケットで登録し直されるだけなので、正規の Sender が不当に
+// 絞られることはない。送信元を偽装した無作為なフラッドは送信元別の制限を
+// すり抜けるため、全体の上限（1 秒窓あたりの受理数）で抑える。
+// 表は全ワーカーで共有する。エントリは relaxed のアトミックな読み書きで更新し
+// （競合で更新が失われても数本多く通すだけ）、1 パケットあたりの処理は
+// ハッシュ 1 回とキャッシュライン 1 本の参照、全体上限の atomic add 1 回。
+
+#ifndef STAMP_RATELIMIT_H
+#define STAMP_RATELIMIT_H
+
+#include "stamp_net.h" // stamp_parse_u32_range
+#include "stamp_session.h"
+
+// 表のウェイ数とセット数（16384 送信元、256 KiB）
+#define STAMP_RATE_WAYS 4U
+#define STAMP_RATE_SETS 4096U
+// 送信元別・全体の上限として指定できる最大の pps（間隔 1 ns）
+#define STAMP_RATE_MAX_PPS 1000000000U
+
+/**
+ * レート制限の判定結果（破棄の理由）
+ */
+enum stamp_rate_verdict {
+	STAMP_RATE_PASS = 0,
+	STAMP_RATE_DROP_SOURCE, // 送信元別のバケットが空
+	STAMP_RATE_DROP_GLOBAL, // 全体の上限を超過
+};
+
+/**
+ * 送信元 1 件のバケット（tag == 0 なら未使用）
+ */
+struct stamp_rate_entry {
+	uint64_t tag; // 送信元アドレスのハッシュの上位（最下位ビットは常に 1）
+	uint64_t tat; // 理論到着時刻（ns、単調クロック）
+};
+
+/**
+ * 同じセットに写る送信元（キャッシュライン 1 本）
+ */
+struct stamp_rate_set {
+	struct stamp_rate_entry ways[STAMP_RATE_WAYS];
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct stamp_rate_set) == 64,
+	       "one rate-limit set must fill exactly one cache line");
+
+/**
+ * レート制限の状態（全ワーカーで共有）
+ */
+struct stamp_rate_limiter {
+	uint64_t interval_ns;  // 送信元ごとの 1 本あたりの間隔（0=送信元別の制限なし）
+	uint64_t tolerance_ns; // バースト分の先行許容 interval × (burst − 1)
+	uint64_t global_pps;   // 全体の上限（0=上限なし）
+	uint64_t seed;
+	uint64_t window_sec __attribute__((aligned(64))); // 全体上限の計数中の秒
+	uint64_t window_count; // その秒に判定した数
+	struct stamp_rate_set sets[STAMP_RATE_SETS];
+};
+
+/**
+ * -r の引数 "pps" または "pps:burst" を解析する（burst の既定値は pps）
+ * @return 成功時 0、不正な形式・範囲外の場合 -1
+ */
+__attribute__((nonnull(1, 2, 3), cold)) static inline int
+stamp_rate_parse(const char *arg, uint32_t *pps, uint32_t *burst)
+{
+	char num[16];
+	const char *colon = strchr(arg, ':');
+	size_t n = colon != NULL ? (size_t)(colon - arg) : strlen(arg);
+	if (n == 0 || n >= sizeof(num)) {
+		return -1;
+	}
+	memcpy(num, arg, n);
+	num[n] = '\0';
+	if (stamp_parse_u32_range(num, pps, STAMP_RATE_MAX_PPS) != 0) {
+		return -1;
+	}
+	if (colon == NULL) {
+		*burst = *pps;
+		return 0;
+	}
+	return stamp_parse_u32_range(colon + 1, burst, UINT32_MAX);
+}
+
+/**
+ * 初期化する（全エントリを未使用にする）
+ * @param pps 送信元ごとの上限（0=送信元別の制限なし）
+ * @param burst 送信元ごとに連続して受理できる数（1 以上）
+ * @param global_pps 全体の上限（0=上限なし）
+ * @param seed ハッシュの種（外部から同じセットへの衝突を狙いにくくする）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_rate_init(struct stamp_rate_limiter *lim,
+		uint32_t pps,
+		uint32_t burst,
+		uint32_t global_pps,
+		uint64_t seed)
+{
+	memset(lim, 0, sizeof(*lim));
+	if (pps > 0) {
+		lim->interval_ns = NSEC_PER_SEC / pps;
+		lim->tolerance_ns = lim->interval_ns * (burst > 0 ? burst - 1U : 0);
+	}
+	lim->global_pps = global_pps;
+	lim->seed = seed;
+}
+
+/**
+ * レート制限が有効か
+ */
+__attribute__((nonnull(1), pure)) static inline bool
+stamp_rate_enabled(const struct stamp_rate_limiter *lim)
+{
+	return lim->interval_ns != 0 || lim->global_pps != 0;
+}
+
+/**
+ * 送信元アドレス（ポートを除く）のハッシュ
+ */
+__attribute__((nonnull(1), pure)) static inline uint64_t
+stamp_rate_hash(const struct sockaddr_storage *addr, uint64_t seed)
+{
+	struct stamp_session_key key;
+	stamp_session_key_from(&key, addr, 0);
+	key.port = 0;
+	uint64_t w[3];
+	memcpy(w, &key, sizeof(w));
+	uint64_t h = seed;
+	for (int i = 0; i < 3; i++) {
+		h = (h ^ w[i]) * UINT64_C(0x9E3779B97F4A7C15);
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+/**
+ * 送信元のバケットから 1 本分を取り出す
+ * @return 受理する場合 true、バケットが空の場合 false
+ */
+__attribute__((nonnull(1, 2), hot)) static inline bool
+stamp_rate_admit_source(struct stamp_rate_limiter *lim,
+			const struct sockaddr_storage *addr,
+			uint64_t now_ns)
+{
+	uint64_t h = stamp_rate_hash(addr, lim->seed);
+	struct stamp_rate_set *set = &lim->sets[h & (STAMP_RATE_SETS - 1U)];
+	uint64_t tag = (h >> 32) | 1U;
+	struct stamp_rate_entry *victim = &set->ways[0];
+	uint64_t victim_tat = UINT64_MAX;
+	for (uint32_t w = 0; w < STAMP_RATE_WAYS; w++) {
+		struct stamp_rate_entry *e = &set->ways[w];
+		uint64_t tat = __atomic_load_n(&e->tat, __ATOMIC_RELAXED);
+		if (__atomic_load_n(&e->tag, __ATOMIC_RELAXED) == tag) {
+			uint64_t start = tat > now_ns ? tat : now_ns;
+			if (start - now_ns > lim->tolerance_ns) {
+				return false;
+			}
+			__atomic_store_n(&e->tat,
+					 start + lim->interval_ns,
+					 __ATOMIC_RELAXED);
+			return true;
+		}
+		if (tat < victim_tat) {
+			victim = e;
+			victim_tat = tat;
+		}
+	}
+	// 未登録: 満杯のバケットで登録し、この 1 本を受理する
+	__atomic_store_n(&victim->tag, tag, __ATOMIC_RELAXED);
+	__atomic_store_n(&victim->tat, now_ns + lim->interval_ns, __ATOMIC_RELAXED);
+	return true;
+}
+
+/**
+ * 全体の上限を判定する（1 秒窓ごとの受理数）
+ * 窓の切り替えと加算の競合で境界付近の数本がずれることは許容する。
+ * @return 上限内なら true
+ */
+__attribute__((nonnull(1), hot)) static inline bool
+stamp_rate_admit_global(struct stamp_rate_limiter *lim, uint64_t now_ns)
+{
+	uint64_t sec = now_ns / NSEC_PER_SEC;
+	uint64_t window = __atomic_load_n(&lim->window_sec, __ATOMIC_RELAXED);
+	if (unlikely(window != sec) &&
+	    __atomic_compare_exchange_n(&lim->window_sec,
+					&window,
+					sec,
+					false,
+					__ATOMIC_RELAXED,
+					__ATOMIC_RELAXED)) {
+		__atomic_store_n(&lim->window_count, 0, __ATOMIC_RELAXED);
+	}
+	return __atomic_fetch_add(&lim->window_count, 1U, __ATOMIC_RELAXED) <
+	       lim->global_pps;
+}
+
+/**
+ * 受信 1 本を判定する（送信元別 → 全体の順。送信元別で捨てた分は全体の
+ * 上限を消費しない）
+ * @param now_ns 単調クロックの現在時刻（ns）
+ */
+__attribute__((nonnull(1, 2), hot)) static inline enum stamp_rate_verdict
+stamp_rate_admit(struct stamp_rate_limiter *lim,
+		 const struct sockaddr_storage *addr,
+		 uint64_t now_ns)
+{
+	if (lim->interval_ns != 0 && !stamp_rate_admit_source(lim, addr, now_ns)) {
+		return STAMP_RATE_DROP_SOURCE;
+	}
+	if (lim->global_pps != 0 && !stamp_rate_admit_global(lim, now_ns)) {
+		return STAMP_RATE_DROP_GLOBAL;
+	}
+	return STAMP_RATE_PASS;
+}
+
+#endif // STAMP_RATELIMIT_H
@@ -0,0 +1,200 @@
+// RFC 8762 STAMP - Sender の順序逆転の指標（RFC 4737）と seq 隣接の IPDV
+// 期限内に受信した応答（stamp_inflight_match() の IN_ORDER / REORDERED）を
+// 到着順に記録し、順序逆転の extent と n-reordering を集計する。
+// 応答待ち表と同じ容量で seq & mask に直接索引するリングを持ち、各 seq に
+// 「その seq 以上を最初に運んだ到着の番号」と受信済みの遅延を置く。
+// 最大 seq が進むたびに飛ばした seq のスロットを埋めるので、スロットの更新は
+// 送信 1 本あたり償却 O(1)、n-reordering の走査は STAMP_REORDER_N_MAX 本まで。
+// 遅延を保持するため、IPDV（RFC 3393）は到着順に関係なく seq が隣接する
+// 2 本が揃った時点で 1 回ずつ求められる。
+// 遅着・重複・喪失の判定は応答待ち表（stamp_inflight.h）が行う。
+
+#ifndef STAMP_REORDER_H
+#define STAMP_REORDER_H
+
+#include "stamp_platform.h"
+
+// n-reordering を数える上限（これ以上は n = STAMP_REORDER_N_MAX にまとめる、2 の冪）
+#define STAMP_REORDER_N_MAX 8U
+
+/**
+ * seq 1 本分の記録
+ */
+struct stamp_reorder_slot {
+	double rtt; // 受信した応答の遅延（ms、IPDV の相手）
+	double fwd;
+	double bwd;
+	uint32_t seq;	      // このスロットの seq（古い周回の判定）
+	uint32_t first_above; // seq 以上の seq を最初に運んだ到着の番号
+	bool received;	      // 期限内に受信済みか
+};
+
+/**
+ * 順序逆転の集計（セッションごと）
+ * stamp_reorder_init() で確保し stamp_reorder_free() で解放する。
+ */
+struct stamp_reorder {
+	struct stamp_reorder_slot *slots;
+	uint32_t mask;	    // 容量 - 1
+	uint32_t arrivals;  // 記録した応答数（次の到着の番号）
+	uint32_t highest;   // 受信済みの最大 seq
+	uint32_t next_fill; // 次にスロットを埋める seq
+	bool has_rx;	    // highest が有効か
+	uint32_t recent[STAMP_REORDER_N_MAX]; // 直近の到着の seq
+	uint32_t reordered;		      // 順序逆転した応答数
+	uint64_t extent_sum;		      // reordering extent の合計
+	uint32_t extent_max;
+	// [n]: 直前に続けて到着した大きい seq が n 本だった応答数
+	// （n = 0 は直前の到着の方が小さい seq、最後は N_MAX 本以上）
+	uint32_t n_hist[STAMP_REORDER_N_MAX + 1U];
+};
+
+/**
+ * 空の状態で確保する
+ * @param cap 容量（2 の冪。応答待ち表と同じ値を使う）
+ * @param first_seq 最初に送る seq（先頭付近の応答が遅れて届いた場合の extent 用）
+ * @return 成功時 0、容量が不正または確保失敗時 -1
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_reorder_init(struct stamp_reorder *r, uint32_t cap, uint32_t first_seq)
+{
+	memset(r, 0, sizeof(*r));
+	if (cap == 0 || (cap & (cap - 1U)) != 0) {
+		return -1;
+	}
+	r->slots = calloc(cap, sizeof(*r->slots));
+	if (r->slots == NULL) {
+		return -1;
+	}
+	r->mask = cap - 1U;
+	r->next_fill = first_seq;
+	return 0;
+}
+
+/**
+ * 解放する（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_reorder_free(struct stamp_reorder *r)
+{
+	free(r->slots);
+	memset(r, 0, sizeof(*r));
+}
+
+/**
+ * seq の記録を返す（古い周回で上書き済みなら NULL）
+ */
+__attribute__((nonnull(1), pure)) static inline const struct stamp_reorder_slot *
+stamp_reorder_slot_of(const struct stamp_reorder *r, uint32_t seq)
+{
+	const struct stamp_reorder_slot *s = &r->slots[seq & r->mask];
+	return s->seq == seq ? s : NULL;
+}
+
+/**
+ * 期限内の応答 1 本を到着順に記録する
+ * 最大 seq を更新した場合は飛ばした seq のスロットを埋め、順序逆転した場合は
+ * extent（先に届いた大きい seq の最初の到着から数えた到着数）と n を集計する。
+ * @param rtt,fwd,bwd 応答の遅延（ms）
+ * @param pairs seq が隣接する受信済みの応答（seq − 1 と seq + 1、最大 2 件）
+ * @return pairs に格納した件数
+ */
+__attribute__((nonnull(1, 6), hot)) static inline uint32_t
+stamp_reorder_record(struct stamp_reorder *r,
+		     uint32_t seq,
+		     double rtt,
+		     double fwd,
+		     double bwd,
+		     const struct stamp_reorder_slot *pairs[2])
+{
+	uint32_t arrival = r->arrivals++;
+	if (!r->has_rx || (int32_t)(seq - r->highest) > 0) {
+		// 表の範囲より古い seq は埋めない（後で届いても照合できない）
+		uint32_t from = r->next_fill;
+		if ((int32_t)(seq - from) < 0 || seq - from > r->mask) {
+			from = seq - r->mask;
+		}
+		for (uint32_t s = from; s != seq + 1U; s++) {
+			struct stamp_reorder_slot *fill = &r->slots[s & r->mask];
+			fill->seq = s;
+			fill->first_above = arrival;
+			fill->received = false;
+		}
+		r->highest = seq;
+		r->next_fill = seq + 1U;
+		r->has_rx = true;
+	} else if ((int32_t)(seq - r->highest) < 0) {
+		const struct stamp_reorder_slot *above =
+			stamp_reorder_slot_of(r, seq + 1U);
+		if (above != NULL) {
+			uint32_t extent = arrival - above->first_above;
+			r->extent_sum += extent;
+			if (extent > r->extent_max) {
+				r->extent_max = extent;
+			}
+		}
+		uint32_t depth = arrival < STAMP_REORDER_N_MAX ? arrival
+							       : STAMP_REORDER_N_MAX;
+		uint32_t n = 0;
+		while (n < depth &&
+		       (int32_t)(r->recent[(arrival - 1U - n) &
+					   (STAMP_REORDER_N_MAX - 1U)] -
+				 seq) > 0) {
+			n++;
+		}
+		r->n_hist[n]++;
+		r->reordered++;
+	}
+	r->recent[arrival & (STAMP_REORDER_N_MAX - 1U)] = seq;
+
+	uint32_t count = 0;
+	struct stamp_reorder_slot *self = &r->slots[seq & r->mask];
+	if (self->seq != seq) {
+		return 0;
+	}
+	self->rtt = rtt;
+	self->fwd = fwd;
+	self->bwd = bwd;
+	self->received = true;
+	const struct stamp_reorder_slot *prev = stamp_reorder_slot_of(r, seq - 1U);
+	const struct stamp_reorder_slot *next = stamp_reorder_slot_of(r, seq + 1U);
+	if (prev != NULL && prev->received) {
+		pairs[count++] = prev;
+	}
+	if (next != NULL && next->received) {
+		pairs[count++] = next;
+	}
+	return count;
+}
+
+/**
+ * 受信数に対する n-reordering の比率（RFC 4737 Section 5）
+ * 直前に続けて到着した n 本以上がいずれも大きい seq だった応答の割合。
+ * @param n 1..STAMP_REORDER_N_MAX
+ * @param received 期限内に受信した応答数
+ * @return 比率（受信 0 の場合 NAN）
+ */
+__attribute__((nonnull(1), pure)) static inline double
+stamp_reorder_n_ratio(const struct stamp_reorder *r, uint32_t n, uint32_t received)
+{
+	if (received == 0) {
+		return (double)NAN;
+	}
+	uint64_t count = 0;
+	for (uint32_t k = n; k <= STAMP_REORDER_N_MAX; k++) {
+		count += r->n_hist[k];
+	}
+	return (double)count / (double)received;
+}
+
+/**
+ * reordering extent の平均（順序逆転が無い場合 NAN）
+ */
+__attribute__((nonnull(1), pure)) static inline double
+stamp_reorder_extent_avg(const struct stamp_reorder *r)
+{
+	return r->reordered > 0 ? (double)r->extent_sum / (double)r->reordered
+				: (double)NAN;
+}
+
+#endif // STAMP_REORDER_H
@@ -30,10 +30,18 @@ enum output_format {
 	OUTPUT_CSV,
 };
 
+// 数値メトリクスの種別（出力する小数桁数を決める）
+enum stamp_report_kind {
+	STAMP_REPORT_VALUE = 0, // 時間量・平均値など（小数 3 桁）
+	STAMP_REPORT_RATIO,	// 比率・確率（loss_ratio と同じ小数 6 桁）
+	STAMP_REPORT_COUNT,	// 件数（整数）
+};
+
 // 数値メトリクス 1 件（value が非有限なら未集計＝JSON null / CSV 空フィールド）
 struct stamp_report_field {
 	const char *key;
 	double value;
+	enum stamp_report_kind kind;
 };
 
 // レポート全体（メタデータ + 数値メトリクス配列）
@@ -48,6 +56,9 @@ struct stamp_report {
 	uint32_t packets_tx;
 	uint32_t packets_rx;
 	uint32_t timeouts;
+	uint32_t late;	    // タイムアウト後に到着した応答（timeouts の内数）
+	uint32_t reordered; // 到着順が送信順と逆転した応答
+	uint32_t duplicates;
 	double loss_ratio; // 0.0–1.0
 	const struct stamp_report_field *fields;
 	size_t field_count;
@@ -92,7 +103,7 @@ stamp_report_iso8601_utc(char *buf, size_t buflen)
  * @param buf 出力バッファ
  * @param buflen バッファ長
  * @param v 値
- * @param prec 小数桁数（6 のみ高精度、その他は 3 桁）
+ * @param prec 小数桁数（6 は高精度、0 は整数、その他は 3 桁）
  */
 __attribute__((nonnull(1))) static inline void
 stamp_report_fmt_double(char *buf, size_t buflen, double v, int prec)
@@ -109,8 +120,14 @@ stamp_report_fmt_double(char *buf, size_t buflen, double v, int prec)
 	// なり、-Wformat-truncation=2 が誤検知しない。表示フィールド buf には
 	// 長さ検査を通った場合のみコピーする。
 	char tmp[STAMP_REPORT_DOUBLE_MAX];
-	int written = (prec == 6) ? snprintf(tmp, sizeof(tmp), "%.6f", v)
-				  : snprintf(tmp, sizeof(tmp), "%.3f", v);
+	int written;
+	if (prec == 6) {
+		written = snprintf(tmp, sizeof(tmp), "%.6f", v);
+	} else if (prec == 0) {
+		written = snprintf(tmp, sizeof(tmp), "%.0f", v);
+	} else {
+		written = snprintf(tmp, sizeof(tmp), "%.3f", v);
+	}
 	if (written < 0 || (size_t)written >= buflen) {
 		// 表示フィールドに収まらない値は欠損（空文字）扱い
 		buf[0] = '\0';
@@ -126,6 +143,30 @@ stamp_report_fmt_double(char *buf, size_t buflen, double v, int prec)
 	memcpy(buf, tmp, (size_t)written + 1);
 }
 
+/**
+ * メトリクス 1 件をその種別の小数桁数で整形する（非有限値は空文字）
+ */
+__attribute__((nonnull(1, 3))) static inline void
+stamp_report_fmt_field(char *buf,
+		       size_t buflen,
+		       const struct stamp_report_field *f)
+{
+	int prec;
+	switch (f->kind) {
+	case STAMP_REPORT_RATIO:
+		prec = 6;
+		break;
+	case STAMP_REPORT_COUNT:
+		prec = 0;
+		break;
+	case STAMP_REPORT_VALUE:
+	default:
+		prec = 3;
+		break;
+	}
+	stamp_report_fmt_double(buf, buflen, f->value, prec);
+}
+
 /**
  * JSON 文字列エスケープ（" と \ と制御文字 0x00-0x1F を \uXXXX に）。
  * @param in 入力文字列
@@ -156,23 +197,57 @@ stamp_report_json_escape(const char *in, char *out, size_t outlen)
 }
 
 /**
- * レポートを JSON で出力（メタデータ + 全メトリクス）。
- * 非有限値は null。format_version を埋め込む。
- * @param fp 出力先
- * @param r レポート
+ * JSON オブジェクトの ptp 以降（フラグ・カウンタ・全メトリクス）を出力する。
+ * 単一ターゲットと複数ターゲットのレポートで共用する（末尾の改行は含まない）。
+ * @param indent 各行の字下げ
  */
-__attribute__((nonnull(1, 2))) static inline void
-stamp_report_write_json(FILE *fp, const struct stamp_report *r)
+__attribute__((nonnull(1, 2, 3))) static inline void
+stamp_report_write_json_metrics(FILE *fp,
+				const struct stamp_report *r,
+				const char *indent)
 {
-	char ts[STAMP_REPORT_TS_MAX];
-	bool ts_ok = (stamp_report_iso8601_utc(ts, sizeof(ts)) == 0);
-	char target[STAMP_REPORT_STR_MAX];
-	stamp_report_json_escape(r->target != NULL ? r->target : "",
-				 target,
-				 sizeof(target));
 	char loss[STAMP_REPORT_NUM_MAX];
 	stamp_report_fmt_double(loss, sizeof(loss), r->loss_ratio, 6);
 
+	fprintf(fp, "%s\"ptp\": %s,\n", indent, r->ptp ? "true" : "false");
+	fprintf(fp,
+		"%s\"oneway\": %s,\n",
+		indent,
+		r->oneway ? "true" : "false");
+	fprintf(fp,
+		"%s\"samples_truncated\": %s,\n",
+		indent,
+		r->samples_truncated ? "true" : "false");
+	fprintf(fp, "%s\"packets_tx\": %u,\n", indent, r->packets_tx);
+	fprintf(fp, "%s\"packets_rx\": %u,\n", indent, r->packets_rx);
+	fprintf(fp, "%s\"timeouts\": %u,\n", indent, r->timeouts);
+	fprintf(fp, "%s\"late\": %u,\n", indent, r->late);
+	fprintf(fp, "%s\"reordered\": %u,\n", indent, r->reordered);
+	fprintf(fp, "%s\"duplicates\": %u,\n", indent, r->duplicates);
+	fprintf(fp,
+		"%s\"loss_ratio\": %s",
+		indent,
+		loss[0] != '\0' ? loss : "null");
+	for (size_t i = 0; i < r->field_count; i++) {
+		char val[STAMP_REPORT_NUM_MAX];
+		stamp_report_fmt_field(val, sizeof(val), &r->fields[i]);
+		fprintf(fp,
+			",\n%s\"%s\": %s",
+			indent,
+			r->fields[i].key,
+			val[0] != '\0' ? val : "null");
+	}
+}
+
+/**
+ * JSON の先頭（format_version と timestamp）を出力する
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_report_write_json_preamble(FILE *fp)
+{
+	char ts[STAMP_REPORT_TS_MAX];
+	bool ts_ok = (stamp_report_iso8601_utc(ts, sizeof(ts)) == 0);
+
 	fputs("{\n", fp);
 	fputs("  \"format_version\": \"1.0\",\n", fp);
 	// 生成失敗時は他の欠損値と同じく null を出す（空文字列で偽装しない）
@@ -181,60 +256,93 @@ stamp_report_write_json(FILE *fp, const struct stamp_report *r)
 	} else {
 		fputs("  \"timestamp\": null,\n", fp);
 	}
+}
+
+/**
+ * レポートを JSON で出力（メタデータ + 全メトリクス）。
+ * 非有限値は null。format_version を埋め込む。
+ * @param fp 出力先
+ * @param r レポート
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_report_write_json(FILE *fp, const struct stamp_report *r)
+{
+	char target[STAMP_REPORT_STR_MAX];
+	stamp_report_json_escape(r->target != NULL ? r->target : "",
+				 target,
+				 sizeof(target));
+
+	stamp_report_write_json_preamble(fp);
 	fprintf(fp, "  \"target\": \"%s\",\n", target);
 	fprintf(fp,
 		"  \"family\": \"%s\",\n",
 		r->family != NULL ? r->family : "");
 	fputs("  \"protocol\": \"STAMP\",\n", fp);
-	fprintf(fp, "  \"ptp\": %s,\n", r->ptp ? "true" : "false");
-	fprintf(fp, "  \"oneway\": %s,\n", r->oneway ? "true" : "false");
-	fprintf(fp,
-		"  \"samples_truncated\": %s,\n",
-		r->samples_truncated ? "true" : "false");
-	fprintf(fp, "  \"packets_tx\": %u,\n", r->packets_tx);
-	fprintf(fp, "  \"packets_rx\": %u,\n", r->packets_rx);
-	fprintf(fp, "  \"timeouts\": %u,\n", r->timeouts);
-	fprintf(fp, "  \"loss_ratio\": %s", loss[0] != '\0' ? loss : "null");
-	for (size_t i = 0; i < r->field_count; i++) {
-		char val[STAMP_REPORT_NUM_MAX];
-		stamp_report_fmt_double(val,
-					sizeof(val),
-					r->fields[i].value,
-					3);
-		fprintf(fp,
-			",\n  \"%s\": %s",
-			r->fields[i].key,
-			val[0] != '\0' ? val : "null");
-	}
+	stamp_report_write_json_metrics(fp, r, "  ");
 	fputs("\n}\n", fp);
 }
 
 /**
- * レポートを CSV で出力（# コメント行 + ヘッダ行 + データ 1 行、列固定）。
- * 非有限値は空フィールド。
+ * 複数ターゲットのレポートを 1 つの JSON で出力する。
+ * 各ターゲットのメトリクスは "targets" 配下にターゲット表記をキーとして並ぶ
+ * （キー以外の内容は単一ターゲットのレポートと同じ）。
  * @param fp 出力先
- * @param r レポート
+ * @param reports レポート配列
+ * @param count 要素数
  */
 __attribute__((nonnull(1, 2))) static inline void
-stamp_report_write_csv(FILE *fp, const struct stamp_report *r)
+stamp_report_write_json_multi(FILE *fp,
+			      const struct stamp_report *reports,
+			      size_t count)
 {
-	char ts[STAMP_REPORT_TS_MAX];
-	// 生成失敗時は ts[0]='\0' となり空フィールド（CSV の欠損表現）になる
-	(void)stamp_report_iso8601_utc(ts, sizeof(ts));
-	char loss[STAMP_REPORT_NUM_MAX];
-	stamp_report_fmt_double(loss, sizeof(loss), r->loss_ratio, 6);
+	stamp_report_write_json_preamble(fp);
+	fputs("  \"protocol\": \"STAMP\",\n", fp);
+	fputs("  \"targets\": {", fp);
+	for (size_t i = 0; i < count; i++) {
+		const struct stamp_report *r = &reports[i];
+		char target[STAMP_REPORT_STR_MAX];
+		stamp_report_json_escape(r->target != NULL ? r->target : "",
+					 target,
+					 sizeof(target));
+		fprintf(fp, "%s\n    \"%s\": {\n", i > 0 ? "," : "", target);
+		fprintf(fp,
+			"      \"family\": \"%s\",\n",
+			r->family != NULL ? r->family : "");
+		stamp_report_write_json_metrics(fp, r, "      ");
+		fputs("\n    }", fp);
+	}
+	fputs(count > 0 ? "\n  }\n}\n" : "}\n}\n", fp);
+}
 
+/**
+ * CSV の # コメント行とヘッダ行を出力する（列は r の fields に従う）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_report_write_csv_header(FILE *fp, const struct stamp_report *r)
+{
 	fputs("# format_version=1.0\n", fp);
 	fputs("timestamp,target,family,protocol,ptp,oneway,samples_truncated,"
-	      "packets_tx,packets_rx,timeouts,loss_ratio",
+	      "packets_tx,packets_rx,timeouts,late,reordered,duplicates,"
+	      "loss_ratio",
 	      fp);
 	for (size_t i = 0; i < r->field_count; i++) {
 		fprintf(fp, ",%s", r->fields[i].key);
 	}
 	fputc('\n', fp);
+}
+
+/**
+ * CSV のデータ 1 行を出力する
+ * @param ts タイムスタンプ（生成失敗時は空文字＝空フィールド）
+ */
+__attribute__((nonnull(1, 2, 3))) static inline void
+stamp_report_write_csv_row(FILE *fp, const struct stamp_report *r, const char *ts)
+{
+	char loss[STAMP_REPORT_NUM_MAX];
+	stamp_report_fmt_double(loss, sizeof(loss), r->loss_ratio, 6);
 
 	fprintf(fp,
-		"%s,%s,%s,STAMP,%s,%s,%s,%u,%u,%u,%s",
+		"%s,%s,%s,STAMP,%s,%s,%s,%u,%u,%u,%u,%u,%u,%s",
 		ts,
 		r->target != NULL ? r->target : "",
 		r->family != NULL ? r->family : "",
@@ -244,16 +352,55 @@ stamp_report_write_csv(FILE *fp, const struct stamp_report *r)
 		r->packets_tx,
 		r->packets_rx,
 		r->timeouts,
+		r->late,
+		r->reordered,
+		r->duplicates,
 		loss);
 	for (size_t i = 0; i < r->field_count; i++) {
 		char val[STAMP_REPORT_NUM_MAX];
-		stamp_report_fmt_double(val,
-					sizeof(val),
-					r->fields[i].value,
-					3);
+		stamp_report_fmt_field(val, sizeof(val), &r->fields[i]);
 		fprintf(fp, ",%s", val);
 	}
 	fputc('\n', fp);
 }
 
+/**
+ * レポートを CSV で出力（# コメント行 + ヘッダ行 + データ 1 行、列固定）。
+ * 非有限値は空フィールド。
+ * @param fp 出力先
+ * @param r レポート
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_report_write_csv(FILE *fp, const struct stamp_report *r)
+{
+	char ts[STAMP_REPORT_TS_MAX];
+	// 生成失敗時は ts[0]='\0' となり空フィールド（CSV の欠損表現）になる
+	(void)stamp_report_iso8601_utc(ts, sizeof(ts));
+	stamp_report_write_csv_header(fp, r);
+	stamp_report_write_csv_row(fp, r, ts);
+}
+
+/**
+ * 複数ターゲットのレポートを CSV で出力（ヘッダ 1 行 + ターゲットごとに 1 行）。
+ * 全レポートが同じ fields の並びを持つこと（ヘッダは先頭のものを使う）。
+ * @param fp 出力先
+ * @param reports レポート配列（1 件以上）
+ * @param count 要素数
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_report_write_csv_multi(FILE *fp,
+			     const struct stamp_report *reports,
+			     size_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	char ts[STAMP_REPORT_TS_MAX];
+	(void)stamp_report_iso8601_utc(ts, sizeof(ts));
+	stamp_report_write_csv_header(fp, &reports[0]);
+	for (size_t i = 0; i < count; i++) {
+		stamp_report_write_csv_row(fp, &reports[i], ts);
+	}
+}
+
 #endif // STAMP_REPORT_H
@@ -0,0 +1,263 @@
+// RFC 8762 STAMP - Sender の送信時刻スケジュール
+// 固定間隔（periodic）に加え、指数分布間隔（Poisson、RFC 2330 11.1.1）と
+// 開始時刻に有界な乱数オフセットを 1 回だけ加える周期ストリーム（RFC 3432）
+// を扱う。
+// 送信予定は絶対時刻（単調クロック）のリングへまとめて事前計算し、乱数生成
+// と対数計算を送信ごとのホットパスから外す。待機・送信は呼び出し元に委ねる。
+
+#ifndef STAMP_SCHEDULE_H
+#define STAMP_SCHEDULE_H
+
+#include "stamp_platform.h"
+
+// 事前計算リングの容量（2 の冪）。残りが半分になったら半分ずつ補充する
+#define STAMP_SCHED_RING_CAP  256U
+#define STAMP_SCHED_RING_MASK (STAMP_SCHED_RING_CAP - 1U)
+
+// -S（予定時刻直前のビジーウェイト幅、マイクロ秒）の上限
+#define STAMP_SCHED_SPIN_USEC_MAX 10000U
+
+// 送信間隔の分布
+enum stamp_sched_mode {
+	STAMP_SCHED_PERIODIC = 0, // 固定間隔（開始時刻 + k × 間隔）
+	STAMP_SCHED_POISSON,	  // 指数分布間隔（平均 = 間隔）
+	STAMP_SCHED_OFFSET,	  // 開始時刻 + [0, offset) の乱数、以後は固定間隔
+};
+
+/**
+ * 擬似乱数生成器（xoshiro256**）
+ * 測定スケジュール用であり暗号用途には使わないこと。
+ */
+struct stamp_rng {
+	uint64_t s[4];
+};
+
+/**
+ * 送信予定リング
+ * deadline_ns[] には非減少の絶対時刻が head から count 本並ぶ。
+ */
+struct stamp_sched {
+	uint64_t deadline_ns[STAMP_SCHED_RING_CAP];
+	uint32_t head;
+	uint32_t count;
+	enum stamp_sched_mode mode;
+	uint64_t start_ns;    // 格子の起点（offset モードでは乱数オフセット込み）
+	uint64_t interval_ns; // 間隔（Poisson では平均間隔）
+	uint64_t offset_ns;   // offset モードで開始時刻に加えたオフセット
+	uint64_t slot;	      // 次に生成する格子点の番号（periodic / offset）
+	uint64_t last_ns;     // 最後に生成した予定時刻（Poisson の累積起点）
+	struct stamp_rng rng;
+};
+
+/**
+ * splitmix64（シード展開用）
+ */
+static inline uint64_t stamp_splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * 64 ビットのシードから乱数状態を初期化する（全 0 状態は生じない）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_rng_seed(struct stamp_rng *rng, uint64_t seed)
+{
+	for (size_t i = 0; i < 4; i++) {
+		rng->s[i] = stamp_splitmix64(&seed);
+	}
+}
+
+static inline uint64_t stamp_rotl64(uint64_t x, unsigned int k)
+{
+	return (x << k) | (x >> (64U - k));
+}
+
+/**
+ * 64 ビット一様乱数
+ */
+__attribute__((nonnull(1))) static inline uint64_t
+stamp_rng_next(struct stamp_rng *rng)
+{
+	uint64_t *s = rng->s;
+	uint64_t result = stamp_rotl64(s[1] * 5U, 7) * 9U;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = stamp_rotl64(s[3], 45);
+	return result;
+}
+
+/**
+ * (0, 1] の一様乱数（53 ビット精度。0 を返さないので log() に渡せる）
+ */
+__attribute__((nonnull(1))) static inline double
+stamp_rng_uniform01(struct stamp_rng *rng)
+{
+	return (double)((stamp_rng_next(rng) >> 11) + 1U) * 0x1.0p-53;
+}
+
+/**
+ * 次の送信予定時刻を 1 本生成する
+ */
+__attribute__((nonnull(1))) static inline uint64_t
+stamp_sched_generate(struct stamp_sched *sched)
+{
+	switch (sched->mode) {
+	case STAMP_SCHED_POISSON: {
+		// 逆関数法: -ln(U) × 平均 が指数分布に従う
+		double gap = -log(stamp_rng_uniform01(&sched->rng)) *
+			     (double)sched->interval_ns;
+		sched->last_ns += (uint64_t)(gap + 0.5);
+		return sched->last_ns;
+	}
+	case STAMP_SCHED_OFFSET:
+	case STAMP_SCHED_PERIODIC:
+	default:
+		sched->last_ns =
+			sched->start_ns + sched->slot++ * sched->interval_ns;
+		return sched->last_ns;
+	}
+}
+
+/**
+ * リングの空きを送信予定で埋める（乱数・対数計算はここでまとめて行う）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_sched_refill(struct stamp_sched *sched)
+{
+	while (sched->count < STAMP_SCHED_RING_CAP) {
+		uint32_t tail = (sched->head + sched->count) & STAMP_SCHED_RING_MASK;
+		sched->deadline_ns[tail] = stamp_sched_generate(sched);
+		sched->count++;
+	}
+}
+
+/**
+ * スケジュールを初期化し、リングを満たす
+ * 最初の送信予定は periodic では start_ns、Poisson では start_ns から指数
+ * 分布の待ち時間後、offset では start_ns + [0, max_offset_ns) となる。
+ * offset モードのオフセットは開始時に 1 回だけ引き、以後の間隔は固定のまま
+ * 保つ（RFC 3432 の周期ストリームの性質を崩さない）。
+ * @param interval_ns 間隔（Poisson では平均間隔、0 より大きいこと）
+ * @param max_offset_ns offset モードの開始オフセット上限（interval_ns を超える
+ *                      値は interval_ns に丸める。最初の 1 周期内で始めるため）
+ * @param seed 乱数シード
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_sched_init(struct stamp_sched *sched,
+		 enum stamp_sched_mode mode,
+		 uint64_t start_ns,
+		 uint64_t interval_ns,
+		 uint64_t max_offset_ns,
+		 uint64_t seed)
+{
+	memset(sched, 0, sizeof(*sched));
+	sched->mode = mode;
+	sched->interval_ns = interval_ns;
+	stamp_rng_seed(&sched->rng, seed);
+	if (mode == STAMP_SCHED_OFFSET) {
+		uint64_t bound = max_offset_ns < interval_ns ? max_offset_ns
+							     : interval_ns;
+		// 剰余の偏りは bound ≪ 2^64 のため無視できる
+		if (bound > 0) {
+			sched->offset_ns = stamp_rng_next(&sched->rng) % bound;
+		}
+	}
+	sched->start_ns = start_ns + sched->offset_ns;
+	sched->last_ns = start_ns;
+	stamp_sched_refill(sched);
+}
+
+/**
+ * 次の送信予定時刻（リングは常に 1 本以上を保持する）
+ */
+__attribute__((nonnull(1), pure)) static inline uint64_t
+stamp_sched_peek(const struct stamp_sched *sched)
+{
+	return sched->deadline_ns[sched->head];
+}
+
+/**
+ * 次の送信予定に対するスケジュール誤差（実送信時刻 − 予定時刻）
+ * 予定より前に送ることはないが、呼び出し側の時刻が予定より前なら 0 とする。
+ * @param now_ns 実送信時刻（単調クロック）
+ * @return 誤差（マイクロ秒）
+ */
+__attribute__((nonnull(1), pure)) static inline double
+stamp_sched_error_us(const struct stamp_sched *sched, uint64_t now_ns)
+{
+	uint64_t deadline = stamp_sched_peek(sched);
+	if (now_ns <= deadline) {
+		return 0.0;
+	}
+	return (double)(now_ns - deadline) / 1000.0;
+}
+
+/**
+ * 送信済みの予定を取り除き、now_ns 時点で平均間隔以上過ぎた予定を読み飛ばす
+ * 処理遅延で遅れた分を詰めて送らない（バースト送信で測定対象を乱さない）。
+ * 1 間隔未満の遅れは直ちに送る（Poisson の短い間隔を読み飛ばさないため）。
+ * リングが半分まで減ったら補充する。
+ * @return 読み飛ばした予定数
+ */
+__attribute__((nonnull(1))) static inline uint32_t
+stamp_sched_advance(struct stamp_sched *sched, uint64_t now_ns)
+{
+	uint32_t missed = 0;
+	for (;;) {
+		sched->head = (sched->head + 1U) & STAMP_SCHED_RING_MASK;
+		sched->count--;
+		if (sched->count <= STAMP_SCHED_RING_CAP / 2U) {
+			stamp_sched_refill(sched);
+		}
+		if (stamp_sched_peek(sched) + sched->interval_ns > now_ns) {
+			return missed;
+		}
+		missed++;
+	}
+}
+
+/**
+ * スケジュール名（"periodic" / "poisson" / "offset"）を enum に解析する
+ * @return 成功時 0、未知の名前なら -1
+ */
+__attribute__((nonnull(1, 2))) static inline int
+stamp_sched_parse_mode(const char *arg, enum stamp_sched_mode *out)
+{
+	if (strcmp(arg, "periodic") == 0) {
+		*out = STAMP_SCHED_PERIODIC;
+	} else if (strcmp(arg, "poisson") == 0) {
+		*out = STAMP_SCHED_POISSON;
+	} else if (strcmp(arg, "offset") == 0) {
+		*out = STAMP_SCHED_OFFSET;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * enum に対応するスケジュール名
+ */
+__attribute__((const)) static inline const char *
+stamp_sched_mode_str(enum stamp_sched_mode mode)
+{
+	switch (mode) {
+	case STAMP_SCHED_POISSON:
+		return "poisson";
+	case STAMP_SCHED_OFFSET:
+		return "offset";
+	case STAMP_SCHED_PERIODIC:
+	default:
+		return "periodic";
+	}
+}
+
+#endif // STAMP_SCHEDULE_H
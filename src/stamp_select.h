@@ -0,0 +1,258 @@
+// RFC 8762 STAMP - 全サンプルからの正確なパーセンタイル（選択アルゴリズム）
+// 求める順位が数個であれば配列全体をソートせず、Floyd–Rivest 選択（分割が
+// 深くなりすぎた区間は基数ソートへ切り替える introselect 方式）で該当順位
+// だけをその場で確定する。順位の昇順に選び、選択済みの順位より後ろの区間
+// だけを次の対象とするため、期待計算量は O(n) 程度。
+// 順位が多い場合は IEEE 754 のビット列をキーとする LSD 基数ソートで全体を
+// 整列する。NaN は stamp_double_cmp と同じく他のあらゆる値より大きく扱う。
+
+#ifndef STAMP_SELECT_H
+#define STAMP_SELECT_H
+
+#include "stamp_time.h" // stamp_double_cmp, stamp_percentile_index
+
+// これ以下の区間は基数ソートせず qsort する
+#define STAMP_SELECT_SMALL 16U
+// これより大きな区間は標本からピボットを選ぶ（Floyd–Rivest）
+#define STAMP_SELECT_SAMPLE_MIN 600
+// 1 回の呼び出しで選択する順位の上限（超えたら基数ソート）
+#define STAMP_SELECT_MAX_RANKS 16U
+
+/**
+ * NaN を最大とみなす x < y（分岐を含まない比較）
+ */
+__attribute__((const)) static inline bool stamp_double_less(double x, double y)
+{
+	return ((x < y) | (isnan(y) & !isnan(x))) != 0;
+}
+
+/**
+ * 大小関係を保つ 64 ビット整数キー（NaN は UINT64_MAX）
+ * 正値は符号ビットを立て、負値は全ビットを反転する。
+ */
+__attribute__((const)) static inline uint64_t stamp_double_key(double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	if (isnan(v)) {
+		return UINT64_MAX;
+	}
+	return bits ^ ((0U - (bits >> 63)) | (UINT64_C(1) << 63));
+}
+
+/**
+ * double 配列の LSD 基数ソート（8 ビット × 8 パス。全要素で桁が同じパスは省く）
+ * @param tmp n 要素の作業領域
+ */
+__attribute__((nonnull(1, 3))) static inline void
+stamp_radix_sort_doubles(double *arr, size_t n, double *tmp)
+{
+	size_t counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for (size_t i = 0; i < n; i++) {
+		uint64_t key = stamp_double_key(arr[i]);
+		for (unsigned d = 0; d < 8; d++) {
+			counts[d][(key >> (d * 8U)) & 0xFFU]++;
+		}
+	}
+
+	double *src = arr;
+	double *dst = tmp;
+	for (unsigned d = 0; d < 8; d++) {
+		size_t *cnt = counts[d];
+		size_t offset = 0;
+		bool trivial = false;
+		for (unsigned b = 0; b < 256; b++) {
+			size_t c = cnt[b];
+			trivial |= (c == n);
+			cnt[b] = offset;
+			offset += c;
+		}
+		if (trivial) {
+			continue;
+		}
+		for (size_t i = 0; i < n; i++) {
+			uint64_t key = stamp_double_key(src[i]);
+			dst[cnt[(key >> (d * 8U)) & 0xFFU]++] = src[i];
+		}
+		double *swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != arr) {
+		memcpy(arr, src, n * sizeof(*arr));
+	}
+}
+
+/**
+ * 区間 arr[0..n) を昇順に並べる（基数ソート。作業領域を確保できなければ qsort）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_sort_doubles(double *arr, size_t n)
+{
+	if (n <= STAMP_SELECT_SMALL) {
+		qsort(arr, n, sizeof(*arr), stamp_double_cmp);
+		return;
+	}
+	double *tmp = malloc(n * sizeof(*tmp));
+	if (tmp == NULL) {
+		qsort(arr, n, sizeof(*arr), stamp_double_cmp);
+		return;
+	}
+	stamp_radix_sort_doubles(arr, n, tmp);
+	free(tmp);
+}
+
+static inline void stamp_double_swap(double *x, double *y)
+{
+	double t = *x;
+	*x = *y;
+	*y = t;
+}
+
+/**
+ * arr[left..right] の中で昇順 k 番目の要素を arr[k] に確定する（Floyd–Rivest）
+ * 大きな区間では k の位置を挟む小さな標本区間を先に再帰で選び、その値を
+ * ピボットにして 1 回の分割で区間の大半を捨てる。分割の回数が depth を
+ * 超えた区間（ピボットの偏りが続く入力）は基数ソートで確定する。
+ */
+__attribute__((nonnull(1))) static inline void stamp_select_range(
+	double *arr, int64_t left, int64_t right, int64_t k, unsigned depth)
+{
+	while (right > left) {
+		if (depth-- == 0) {
+			stamp_sort_doubles(arr + left, (size_t)(right - left + 1));
+			return;
+		}
+		if (right - left > STAMP_SELECT_SAMPLE_MIN) {
+			double n = (double)(right - left + 1);
+			double i = (double)(k - left + 1);
+			double z = log(n);
+			double s = 0.5 * exp(2.0 * z / 3.0);
+			double sd = 0.5 * sqrt(z * s * (n - s) / n) *
+				    (i < n / 2.0 ? -1.0 : 1.0);
+			int64_t sl = (int64_t)((double)k - i * s / n + sd);
+			int64_t sr = (int64_t)((double)k + (n - i) * s / n + sd);
+			stamp_select_range(arr,
+					   sl < left ? left : sl,
+					   sr > right ? right : sr,
+					   k,
+					   depth);
+		}
+
+		// arr[left] と arr[right] をピボット以下・以上の番兵にして分割する
+		double pivot = arr[k];
+		int64_t i = left;
+		int64_t j = right;
+		stamp_double_swap(&arr[left], &arr[k]);
+		if (stamp_double_less(pivot, arr[right])) {
+			stamp_double_swap(&arr[right], &arr[left]);
+		}
+		while (i < j) {
+			stamp_double_swap(&arr[i], &arr[j]);
+			i++;
+			j--;
+			while (stamp_double_less(arr[i], pivot)) {
+				i++;
+			}
+			while (stamp_double_less(pivot, arr[j])) {
+				j--;
+			}
+		}
+		// ピボットが arr[left] に残っていれば j へ、arr[right] なら j + 1 へ
+		if (!stamp_double_less(arr[left], pivot)) {
+			stamp_double_swap(&arr[left], &arr[j]);
+		} else {
+			j++;
+			stamp_double_swap(&arr[j], &arr[right]);
+		}
+		// arr[j] = pivot、arr[left..j) ≤ pivot、arr(j..right] ≥ pivot
+		if (j <= k) {
+			left = j + 1;
+		}
+		if (k <= j) {
+			right = j - 1;
+		}
+	}
+}
+
+/**
+ * arr[0..n) を部分的に並べ替え、昇順で k 番目（0 始まり）の要素を arr[k] に
+ * 置く。arr[0..k) は arr[k] 以下、arr(k..n) は arr[k] 以上となる。
+ * @return arr[k]
+ */
+__attribute__((nonnull(1))) static inline double
+stamp_select_nth(double *arr, size_t n, size_t k)
+{
+	if (k == 0) {
+		// 最小値は 1 回の走査で求まる
+		size_t m = 0;
+		for (size_t i = 1; i < n; i++) {
+			m = stamp_double_less(arr[i], arr[m]) ? i : m;
+		}
+		stamp_double_swap(&arr[0], &arr[m]);
+		return arr[0];
+	}
+	// 分割回数の上限 2 × log2(n)。超えたら残りの区間を整列する
+	unsigned depth = 0;
+	for (size_t m = n; m > 1; m >>= 1) {
+		depth += 2;
+	}
+	stamp_select_range(arr, 0, (int64_t)n - 1, (int64_t)k, depth);
+	return arr[k];
+}
+
+/**
+ * 複数の nearest-rank パーセンタイルを求める（配列は並べ替えられる）
+ * 順位の昇順に選択し、確定した順位より後ろの区間だけを次の選択対象とする。
+ * 順位が STAMP_SELECT_MAX_RANKS を超える場合は全体を基数ソートする。
+ * @param ps パーセンタイル (0.0..100.0) の配列（順不同・重複可）
+ * @param out 結果の格納先（ps と同じ並び）。n==0 の場合は全て NAN
+ * @param count ps / out の要素数
+ */
+__attribute__((nonnull(1, 3, 4))) static inline void
+stamp_percentiles_select(double *arr,
+			 size_t n,
+			 const double *ps,
+			 double *out,
+			 size_t count)
+{
+	if (n == 0) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = NAN;
+		}
+		return;
+	}
+	if (count > STAMP_SELECT_MAX_RANKS) {
+		stamp_sort_doubles(arr, n);
+		for (size_t i = 0; i < count; i++) {
+			out[i] = arr[stamp_percentile_index(n, ps[i])];
+		}
+		return;
+	}
+
+	// 順位の昇順に並べた ps の添字（挿入ソート）
+	size_t order[STAMP_SELECT_MAX_RANKS];
+	size_t idx[STAMP_SELECT_MAX_RANKS];
+	for (size_t i = 0; i < count; i++) {
+		idx[i] = stamp_percentile_index(n, ps[i]);
+		size_t j = i;
+		while (j > 0 && idx[order[j - 1]] > idx[i]) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+	}
+
+	size_t lo = 0;
+	for (size_t i = 0; i < count; i++) {
+		size_t k = idx[order[i]];
+		if (k >= lo) {
+			stamp_select_nth(arr + lo, n - lo, k - lo);
+			lo = k + 1;
+		}
+		out[order[i]] = arr[k];
+	}
+}
+
+#endif // STAMP_SELECT_H
@@ -0,0 +1,492 @@
+// RFC 8762 STAMP - ステートフル Reflector のセッション表（Section 4.3）
+// (送信元アドレス, ポート, SSID) をキーにセッションごとの Reflector 側 seq を
+// 払い出す。索引・プール・期限処理は送信元別統計表（stamp_clients.h）と共通の
+// キー付きプール（struct stamp_pool）で持つ。索引は線形探索のオープンアドレス
+// 表（8 バイトの固定長スロットにハッシュとエントリ番号のみを置く）、エントリは
+// 固定長の事前確保プールに置き、上限数を超えて確保しない。一定時間受信の無い
+// エントリは 1 秒刻みのタイマーホイール（stamp_wheel.h）で期限切れにする。
+// 受信ごとの更新は最終受信時刻の書き換えのみで、期限処理時に未到来なら付け
+// 替える。スレッド間で共有しない（Reflector はワーカーごとに表を持つ）。
+
+#ifndef STAMP_SESSION_H
+#define STAMP_SESSION_H
+
+#include "stamp_protocol.h"
+#include "stamp_wheel.h"
+
+// セッション数の既定値と上限（-s）
+#define STAMP_SESSION_DEFAULT_MAX 65536U
+#define STAMP_SESSION_MAX	  (1U << 22)
+// 無受信で期限切れとするまでの秒数の既定値（-e）
+#define STAMP_SESSION_DEFAULT_IDLE_SEC 60U
+
+#define STAMP_SESSION_NONE UINT32_MAX
+
+/**
+ * セッションのキー（memcmp で比較するため未使用部は 0 にする）
+ */
+struct stamp_session_key {
+	uint8_t addr[16]; // IPv4 は先頭 4 バイト
+	uint16_t port;	  // ネットワークバイトオーダー
+	uint16_t ssid;	  // Session-Sender Identifier（RFC 8972。未使用なら 0）
+	uint8_t family;
+	uint8_t pad[3];
+};
+
+/**
+ * プールのエントリ共通部（各表のエントリ構造体の先頭メンバーに置く）
+ */
+struct stamp_pool_entry {
+	struct stamp_session_key key; // key.family == 0 なら未使用
+	uint32_t last_seen_sec;	      // 最終受信時刻（秒）
+};
+
+/**
+ * セッション 1 件（受信ごとに触るキー・時刻・seq のみを置く）
+ */
+struct stamp_session {
+	struct stamp_pool_entry entry;
+	uint32_t next_seq; // 次に払い出す Reflector seq
+};
+
+/**
+ * 索引スロット（idx == STAMP_SESSION_NONE なら空き）
+ */
+struct stamp_session_slot {
+	uint32_t hash;
+	uint32_t idx;
+};
+
+/**
+ * 索引へ登録する（空きスロットがあること）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_session_slot_insert(struct stamp_session_slot *slots,
+			  uint32_t mask,
+			  uint32_t hash,
+			  uint32_t idx)
+{
+	uint32_t i = hash & mask;
+	while (slots[i].idx != STAMP_SESSION_NONE) {
+		i = (i + 1U) & mask;
+	}
+	slots[i] = (struct stamp_session_slot){hash, idx};
+}
+
+/**
+ * idx を指すスロットを索引から外す（後続スロットを前へ詰め、墓標を残さない）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_session_slot_delete(struct stamp_session_slot *slots,
+			  uint32_t mask,
+			  uint32_t hash,
+			  uint32_t idx)
+{
+	uint32_t i = hash & mask;
+	while (slots[i].idx != idx) {
+		i = (i + 1U) & mask;
+	}
+	for (uint32_t j = (i + 1U) & mask; slots[j].idx != STAMP_SESSION_NONE;
+	     j = (j + 1U) & mask) {
+		uint32_t home = slots[j].hash & mask;
+		// home が (i, j] の外にあれば j のスロットを i へ移せる
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			slots[i] = slots[j];
+			i = j;
+		}
+	}
+	slots[i].idx = STAMP_SESSION_NONE;
+}
+
+/**
+ * キー付きプール（索引・事前確保エントリ・空きスタック・期限のホイール）
+ * エントリは entry_size バイトの固定長で、先頭が struct stamp_pool_entry。
+ * 期限のノードはエントリから外し、同じ番号の timers[] に置く（受信ごとに
+ * 触るエントリを小さく保つ）。
+ */
+struct stamp_pool {
+	struct stamp_session_slot *slots;
+	uint32_t slot_mask;
+	void *entries;
+	struct stamp_wheel_node *timers;
+	uint32_t *free_stack; // 空きエントリ番号のスタック
+	size_t entry_size;
+	uint32_t free_count;
+	uint32_t cap;
+	uint32_t idle_sec;
+	uint32_t active;
+	uint64_t seed;
+	uint64_t last_expire_sec;
+	uint64_t expired; // 無受信で期限切れにした数
+	struct stamp_wheel wheel;
+};
+
+/**
+ * 期限切れで外す直前に呼ぶコールバック（エントリはまだ有効）
+ */
+typedef void (*stamp_pool_evict_fn)(void *ctx, struct stamp_pool_entry *e);
+
+/**
+ * セッション表
+ */
+struct stamp_session_table {
+	struct stamp_pool pool;
+	uint64_t created;
+	uint64_t overflow; // 上限到達で払い出せなかった受信数
+};
+
+/**
+ * 送信元アドレスと SSID からキーを作る
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_session_key_from(struct stamp_session_key *key,
+		       const struct sockaddr_storage *addr,
+		       uint16_t ssid)
+{
+	memset(key, 0, sizeof(*key));
+	key->family = (uint8_t)addr->ss_family;
+	key->ssid = ssid;
+	if (addr->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *sin6 =
+			(const struct sockaddr_in6 *)addr;
+		memcpy(key->addr, &sin6->sin6_addr, 16);
+		key->port = sin6->sin6_port;
+	} else {
+		const struct sockaddr_in *sin = (const struct sockaddr_in *)addr;
+		memcpy(key->addr, &sin->sin_addr, 4);
+		key->port = sin->sin_port;
+	}
+}
+
+/**
+ * キーのアドレスとポートを sockaddr_storage へ戻す（表示用）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_session_key_addr(const struct stamp_session_key *key,
+		       struct sockaddr_storage *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	if (key->family == AF_INET6) {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+		sin6->sin6_family = AF_INET6;
+		memcpy(&sin6->sin6_addr, key->addr, 16);
+		sin6->sin6_port = key->port;
+	} else {
+		struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+		sin->sin_family = AF_INET;
+		memcpy(&sin->sin_addr, key->addr, 4);
+		sin->sin_port = key->port;
+	}
+}
+
+/**
+ * Session-Sender パケットの SSID（RFC 8972: Error Estimate 直後の 2 バイト）
+ * @param buffer 受信ペイロード（STAMP_BASE_PACKET_SIZE 以上にパディング済み）
+ */
+__attribute__((nonnull(1), pure)) static inline uint16_t
+stamp_sender_ssid(const uint8_t *buffer)
+{
+	return (uint16_t)((buffer[14] << 8) | buffer[15]);
+}
+
+_Static_assert(sizeof(struct stamp_session_key) == 24,
+	       "stamp_session_hash reads the key as three 64-bit words");
+
+__attribute__((nonnull(1), pure)) static inline uint32_t
+stamp_session_hash(const struct stamp_session_key *key, uint64_t seed)
+{
+	uint64_t w[3];
+	memcpy(w, key, sizeof(w));
+	uint64_t h = seed;
+	for (int i = 0; i < 3; i++) {
+		h = (h ^ w[i]) * UINT64_C(0x9E3779B97F4A7C15);
+		h ^= h >> 29;
+	}
+	return (uint32_t)(h >> 32);
+}
+
+/**
+ * プールを確保する
+ * @param cap エントリ数の上限（1..STAMP_SESSION_MAX）
+ * @param entry_size エントリ 1 件のバイト数（先頭が struct stamp_pool_entry）
+ * @param idle_sec 無受信で期限切れとするまでの秒数（1 以上）
+ * @param seed ハッシュの種（外部から衝突を狙いにくくする）
+ * @param now_sec 現在時刻（秒、単調クロック）
+ * @return 成功時 0、引数不正・確保失敗時 -1（確保済みの領域は解放する）
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_pool_init(struct stamp_pool *pool,
+		uint32_t cap,
+		size_t entry_size,
+		uint32_t idle_sec,
+		uint64_t seed,
+		uint64_t now_sec)
+{
+	memset(pool, 0, sizeof(*pool));
+	if (cap == 0 || cap > STAMP_SESSION_MAX || idle_sec == 0 ||
+	    entry_size < sizeof(struct stamp_pool_entry)) {
+		return -1;
+	}
+	// 負荷率 1/2 以下に保つ
+	uint32_t nslots = 1;
+	while (nslots < cap * 2U) {
+		nslots <<= 1;
+	}
+	pool->slots = malloc(nslots * sizeof(*pool->slots));
+	pool->entries = calloc(cap, entry_size);
+	pool->timers = calloc(cap, sizeof(*pool->timers));
+	pool->free_stack = malloc(cap * sizeof(*pool->free_stack));
+	if (pool->slots == NULL || pool->entries == NULL ||
+	    pool->timers == NULL || pool->free_stack == NULL) {
+		free(pool->slots);
+		free(pool->entries);
+		free(pool->timers);
+		free(pool->free_stack);
+		memset(pool, 0, sizeof(*pool));
+		return -1;
+	}
+	for (uint32_t i = 0; i < nslots; i++) {
+		pool->slots[i].idx = STAMP_SESSION_NONE;
+	}
+	// 番号の小さいエントリから使う
+	for (uint32_t i = 0; i < cap; i++) {
+		pool->free_stack[i] = cap - 1U - i;
+	}
+	pool->free_count = cap;
+	pool->slot_mask = nslots - 1U;
+	pool->entry_size = entry_size;
+	pool->cap = cap;
+	pool->idle_sec = idle_sec;
+	pool->seed = seed;
+	pool->last_expire_sec = now_sec;
+	stamp_wheel_init(&pool->wheel, NSEC_PER_SEC, now_sec * NSEC_PER_SEC);
+	return 0;
+}
+
+/**
+ * プールの解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_pool_free(struct stamp_pool *pool)
+{
+	free(pool->slots);
+	free(pool->entries);
+	free(pool->timers);
+	free(pool->free_stack);
+	pool->slots = NULL;
+	pool->entries = NULL;
+	pool->timers = NULL;
+	pool->free_stack = NULL;
+	pool->cap = 0;
+	pool->free_count = 0;
+	pool->active = 0;
+}
+
+/**
+ * 番号 idx のエントリ
+ */
+__attribute__((nonnull(1), pure)) static inline struct stamp_pool_entry *
+stamp_pool_at(const struct stamp_pool *pool, uint32_t idx)
+{
+	return (struct stamp_pool_entry *)(void *)((char *)pool->entries +
+						   (size_t)idx * pool->entry_size);
+}
+
+/**
+ * キーのエントリを探す
+ * @return エントリ番号、無ければ STAMP_SESSION_NONE
+ */
+__attribute__((nonnull(1, 2))) static inline uint32_t
+stamp_pool_find(const struct stamp_pool *pool,
+		const struct stamp_session_key *key,
+		uint32_t hash)
+{
+	for (uint32_t i = hash & pool->slot_mask;; i = (i + 1U) & pool->slot_mask) {
+		const struct stamp_session_slot *slot = &pool->slots[i];
+		if (slot->idx == STAMP_SESSION_NONE) {
+			return STAMP_SESSION_NONE;
+		}
+		if (slot->hash == hash &&
+		    memcmp(&stamp_pool_at(pool, slot->idx)->key,
+			   key,
+			   sizeof(*key)) == 0) {
+			return slot->idx;
+		}
+	}
+}
+
+/**
+ * エントリを索引から外して空きへ戻す
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_pool_remove(struct stamp_pool *pool, uint32_t idx)
+{
+	struct stamp_pool_entry *e = stamp_pool_at(pool, idx);
+	stamp_session_slot_delete(pool->slots,
+				  pool->slot_mask,
+				  stamp_session_hash(&e->key, pool->seed),
+				  idx);
+	stamp_wheel_cancel(&pool->wheel, &pool->timers[idx]);
+	e->key.family = 0;
+	pool->free_stack[pool->free_count++] = idx;
+	pool->active--;
+}
+
+/**
+ * キーのエントリを引く（無ければ 0 で埋めて作り、期限を登録する）
+ * 最終受信時刻を now_sec に更新する。
+ * @param created 新規に作った場合 true を格納する
+ * @return エントリ。上限到達で作れない場合 NULL
+ */
+__attribute__((nonnull(1, 2, 4), hot)) static inline struct stamp_pool_entry *
+stamp_pool_acquire(struct stamp_pool *pool,
+		   const struct stamp_session_key *key,
+		   uint64_t now_sec,
+		   bool *created)
+{
+	uint32_t hash = stamp_session_hash(key, pool->seed);
+	uint32_t idx = stamp_pool_find(pool, key, hash);
+	*created = false;
+	if (idx == STAMP_SESSION_NONE) {
+		if (pool->free_count == 0) {
+			return NULL;
+		}
+		idx = pool->free_stack[--pool->free_count];
+		memset(stamp_pool_at(pool, idx), 0, pool->entry_size);
+		stamp_pool_at(pool, idx)->key = *key;
+		stamp_session_slot_insert(pool->slots, pool->slot_mask, hash, idx);
+		stamp_wheel_arm(&pool->wheel,
+				&pool->timers[idx],
+				(now_sec + pool->idle_sec) * NSEC_PER_SEC);
+		pool->active++;
+		*created = true;
+	}
+	struct stamp_pool_entry *e = stamp_pool_at(pool, idx);
+	e->last_seen_sec = (uint32_t)now_sec;
+	return e;
+}
+
+/**
+ * 期限処理中の状態（stamp_wheel_expire のコールバックへ渡す）
+ */
+struct stamp_pool_expiry {
+	struct stamp_pool *pool;
+	stamp_pool_evict_fn evict;
+	void *ctx;
+};
+
+static inline void stamp_pool_on_timer(struct stamp_wheel_node *node, void *arg)
+{
+	const struct stamp_pool_expiry *ex = arg;
+	struct stamp_pool *pool = ex->pool;
+	uint32_t idx = (uint32_t)(node - pool->timers);
+	struct stamp_pool_entry *e = stamp_pool_at(pool, idx);
+	uint64_t deadline = (uint64_t)e->last_seen_sec + pool->idle_sec;
+	// tick は 1 秒なので cur_tick が現在時刻（秒）
+	if (deadline > pool->wheel.cur_tick) {
+		// 期限までに受信があった。最終受信から数え直す
+		stamp_wheel_arm(&pool->wheel, node, deadline * NSEC_PER_SEC);
+		return;
+	}
+	if (ex->evict != NULL) {
+		ex->evict(ex->ctx, e);
+	}
+	stamp_pool_remove(pool, idx);
+	pool->expired++;
+}
+
+/**
+ * 無受信のまま idle_sec 経過したエントリを期限切れにする
+ * @param evict 外す直前に呼ぶコールバック（不要なら NULL）
+ * @return 期限切れにした件数
+ */
+__attribute__((nonnull(1))) static inline uint32_t
+stamp_pool_expire(struct stamp_pool *pool,
+		  uint64_t now_sec,
+		  stamp_pool_evict_fn evict,
+		  void *ctx)
+{
+	struct stamp_pool_expiry ex = {pool, evict, ctx};
+	uint64_t before = pool->expired;
+	pool->last_expire_sec = now_sec;
+	stamp_wheel_expire(&pool->wheel,
+			   now_sec * NSEC_PER_SEC,
+			   stamp_pool_on_timer,
+			   &ex);
+	return (uint32_t)(pool->expired - before);
+}
+
+/**
+ * 表を確保する
+ * @param max_sessions セッション数の上限（1..STAMP_SESSION_MAX）
+ * @param idle_sec 無受信で期限切れとするまでの秒数（1 以上）
+ * @param seed ハッシュの種（外部から衝突を狙いにくくする）
+ * @param now_sec 現在時刻（秒、単調クロック）
+ * @return 成功時 0、引数不正・確保失敗時 -1（確保済みの領域は解放する）
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_session_table_init(struct stamp_session_table *tbl,
+			 uint32_t max_sessions,
+			 uint32_t idle_sec,
+			 uint64_t seed,
+			 uint64_t now_sec)
+{
+	memset(tbl, 0, sizeof(*tbl));
+	return stamp_pool_init(&tbl->pool,
+			       max_sessions,
+			       sizeof(struct stamp_session),
+			       idle_sec,
+			       seed,
+			       now_sec);
+}
+
+/**
+ * 表の解放（未確保・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_session_table_free(struct stamp_session_table *tbl)
+{
+	stamp_pool_free(&tbl->pool);
+}
+
+/**
+ * 無受信のまま idle_sec 経過したセッションを期限切れにする
+ * @return 期限切れにした件数
+ */
+__attribute__((nonnull(1))) static inline uint32_t
+stamp_session_expire(struct stamp_session_table *tbl, uint64_t now_sec)
+{
+	return stamp_pool_expire(&tbl->pool, now_sec, NULL, NULL);
+}
+
+/**
+ * 受信 1 本分: キーのセッションの次の Reflector seq を払い出す（無ければ作る）
+ * 1 秒に 1 回、期限処理も行う。
+ * @param seq 払い出した seq（ホストバイトオーダー）
+ * @return 払い出した場合 true、上限到達で新規セッションを作れない場合 false
+ */
+__attribute__((nonnull(1, 2, 4), hot)) static inline bool
+stamp_session_next_seq(struct stamp_session_table *tbl,
+		       const struct stamp_session_key *key,
+		       uint64_t now_sec,
+		       uint32_t *seq)
+{
+	if (now_sec != tbl->pool.last_expire_sec) {
+		stamp_session_expire(tbl, now_sec);
+	}
+
+	bool created;
+	struct stamp_pool_entry *e =
+		stamp_pool_acquire(&tbl->pool, key, now_sec, &created);
+	if (e == NULL) {
+		tbl->overflow++;
+		return false;
+	}
+	if (created) {
+		tbl->created++;
+	}
+	*seq = ((struct stamp_session *)e)->next_seq++;
+	return true;
+}
+
+#endif // STAMP_SESSION_H
@@ -0,0 +1,179 @@
+// RFC 8762 STAMP - 遅延分布のストリーミング分位点スケッチ
+// HDR Histogram 型の対数線形ヒストグラム。値の 2 の冪ごとの区間を
+// STAMP_SKETCH_SUB 個の等幅バケットに分け、IEEE 754 の指数部と仮数部の
+// 上位ビットから直接バケットを求める（更新は O(1)、メモリは固定）。
+// 分位点は相対誤差 1/(2 × STAMP_SKETCH_SUB) 以内で推定し、最小・最大は
+// 正確に保持する。同じ構成のスケッチはバケットの加算で併合できる。
+// 片方向遅延はクロックずれで負になりうるため、負値は別の配列で扱う。
+
+#ifndef STAMP_SKETCH_H
+#define STAMP_SKETCH_H
+
+#include "stamp_platform.h"
+
+// 2 の冪ごとのバケット数（2^SUB_BITS）。相対誤差は 1/(2 × SUB) ≒ 0.39%
+#define STAMP_SKETCH_SUB_BITS 7U
+#define STAMP_SKETCH_SUB      (1U << STAMP_SKETCH_SUB_BITS)
+// 表現する絶対値の範囲 [2^EXP_MIN, 2^EXP_MAX)。ミリ秒単位で約 15 ns – 262 s。
+// 範囲外の値は端のバケットに入る（最小・最大は別途正確に保持する）
+#define STAMP_SKETCH_EXP_MIN (-16)
+#define STAMP_SKETCH_EXP_MAX 18
+#define STAMP_SKETCH_BUCKETS                                                   \
+	((uint32_t)(STAMP_SKETCH_EXP_MAX - STAMP_SKETCH_EXP_MIN) * STAMP_SKETCH_SUB)
+
+/**
+ * 分位点スケッチ（全 0 初期化で空）
+ */
+struct stamp_sketch {
+	uint64_t neg[STAMP_SKETCH_BUCKETS]; // 負値（絶対値でバケット化）
+	uint64_t pos[STAMP_SKETCH_BUCKETS]; // 正値
+	uint64_t zero;
+	uint64_t count;
+	double min; // count > 0 のときのみ有効
+	double max;
+};
+
+/**
+ * 正の有限値が入るバケット番号
+ */
+__attribute__((const)) static inline uint32_t stamp_sketch_index(double mag)
+{
+	uint64_t bits;
+	memcpy(&bits, &mag, sizeof(bits));
+	int exp = (int)((bits >> 52) & 0x7FFU) - 1023;
+	if (exp < STAMP_SKETCH_EXP_MIN) {
+		return 0;
+	}
+	if (exp >= STAMP_SKETCH_EXP_MAX) {
+		return STAMP_SKETCH_BUCKETS - 1U;
+	}
+	uint32_t sub = (uint32_t)(bits >> (52U - STAMP_SKETCH_SUB_BITS)) &
+		       (STAMP_SKETCH_SUB - 1U);
+	return (uint32_t)(exp - STAMP_SKETCH_EXP_MIN) * STAMP_SKETCH_SUB + sub;
+}
+
+/**
+ * バケットの代表値（区間の中点）
+ */
+__attribute__((const)) static inline double stamp_sketch_value(uint32_t index)
+{
+	int exp = (int)(index / STAMP_SKETCH_SUB) + STAMP_SKETCH_EXP_MIN;
+	double sub = (double)(index % STAMP_SKETCH_SUB);
+	return ldexp(1.0 + (sub + 0.5) / (double)STAMP_SKETCH_SUB, exp);
+}
+
+/**
+ * 値を 1 件加える（NaN・無限大は無視する）
+ */
+__attribute__((nonnull(1), hot)) static inline void
+stamp_sketch_add(struct stamp_sketch *sk, double v)
+{
+	if (unlikely(!isfinite(v))) {
+		return;
+	}
+	if (v > 0.0) {
+		sk->pos[stamp_sketch_index(v)]++;
+	} else if (v < 0.0) {
+		sk->neg[stamp_sketch_index(-v)]++;
+	} else {
+		sk->zero++;
+	}
+	if (sk->count == 0 || v < sk->min) {
+		sk->min = v;
+	}
+	if (sk->count == 0 || v > sk->max) {
+		sk->max = v;
+	}
+	sk->count++;
+}
+
+/**
+ * src の内容を dst へ併合する（dst = dst ∪ src）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_sketch_merge(struct stamp_sketch *dst, const struct stamp_sketch *src)
+{
+	if (src->count == 0) {
+		return;
+	}
+	for (uint32_t i = 0; i < STAMP_SKETCH_BUCKETS; i++) {
+		dst->neg[i] += src->neg[i];
+		dst->pos[i] += src->pos[i];
+	}
+	dst->zero += src->zero;
+	if (dst->count == 0 || src->min < dst->min) {
+		dst->min = src->min;
+	}
+	if (dst->count == 0 || src->max > dst->max) {
+		dst->max = src->max;
+	}
+	dst->count += src->count;
+}
+
+/**
+ * nearest-rank パーセンタイルの推定値（stamp_percentile_sorted と同じ定義）
+ * 順位が最小・最大に当たる場合は正確な値を返し、それ以外はバケットの中点を
+ * [min, max] に収めて返す。
+ * @param p パーセンタイル (0.0..100.0)
+ * @return 推定値。空の場合 NAN
+ */
+__attribute__((nonnull(1), pure)) static inline double
+stamp_sketch_quantile(const struct stamp_sketch *sk, double p)
+{
+	if (sk->count == 0) {
+		return NAN;
+	}
+	double r = ceil(p / 100.0 * (double)sk->count);
+	uint64_t rank = r <= 1.0 ? 1U : (uint64_t)r;
+	if (rank == 1) {
+		return sk->min;
+	}
+	if (rank >= sk->count) {
+		return sk->max;
+	}
+
+	double v = sk->max;
+	uint64_t seen = 0;
+	bool found = false;
+	// 小さい順: 負値（絶対値の大きい順）→ 0 → 正値
+	for (uint32_t i = STAMP_SKETCH_BUCKETS; i-- > 0;) {
+		seen += sk->neg[i];
+		if (seen >= rank) {
+			v = -stamp_sketch_value(i);
+			found = true;
+			break;
+		}
+	}
+	if (!found) {
+		seen += sk->zero;
+		if (seen >= rank) {
+			return 0.0;
+		}
+		for (uint32_t i = 0; i < STAMP_SKETCH_BUCKETS; i++) {
+			seen += sk->pos[i];
+			if (seen >= rank) {
+				v = stamp_sketch_value(i);
+				break;
+			}
+		}
+	}
+	if (v < sk->min) {
+		return sk->min;
+	}
+	return v > sk->max ? sk->max : v;
+}
+
+/**
+ * RFC 5481 PDV（p95 − min）の推定値（min は正確な値）
+ * @return 空の場合 NAN
+ */
+__attribute__((nonnull(1), pure)) static inline double
+stamp_sketch_pdv(const struct stamp_sketch *sk)
+{
+	if (sk->count == 0) {
+		return NAN;
+	}
+	return stamp_sketch_quantile(sk, 95.0) - sk->min;
+}
+
+#endif // STAMP_SKETCH_H
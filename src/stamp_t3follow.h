@@ -0,0 +1,121 @@
+// RFC 8762 STAMP - Reflector の T3 の事後検証（-t）
+// 応答に埋め込む T3 は送信システムコールの直前に読んだ時計の値で、そこから
+// 回線へ出るまでのスケジューリング・スタックの遅れは応答に現れない。
+// 応答ソケットで OPT_ID のキー付き TX タイムスタンプを有効にし、カーネルが
+// 送信順に振るキーごとに埋め込んだ T3 と送信元を固定長のリングへ記録して
+// おく。errqueue から後でまとめて回収した実際の送信時刻と突き合わせ、
+// 差（実際の送信時刻 − 埋め込んだ T3）を集計する。
+// 回収前にリングを一周して上書きされた記録は欠落として数える。
+// スレッド間で共有しない（Reflector はワーカーごとにソケットとリングを持つ）。
+
+#ifndef STAMP_T3FOLLOW_H
+#define STAMP_T3FOLLOW_H
+
+#include "stamp_clients.h"
+
+// 記録を保持する送信数（2 のべき乗）
+#define STAMP_T3_RING 1024U
+
+/**
+ * 送信 1 本分の記録
+ */
+struct stamp_t3_sent {
+	uint64_t t3_ns;		      // 応答に埋め込んだ T3（stamp_timestamp_to_ns）
+	struct stamp_session_key key; // 送信元（ssid は 0）
+	uint32_t tx_key;	      // OPT_ID のキー（スロットの再利用の判定）
+	bool pending;		      // 送信時刻の回収待ち
+};
+
+/**
+ * ワーカー 1 本分の状態
+ */
+struct stamp_t3_followup {
+	struct stamp_t3_sent ring[STAMP_T3_RING];
+	uint32_t next_key;	   // 次に送る datagram のキー
+	uint32_t outstanding;	   // 回収待ちの記録数
+	uint64_t last_collect_sec; // 最後に回収した時刻（秒、単調クロック）
+	uint64_t missed;	   // 送信時刻が届く前に上書きした記録数
+	uint64_t unmatched;	   // 記録の無いキーの送信時刻
+	struct stamp_t3_error total;
+};
+
+/**
+ * 初期化する
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_t3_init(struct stamp_t3_followup *f)
+{
+	memset(f, 0, sizeof(*f));
+}
+
+/**
+ * 送信に成功した応答 1 本を記録する（送信順に呼ぶ）
+ * @param t3_ns 応答に埋め込んだ T3
+ */
+__attribute__((nonnull(1, 3), hot)) static inline void
+stamp_t3_record(struct stamp_t3_followup *f,
+		uint64_t t3_ns,
+		const struct sockaddr_storage *addr)
+{
+	struct stamp_t3_sent *s = &f->ring[f->next_key & (STAMP_T3_RING - 1U)];
+	if (s->pending) {
+		f->missed++;
+		f->outstanding--;
+	}
+	s->t3_ns = t3_ns;
+	stamp_session_key_from(&s->key, addr, 0);
+	s->tx_key = f->next_key++;
+	s->pending = true;
+	f->outstanding++;
+}
+
+/**
+ * 送信が失敗してもカーネルがキーを払い出した場合に、キーを 1 つ進める
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_t3_skip_key(struct stamp_t3_followup *f)
+{
+	f->next_key++;
+}
+
+/**
+ * 回収した送信時刻を記録と突き合わせ、誤差を全体の集計へ加える
+ * @param actual_ns 実際の送信時刻（埋め込んだ T3 と同じ起点）
+ * @param out_key 対応する送信元（送信元別の集計用）
+ * @param out_err 誤差 actual − T3（ns）
+ * @return 回収待ちの記録と一致した場合 true
+ */
+__attribute__((nonnull(1, 4, 5), hot)) static inline bool
+stamp_t3_resolve(struct stamp_t3_followup *f,
+		 uint32_t tx_key,
+		 uint64_t actual_ns,
+		 struct stamp_session_key *out_key,
+		 int64_t *out_err)
+{
+	struct stamp_t3_sent *s = &f->ring[tx_key & (STAMP_T3_RING - 1U)];
+	if (!s->pending || s->tx_key != tx_key) {
+		f->unmatched++;
+		return false;
+	}
+	s->pending = false;
+	f->outstanding--;
+	*out_key = s->key;
+	*out_err = (int64_t)(actual_ns - s->t3_ns);
+	stamp_t3_error_add(&f->total, *out_err);
+	return true;
+}
+
+/**
+ * errqueue を読むべきか（回収待ちが一度に読む件数に達したか、1 秒経ったか）
+ * 送信ごとに読まず、システムコールをまとめる。
+ */
+__attribute__((nonnull(1), pure)) static inline bool
+stamp_t3_should_collect(const struct stamp_t3_followup *f,
+			uint32_t batch,
+			uint64_t now_sec)
+{
+	return f->outstanding >= batch ||
+	       (f->outstanding > 0 && now_sec != f->last_collect_sec);
+}
+
+#endif // STAMP_T3FOLLOW_H
@@ -6,15 +6,57 @@
 #include "stamp_protocol.h"
 
 // NTP小数部変換マクロ (丸め付き)（stamp_protocol.h から移設）
-// ナノ秒からNTP小数部への変換: nsec * 2^32 / 10^9
-#define NSEC_TO_NTP_FRAC(nsec)                                               \
-	((uint32_t)(((uint64_t)(nsec) * NTP_FRAC_SCALE_INT + 500000000ULL) / \
-		    NSEC_PER_SEC))
+// ナノ秒からNTP小数部への変換: nsec * 2^32 / 10^9（nsec < 2^32）
+#define NSEC_TO_NTP_FRAC(nsec) stamp_nsec_frac_round((uint32_t)(nsec))
+
+// マイクロ秒からNTP小数部への変換: usec * 2^32 / 10^6（usec < 2^32）
+#define USEC_TO_NTP_FRAC(usec) stamp_usec_frac_round((uint32_t)(usec))
+
+#ifdef __SIZEOF_INT128__
+// 5^9 / 5^6 での除算に使う逆数 ⌈2^76 / 5^9⌉、⌈2^72 / 5^6⌉。
+// m·d − 2^k ≤ 2^(k − 55) / 2^(k − 58) を満たすため、被除数がそれぞれ
+// 2^55 / 2^58 未満の範囲で商は正確（nsec・usec が 2^32 未満に相当）
+#define STAMP_DIV_5P9_MAGIC  UINT64_C(0x89705F4136B4A6)
+#define STAMP_DIV_5P9_SHIFT  76
+#define STAMP_DIV_5P6_MAGIC  UINT64_C(0x431BDE82D7B634E)
+#define STAMP_DIV_5P6_SHIFT  72
+#endif
 
-// マイクロ秒からNTP小数部への変換: usec * 2^32 / 10^6
-#define USEC_TO_NTP_FRAC(usec)                                            \
-	((uint32_t)(((uint64_t)(usec) * NTP_FRAC_SCALE_INT + 500000ULL) / \
-		    USEC_PER_SEC))
+/**
+ * ナノ秒を NTP 小数部へ丸める（⌊(nsec · 2^32 + 5·10^8) / 10^9⌋ の下位 32 ビット）
+ * 10^9 = 2^9 · 5^9 なので、被除数を先に 2^9 で割った
+ * ⌊(nsec · 2^23 + 976562) / 5^9⌋ と等しい。5^9 での除算は逆数との乗算の
+ * 上位ビットで求め、除算命令を使わない（128 ビット整数が無い環境を除く）。
+ */
+__attribute__((const)) static inline uint32_t
+stamp_nsec_frac_round(uint32_t nsec)
+{
+#ifdef __SIZEOF_INT128__
+	__extension__ typedef unsigned __int128 u128;
+	uint64_t x = ((uint64_t)nsec << 23) + 976562U;
+	return (uint32_t)(((u128)x * STAMP_DIV_5P9_MAGIC) >> STAMP_DIV_5P9_SHIFT);
+#else
+	return (uint32_t)(((uint64_t)nsec * NTP_FRAC_SCALE_INT + 500000000ULL) /
+			  NSEC_PER_SEC);
+#endif
+}
+
+/**
+ * マイクロ秒を NTP 小数部へ丸める（⌊(usec · 2^32 + 5·10^5) / 10^6⌋ の下位 32 ビット）
+ * 10^6 = 2^6 · 5^6 として stamp_nsec_frac_round() と同様に求める。
+ */
+__attribute__((const)) static inline uint32_t
+stamp_usec_frac_round(uint32_t usec)
+{
+#ifdef __SIZEOF_INT128__
+	__extension__ typedef unsigned __int128 u128;
+	uint64_t x = ((uint64_t)usec << 26) + 7812U;
+	return (uint32_t)(((u128)x * STAMP_DIV_5P6_MAGIC) >> STAMP_DIV_5P6_SHIFT);
+#else
+	return (uint32_t)(((uint64_t)usec * NTP_FRAC_SCALE_INT + 500000ULL) /
+			  USEC_PER_SEC);
+#endif
+}
 
 #ifdef _WIN32
 // Windows epoch から NTP epoch への変換定数（stamp_protocol.h から移設）
@@ -127,13 +169,12 @@ __attribute__((const)) static inline uint32_t stamp_ntp_frac_to_nsec(uint32_t nt
  */
 __attribute__((const)) static inline uint32_t stamp_nsec_to_ntp_frac(uint64_t nsec)
 {
-	uint64_t product;
-	if (__builtin_mul_overflow(nsec, NTP_FRAC_SCALE_INT, &product)) {
-		// nsec が想定範囲外（>= 2^32）の場合、最大値にクランプ
+	// nsec が想定範囲外（>= 2^32、nsec · 2^32 が 64 ビットを超える）の場合、
+	// 最大値にクランプ
+	if (unlikely(nsec > UINT32_MAX)) {
 		nsec = NSEC_PER_SEC - 1;
-		product = nsec * NTP_FRAC_SCALE_INT;
 	}
-	return (uint32_t)((product + 500000000ULL) / NSEC_PER_SEC);
+	return stamp_nsec_frac_round((uint32_t)nsec);
 }
 
 /**
@@ -152,6 +193,25 @@ stamp_timestamp_to_double(uint32_t sec, uint32_t frac, uint16_t error_estimate)
 	return stamp_ntp_to_double(sec, frac);
 }
 
+/**
+ * Z-bit に応じてタイムスタンプを整数ナノ秒に変換
+ * double 変換（現在時刻付近で分解能約 0.5 µs）では潰れる、同一時計で打刻
+ * された近接タイムスタンプ同士の差（列車内の到着間隔等）を求めるために使う。
+ * @param sec  秒部分（ネットワークバイトオーダー）
+ * @param frac 小数部分/ナノ秒部分（ネットワークバイトオーダー）
+ * @param error_estimate Error Estimate フィールド（ホストバイトオーダー）
+ * @return ナノ秒（NTP・PTP とも秒は 1900 年（NTP エポック）起点）
+ */
+__attribute__((const)) static inline uint64_t
+stamp_timestamp_to_ns(uint32_t sec, uint32_t frac, uint16_t error_estimate)
+{
+	uint64_t ns = (uint64_t)ntohl(sec) * NSEC_PER_SEC;
+	if (error_estimate & ERROR_ESTIMATE_Z_BIT) {
+		return ns + ntohl(frac);
+	}
+	return ns + stamp_ntp_frac_to_nsec(ntohl(frac));
+}
+
 /**
  * PTPタイムスタンプを取得 (CLOCK_REALTIME → PTP truncated format)
  * @param sec  秒部分（ネットワークバイトオーダー）
@@ -369,6 +429,93 @@ __attribute__((const)) static inline double stamp_clock_offset(double t1,
 	return ((t2 - t1) + (t3 - t4)) * 0.5 * MSEC_PER_SEC;
 }
 
+/**
+ * 回線上のタイムスタンプ（ホストバイトオーダーに直し、形式を添えたもの）
+ */
+struct stamp_wire_ts {
+	uint32_t sec;
+	uint32_t frac; // NTP: 2^-32 秒単位、PTP: ナノ秒
+	bool ptp;      // Error Estimate の Z ビット
+};
+
+/**
+ * パケットのタイムスタンプを整数の差分計算用に取り出す
+ * @param sec  秒部分（ネットワークバイトオーダー）
+ * @param frac 小数部分/ナノ秒部分（ネットワークバイトオーダー）
+ * @param error_estimate そのタイムスタンプの Error Estimate（ホストバイトオーダー）
+ */
+__attribute__((const)) static inline struct stamp_wire_ts
+stamp_wire_ts(uint32_t sec, uint32_t frac, uint16_t error_estimate)
+{
+	return (struct stamp_wire_ts){
+		.sec = ntohl(sec),
+		.frac = ntohl(frac),
+		.ptp = (error_estimate & ERROR_ESTIMATE_Z_BIT) != 0,
+	};
+}
+
+/**
+ * タイムスタンプの差 to − from（ナノ秒）を整数で求める
+ * 秒の差は 32 ビットの剰余で取るため、NTP の Era の境界（2036 年）を跨いでも
+ * 差が ±68 年未満なら正しい。両方が NTP 形式なら 32.32 固定小数点のまま
+ * 引いてから 1 回だけ ns へ丸め、PTP 形式同士は丸めずに求める。
+ * NTP と PTP が混在する場合は NTP 側の小数部を ns へ丸めてから引く。
+ */
+__attribute__((const)) static inline int64_t
+stamp_ts_diff_ns(struct stamp_wire_ts from, struct stamp_wire_ts to)
+{
+	if (!from.ptp && !to.ptp) {
+		uint64_t a = ((uint64_t)from.sec << 32) | from.frac;
+		uint64_t b = ((uint64_t)to.sec << 32) | to.frac;
+		int64_t d = (int64_t)(b - a);
+		// 算術シフトで秒を切り下げ、残りの小数部（非負）を ns へ丸める
+		return (d >> 32) * (int64_t)NSEC_PER_SEC +
+		       (int64_t)stamp_ntp_frac_to_nsec((uint32_t)d);
+	}
+	int64_t from_ns = from.ptp ? (int64_t)from.frac
+				   : (int64_t)stamp_ntp_frac_to_nsec(from.frac);
+	int64_t to_ns = to.ptp ? (int64_t)to.frac
+			       : (int64_t)stamp_ntp_frac_to_nsec(to.frac);
+	return (int64_t)(int32_t)(to.sec - from.sec) * (int64_t)NSEC_PER_SEC +
+	       (to_ns - from_ns);
+}
+
+/**
+ * T1〜T4 から求めた遅延（ナノ秒）
+ */
+struct stamp_delays_ns {
+	int64_t forward;   // T2 − T1
+	int64_t backward;  // T4 − T3
+	int64_t rtt;	   // forward + backward
+	int64_t offset_x2; // (T2 − T1) + (T3 − T4)（オフセットの 2 倍。0.5 ns を落とさない）
+};
+
+/**
+ * T1〜T4 から往路・復路・RTT・クロックオフセットを整数ナノ秒で求める
+ * 絶対時刻を double にすると現在時刻付近で約 0.2 µs に丸まるため、差を
+ * 整数で取ってから最後に stamp_ns_to_ms() で浮動小数点にする。
+ */
+__attribute__((nonnull(1, 2, 3, 4, 5))) static inline void
+stamp_compute_delays_ns(const struct stamp_wire_ts *t1,
+			const struct stamp_wire_ts *t2,
+			const struct stamp_wire_ts *t3,
+			const struct stamp_wire_ts *t4,
+			struct stamp_delays_ns *out)
+{
+	out->forward = stamp_ts_diff_ns(*t1, *t2);
+	out->backward = stamp_ts_diff_ns(*t3, *t4);
+	out->rtt = out->forward + out->backward;
+	out->offset_x2 = out->forward - out->backward;
+}
+
+/**
+ * ナノ秒の遅延をミリ秒へ変換
+ */
+__attribute__((const)) static inline double stamp_ns_to_ms(int64_t ns)
+{
+	return (double)ns / 1e6;
+}
+
 /**
  * パケットロス率を計算 (パーセント)
  * @param sent 送信パケット数
@@ -529,6 +676,20 @@ static inline int stamp_double_cmp(const void *a, const void *b)
 	return (x > y) - (x < y);
 }
 
+/**
+ * nearest-rank パーセンタイルの 0 始まり添字（rank = ceil(p/100 × n) − 1 を
+ * [0, n−1] に収める）。
+ * @param n 要素数（1 以上）
+ * @param p パーセンタイル (0.0..100.0)
+ */
+__attribute__((const)) static inline size_t
+stamp_percentile_index(size_t n, double p)
+{
+	double rank = ceil(p / 100.0 * (double)n);
+	size_t idx = rank <= 1.0 ? 0 : (size_t)rank - 1;
+	return idx >= n ? n - 1 : idx;
+}
+
 /**
  * 昇順ソート済み配列に対する nearest-rank パーセンタイル (RFC 7679 EDF)。
  * @param sorted 昇順ソート済み配列（非 NULL）
@@ -545,13 +706,7 @@ stamp_percentile_sorted(const double *sorted, size_t n, double p)
 	if (n == 1) {
 		return sorted[0];
 	}
-	// nearest-rank: rank = ceil(p/100 * n)、0 始まり添字に変換
-	double rank = ceil(p / 100.0 * (double)n);
-	size_t idx = rank <= 1.0 ? 0 : (size_t)rank - 1;
-	if (idx >= n) {
-		idx = n - 1;
-	}
-	return sorted[idx];
+	return sorted[stamp_percentile_index(n, p)];
 }
 
 // =============================================================================
@@ -0,0 +1,250 @@
+// RFC 8762 STAMP - Sender のパケット列車（バースト）集計
+// 連続 seq の K 本を 1 列車として、Reflector 到着時刻（T2）の広がり
+// （dispersion）、列車内の往復遅延の増加、列車内ロスを列車ごとに求めて
+// 集計する。送信（sendmmsg 等）と応答の照合は呼び出し元（sender）に委ねる。
+
+#ifndef STAMP_TRAIN_H
+#define STAMP_TRAIN_H
+
+#include "stamp_time.h" // struct stamp_welford
+
+// 列車長の上限（-B の上限、1 回の sendmmsg で送る本数）
+#define STAMP_TRAIN_MAX_LEN 64U
+
+// 同時に集計中にできる列車数（2 の冪）
+#define STAMP_TRAIN_RING_CAP  4096U
+#define STAMP_TRAIN_RING_MASK (STAMP_TRAIN_RING_CAP - 1U)
+
+/**
+ * 集計中の列車 1 本分
+ * 到着順が入れ替わっても求まるよう、T2 は最小・最大を、往復遅延は最小・
+ * 最大 seq のものを保持する。
+ */
+struct stamp_train {
+	uint32_t first_seq;
+	uint32_t lo_seq; // 受信した最小 seq
+	uint32_t hi_seq; // 受信した最大 seq
+	uint64_t min_t2_ns;
+	uint64_t max_t2_ns;
+	double lo_rtt; // lo_seq の往復遅延（ms）
+	double hi_rtt; // hi_seq の往復遅延（ms）
+	uint16_t sent;	   // 実際に送信できた本数
+	uint16_t received; // 期限内に応答を受信した本数
+	uint16_t resolved; // 受信 + ロス確定の本数（sent に達したら集計）
+	bool active;
+	bool open; // 間隔を空けて送信中（閉じるまで集計を確定しない）
+};
+
+/**
+ * 列車集計の結果（全列車分）
+ */
+struct stamp_train_summary {
+	uint32_t trains;       // 集計を終えた列車数
+	uint32_t complete;     // 全本の応答を受信した列車数
+	uint64_t packets;      // 列車として送信した本数
+	uint64_t lost;	       // 列車内でロスした本数
+	struct stamp_welford dispersion_us;     // T2 の最大 − 最小（µs）
+	struct stamp_welford delay_increase_ms; // 最大 seq − 最小 seq の往復遅延
+};
+
+/**
+ * 列車の集計表（train 番号 = (seq − base_seq) / len で直接索引するリング）
+ * 各列車は seq を len 本ずつ連続して消費する前提（送信失敗で欠番が生じても
+ * 列車の先頭 seq は len 刻みを保つこと）。
+ */
+struct stamp_train_table {
+	struct stamp_train slots[STAMP_TRAIN_RING_CAP];
+	uint32_t base_seq;
+	uint32_t len;
+	struct stamp_train_summary sum;
+};
+
+/**
+ * 集計表を初期化する
+ * @param base_seq 最初の列車の先頭 seq
+ * @param len 列車長（2..STAMP_TRAIN_MAX_LEN）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_table_init(struct stamp_train_table *tbl,
+		       uint32_t base_seq,
+		       uint32_t len)
+{
+	memset(tbl, 0, sizeof(*tbl));
+	tbl->base_seq = base_seq;
+	tbl->len = len;
+}
+
+/**
+ * 列車の集計を確定して summary へ加える（未解決の本数はロスとみなす）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_train_finish(struct stamp_train_table *tbl, struct stamp_train *tr)
+{
+	struct stamp_train_summary *sum = &tbl->sum;
+	sum->trains++;
+	sum->packets += tr->sent;
+	sum->lost += (uint64_t)(tr->sent - tr->received);
+	if (tr->received == tr->sent) {
+		sum->complete++;
+	}
+	if (tr->received >= 2) {
+		stamp_welford_update(&sum->dispersion_us,
+				     (double)(tr->max_t2_ns - tr->min_t2_ns) /
+					     1000.0);
+		stamp_welford_update(&sum->delay_increase_ms,
+				     tr->hi_rtt - tr->lo_rtt);
+	}
+	tr->active = false;
+}
+
+/**
+ * seq が属する集計中の列車（無ければ NULL）
+ */
+__attribute__((nonnull(1))) static inline struct stamp_train *
+stamp_train_lookup(struct stamp_train_table *tbl, uint32_t seq)
+{
+	uint32_t index = (seq - tbl->base_seq) / tbl->len;
+	struct stamp_train *tr = &tbl->slots[index & STAMP_TRAIN_RING_MASK];
+	if (!tr->active || (uint32_t)(seq - tr->first_seq) >= tr->sent) {
+		return NULL;
+	}
+	return tr;
+}
+
+/**
+ * 先頭 seq が first_seq の列車を保持するスロット
+ */
+__attribute__((nonnull(1))) static inline struct stamp_train *
+stamp_train_slot(struct stamp_train_table *tbl, uint32_t first_seq)
+{
+	uint32_t index = (first_seq - tbl->base_seq) / tbl->len;
+	return &tbl->slots[index & STAMP_TRAIN_RING_MASK];
+}
+
+/**
+ * 送信した列車を登録する
+ * 同じスロットに集計中の古い列車が残っていた場合は、その時点の結果で
+ * 確定させる（応答待ち表から追い出されて解決しないプローブはロス扱い）。
+ * @param first_seq 先頭 seq（base_seq から len 刻み）
+ * @param sent 送信できた本数（1..len。first_seq から連続）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_begin(struct stamp_train_table *tbl, uint32_t first_seq, uint32_t sent)
+{
+	struct stamp_train *tr = stamp_train_slot(tbl, first_seq);
+	if (tr->active) {
+		stamp_train_finish(tbl, tr);
+	}
+	memset(tr, 0, sizeof(*tr));
+	tr->first_seq = first_seq;
+	tr->sent = (uint16_t)sent;
+	tr->active = sent > 0;
+}
+
+/**
+ * 間隔を空けて 1 本ずつ送る列車を登録する（先頭の 1 本を送信済み）
+ * 残りを送り終えて stamp_train_close するまでは、送信済みの全本が解決
+ * しても集計を確定しない。
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_open(struct stamp_train_table *tbl, uint32_t first_seq)
+{
+	stamp_train_begin(tbl, first_seq, 1);
+	stamp_train_slot(tbl, first_seq)->open = true;
+}
+
+/**
+ * 送信中の列車に続きの 1 本（first_seq + sent）を加える
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_add_sent(struct stamp_train_table *tbl, uint32_t first_seq)
+{
+	struct stamp_train *tr = stamp_train_slot(tbl, first_seq);
+	if (tr->active && tr->first_seq == first_seq) {
+		tr->sent++;
+	}
+}
+
+/**
+ * 送信中の列車の送信を終える（全本解決済みならここで集計を確定する）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_close(struct stamp_train_table *tbl, uint32_t first_seq)
+{
+	struct stamp_train *tr = stamp_train_slot(tbl, first_seq);
+	if (!tr->active || tr->first_seq != first_seq) {
+		return;
+	}
+	tr->open = false;
+	if (tr->resolved >= tr->sent) {
+		stamp_train_finish(tbl, tr);
+	}
+}
+
+/**
+ * 期限内に受信した応答を列車へ反映する
+ * @param t2_ns Reflector の受信時刻（stamp_timestamp_to_ns）
+ * @param rtt_ms 往復遅延（ms）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_on_reply(struct stamp_train_table *tbl,
+		     uint32_t seq,
+		     uint64_t t2_ns,
+		     double rtt_ms)
+{
+	struct stamp_train *tr = stamp_train_lookup(tbl, seq);
+	if (tr == NULL) {
+		return;
+	}
+	if (tr->received == 0) {
+		tr->lo_seq = tr->hi_seq = seq;
+		tr->min_t2_ns = tr->max_t2_ns = t2_ns;
+		tr->lo_rtt = tr->hi_rtt = rtt_ms;
+	} else {
+		if (t2_ns < tr->min_t2_ns) {
+			tr->min_t2_ns = t2_ns;
+		}
+		if (t2_ns > tr->max_t2_ns) {
+			tr->max_t2_ns = t2_ns;
+		}
+		if ((int32_t)(seq - tr->lo_seq) < 0) {
+			tr->lo_seq = seq;
+			tr->lo_rtt = rtt_ms;
+		}
+		if ((int32_t)(seq - tr->hi_seq) > 0) {
+			tr->hi_seq = seq;
+			tr->hi_rtt = rtt_ms;
+		}
+	}
+	tr->received++;
+	if (++tr->resolved >= tr->sent && !tr->open) {
+		stamp_train_finish(tbl, tr);
+	}
+}
+
+/**
+ * 列車内のプローブのロス（応答待ちタイムアウト）を反映する
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_on_loss(struct stamp_train_table *tbl, uint32_t seq)
+{
+	struct stamp_train *tr = stamp_train_lookup(tbl, seq);
+	if (tr != NULL && ++tr->resolved >= tr->sent && !tr->open) {
+		stamp_train_finish(tbl, tr);
+	}
+}
+
+/**
+ * 集計中の列車をすべて確定する（計測終了時。未解決の本数はロス扱い）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_train_flush(struct stamp_train_table *tbl)
+{
+	for (uint32_t i = 0; i < STAMP_TRAIN_RING_CAP; i++) {
+		if (tbl->slots[i].active) {
+			stamp_train_finish(tbl, &tbl->slots[i]);
+		}
+	}
+}
+
+#endif // STAMP_TRAIN_H
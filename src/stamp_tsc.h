@@ -0,0 +1,514 @@
+// RFC 8762 STAMP - 不変 TSC による T1/T3 の打刻（-C tsc）
+// 打刻ごとの clock_gettime（vDSO）と NTP 小数部への変換を、rdtscp 1 回と
+// 事前に求めた乗算・シフトに置き換える。TSC の値から UNIX ナノ秒と
+// NTP 32.32 固定小数点への係数を CLOCK_REALTIME との対から求め、
+// バックグラウンドのスレッドが 1 秒ごとに基準点を取り直して係数を補正する
+// （打刻側は較正しない）。係数はシーケンスロックで公開し、打刻側はロックを
+// 取らない。NTP 形式は 32.32 の基準値へ差分を足すだけで除算が無い。
+// 不変 TSC（CPUID 0x80000007 EDX[8]）と rdtscp が無い CPU、カーネルが TSC を
+// クロックソースに使っていない（不安定と判定した）環境では有効にならず、
+// 呼び出し元は clock_gettime に戻す。x86-64 の Linux のみ。
+
+#ifndef STAMP_TSC_H
+#define STAMP_TSC_H
+
+#include "stamp_time.h"
+
+#if defined(__linux__) && defined(__x86_64__)
+#define STAMP_HAVE_TSC 1
+#include <cpuid.h>
+#include <pthread.h>
+#include <signal.h>
+#include <x86intrin.h>
+#endif
+
+/**
+ * 打刻に使う時計（-C）
+ */
+enum stamp_clock_source {
+	STAMP_CLOCK_SYSTEM = 0, // clock_gettime(CLOCK_REALTIME)
+	STAMP_CLOCK_TSC,	// 較正済みの不変 TSC
+};
+
+/**
+ * -C の引数を解析する（"system" / "tsc"）
+ * @return 成功時 0、不明な名前の場合 -1
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_clock_source_parse(const char *arg, enum stamp_clock_source *out)
+{
+	if (strcmp(arg, "system") == 0) {
+		*out = STAMP_CLOCK_SYSTEM;
+		return 0;
+	}
+	if (strcmp(arg, "tsc") == 0) {
+		*out = STAMP_CLOCK_TSC;
+		return 0;
+	}
+	return -1;
+}
+
+#ifdef STAMP_HAVE_TSC
+
+// 係数の固定小数点のビット数
+#define STAMP_TSC_SHIFT 32
+// 起動時の較正区間（ns）と、その後の再較正の間隔（ns）
+#define STAMP_TSC_INIT_CAL_NS 50000000ULL
+#define STAMP_TSC_RECAL_NS    NSEC_PER_SEC
+// TSC と CLOCK_REALTIME の対を読む回数（TSC の読み取り幅が最も狭い対を使う）
+#define STAMP_TSC_SAMPLE_TRIES 16
+// 1 回の再較正で受け入れる周波数の変化（ppm）。時刻の飛び（settimeofday や
+// NTP のステップ）を周波数の変化と誤認しない
+#define STAMP_TSC_MAX_SLEW_PPM 500U
+
+// 係数の計算と変換に使う 128 ビット整数（GCC/Clang の拡張）
+__extension__ typedef __int128 stamp_i128;
+__extension__ typedef unsigned __int128 stamp_u128;
+
+/**
+ * 同じ瞬間の TSC と CLOCK_REALTIME の対
+ */
+struct stamp_tsc_sample {
+	uint64_t tsc;
+	uint64_t ns; // UNIX 時刻（ns）
+};
+
+/**
+ * 変換の係数（基準点からの差分に掛ける）
+ */
+struct stamp_tsc_params {
+	uint64_t base_tsc;
+	uint64_t base_ns;  // base_tsc 時点の UNIX 時刻（ns）
+	uint64_t base_ntp; // 同じ時点の NTP 32.32 固定小数点
+	uint64_t ns_mult;  // ns  = (Δtsc × ns_mult)  >> STAMP_TSC_SHIFT
+	uint64_t ntp_mult; // ntp = (Δtsc × ntp_mult) >> STAMP_TSC_SHIFT
+};
+
+/**
+ * TSC 時計（プロセスに 1 個。打刻は全スレッドから行える）
+ */
+struct stamp_tsc_clock {
+	uint32_t seq; // シーケンスロック（奇数の間は更新中）
+	struct stamp_tsc_params params;
+	bool enabled;
+	// 以下は較正スレッドと開始・停止だけが触る
+	struct stamp_tsc_sample last; // 直近の基準点
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool stop;
+};
+
+/**
+ * CPU とカーネルが TSC の打刻に対応しているか
+ * @param reason 非対応の理由（非対応の場合のみ設定）
+ */
+__attribute__((nonnull(1), cold)) static inline bool
+stamp_tsc_supported(const char **reason)
+{
+	unsigned int eax;
+	unsigned int ebx;
+	unsigned int ecx;
+	unsigned int edx;
+	if (__get_cpuid(0x80000000U, &eax, &ebx, &ecx, &edx) == 0 ||
+	    eax < 0x80000007U) {
+		*reason = "CPU does not report TSC capabilities";
+		return false;
+	}
+	if (__get_cpuid(0x80000007U, &eax, &ebx, &ecx, &edx) == 0 ||
+	    (edx & (1U << 8)) == 0) {
+		*reason = "TSC is not invariant";
+		return false;
+	}
+	if (__get_cpuid(0x80000001U, &eax, &ebx, &ecx, &edx) == 0 ||
+	    (edx & (1U << 27)) == 0) {
+		*reason = "CPU lacks RDTSCP";
+		return false;
+	}
+	// カーネルが TSC を不安定と判定して別のクロックソースへ切り替えていれば
+	// CPU 間の同期を信用しない（読めない環境では CPUID の判定に従う）
+	char name[32] = {0};
+	FILE *fp = fopen("/sys/devices/system/clocksource/clocksource0/"
+			 "current_clocksource",
+			 "r");
+	if (fp != NULL) {
+		bool ok = fgets(name, sizeof(name), fp) == NULL ||
+			  strncmp(name, "tsc", 3) == 0;
+		fclose(fp);
+		if (!ok) {
+			*reason = "kernel clocksource is not tsc";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * TSC を読む（rdtscp は先行する命令の完了を待つ）
+ */
+__attribute__((hot)) static inline uint64_t stamp_tsc_read(void)
+{
+	unsigned int aux;
+	return __rdtscp(&aux);
+}
+
+/**
+ * TSC と CLOCK_REALTIME の対を読む
+ * 前後の TSC の幅が最も狭い対を選び、その中点を clock_gettime の瞬間とする。
+ * @return 成功時 0、clock_gettime が失敗した場合 -1
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_tsc_sample(struct stamp_tsc_sample *out)
+{
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < STAMP_TSC_SAMPLE_TRIES; i++) {
+		struct timespec ts;
+		uint64_t before = stamp_tsc_read();
+		if (clock_gettime(CLOCK_REALTIME, &ts) != 0) {
+			return -1;
+		}
+		uint64_t after = stamp_tsc_read();
+		if (after - before < best) {
+			best = after - before;
+			out->tsc = before + (after - before) / 2U;
+			out->ns = (uint64_t)ts.tv_sec * NSEC_PER_SEC +
+				  (uint64_t)ts.tv_nsec;
+		}
+	}
+	return 0;
+}
+
+/**
+ * 2 つの対から係数を求める
+ * @return 成功時 0、時刻が進んでいない場合 -1
+ */
+__attribute__((nonnull(1, 2, 3, 4))) static inline int
+stamp_tsc_mult(const struct stamp_tsc_sample *from,
+	       const struct stamp_tsc_sample *to,
+	       uint64_t *ns_mult,
+	       uint64_t *ntp_mult)
+{
+	if (to->tsc <= from->tsc || to->ns <= from->ns) {
+		return -1;
+	}
+	stamp_u128 dtsc = to->tsc - from->tsc;
+	stamp_u128 dns = to->ns - from->ns;
+	*ns_mult = (uint64_t)((dns << STAMP_TSC_SHIFT) / dtsc);
+	// 1 tick あたりの NTP 単位（2^-32 秒）は ns の 2^32 / 10^9 倍
+	*ntp_mult = (uint64_t)((dns << (32 + STAMP_TSC_SHIFT)) /
+			       (dtsc * NSEC_PER_SEC));
+	return 0;
+}
+
+/**
+ * 新しい係数を受け入れるか（前回からの変化が STAMP_TSC_MAX_SLEW_PPM 以内）
+ */
+__attribute__((const)) static inline bool
+stamp_tsc_mult_plausible(uint64_t old_mult, uint64_t new_mult)
+{
+	uint64_t diff = new_mult > old_mult ? new_mult - old_mult
+					    : old_mult - new_mult;
+	return (stamp_u128)diff * 1000000U <=
+	       (stamp_u128)old_mult * STAMP_TSC_MAX_SLEW_PPM;
+}
+
+/**
+ * 基準点と係数から変換の係数一式を組み立てる
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_tsc_params_set(struct stamp_tsc_params *p,
+		     const struct stamp_tsc_sample *base,
+		     uint64_t ns_mult,
+		     uint64_t ntp_mult)
+{
+	uint64_t sec = base->ns / NSEC_PER_SEC;
+	uint64_t nsec = base->ns % NSEC_PER_SEC;
+	p->base_tsc = base->tsc;
+	p->base_ns = base->ns;
+	// 2036 年以降は上位が桁あふれするが、秒は下位 32 ビットだけを使う
+	p->base_ntp = ((sec + NTP_OFFSET) << 32) + NSEC_TO_NTP_FRAC(nsec);
+	p->ns_mult = ns_mult;
+	p->ntp_mult = ntp_mult;
+}
+
+/**
+ * TSC の値を STAMP タイムスタンプへ変換する
+ * 基準点より前の値（CPU 間の僅かなずれ）は負の差分として扱う。
+ * @param sec 秒部分（ネットワークバイトオーダー）
+ * @param frac 小数部分（ネットワークバイトオーダー）
+ */
+__attribute__((nonnull(1, 3, 4), hot)) static inline void
+stamp_tsc_convert(const struct stamp_tsc_params *p,
+		  uint64_t tsc,
+		  uint32_t *sec,
+		  uint32_t *frac,
+		  bool ptp_mode)
+{
+	stamp_i128 delta = (int64_t)(tsc - p->base_tsc);
+	if (ptp_mode) {
+		uint64_t ns = p->base_ns +
+			      (uint64_t)(int64_t)((delta * (stamp_i128)p->ns_mult) >>
+						  STAMP_TSC_SHIFT);
+		// 定数による除算はコンパイラが乗算とシフトに置き換える
+		*sec = htonl((uint32_t)(ns / NSEC_PER_SEC + NTP_OFFSET));
+		*frac = htonl((uint32_t)(ns % NSEC_PER_SEC));
+	} else {
+		uint64_t ntp = p->base_ntp +
+			       (uint64_t)(int64_t)((delta * (stamp_i128)p->ntp_mult) >>
+						   STAMP_TSC_SHIFT);
+		*sec = htonl((uint32_t)(ntp >> 32));
+		*frac = htonl((uint32_t)ntp);
+	}
+}
+
+/**
+ * 係数を公開する（書き手は較正スレッドと開始処理だけ）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_tsc_publish(struct stamp_tsc_clock *clk, const struct stamp_tsc_params *p)
+{
+	uint32_t seq = clk->seq;
+	__atomic_store_n(&clk->seq, seq + 1U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&clk->params.base_tsc, p->base_tsc, __ATOMIC_RELAXED);
+	__atomic_store_n(&clk->params.base_ns, p->base_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&clk->params.base_ntp, p->base_ntp, __ATOMIC_RELAXED);
+	__atomic_store_n(&clk->params.ns_mult, p->ns_mult, __ATOMIC_RELAXED);
+	__atomic_store_n(&clk->params.ntp_mult, p->ntp_mult, __ATOMIC_RELAXED);
+	__atomic_store_n(&clk->seq, seq + 2U, __ATOMIC_RELEASE);
+}
+
+/**
+ * 現在時刻を STAMP タイムスタンプとして取得する（打刻用）
+ * 係数の更新と重なった場合だけ読み直す。
+ * @return 常に 0（stamp_get_timestamp と同じ形）
+ */
+__attribute__((nonnull(1, 2, 3), hot)) static inline int
+stamp_tsc_get_timestamp(struct stamp_tsc_clock *clk,
+			uint32_t *sec,
+			uint32_t *frac,
+			bool ptp_mode)
+{
+	struct stamp_tsc_params p;
+	uint32_t seq;
+	do {
+		seq = __atomic_load_n(&clk->seq, __ATOMIC_ACQUIRE);
+		p.base_tsc = __atomic_load_n(&clk->params.base_tsc, __ATOMIC_RELAXED);
+		p.base_ns = __atomic_load_n(&clk->params.base_ns, __ATOMIC_RELAXED);
+		p.base_ntp = __atomic_load_n(&clk->params.base_ntp, __ATOMIC_RELAXED);
+		p.ns_mult = __atomic_load_n(&clk->params.ns_mult, __ATOMIC_RELAXED);
+		p.ntp_mult = __atomic_load_n(&clk->params.ntp_mult, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (unlikely((seq & 1U) != 0 ||
+			  seq != __atomic_load_n(&clk->seq, __ATOMIC_RELAXED)));
+	stamp_tsc_convert(&p, stamp_tsc_read(), sec, frac, ptp_mode);
+	return 0;
+}
+
+/**
+ * 基準点を取り直し、前回の基準点からの実測で係数を補正する
+ * 時刻が戻った・飛んだ区間の実測は捨て、係数はそのままで基準点だけ移す。
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_tsc_recalibrate(struct stamp_tsc_clock *clk)
+{
+	struct stamp_tsc_sample now;
+	if (stamp_tsc_sample(&now) != 0) {
+		return;
+	}
+	uint64_t ns_mult = clk->params.ns_mult;
+	uint64_t ntp_mult = clk->params.ntp_mult;
+	uint64_t new_ns_mult;
+	uint64_t new_ntp_mult;
+	if (stamp_tsc_mult(&clk->last, &now, &new_ns_mult, &new_ntp_mult) == 0 &&
+	    stamp_tsc_mult_plausible(ns_mult, new_ns_mult)) {
+		ns_mult = new_ns_mult;
+		ntp_mult = new_ntp_mult;
+	}
+	struct stamp_tsc_params p;
+	stamp_tsc_params_set(&p, &now, ns_mult, ntp_mult);
+	stamp_tsc_publish(clk, &p);
+	clk->last = now;
+}
+
+/**
+ * 較正スレッド（停止が要求されるまで STAMP_TSC_RECAL_NS ごとに再較正する）
+ */
+__attribute__((cold)) static inline void *stamp_tsc_thread(void *arg)
+{
+	struct stamp_tsc_clock *clk = arg;
+	pthread_mutex_lock(&clk->lock);
+	while (!clk->stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += (time_t)(STAMP_TSC_RECAL_NS / NSEC_PER_SEC);
+		pthread_cond_timedwait(&clk->wake, &clk->lock, &deadline);
+		if (clk->stop) {
+			break;
+		}
+		pthread_mutex_unlock(&clk->lock);
+		stamp_tsc_recalibrate(clk);
+		pthread_mutex_lock(&clk->lock);
+	}
+	pthread_mutex_unlock(&clk->lock);
+	return NULL;
+}
+
+/**
+ * 対応を確認して初回の較正を行い、較正スレッドを起動する
+ * 初回の較正のため STAMP_TSC_INIT_CAL_NS だけ待つ。較正スレッドはシグナルを
+ * 受けない（シグナルは呼び出し元のスレッドで処理する）。
+ * @param reason 失敗の理由（失敗した場合のみ設定）
+ * @return 成功時 0、非対応・失敗の場合 -1（clk->enabled は false のまま）
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_tsc_start(struct stamp_tsc_clock *clk, const char **reason)
+{
+	memset(clk, 0, sizeof(*clk));
+	if (!stamp_tsc_supported(reason)) {
+		return -1;
+	}
+	struct stamp_tsc_sample first;
+	struct timespec wait = {0, (long)STAMP_TSC_INIT_CAL_NS};
+	uint64_t ns_mult;
+	uint64_t ntp_mult;
+	if (stamp_tsc_sample(&first) != 0 || nanosleep(&wait, NULL) != 0 ||
+	    stamp_tsc_sample(&clk->last) != 0 ||
+	    stamp_tsc_mult(&first, &clk->last, &ns_mult, &ntp_mult) != 0) {
+		*reason = "calibration against CLOCK_REALTIME failed";
+		return -1;
+	}
+	struct stamp_tsc_params p;
+	stamp_tsc_params_set(&p, &clk->last, ns_mult, ntp_mult);
+	stamp_tsc_publish(clk, &p);
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&clk->wake, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&clk->lock, NULL);
+
+	sigset_t all;
+	sigset_t saved;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+	int rc = pthread_create(&clk->thread, NULL, stamp_tsc_thread, clk);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (rc != 0) {
+		pthread_cond_destroy(&clk->wake);
+		pthread_mutex_destroy(&clk->lock);
+		*reason = "cannot start calibration thread";
+		return -1;
+	}
+	clk->enabled = true;
+	return 0;
+}
+
+/**
+ * 較正スレッドを止める（有効でなければ何もしない）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_tsc_stop(struct stamp_tsc_clock *clk)
+{
+	if (!clk->enabled) {
+		return;
+	}
+	pthread_mutex_lock(&clk->lock);
+	clk->stop = true;
+	pthread_cond_signal(&clk->wake);
+	pthread_mutex_unlock(&clk->lock);
+	pthread_join(clk->thread, NULL);
+	pthread_cond_destroy(&clk->wake);
+	pthread_mutex_destroy(&clk->lock);
+	clk->enabled = false;
+}
+
+/**
+ * 較正済みの TSC 周波数（MHz、表示用）
+ */
+__attribute__((nonnull(1), cold)) static inline double
+stamp_tsc_mhz(const struct stamp_tsc_clock *clk)
+{
+	return clk->params.ns_mult != 0
+		       ? (double)(1ULL << STAMP_TSC_SHIFT) * 1000.0 /
+				 (double)clk->params.ns_mult
+		       : 0.0;
+}
+
+#else // !STAMP_HAVE_TSC
+
+struct stamp_tsc_clock {
+	bool enabled;
+};
+
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_tsc_start(struct stamp_tsc_clock *clk, const char **reason)
+{
+	clk->enabled = false;
+	*reason = "requires x86-64 Linux";
+	return -1;
+}
+
+__attribute__((nonnull(1), cold)) static inline void
+stamp_tsc_stop(struct stamp_tsc_clock *clk)
+{
+	(void)clk;
+}
+
+__attribute__((nonnull(1, 2, 3))) static inline int
+stamp_tsc_get_timestamp(struct stamp_tsc_clock *clk,
+			uint32_t *sec,
+			uint32_t *frac,
+			bool ptp_mode)
+{
+	(void)clk;
+	return stamp_get_timestamp(sec, frac, ptp_mode);
+}
+
+__attribute__((nonnull(1), cold)) static inline double
+stamp_tsc_mhz(const struct stamp_tsc_clock *clk)
+{
+	(void)clk;
+	return 0.0;
+}
+
+#endif // STAMP_HAVE_TSC
+
+/**
+ * TSC で打刻するか（開始に成功している場合のみ）
+ */
+__attribute__((nonnull(1), pure)) static inline bool
+stamp_tsc_enabled(const struct stamp_tsc_clock *clk)
+{
+	return clk->enabled;
+}
+
+/**
+ * -C の指定に従って TSC 時計を開始する（両 main() 共通）
+ * PHC で打刻する場合（-c）は PHC を優先して TSC を使わない。TSC が使えない
+ * 環境では警告を出し、clock_gettime のまま続行する。
+ * @param phc_enabled PHC が有効化されたか
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_tsc_setup_from_options(struct stamp_tsc_clock *clk,
+			     enum stamp_clock_source source,
+			     bool phc_enabled)
+{
+	clk->enabled = false;
+	if (source != STAMP_CLOCK_TSC) {
+		return;
+	}
+	if (phc_enabled) {
+		fprintf(stderr, "Warning: -C tsc is ignored while using PHC (-c)\n");
+		return;
+	}
+	const char *reason = NULL;
+	if (stamp_tsc_start(clk, &reason) != 0) {
+		fprintf(stderr,
+			"Warning: TSC clock unavailable (%s); using system clock\n",
+			reason);
+	}
+}
+
+#endif // STAMP_TSC_H
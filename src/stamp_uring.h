@@ -0,0 +1,503 @@
+// RFC 8762 STAMP - io_uring による受信・返送 plumbing（Linux 専用・liburing 非依存）
+// provided buffer ring を用いた multishot recvmsg を常時 armed に保ち、
+// 応答は sendmsg SQE として積んで 1 回の io_uring_enter で投入と完了待ちを行う。
+// recvmsg の制御メッセージ（SCM_TIMESTAMPING / IP_TTL 等）は msghdr ビューとして
+// 取り出し、既存の stamp_extract_kernel_timestamp_linux / stamp_extract_ttl_from_cmsg
+// でそのまま解釈できるようにする。反射ポリシー（検証・T3 打刻）は呼び出し元に委ねる。
+
+#ifndef STAMP_URING_H
+#define STAMP_URING_H
+
+#include "stamp_recv.h" // STAMP_CMSG_BUFSIZE, cmsg 抽出ヘルパー
+
+#ifdef __linux__
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+// multishot recvmsg（Linux 6.0+）のヘッダー定義があれば provided buffer ring
+// （5.19+）と EXT_ARG タイムアウト（5.11+）も揃っている
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ENTER_EXT_ARG) && \
+	defined(__NR_io_uring_setup)
+#define STAMP_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef STAMP_HAVE_IO_URING
+
+#define STAMP_URING_SQ_ENTRIES 512 // 送信中バッファ数 + recv 1 本を常に収容できる数
+#define STAMP_URING_BUF_COUNT  256 // provided buffer 数（2 のべき乗）
+#define STAMP_URING_PAYLOAD_MAX                                               \
+	9216 // 1 バッファに収まる最大ペイロード（ジャンボフレーム相当）
+#define STAMP_URING_BGID 0
+
+// 1 バッファのレイアウト: io_uring_recvmsg_out | name | control | payload
+#define STAMP_URING_NAME_LEN ((uint32_t)sizeof(struct sockaddr_storage))
+#define STAMP_URING_BUF_SIZE                                            \
+	((uint32_t)(sizeof(struct io_uring_recvmsg_out) +               \
+		    sizeof(struct sockaddr_storage) + STAMP_CMSG_BUFSIZE + \
+		    STAMP_URING_PAYLOAD_MAX))
+
+// user_data 上位 8bit で完了種別、下位 16bit でバッファ ID を表す
+#define STAMP_URING_UD_RECV	   ((uint64_t)1 << 56)
+#define STAMP_URING_UD_SEND	   ((uint64_t)2 << 56)
+#define STAMP_URING_UD_KIND(ud)	   ((ud) & ((uint64_t)0xFF << 56))
+#define STAMP_URING_UD_BID(ud)	   ((uint16_t)((ud) & 0xFFFF))
+
+/**
+ * 送信中の応答 1 本分（完了まで msghdr/iovec を保持する必要がある）
+ */
+struct stamp_uring_tx {
+	struct msghdr msg;
+	struct iovec iov;
+	uint8_t ttl;
+};
+
+/**
+ * io_uring インスタンスと provided buffer ring 一式
+ * SQ/CQ のインデックスは共有メモリ上にあり、カーネルとの受け渡しは
+ * __atomic の acquire/release で行う。
+ */
+struct stamp_uring {
+	int fd;
+	// SQ
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	struct io_uring_sqe *sqes;
+	unsigned int sq_local_tail;
+	unsigned int sq_pending; // 未投入の SQE 数
+	// CQ
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	// mmap 領域
+	void *sq_ring_ptr;
+	size_t sq_ring_size;
+	void *cq_ring_ptr;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	// provided buffer ring
+	struct io_uring_buf_ring *br;
+	size_t br_size;
+	uint8_t *bufs;
+	uint16_t br_tail;
+	bool br_registered;
+	// multishot recvmsg の雛形（armed の間カーネルが参照する）
+	struct msghdr recv_tmpl;
+	bool recv_armed;
+	struct stamp_uring_tx tx[STAMP_URING_BUF_COUNT];
+};
+
+/**
+ * 受信完了 1 件分の解析結果
+ * msg は制御メッセージのみを指すビューで、cmsg 抽出ヘルパーに渡せる。
+ */
+struct stamp_uring_recv {
+	uint16_t bid;
+	struct msghdr msg;
+	struct sockaddr_storage *addr;
+	socklen_t addrlen;
+	uint8_t *payload;
+	int len;
+	bool truncated;
+};
+
+static inline void *stamp_uring_ptr_at(void *base, uint32_t off)
+{
+	return (uint8_t *)base + off;
+}
+
+/**
+ * io_uring の解放（未初期化・二重呼び出しでも安全）
+ */
+__attribute__((cold)) static inline void stamp_uring_free(struct stamp_uring *ring)
+{
+	if (ring->br_registered) {
+		struct io_uring_buf_reg reg;
+		memset(&reg, 0, sizeof(reg));
+		reg.bgid = STAMP_URING_BGID;
+		(void)syscall(__NR_io_uring_register,
+			      ring->fd,
+			      IORING_UNREGISTER_PBUF_RING,
+			      &reg,
+			      1);
+	}
+	if (ring->br) {
+		munmap(ring->br, ring->br_size);
+	}
+	free(ring->bufs);
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring_ptr && ring->cq_ring_ptr != ring->sq_ring_ptr) {
+		munmap(ring->cq_ring_ptr, ring->cq_ring_size);
+	}
+	if (ring->sq_ring_ptr) {
+		munmap(ring->sq_ring_ptr, ring->sq_ring_size);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+/**
+ * io_uring_setup（SINGLE_ISSUER|DEFER_TASKRUN は 6.1 未満では無効のため再試行）
+ * @return fd、エラー時 -1（errno 設定）
+ */
+__attribute__((cold)) static inline int
+stamp_uring_setup_fd(unsigned int entries, struct io_uring_params *params)
+{
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_DEFER_TASKRUN)
+	memset(params, 0, sizeof(*params));
+	params->flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	long fd = syscall(__NR_io_uring_setup, entries, params);
+	if (fd >= 0 || errno != EINVAL) {
+		return (int)fd;
+	}
+#endif
+	memset(params, 0, sizeof(*params));
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+/**
+ * provided buffer ring の登録と全バッファの投入
+ * @return 成功時0、エラー時-1（errno 設定）
+ */
+__attribute__((cold)) static inline int
+stamp_uring_setup_buffers(struct stamp_uring *ring)
+{
+	ring->br_size = STAMP_URING_BUF_COUNT * sizeof(struct io_uring_buf);
+	void *br = mmap(NULL,
+			ring->br_size,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0);
+	if (br == MAP_FAILED) {
+		return -1;
+	}
+	ring->br = br;
+
+	ring->bufs = aligned_alloc(64, (size_t)STAMP_URING_BUF_COUNT * STAMP_URING_BUF_SIZE);
+	if (ring->bufs == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ring->br;
+	reg.ring_entries = STAMP_URING_BUF_COUNT;
+	reg.bgid = STAMP_URING_BGID;
+	if (syscall(__NR_io_uring_register,
+		    ring->fd,
+		    IORING_REGISTER_PBUF_RING,
+		    &reg,
+		    1) < 0) {
+		return -1;
+	}
+	ring->br_registered = true;
+
+	for (uint16_t bid = 0; bid < STAMP_URING_BUF_COUNT; bid++) {
+		struct io_uring_buf *buf = &ring->br->bufs[bid];
+		buf->addr = (uint64_t)(uintptr_t)(ring->bufs +
+						  (size_t)bid * STAMP_URING_BUF_SIZE);
+		buf->len = STAMP_URING_BUF_SIZE;
+		buf->bid = bid;
+	}
+	ring->br_tail = STAMP_URING_BUF_COUNT;
+	__atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * io_uring の初期化（SQ/CQ の mmap と provided buffer ring の登録）
+ * @return 成功時0、エラー時-1（errno 設定。ENOSYS/EPERM はカーネル非対応・無効化）
+ */
+__attribute__((cold)) static inline int stamp_uring_init(struct stamp_uring *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+
+	struct io_uring_params params;
+	ring->fd = stamp_uring_setup_fd(STAMP_URING_SQ_ENTRIES, &params);
+	if (ring->fd < 0) {
+		return -1;
+	}
+
+	ring->sq_ring_size = params.sq_off.array +
+			     params.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = params.cq_off.cqes +
+			     params.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+		ring->sq_ring_size = ring->cq_ring_size;
+	}
+
+	void *sq = mmap(NULL,
+			ring->sq_ring_size,
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE,
+			ring->fd,
+			IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) {
+		goto fail;
+	}
+	ring->sq_ring_ptr = sq;
+
+	if (single_mmap) {
+		ring->cq_ring_ptr = sq;
+		ring->cq_ring_size = ring->sq_ring_size;
+	} else {
+		void *cq = mmap(NULL,
+				ring->cq_ring_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE,
+				ring->fd,
+				IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) {
+			goto fail;
+		}
+		ring->cq_ring_ptr = cq;
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes = mmap(NULL,
+			  ring->sqes_size,
+			  PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE,
+			  ring->fd,
+			  IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+	ring->sqes = sqes;
+
+	ring->sq_head = stamp_uring_ptr_at(sq, params.sq_off.head);
+	ring->sq_tail = stamp_uring_ptr_at(sq, params.sq_off.tail);
+	ring->sq_mask = *(unsigned int *)stamp_uring_ptr_at(sq, params.sq_off.ring_mask);
+	ring->cq_head = stamp_uring_ptr_at(ring->cq_ring_ptr, params.cq_off.head);
+	ring->cq_tail = stamp_uring_ptr_at(ring->cq_ring_ptr, params.cq_off.tail);
+	ring->cq_mask = *(unsigned int *)stamp_uring_ptr_at(ring->cq_ring_ptr,
+							    params.cq_off.ring_mask);
+	ring->cqes = stamp_uring_ptr_at(ring->cq_ring_ptr, params.cq_off.cqes);
+	ring->sq_local_tail = *ring->sq_tail;
+
+	// SQ 配列は SQE 番号と 1:1 に固定する
+	unsigned int *sq_array = stamp_uring_ptr_at(sq, params.sq_off.array);
+	for (unsigned int i = 0; i < params.sq_entries; i++) {
+		sq_array[i] = i;
+	}
+
+	if (stamp_uring_setup_buffers(ring) != 0) {
+		goto fail;
+	}
+
+	ring->recv_tmpl.msg_namelen = STAMP_URING_NAME_LEN;
+	ring->recv_tmpl.msg_controllen = STAMP_CMSG_BUFSIZE;
+	return 0;
+
+fail:;
+	int saved = errno;
+	stamp_uring_free(ring);
+	errno = saved;
+	return -1;
+}
+
+/**
+ * 空き SQE の取得（SQ 満杯時は NULL）
+ */
+__attribute__((hot)) static inline struct io_uring_sqe *
+stamp_uring_get_sqe(struct stamp_uring *ring)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (ring->sq_local_tail - head > ring->sq_mask) {
+		return NULL;
+	}
+	struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_local_tail++;
+	ring->sq_pending++;
+	return sqe;
+}
+
+/**
+ * multishot recvmsg の投入（provided buffer ring から受信バッファを選択）
+ * @return 成功時0、SQ 満杯時-1
+ */
+__attribute__((hot)) static inline int
+stamp_uring_arm_recv(struct stamp_uring *ring, SOCKET sockfd)
+{
+	struct io_uring_sqe *sqe = stamp_uring_get_sqe(ring);
+	if (sqe == NULL) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = sockfd;
+	sqe->addr = (uint64_t)(uintptr_t)&ring->recv_tmpl;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = STAMP_URING_BGID;
+	sqe->user_data = STAMP_URING_UD_RECV;
+	ring->recv_armed = true;
+	return 0;
+}
+
+/**
+ * バッファ bid の先頭アドレス
+ */
+__attribute__((pure)) static inline uint8_t *
+stamp_uring_buf(const struct stamp_uring *ring, uint16_t bid)
+{
+	return ring->bufs + (size_t)bid * STAMP_URING_BUF_SIZE;
+}
+
+/**
+ * 処理済みバッファを provided buffer ring へ返却
+ */
+__attribute__((hot)) static inline void
+stamp_uring_recycle(struct stamp_uring *ring, uint16_t bid)
+{
+	struct io_uring_buf *buf =
+		&ring->br->bufs[ring->br_tail & (STAMP_URING_BUF_COUNT - 1)];
+	const uint8_t *addr = stamp_uring_buf(ring, bid);
+	buf->addr = (uint64_t)(uintptr_t)addr;
+	buf->len = STAMP_URING_BUF_SIZE;
+	buf->bid = bid;
+	ring->br_tail++;
+	__atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * recvmsg 完了の解析（io_uring_recvmsg_out レイアウトの分解）
+ * @param res cqe->res（受信に使われたバッファ全体の使用量）
+ * @return 解析成功時 true
+ */
+__attribute__((hot)) static inline bool
+stamp_uring_parse_recv(const struct stamp_uring *ring,
+		       const struct io_uring_cqe *cqe,
+		       struct stamp_uring_recv *out)
+{
+	if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+		return false;
+	}
+	out->bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+	void *base = stamp_uring_buf(ring, out->bid);
+	const struct io_uring_recvmsg_out *hdr = base;
+	uint32_t name_off = (uint32_t)sizeof(*hdr);
+	uint32_t control_off = name_off + STAMP_URING_NAME_LEN;
+	uint32_t payload_off = control_off + STAMP_CMSG_BUFSIZE;
+
+	out->addr = stamp_uring_ptr_at(base, name_off);
+	out->addrlen = hdr->namelen > STAMP_URING_NAME_LEN ? STAMP_URING_NAME_LEN
+							   : hdr->namelen;
+	memset(&out->msg, 0, sizeof(out->msg));
+	out->msg.msg_control = stamp_uring_ptr_at(base, control_off);
+	out->msg.msg_controllen = hdr->controllen > STAMP_CMSG_BUFSIZE
+					  ? STAMP_CMSG_BUFSIZE
+					  : hdr->controllen;
+	out->payload = stamp_uring_ptr_at(base, payload_off);
+	out->truncated = (hdr->flags & MSG_TRUNC) != 0 ||
+			 hdr->payloadlen > STAMP_URING_PAYLOAD_MAX;
+	out->len = out->truncated ? STAMP_URING_PAYLOAD_MAX : (int)hdr->payloadlen;
+	return true;
+}
+
+/**
+ * 受信バッファ上で構築済みの応答を sendmsg SQE として積む
+ * 宛先は受信時の送信元。バッファは送信完了まで再利用してはならない。
+ * @return 成功時0、SQ 満杯時-1
+ */
+__attribute__((hot)) static inline int
+stamp_uring_queue_send(struct stamp_uring *ring,
+		       SOCKET sockfd,
+		       const struct stamp_uring_recv *rx,
+		       int send_len,
+		       uint8_t ttl)
+{
+	struct io_uring_sqe *sqe = stamp_uring_get_sqe(ring);
+	if (sqe == NULL) {
+		return -1;
+	}
+	struct stamp_uring_tx *tx = &ring->tx[rx->bid];
+	tx->iov.iov_base = rx->payload;
+	tx->iov.iov_len = (size_t)send_len;
+	memset(&tx->msg, 0, sizeof(tx->msg));
+	tx->msg.msg_name = rx->addr;
+	tx->msg.msg_namelen = rx->addrlen;
+	tx->msg.msg_iov = &tx->iov;
+	tx->msg.msg_iovlen = 1;
+	tx->ttl = ttl;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = sockfd;
+	sqe->addr = (uint64_t)(uintptr_t)&tx->msg;
+	sqe->len = 1;
+	sqe->user_data = STAMP_URING_UD_SEND | rx->bid;
+	return 0;
+}
+
+/**
+ * 積んだ SQE の投入と完了待ち（1 回の io_uring_enter）
+ * @param timeout_ms 完了が 1 件も無い場合の最大待ち時間
+ * @return 成功時0（タイムアウト含む）、エラー時-1（errno 設定。EINTR は呼び出し元で判定）
+ */
+__attribute__((hot)) static inline int
+stamp_uring_submit_and_wait(struct stamp_uring *ring, long timeout_ms)
+{
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	struct __kernel_timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.ts = (uint64_t)(uintptr_t)&ts;
+
+	long rc = syscall(__NR_io_uring_enter,
+			  ring->fd,
+			  ring->sq_pending,
+			  1,
+			  IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			  &arg,
+			  sizeof(arg));
+	if (rc < 0) {
+		return errno == ETIME ? 0 : -1;
+	}
+	ring->sq_pending = rc >= (long)ring->sq_pending
+				   ? 0
+				   : ring->sq_pending - (unsigned int)rc;
+	return 0;
+}
+
+/**
+ * 次の完了エントリ（無ければ NULL）。処理後に stamp_uring_cqe_seen() を呼ぶ。
+ */
+__attribute__((hot)) static inline struct io_uring_cqe *
+stamp_uring_peek_cqe(struct stamp_uring *ring)
+{
+	unsigned int head = *ring->cq_head;
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+	return &ring->cqes[head & ring->cq_mask];
+}
+
+__attribute__((hot)) static inline void stamp_uring_cqe_seen(struct stamp_uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif // STAMP_HAVE_IO_URING
+
+#endif // STAMP_URING_H
@@ -0,0 +1,182 @@
+// RFC 8762 STAMP - 多セッション Sender のタイマーホイール
+// 絶対時刻（単調クロック、ナノ秒）の期限を tick 単位のスロットへハッシュする
+// 単層のタイマーホイール。登録・取り消しは O(1)、期限処理は経過 tick 数に
+// 比例する。1 周（スロット数 × tick）より先の期限も同じスロットに置き、
+// 期限処理時に周回を判定する。ノードは呼び出し元の構造体に埋め込む。
+
+#ifndef STAMP_WHEEL_H
+#define STAMP_WHEEL_H
+
+#include "stamp_platform.h"
+
+// スロット数（2 の冪）
+#define STAMP_WHEEL_SLOTS 1024U
+#define STAMP_WHEEL_MASK  (STAMP_WHEEL_SLOTS - 1U)
+
+/**
+ * タイマー 1 件（呼び出し元の構造体に埋め込む。data で持ち主を指す）
+ * pprev == NULL なら未登録。
+ */
+struct stamp_wheel_node {
+	struct stamp_wheel_node *next;
+	struct stamp_wheel_node **pprev;
+	uint64_t deadline_ns;
+	void *data;
+};
+
+/**
+ * タイマーホイール本体
+ */
+struct stamp_wheel {
+	struct stamp_wheel_node *slots[STAMP_WHEEL_SLOTS];
+	uint64_t tick_ns;  // 1 スロットの時間幅
+	uint64_t cur_tick; // 期限処理済みの tick（これより前のスロットは空）
+	uint32_t count;	   // 登録中のノード数
+};
+
+/**
+ * ホイールを空の状態で初期化する
+ * @param tick_ns 1 スロットの時間幅（0 より大きいこと）
+ * @param now_ns 現在時刻（単調クロック）
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_wheel_init(struct stamp_wheel *w, uint64_t tick_ns, uint64_t now_ns)
+{
+	memset(w, 0, sizeof(*w));
+	w->tick_ns = tick_ns;
+	w->cur_tick = now_ns / tick_ns;
+}
+
+static inline void stamp_wheel_link(struct stamp_wheel_node **head,
+				    struct stamp_wheel_node *node)
+{
+	node->next = *head;
+	if (*head != NULL) {
+		(*head)->pprev = &node->next;
+	}
+	*head = node;
+	node->pprev = head;
+}
+
+/**
+ * 登録中のタイマーを取り消す（未登録なら何もしない）
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_wheel_cancel(struct stamp_wheel *w, struct stamp_wheel_node *node)
+{
+	if (node->pprev == NULL) {
+		return;
+	}
+	*node->pprev = node->next;
+	if (node->next != NULL) {
+		node->next->pprev = node->pprev;
+	}
+	node->next = NULL;
+	node->pprev = NULL;
+	w->count--;
+}
+
+/**
+ * タイマーを deadline_ns に登録する（登録中なら付け替える）
+ * 処理済みの tick より前の期限は次の期限処理で直ちに満了する。
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_wheel_arm(struct stamp_wheel *w,
+		struct stamp_wheel_node *node,
+		uint64_t deadline_ns)
+{
+	stamp_wheel_cancel(w, node);
+	uint64_t tick = deadline_ns / w->tick_ns;
+	if (tick < w->cur_tick) {
+		tick = w->cur_tick;
+	}
+	node->deadline_ns = deadline_ns;
+	stamp_wheel_link(&w->slots[tick & STAMP_WHEEL_MASK], node);
+	w->count++;
+}
+
+/**
+ * now_ns までに期限を迎えたタイマーを登録解除し、cb を呼ぶ
+ * 満了したノードを先にすべて取り出してからコールバックを呼ぶため、
+ * コールバック内で同じノードや他のノードを登録し直してよい。
+ * 満了順は tick 順（同一 tick 内の順序は不定）。
+ * @return 満了させた件数
+ */
+__attribute__((nonnull(1, 3))) static inline uint32_t
+stamp_wheel_expire(struct stamp_wheel *w,
+		   uint64_t now_ns,
+		   void (*cb)(struct stamp_wheel_node *node, void *ctx),
+		   void *ctx)
+{
+	uint64_t now_tick = now_ns / w->tick_ns;
+	if (now_tick < w->cur_tick) {
+		return 0;
+	}
+	uint64_t span = now_tick - w->cur_tick + 1U;
+	if (span > STAMP_WHEEL_SLOTS) {
+		span = STAMP_WHEEL_SLOTS;
+	}
+
+	struct stamp_wheel_node *ready = NULL;
+	struct stamp_wheel_node **ready_tail = &ready;
+	for (uint64_t i = 0; i < span; i++) {
+		struct stamp_wheel_node **head =
+			&w->slots[(w->cur_tick + i) & STAMP_WHEEL_MASK];
+		struct stamp_wheel_node *node = *head;
+		while (node != NULL) {
+			struct stamp_wheel_node *next = node->next;
+			if (node->deadline_ns <= now_ns) {
+				stamp_wheel_cancel(w, node);
+				*ready_tail = node;
+				ready_tail = &node->next;
+			}
+			node = next;
+		}
+	}
+	w->cur_tick = now_tick;
+
+	uint32_t fired = 0;
+	while (ready != NULL) {
+		struct stamp_wheel_node *node = ready;
+		ready = node->next;
+		node->next = NULL;
+		cb(node, ctx);
+		fired++;
+	}
+	return fired;
+}
+
+/**
+ * 最も早い期限を返す
+ * 1 周分のスロットを tick 順に走査し、その周回に満了するノードが最初に
+ * 見つかったスロットの最小期限を返す。1 周以内に無ければ全ノードの最小値。
+ * @param deadline_ns 期限の格納先
+ * @return 登録中のタイマーが無ければ false
+ */
+__attribute__((nonnull(1, 2))) static inline bool
+stamp_wheel_next_deadline(const struct stamp_wheel *w, uint64_t *deadline_ns)
+{
+	if (w->count == 0) {
+		return false;
+	}
+	uint64_t best = UINT64_MAX;
+	for (uint64_t i = 0; i < STAMP_WHEEL_SLOTS; i++) {
+		uint64_t tick = w->cur_tick + i;
+		for (const struct stamp_wheel_node *node =
+			     w->slots[tick & STAMP_WHEEL_MASK];
+		     node != NULL;
+		     node = node->next) {
+			if (node->deadline_ns < best) {
+				best = node->deadline_ns;
+			}
+		}
+		if (best / w->tick_ns <= tick) {
+			*deadline_ns = best;
+			return true;
+		}
+	}
+	*deadline_ns = best;
+	return true;
+}
+
+#endif // STAMP_WHEEL_H
@@ -0,0 +1,1040 @@
+// RFC 8762 STAMP - AF_XDP による反射 plumbing（Linux 専用・libbpf/libxdp 非依存）
+// インターフェースに XDP プログラム（eBPF 命令列をここで直接組み立てる）を付け、
+// Reflector のポート宛ての UDP だけを受信キューごとの AF_XDP ソケットへ振り向け
+// る（それ以外の ARP・ICMP・他ポート・IP オプション付き・断片はカーネルの
+// スタックへ渡す）。受信フレームは UMEM 上でそのまま応答へ書き換え（STAMP
+// ペイロード・Ethernet/IP/UDP ヘッダの入れ替え・チェックサム）、同じフレームを
+// TX リングへ積んで送るため、ゼロコピー対応ドライバではコピーが発生しない。
+// 対応ドライバでは XDP RX メタデータ（bpf_xdp_metadata_rx_timestamp）の HW
+// タイムスタンプをフレーム直前のメタデータ領域に置き、T2 に使える。
+// フレームの解析・書き換えは全プラットフォーム共通、ソケットと XDP プログラム
+// は Linux のみ。反射ポリシー（検証・T2/T3 打刻）は呼び出し元に委ねる。
+
+#ifndef STAMP_XDP_H
+#define STAMP_XDP_H
+
+#include "stamp_net.h"
+
+#ifdef __linux__
+#if defined(__has_include)
+#if __has_include(<linux/if_xdp.h>) && __has_include(<linux/bpf.h>) && \
+	__has_include(<linux/btf.h>) && __has_include(<linux/if_link.h>)
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/if_link.h> // XDP_FLAGS_*
+#include <linux/if_xdp.h>
+#include <poll.h>
+#include <stddef.h> // offsetof
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+// need_wakeup（5.4+）と BPF リンクによる XDP の付与（5.9+）の定義があること
+#if defined(XDP_USE_NEED_WAKEUP) && defined(XDP_FLAGS_DRV_MODE) && \
+	defined(__NR_bpf) && defined(SOL_XDP)
+#define STAMP_HAVE_AF_XDP 1
+#endif
+#endif
+
+// Ethernet ヘッダ長（VLAN タグ付きフレームは XDP プログラムがスタックへ渡す）
+#define STAMP_XDP_ETH_HLEN 14U
+// 応答の TTL / Hop Limit（Linux の既定値 ip_default_ttl と同じ）
+#define STAMP_XDP_REPLY_TTL 64U
+
+/**
+ * UMEM 上の受信フレーム 1 本の解析結果
+ */
+struct stamp_xdp_frame {
+	uint8_t *data;	      // Ethernet ヘッダ先頭
+	uint32_t len;	      // フレーム長
+	uint32_t l4_off;      // UDP ヘッダの位置
+	uint32_t payload_len; // UDP ペイロード長（UDP ヘッダの長さ欄による）
+	uint8_t family;	      // AF_INET / AF_INET6
+	uint8_t ttl;	      // 受信時の TTL / Hop Limit
+};
+
+static inline uint16_t stamp_xdp_get16(const uint8_t *p)
+{
+	return (uint16_t)((uint32_t)p[0] << 8 | p[1]);
+}
+
+static inline void stamp_xdp_put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 8);
+	p[1] = (uint8_t)v;
+}
+
+static inline void stamp_xdp_swap(uint8_t *x, uint8_t *y, size_t n)
+{
+	uint8_t tmp[16];
+	memcpy(tmp, x, n);
+	memcpy(x, y, n);
+	memcpy(y, tmp, n);
+}
+
+/**
+ * 1 の補数和へ加算する（16 ビット語はネットワークバイトオーダー）
+ */
+__attribute__((pure, nonnull(2))) static inline uint64_t
+stamp_xdp_csum_add(uint64_t sum, const uint8_t *p, uint32_t len)
+{
+	uint32_t i = 0;
+	for (; i + 1U < len; i += 2U) {
+		sum += stamp_xdp_get16(p + i);
+	}
+	if (i < len) {
+		sum += (uint64_t)p[i] << 8;
+	}
+	return sum;
+}
+
+__attribute__((const)) static inline uint16_t stamp_xdp_csum_fold(uint64_t sum)
+{
+	while (sum >> 16) {
+		sum = (sum & 0xFFFFU) + (sum >> 16);
+	}
+	return (uint16_t)~sum;
+}
+
+/**
+ * Ethernet フレームを解析し、port 宛ての UDP であれば位置と長さを返す
+ * IP の長さ欄で切り詰めるため、最小フレーム長へのパディングは含まない。
+ * @return port 宛ての UDP（断片・IPv6 拡張ヘッダなし）なら true
+ */
+__attribute__((nonnull(1, 4))) static inline bool
+stamp_xdp_parse(uint8_t *data,
+		uint32_t len,
+		uint16_t port,
+		struct stamp_xdp_frame *out)
+{
+	const uint32_t l3 = STAMP_XDP_ETH_HLEN;
+	if (len < l3 + 20U + 8U) {
+		return false;
+	}
+	uint32_t ip_end;
+	uint16_t ethertype = stamp_xdp_get16(data + 12);
+	if (ethertype == 0x0800U) {
+		uint32_t ihl = (uint32_t)(data[l3] & 0x0FU) * 4U;
+		uint32_t tot_len = stamp_xdp_get16(data + l3 + 2);
+		if ((data[l3] >> 4) != 4U || ihl < 20U || data[l3 + 9] != 17U ||
+		    (stamp_xdp_get16(data + l3 + 6) & 0x3FFFU) != 0 ||
+		    tot_len < ihl + 8U || l3 + tot_len > len) {
+			return false;
+		}
+		out->family = AF_INET;
+		out->ttl = data[l3 + 8];
+		out->l4_off = l3 + ihl;
+		ip_end = l3 + tot_len;
+	} else if (ethertype == 0x86DDU) {
+		uint32_t plen = stamp_xdp_get16(data + l3 + 4);
+		if (len < l3 + 40U + 8U || (data[l3] >> 4) != 6U ||
+		    data[l3 + 6] != 17U || plen < 8U || l3 + 40U + plen > len) {
+			return false;
+		}
+		out->family = AF_INET6;
+		out->ttl = data[l3 + 7];
+		out->l4_off = l3 + 40U;
+		ip_end = l3 + 40U + plen;
+	} else {
+		return false;
+	}
+
+	const uint8_t *udp = data + out->l4_off;
+	uint32_t udp_len = stamp_xdp_get16(udp + 4);
+	if (stamp_xdp_get16(udp + 2) != port || udp_len < 8U ||
+	    out->l4_off + udp_len > ip_end) {
+		return false;
+	}
+	out->data = data;
+	out->len = len;
+	out->payload_len = udp_len - 8U;
+	return true;
+}
+
+/**
+ * フレームの送信元アドレス・ポート
+ */
+__attribute__((nonnull(1, 2))) static inline void
+stamp_xdp_source(const struct stamp_xdp_frame *frame,
+		 struct sockaddr_storage *out)
+{
+	const uint8_t *ip = frame->data + STAMP_XDP_ETH_HLEN;
+	uint16_t sport_nbo;
+	memcpy(&sport_nbo, frame->data + frame->l4_off, sizeof(sport_nbo));
+	memset(out, 0, sizeof(*out));
+	if (frame->family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)out;
+		sin->sin_family = AF_INET;
+		sin->sin_port = sport_nbo;
+		memcpy(&sin->sin_addr, ip + 12, 4);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)out;
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = sport_nbo;
+		memcpy(&sin6->sin6_addr, ip + 8, 16);
+	}
+}
+
+/**
+ * 受信フレームのヘッダを応答用に書き換える（MAC・IP・ポートの入れ替え）
+ * ペイロード長を payload_len に合わせて IP/UDP の長さ欄とフレーム長を更新し、
+ * TTL / Hop Limit、TOS / Traffic Class・Flow Label は通常のソケットからの
+ * 送信と同じ値にする。チェックサムは stamp_xdp_finish_reply() で計算する。
+ * 呼び出し元は UDP ペイロードの後ろに payload_len までの余地を確保すること。
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_xdp_build_reply_headers(struct stamp_xdp_frame *frame,
+			      uint32_t payload_len)
+{
+	uint8_t *d = frame->data;
+	uint8_t *ip = d + STAMP_XDP_ETH_HLEN;
+	uint8_t *udp = d + frame->l4_off;
+	uint32_t udp_len = 8U + payload_len;
+
+	stamp_xdp_swap(d, d + 6, 6);
+	if (frame->family == AF_INET) {
+		stamp_xdp_swap(ip + 12, ip + 16, 4);
+		stamp_xdp_put16(ip + 2, frame->l4_off - STAMP_XDP_ETH_HLEN + udp_len);
+		ip[1] = 0;				 // TOS
+		stamp_xdp_put16(ip + 4, 0);		 // ID（DF 付きのため 0）
+		stamp_xdp_put16(ip + 6, 0x4000U);	 // DF
+		ip[8] = (uint8_t)STAMP_XDP_REPLY_TTL;
+	} else {
+		stamp_xdp_swap(ip + 8, ip + 24, 16);
+		stamp_xdp_put16(ip + 4, udp_len);
+		// Version 6、Traffic Class・Flow Label は 0
+		ip[0] = 0x60;
+		ip[1] = 0;
+		ip[2] = 0;
+		ip[3] = 0;
+		ip[7] = (uint8_t)STAMP_XDP_REPLY_TTL;
+	}
+	stamp_xdp_swap(udp, udp + 2, 2);
+	stamp_xdp_put16(udp + 4, udp_len);
+	frame->payload_len = payload_len;
+	frame->len = frame->l4_off + udp_len;
+}
+
+/**
+ * 応答の IPv4 ヘッダチェックサムと UDP チェックサムを計算する
+ * ペイロードに T3 を打刻した後、送信直前に呼ぶ。
+ */
+__attribute__((nonnull(1))) static inline void
+stamp_xdp_finish_reply(const struct stamp_xdp_frame *frame)
+{
+	uint8_t *ip = frame->data + STAMP_XDP_ETH_HLEN;
+	uint8_t *udp = frame->data + frame->l4_off;
+	uint32_t udp_len = 8U + frame->payload_len;
+	uint64_t sum;
+
+	if (frame->family == AF_INET) {
+		uint32_t ihl = frame->l4_off - STAMP_XDP_ETH_HLEN;
+		stamp_xdp_put16(ip + 10, 0);
+		stamp_xdp_put16(ip + 10, stamp_xdp_csum_fold(stamp_xdp_csum_add(0, ip, ihl)));
+		sum = stamp_xdp_csum_add(0, ip + 12, 8);
+	} else {
+		sum = stamp_xdp_csum_add(0, ip + 8, 32);
+	}
+	// 疑似ヘッダの残り（プロトコル番号と UDP 長）
+	sum += 17U + udp_len;
+	stamp_xdp_put16(udp + 6, 0);
+	uint16_t csum = stamp_xdp_csum_fold(stamp_xdp_csum_add(sum, udp, udp_len));
+	// 計算結果 0 は「チェックサムなし」と区別するため 0xFFFF で送る
+	stamp_xdp_put16(udp + 6, csum == 0 ? 0xFFFFU : csum);
+}
+
+#ifdef STAMP_HAVE_AF_XDP
+
+#ifndef BPF_F_XDP_DEV_BOUND_ONLY
+#define BPF_F_XDP_DEV_BOUND_ONLY (1U << 6)
+#endif
+
+// UMEM のフレーム（チャンク）サイズと数。フィル／完了リングは全フレームを収容する
+#define STAMP_XDP_FRAME_SIZE 2048U
+#define STAMP_XDP_FRAMES     4096U
+#define STAMP_XDP_RING_SIZE  2048U // RX / TX リング
+#define STAMP_XDP_BATCH	     64U   // 1 回に処理する受信フレーム数の上限
+// XDP プログラムの命令数の上限
+#define STAMP_XDP_MAX_INSNS 64U
+// RX メタデータ領域 {u64 HW タイムスタンプ, u64 目印}。目印はフレームが
+// 再利用されても古い値を読まないよう、読んだ側が消す
+#define STAMP_XDP_META_LEN   16U
+#define STAMP_XDP_META_MAGIC 0x5354414DU // "STAM"
+
+/**
+ * 生産者・消費者リング 1 本の mmap ビュー
+ * 自分が進める側のインデックスは cached_* に持ち、まとめて公開する。
+ */
+struct stamp_xdp_ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *descs;
+	uint32_t mask;
+	uint32_t cached_prod;
+	uint32_t cached_cons;
+	void *map;
+	size_t map_size;
+};
+
+/**
+ * キュー 1 本分の AF_XDP ソケットと UMEM
+ */
+struct stamp_xdp_socket {
+	int fd;
+	uint8_t *umem;
+	size_t umem_size;
+	struct stamp_xdp_ring fill;
+	struct stamp_xdp_ring comp;
+	struct stamp_xdp_ring rx;
+	struct stamp_xdp_ring tx;
+	bool zerocopy;
+};
+
+/**
+ * インターフェースに付けた XDP プログラムと XSKMAP
+ * リンクの fd を閉じるとプログラムはインターフェースから外れる。
+ */
+struct stamp_xdp_prog {
+	int map_fd;
+	int prog_fd;
+	int link_fd;
+	bool native; // ドライバモード（false: 汎用 SKB モード）
+	bool rx_meta; // RX メタデータの HW タイムスタンプを書き込む
+};
+
+/**
+ * XDP プログラムの命令列
+ */
+struct stamp_xdp_insns {
+	struct bpf_insn insns[STAMP_XDP_MAX_INSNS];
+	uint32_t len;
+};
+
+static inline long stamp_xdp_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static inline void stamp_xdp_insn(struct stamp_xdp_insns *prog,
+				  uint8_t code,
+				  uint8_t dst,
+				  uint8_t src,
+				  int16_t off,
+				  int32_t imm)
+{
+	struct bpf_insn *insn = &prog->insns[prog->len++];
+	memset(insn, 0, sizeof(*insn));
+	insn->code = code;
+	insn->dst_reg = dst & 0x0FU;
+	insn->src_reg = src & 0x0FU;
+	insn->off = off;
+	insn->imm = imm;
+}
+
+/**
+ * 条件ジャンプを積み、飛び先を後で埋めるため位置を返す
+ */
+static inline uint32_t stamp_xdp_jump(struct stamp_xdp_insns *prog,
+				      uint8_t op,
+				      uint8_t dst,
+				      int32_t imm)
+{
+	stamp_xdp_insn(prog, BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+	return prog->len - 1U;
+}
+
+static inline void stamp_xdp_patch(struct stamp_xdp_insns *prog,
+				   uint32_t at,
+				   uint32_t target)
+{
+	prog->insns[at].off = (int16_t)((int32_t)target - (int32_t)at - 1);
+}
+
+/**
+ * XDP プログラムを組み立てる
+ * port 宛ての UDP（IPv4 はオプションなし・非断片、IPv6 は拡張ヘッダなし）を
+ * 受信キュー番号をキーに XSKMAP のソケットへ振り向け、キューにソケットが
+ * 無い場合とそれ以外のフレームは XDP_PASS でスタックへ渡す。
+ * @param meta_kfunc_id bpf_xdp_metadata_rx_timestamp の BTF ID（0: 使わない）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_xdp_build_prog(struct stamp_xdp_insns *prog,
+		     int map_fd,
+		     uint16_t port,
+		     int32_t meta_kfunc_id)
+{
+	uint32_t to_pass[16];
+	uint32_t npass = 0;
+	const int16_t data_off = (int16_t)offsetof(struct xdp_md, data);
+	const int16_t end_off = (int16_t)offsetof(struct xdp_md, data_end);
+	const int32_t port_nbo = htons(port);
+
+	prog->len = 0;
+	// r6 = ctx（ヘルパー呼び出しをまたいで保持）
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0);
+
+	uint32_t to_parse[2];
+	uint32_t nparse = 0;
+	if (meta_kfunc_id > 0) {
+		// メタデータ領域を確保し、HW タイムスタンプと目印を書く
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0);
+		stamp_xdp_insn(prog,
+			       BPF_ALU64 | BPF_MOV | BPF_K,
+			       BPF_REG_2,
+			       0,
+			       0,
+			       -(int32_t)STAMP_XDP_META_LEN);
+		stamp_xdp_insn(prog, BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_xdp_adjust_meta);
+		to_parse[nparse++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_0, 0);
+		stamp_xdp_insn(prog, BPF_ST | BPF_MEM | BPF_DW, BPF_REG_10, 0, -8, 0);
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0);
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0);
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -8);
+		stamp_xdp_insn(prog,
+			       BPF_JMP | BPF_CALL,
+			       0,
+			       BPF_PSEUDO_KFUNC_CALL,
+			       0,
+			       meta_kfunc_id);
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_7, BPF_REG_0, 0, 0);
+		stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, data_off, 0);
+		stamp_xdp_insn(prog,
+			       BPF_LDX | BPF_MEM | BPF_W,
+			       BPF_REG_3,
+			       BPF_REG_6,
+			       (int16_t)offsetof(struct xdp_md, data_meta),
+			       0);
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+		stamp_xdp_insn(prog,
+			       BPF_ALU64 | BPF_ADD | BPF_K,
+			       BPF_REG_4,
+			       0,
+			       0,
+			       (int32_t)STAMP_XDP_META_LEN);
+		to_parse[nparse++] = prog->len;
+		stamp_xdp_insn(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+		// 取得できなかった場合はタイムスタンプ 0（目印は書く）
+		stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_1, BPF_REG_10, -8, 0);
+		stamp_xdp_insn(prog, BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_7, 0, 1, 0);
+		stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_1, 0, 0, 0);
+		stamp_xdp_insn(prog, BPF_STX | BPF_MEM | BPF_DW, BPF_REG_3, BPF_REG_1, 0, 0);
+		stamp_xdp_insn(prog,
+			       BPF_ALU64 | BPF_MOV | BPF_K,
+			       BPF_REG_1,
+			       0,
+			       0,
+			       (int32_t)STAMP_XDP_META_MAGIC);
+		stamp_xdp_insn(prog, BPF_STX | BPF_MEM | BPF_DW, BPF_REG_3, BPF_REG_1, 8, 0);
+	}
+	for (uint32_t i = 0; i < nparse; i++) {
+		stamp_xdp_patch(prog, to_parse[i], prog->len);
+	}
+
+	// r2 = data, r3 = data_end
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, data_off, 0);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6, end_off, 0);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, STAMP_XDP_ETH_HLEN);
+	to_pass[npass++] = prog->len;
+	stamp_xdp_insn(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0);
+	uint32_t to_v6 = stamp_xdp_jump(prog, BPF_JEQ, BPF_REG_5, htons(0x86DD));
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, htons(0x0800));
+
+	// IPv4: Version 4・IHL 5、UDP、断片でない、宛先ポート
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 14 + 20 + 8);
+	to_pass[npass++] = prog->len;
+	stamp_xdp_insn(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14, 0);
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, 0x45);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14 + 9, 0);
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, IPPROTO_UDP);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 14 + 6, 0);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3FFF));
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, 0);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 14 + 20 + 2, 0);
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, port_nbo);
+	uint32_t v4_to_redirect = prog->len;
+	stamp_xdp_insn(prog, BPF_JMP | BPF_JA, 0, 0, 0, 0);
+
+	// IPv6: 次ヘッダが UDP、宛先ポート
+	stamp_xdp_patch(prog, to_v6, prog->len);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 14 + 40 + 8);
+	to_pass[npass++] = prog->len;
+	stamp_xdp_insn(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14 + 6, 0);
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, IPPROTO_UDP);
+	stamp_xdp_insn(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 14 + 40 + 2, 0);
+	to_pass[npass++] = stamp_xdp_jump(prog, BPF_JNE, BPF_REG_5, port_nbo);
+
+	// return bpf_redirect_map(&xskmap, ctx->rx_queue_index, XDP_PASS)
+	stamp_xdp_patch(prog, v4_to_redirect, prog->len);
+	stamp_xdp_insn(prog,
+		       BPF_LDX | BPF_MEM | BPF_W,
+		       BPF_REG_2,
+		       BPF_REG_6,
+		       (int16_t)offsetof(struct xdp_md, rx_queue_index),
+		       0);
+	stamp_xdp_insn(prog, BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd);
+	stamp_xdp_insn(prog, 0, 0, 0, 0, 0);
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS);
+	stamp_xdp_insn(prog, BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+	stamp_xdp_insn(prog, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+	for (uint32_t i = 0; i < npass; i++) {
+		stamp_xdp_patch(prog, to_pass[i], prog->len);
+	}
+	stamp_xdp_insn(prog, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS);
+	stamp_xdp_insn(prog, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+}
+
+/**
+ * vmlinux の BTF から関数（kfunc）の BTF ID を引く
+ * @return BTF ID、見つからない・読めない場合 -1
+ */
+__attribute__((nonnull(1), cold)) static inline int32_t
+stamp_xdp_btf_func_id(const char *name)
+{
+	FILE *fp = fopen("/sys/kernel/btf/vmlinux", "rb");
+	if (fp == NULL) {
+		return -1;
+	}
+	size_t cap = 1U << 22;
+	size_t size = 0;
+	uint8_t *buf = malloc(cap);
+	while (buf != NULL) {
+		size += fread(buf + size, 1, cap - size, fp);
+		if (size < cap) {
+			break;
+		}
+		uint8_t *grown = realloc(buf, cap * 2U);
+		if (grown == NULL) {
+			free(buf);
+			buf = NULL;
+			break;
+		}
+		buf = grown;
+		cap *= 2U;
+	}
+	fclose(fp);
+
+	int32_t found = -1;
+	struct btf_header hdr;
+	if (buf == NULL || size < sizeof(hdr)) {
+		free(buf);
+		return -1;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (hdr.magic != BTF_MAGIC || (size_t)hdr.hdr_len + hdr.type_off +
+						 hdr.type_len > size ||
+	    (size_t)hdr.hdr_len + hdr.str_off + hdr.str_len > size) {
+		free(buf);
+		return -1;
+	}
+	const uint8_t *types = buf + hdr.hdr_len + hdr.type_off;
+	const char *strs = (const char *)buf + hdr.hdr_len + hdr.str_off;
+	size_t off = 0;
+	for (int32_t id = 1; off + sizeof(struct btf_type) <= hdr.type_len; id++) {
+		struct btf_type t;
+		memcpy(&t, types + off, sizeof(t));
+		off += sizeof(t);
+		uint32_t vlen = BTF_INFO_VLEN(t.info);
+		switch (BTF_INFO_KIND(t.info)) {
+		case BTF_KIND_INT:
+		case BTF_KIND_VAR:
+		case BTF_KIND_DECL_TAG:
+			off += 4U;
+			break;
+		case BTF_KIND_ARRAY:
+			off += sizeof(struct btf_array);
+			break;
+		case BTF_KIND_STRUCT:
+		case BTF_KIND_UNION:
+			off += vlen * sizeof(struct btf_member);
+			break;
+		case BTF_KIND_ENUM:
+			off += vlen * sizeof(struct btf_enum);
+			break;
+		case BTF_KIND_ENUM64:
+			off += vlen * sizeof(struct btf_enum64);
+			break;
+		case BTF_KIND_FUNC_PROTO:
+			off += vlen * sizeof(struct btf_param);
+			break;
+		case BTF_KIND_DATASEC:
+			off += vlen * sizeof(struct btf_var_secinfo);
+			break;
+		case BTF_KIND_FUNC:
+			if (t.name_off < hdr.str_len &&
+			    strcmp(strs + t.name_off, name) == 0) {
+				found = id;
+			}
+			break;
+		default:
+			break;
+		}
+		if (found > 0) {
+			break;
+		}
+	}
+	free(buf);
+	return found;
+}
+
+/**
+ * XDP プログラムを読み込んでインターフェースへ付ける
+ * @param native ドライバモードで付ける（false: 汎用 SKB モード）
+ * @param meta_kfunc_id RX メタデータ kfunc の BTF ID（0: 使わない）
+ * @return 成功時 0、エラー時 -1（errno 設定）
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_xdp_prog_load(struct stamp_xdp_prog *xp,
+		    uint32_t ifindex,
+		    uint16_t port,
+		    bool native,
+		    int32_t meta_kfunc_id)
+{
+	struct stamp_xdp_insns insns;
+	stamp_xdp_build_prog(&insns, xp->map_fd, port, meta_kfunc_id);
+
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uint64_t)(uintptr_t)insns.insns;
+	attr.insn_cnt = insns.len;
+	// kfunc の呼び出しには GPL 互換のライセンス表記が必要
+	attr.license = (uint64_t)(uintptr_t) "Dual MIT/GPL";
+	attr.expected_attach_type = BPF_XDP;
+	memcpy(attr.prog_name, "stamp_xdp", sizeof("stamp_xdp"));
+	if (meta_kfunc_id > 0) {
+		// メタデータ kfunc はデバイスに結び付けたプログラムでのみ使える
+		attr.prog_ifindex = ifindex;
+		attr.prog_flags = BPF_F_XDP_DEV_BOUND_ONLY;
+	}
+	long fd = stamp_xdp_bpf(BPF_PROG_LOAD, &attr);
+	if (fd < 0) {
+		return -1;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = (uint32_t)fd;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+	long link = stamp_xdp_bpf(BPF_LINK_CREATE, &attr);
+	if (link < 0) {
+		int saved = errno;
+		close((int)fd);
+		errno = saved;
+		return -1;
+	}
+	xp->prog_fd = (int)fd;
+	xp->link_fd = (int)link;
+	xp->native = native;
+	xp->rx_meta = meta_kfunc_id > 0;
+	return 0;
+}
+
+/**
+ * XDP プログラムの解放（インターフェースから外す。未初期化・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_xdp_prog_free(struct stamp_xdp_prog *xp)
+{
+	if (xp->link_fd >= 0) {
+		close(xp->link_fd);
+	}
+	if (xp->prog_fd >= 0) {
+		close(xp->prog_fd);
+	}
+	if (xp->map_fd >= 0) {
+		close(xp->map_fd);
+	}
+	memset(xp, 0, sizeof(*xp));
+	xp->map_fd = -1;
+	xp->prog_fd = -1;
+	xp->link_fd = -1;
+}
+
+/**
+ * XSKMAP を作り、XDP プログラムをインターフェースへ付ける
+ * ドライバモード + RX メタデータ、ドライバモード、汎用 SKB モードの順に試す。
+ * @param queues XSKMAP の大きさ（キュー 0..queues-1 にソケットを登録できる）
+ * @return 成功時 0、エラー時 -1（errno 設定）
+ */
+__attribute__((nonnull(1), cold)) static inline int
+stamp_xdp_prog_attach(struct stamp_xdp_prog *xp,
+		      uint32_t ifindex,
+		      uint16_t port,
+		      uint32_t queues)
+{
+	memset(xp, 0, sizeof(*xp));
+	xp->map_fd = -1;
+	xp->prog_fd = -1;
+	xp->link_fd = -1;
+
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(uint32_t);
+	attr.value_size = sizeof(uint32_t);
+	attr.max_entries = queues;
+	memcpy(attr.map_name, "stamp_xsk", sizeof("stamp_xsk"));
+	long map = stamp_xdp_bpf(BPF_MAP_CREATE, &attr);
+	if (map < 0) {
+		return -1;
+	}
+	xp->map_fd = (int)map;
+
+	int32_t kfunc = stamp_xdp_btf_func_id("bpf_xdp_metadata_rx_timestamp");
+	if ((kfunc > 0 && stamp_xdp_prog_load(xp, ifindex, port, true, kfunc) == 0) ||
+	    stamp_xdp_prog_load(xp, ifindex, port, true, 0) == 0 ||
+	    stamp_xdp_prog_load(xp, ifindex, port, false, 0) == 0) {
+		return 0;
+	}
+	int saved = errno;
+	stamp_xdp_prog_free(xp);
+	errno = saved;
+	return -1;
+}
+
+/**
+ * リング 1 本を mmap する
+ * @param desc_size 記述子 1 個の大きさ
+ * @return 成功時 0、エラー時 -1（errno 設定）
+ */
+__attribute__((nonnull(3, 6), cold)) static inline int
+stamp_xdp_ring_map(int fd,
+		   uint64_t pgoff,
+		   const struct xdp_ring_offset *off,
+		   uint32_t size,
+		   size_t desc_size,
+		   struct stamp_xdp_ring *ring)
+{
+	ring->map_size = off->desc + size * desc_size;
+	void *map = mmap(NULL,
+			 ring->map_size,
+			 PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE,
+			 fd,
+			 (off_t)pgoff);
+	if (map == MAP_FAILED) {
+		ring->map = NULL;
+		return -1;
+	}
+	ring->map = map;
+	ring->producer = (uint32_t *)(void *)((uint8_t *)map + off->producer);
+	ring->consumer = (uint32_t *)(void *)((uint8_t *)map + off->consumer);
+	ring->flags = (uint32_t *)(void *)((uint8_t *)map + off->flags);
+	ring->descs = (uint8_t *)map + off->desc;
+	ring->mask = size - 1U;
+	ring->cached_prod = __atomic_load_n(ring->producer, __ATOMIC_ACQUIRE);
+	ring->cached_cons = __atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE);
+	return 0;
+}
+
+/**
+ * 生産側（フィル / TX）: 最大 n 個の空きを確保する
+ * @param idx 確保した先頭の位置
+ * @return 確保できた数
+ */
+__attribute__((hot, nonnull(1, 3))) static inline uint32_t
+stamp_xdp_ring_reserve(struct stamp_xdp_ring *ring, uint32_t n, uint32_t *idx)
+{
+	uint32_t size = ring->mask + 1U;
+	uint32_t free_slots = size - (ring->cached_prod - ring->cached_cons);
+	if (free_slots < n) {
+		ring->cached_cons = __atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE);
+		free_slots = size - (ring->cached_prod - ring->cached_cons);
+	}
+	if (n > free_slots) {
+		n = free_slots;
+	}
+	*idx = ring->cached_prod;
+	ring->cached_prod += n;
+	return n;
+}
+
+/**
+ * 生産側: 確保して書き込んだ記述子をカーネルへ公開する
+ */
+__attribute__((hot, nonnull(1))) static inline void
+stamp_xdp_ring_submit(struct stamp_xdp_ring *ring)
+{
+	__atomic_store_n(ring->producer, ring->cached_prod, __ATOMIC_RELEASE);
+}
+
+/**
+ * 消費側（RX / 完了）: 最大 n 個の記述子を取り出す
+ * @param idx 取り出した先頭の位置
+ * @return 取り出せた数（処理後に stamp_xdp_ring_release() を呼ぶ）
+ */
+__attribute__((hot, nonnull(1, 3))) static inline uint32_t
+stamp_xdp_ring_peek(struct stamp_xdp_ring *ring, uint32_t n, uint32_t *idx)
+{
+	uint32_t avail = ring->cached_prod - ring->cached_cons;
+	if (avail == 0) {
+		ring->cached_prod = __atomic_load_n(ring->producer, __ATOMIC_ACQUIRE);
+		avail = ring->cached_prod - ring->cached_cons;
+	}
+	if (n > avail) {
+		n = avail;
+	}
+	*idx = ring->cached_cons;
+	ring->cached_cons += n;
+	return n;
+}
+
+/**
+ * 消費側: 取り出した記述子をカーネルへ返す
+ */
+__attribute__((hot, nonnull(1))) static inline void
+stamp_xdp_ring_release(struct stamp_xdp_ring *ring)
+{
+	__atomic_store_n(ring->consumer, ring->cached_cons, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t *stamp_xdp_addr_at(const struct stamp_xdp_ring *ring,
+					  uint32_t idx)
+{
+	return (uint64_t *)ring->descs + (idx & ring->mask);
+}
+
+static inline struct xdp_desc *stamp_xdp_desc_at(const struct stamp_xdp_ring *ring,
+						 uint32_t idx)
+{
+	return (struct xdp_desc *)ring->descs + (idx & ring->mask);
+}
+
+/**
+ * AF_XDP ソケットの解放（未初期化・二重呼び出しでも安全）
+ */
+__attribute__((nonnull(1), cold)) static inline void
+stamp_xdp_socket_free(struct stamp_xdp_socket *xsk)
+{
+	struct stamp_xdp_ring *rings[] = {&xsk->fill, &xsk->comp, &xsk->rx, &xsk->tx};
+	for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+		if (rings[i]->map != NULL) {
+			munmap(rings[i]->map, rings[i]->map_size);
+		}
+	}
+	if (xsk->fd >= 0) {
+		close(xsk->fd);
+	}
+	if (xsk->umem != NULL) {
+		munmap(xsk->umem, xsk->umem_size);
+	}
+	memset(xsk, 0, sizeof(*xsk));
+	xsk->fd = -1;
+}
+
+/**
+ * フレームをフィルリングへ返す（全フレーム数を収容できるため満杯にならない）
+ */
+__attribute__((hot, nonnull(1))) static inline void
+stamp_xdp_fill(struct stamp_xdp_socket *xsk, uint64_t addr)
+{
+	uint32_t idx;
+	if (stamp_xdp_ring_reserve(&xsk->fill, 1, &idx) == 1) {
+		*stamp_xdp_addr_at(&xsk->fill, idx) =
+			addr & ~(uint64_t)(STAMP_XDP_FRAME_SIZE - 1U);
+	}
+}
+
+/**
+ * 送信を終えたフレームを完了リングからフィルリングへ戻す
+ */
+__attribute__((hot, nonnull(1))) static inline void
+stamp_xdp_recycle_completions(struct stamp_xdp_socket *xsk)
+{
+	uint32_t idx;
+	uint32_t n = stamp_xdp_ring_peek(&xsk->comp, STAMP_XDP_FRAMES, &idx);
+	if (n == 0) {
+		return;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		stamp_xdp_fill(xsk, *stamp_xdp_addr_at(&xsk->comp, idx + i));
+	}
+	stamp_xdp_ring_release(&xsk->comp);
+	stamp_xdp_ring_submit(&xsk->fill);
+}
+
+/**
+ * TX リングに積んだフレームの送信をカーネルへ促す（必要な場合のみ）
+ */
+__attribute__((hot, nonnull(1))) static inline void
+stamp_xdp_kick_tx(const struct stamp_xdp_socket *xsk)
+{
+	if (__atomic_load_n(xsk->tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+		(void)sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+	}
+}
+
+/**
+ * UMEM 上のアドレスのフレーム
+ */
+__attribute__((pure, nonnull(1))) static inline uint8_t *
+stamp_xdp_frame_data(const struct stamp_xdp_socket *xsk, uint64_t addr)
+{
+	return xsk->umem + addr;
+}
+
+/**
+ * フレームの先頭（addr）からチャンク末尾までのバイト数
+ */
+__attribute__((const)) static inline uint32_t stamp_xdp_frame_room(uint64_t addr)
+{
+	return STAMP_XDP_FRAME_SIZE -
+	       (uint32_t)(addr & (STAMP_XDP_FRAME_SIZE - 1U));
+}
+
+/**
+ * XDP プログラムがフレーム直前に置いた RX HW タイムスタンプを取り出す
+ * 読んだ目印は消す（フレームの再利用時に古い値を読まないため）。
+ * @return タイムスタンプ（ナノ秒）があれば true
+ */
+__attribute__((hot, nonnull(1, 3))) static inline bool
+stamp_xdp_rx_timestamp(uint8_t *data, uint64_t addr, uint64_t *ns)
+{
+	if ((addr & (STAMP_XDP_FRAME_SIZE - 1U)) < STAMP_XDP_META_LEN) {
+		return false;
+	}
+	uint64_t magic;
+	memcpy(&magic, data - 8, sizeof(magic));
+	if (magic != STAMP_XDP_META_MAGIC) {
+		return false;
+	}
+	memset(data - 8, 0, sizeof(magic));
+	memcpy(ns, data - STAMP_XDP_META_LEN, sizeof(*ns));
+	return *ns != 0;
+}
+
+/**
+ * キュー queue の AF_XDP ソケットを作り、XSKMAP へ登録する
+ * ゼロコピーで bind できなければコピーモードで bind し直す。
+ * @return 成功時 0、エラー時 -1（errno 設定）
+ */
+__attribute__((nonnull(1, 2), cold)) static inline int
+stamp_xdp_socket_init(struct stamp_xdp_socket *xsk,
+		      const struct stamp_xdp_prog *xp,
+		      uint32_t ifindex,
+		      uint32_t queue)
+{
+	memset(xsk, 0, sizeof(*xsk));
+	xsk->fd = -1;
+
+	xsk->umem_size = (size_t)STAMP_XDP_FRAMES * STAMP_XDP_FRAME_SIZE;
+	void *umem = mmap(NULL,
+			  xsk->umem_size,
+			  PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+			  -1,
+			  0);
+	if (umem == MAP_FAILED) {
+		return -1;
+	}
+	xsk->umem = umem;
+	xsk->fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (xsk->fd < 0) {
+		goto fail;
+	}
+
+	struct xdp_umem_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.addr = (uint64_t)(uintptr_t)xsk->umem;
+	reg.len = xsk->umem_size;
+	reg.chunk_size = STAMP_XDP_FRAME_SIZE;
+	uint32_t frames = STAMP_XDP_FRAMES;
+	uint32_t ring_size = STAMP_XDP_RING_SIZE;
+	if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) != 0 ||
+	    setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &frames, sizeof(frames)) != 0 ||
+	    setsockopt(xsk->fd,
+		       SOL_XDP,
+		       XDP_UMEM_COMPLETION_RING,
+		       &frames,
+		       sizeof(frames)) != 0 ||
+	    setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) != 0 ||
+	    setsockopt(xsk->fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) != 0) {
+		goto fail;
+	}
+
+	struct xdp_mmap_offsets off;
+	socklen_t optlen = sizeof(off);
+	if (getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0 ||
+	    stamp_xdp_ring_map(xsk->fd,
+			       XDP_UMEM_PGOFF_FILL_RING,
+			       &off.fr,
+			       frames,
+			       sizeof(uint64_t),
+			       &xsk->fill) != 0 ||
+	    stamp_xdp_ring_map(xsk->fd,
+			       XDP_UMEM_PGOFF_COMPLETION_RING,
+			       &off.cr,
+			       frames,
+			       sizeof(uint64_t),
+			       &xsk->comp) != 0 ||
+	    stamp_xdp_ring_map(xsk->fd,
+			       XDP_PGOFF_RX_RING,
+			       &off.rx,
+			       ring_size,
+			       sizeof(struct xdp_desc),
+			       &xsk->rx) != 0 ||
+	    stamp_xdp_ring_map(xsk->fd,
+			       XDP_PGOFF_TX_RING,
+			       &off.tx,
+			       ring_size,
+			       sizeof(struct xdp_desc),
+			       &xsk->tx) != 0) {
+		goto fail;
+	}
+
+	// 全フレームを受信用にフィルリングへ積む
+	uint32_t idx;
+	(void)stamp_xdp_ring_reserve(&xsk->fill, frames, &idx);
+	for (uint32_t i = 0; i < frames; i++) {
+		*stamp_xdp_addr_at(&xsk->fill, idx + i) =
+			(uint64_t)i * STAMP_XDP_FRAME_SIZE;
+	}
+	stamp_xdp_ring_submit(&xsk->fill);
+
+	struct sockaddr_xdp sxdp;
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = ifindex;
+	sxdp.sxdp_queue_id = queue;
+	sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+	if (bind(xsk->fd, (const struct sockaddr *)&sxdp, sizeof(sxdp)) != 0) {
+		sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+		if (bind(xsk->fd, (const struct sockaddr *)&sxdp, sizeof(sxdp)) != 0) {
+			goto fail;
+		}
+	}
+	struct xdp_options opts;
+	optlen = sizeof(opts);
+	if (getsockopt(xsk->fd, SOL_XDP, XDP_OPTIONS, &opts, &optlen) == 0) {
+		xsk->zerocopy = (opts.flags & XDP_OPTIONS_ZEROCOPY) != 0;
+	}
+
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = (uint32_t)xp->map_fd;
+	attr.key = (uint64_t)(uintptr_t)&queue;
+	attr.value = (uint64_t)(uintptr_t)&xsk->fd;
+	if (stamp_xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+		goto fail;
+	}
+	return 0;
+
+fail:;
+	int saved = errno;
+	stamp_xdp_socket_free(xsk);
+	errno = saved;
+	return -1;
+}
+
+#endif // STAMP_HAVE_AF_XDP
+
+#endif // STAMP_XDP_H
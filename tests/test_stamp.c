@@ -353,6 +353,23 @@ static void test_stamp_parse_u32_range(void)
 		    "stamp_parse_u32_range negative rejected");
 }
 
+// 0 を許す uint32 パーサのテスト（-J / -G の明示的な 0）
+static void test_stamp_parse_u32_or_zero(void)
+{
+	uint32_t v = 7;
+
+	EXPECT_TRUE(stamp_parse_u32_or_zero("0", &v, UINT32_MAX) == 0 && v == 0,
+		    "stamp_parse_u32_or_zero 0 accepted");
+	EXPECT_TRUE(stamp_parse_u32_or_zero("100", &v, 100) == 0 && v == 100,
+		    "stamp_parse_u32_or_zero at max accepted");
+	EXPECT_TRUE(stamp_parse_u32_or_zero("101", &v, 100) != 0,
+		    "stamp_parse_u32_or_zero over max rejected");
+	EXPECT_TRUE(stamp_parse_u32_or_zero("-0", &v, UINT32_MAX) != 0,
+		    "stamp_parse_u32_or_zero sign rejected");
+	EXPECT_TRUE(stamp_parse_u32_or_zero("", &v, UINT32_MAX) != 0,
+		    "stamp_parse_u32_or_zero empty rejected");
+}
+
 // アドレスファミリ表示文字列のテスト
 static void test_stamp_family_str(void)
 {
@@ -667,7 +684,10 @@ static int pick_free_udp_port_ipv4(uint16_t *out_port)
 	return 0;
 }
 
-static int start_reflector_subprocess(uint16_t port, pid_t *out_pid)
+// extra_opts: "-4" の後に渡す追加オプション（NULL 終端、NULL なら追加なし）
+static int start_reflector_subprocess_opts(uint16_t port,
+					   char *const *extra_opts,
+					   pid_t *out_pid)
 {
 	if (out_pid == NULL) {
 		return -1;
@@ -690,7 +710,17 @@ static int start_reflector_subprocess(uint16_t port, pid_t *out_pid)
 				(void)close(devnull);
 			}
 		}
-		char *const argv[] = {"./reflector", "-4", port_str, NULL};
+		char *argv[16];
+		size_t argc = 0;
+		argv[argc++] = "./reflector";
+		argv[argc++] = "-4";
+		for (size_t i = 0; extra_opts != NULL && extra_opts[i] != NULL &&
+				   argc < 14;
+		     i++) {
+			argv[argc++] = extra_opts[i];
+		}
+		argv[argc++] = port_str;
+		argv[argc] = NULL;
 		execv("./reflector", argv);
 		_exit(127);
 	}
@@ -699,6 +729,11 @@ static int start_reflector_subprocess(uint16_t port, pid_t *out_pid)
 	return 0;
 }
 
+static int start_reflector_subprocess(uint16_t port, pid_t *out_pid)
+{
+	return start_reflector_subprocess_opts(port, NULL, out_pid);
+}
+
 static void stop_reflector_subprocess(pid_t pid)
 {
 	if (pid <= 0) {
@@ -934,6 +969,118 @@ cleanup:
 }
 #endif
 
+#ifdef __linux__
+// 追加オプション付きで reflector を起動し、複数の送信元ポートからの
+// プローブがすべて各自の送信元へ反射されることを検証する
+static void reflector_loopback_multi_client_impl(char *const *extra_opts,
+						  const char *label)
+{
+	enum { CLIENTS = 8, PROBES = 4 };
+	char msg[128];
+	uint16_t port = 0;
+	pid_t reflector_pid = -1;
+	SOCKET socks[CLIENTS];
+	for (int c = 0; c < CLIENTS; c++) {
+		socks[c] = INVALID_SOCKET;
+	}
+
+	if (pick_free_udp_port_ipv4(&port) != 0 || port == 0) {
+		snprintf(msg, sizeof(msg), "%s (port allocation failed)", label);
+		SKIP_TEST(msg);
+		return;
+	}
+	if (start_reflector_subprocess_opts(port, extra_opts, &reflector_pid) !=
+	    0) {
+		snprintf(msg, sizeof(msg), "%s (failed to start reflector)", label);
+		SKIP_TEST(msg);
+		return;
+	}
+	sleep_ms_for_test(150);
+
+	int status = 0;
+	if (waitpid(reflector_pid, &status, WNOHANG) == reflector_pid) {
+		snprintf(msg, sizeof(msg), "%s: subprocess exited early", label);
+		EXPECT_TRUE(0, msg);
+		goto cleanup;
+	}
+
+	struct sockaddr_in dest;
+	memset(&dest, 0, sizeof(dest));
+	dest.sin_family = AF_INET;
+	dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	dest.sin_port = htons(port);
+
+	for (int c = 0; c < CLIENTS; c++) {
+		socks[c] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (SOCKET_ERROR_CHECK(socks[c]) ||
+		    set_recv_timeout_ms(socks[c], 500) != 0) {
+			snprintf(msg, sizeof(msg), "%s (client socket failed)", label);
+			SKIP_TEST(msg);
+			goto cleanup;
+		}
+		for (uint32_t i = 0; i < PROBES; i++) {
+			uint8_t tx[STAMP_BASE_PACKET_SIZE];
+			build_sender_like_payload(tx,
+						  sizeof(tx),
+						  (uint32_t)c * 100 + i,
+						  ERROR_ESTIMATE_DEFAULT);
+			(void)sendto(socks[c],
+				     tx,
+				     sizeof(tx),
+				     0,
+				     (struct sockaddr *)&dest,
+				     sizeof(dest));
+		}
+	}
+
+	int replies = 0;
+	int matched = 0;
+	for (int c = 0; c < CLIENTS; c++) {
+		for (int i = 0; i < PROBES; i++) {
+			uint8_t rx[STAMP_BASE_PACKET_SIZE];
+			ssize_t r = recv(socks[c], rx, sizeof(rx), 0);
+			if (r != (ssize_t)STAMP_BASE_PACKET_SIZE) {
+				break;
+			}
+			replies++;
+			const struct stamp_reflector_packet *rp =
+				(const struct stamp_reflector_packet *)rx;
+			uint32_t seq = ntohl(rp->sender_seq_num);
+			if (seq / 100 == (uint32_t)c && rp->sender_ttl > 0 &&
+			    rp->timestamp_sec != 0) {
+				matched++;
+			}
+		}
+	}
+	snprintf(msg, sizeof(msg), "%s: reflects all probes", label);
+	EXPECT_EQ_ULL(replies, CLIENTS * PROBES, msg);
+	snprintf(msg, sizeof(msg), "%s: replies return to their own client", label);
+	EXPECT_EQ_ULL(matched, CLIENTS * PROBES, msg);
+
+cleanup:
+	for (int c = 0; c < CLIENTS; c++) {
+		if (!SOCKET_ERROR_CHECK(socks[c])) {
+			CLOSE_SOCKET(socks[c]);
+		}
+	}
+	stop_reflector_subprocess(reflector_pid);
+}
+
+// -T（SO_REUSEPORT ワーカー）+ -b（recvmmsg/sendmmsg）
+static void test_reflector_loopback_workers_batch(void)
+{
+	static char *const extra_opts[] = {"-T", "3", "-b", "4", NULL};
+	reflector_loopback_multi_client_impl(extra_opts, "reflector -T/-b");
+}
+
+// -E uring（io_uring 非対応環境では socket エンジンへフォールバックして通る）
+static void test_reflector_loopback_uring(void)
+{
+	static char *const extra_opts[] = {"-T", "2", "-E", "uring", NULL};
+	reflector_loopback_multi_client_impl(extra_opts, "reflector -E uring");
+}
+#endif
+
 static void test_stamp_resolve_address(void)
 {
 	struct sockaddr_storage ss = {0};
@@ -2788,7 +2935,8 @@ static void test_build_so_timestamping_flags_sender(void)
 	EXPECT_TRUE(tx_hw == true, "sender: out_tx_hw true on TX-capable NIC");
 }
 
-// reflector: want_tx_hw=false なので RX HW のみ立ち、TX HW は立たない
+// reflector: want_tx_hw=false なので RX のみ立ち、TX は（SW も）立たない
+// （errqueue を読まないため、TX タイムスタンプが受信バッファを占有しないこと）
 static void test_build_so_timestamping_flags_reflector(void)
 {
 	struct stamp_hwts_caps caps = {.rx_hw = true,
@@ -2797,10 +2945,10 @@ static void test_build_so_timestamping_flags_reflector(void)
 	bool tx_hw = true; // false に更新されることを確認
 	int flags = stamp_build_so_timestamping_flags(&caps, false, &tx_hw);
 	int expected = SOF_TIMESTAMPING_RX_SOFTWARE |
-		       SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+		       SOF_TIMESTAMPING_SOFTWARE |
 		       SOF_TIMESTAMPING_RX_HARDWARE |
 		       SOF_TIMESTAMPING_RAW_HARDWARE;
-	EXPECT_TRUE(flags == expected, "reflector: RX HW only, no TX HW");
+	EXPECT_TRUE(flags == expected, "reflector: RX only, no TX timestamps");
 	EXPECT_TRUE(tx_hw == false,
 		    "reflector: out_tx_hw false when want_tx_hw=false");
 }
@@ -3089,6 +3237,8 @@ static void test_stamp_report_fmt_double(void)
 	EXPECT_TRUE(strcmp(buf, "1.500") == 0, "fmt 1.5 → 1.500");
 	stamp_report_fmt_double(buf, sizeof(buf), 0.123456, 6);
 	EXPECT_TRUE(strcmp(buf, "0.123456") == 0, "fmt prec 6");
+	stamp_report_fmt_double(buf, sizeof(buf), 12.0, 0);
+	EXPECT_TRUE(strcmp(buf, "12") == 0, "fmt prec 0 → integer");
 	// 非有限値は空文字
 	stamp_report_fmt_double(buf, sizeof(buf), NAN, 3);
 	EXPECT_TRUE(buf[0] == '\0', "fmt NaN → empty");
@@ -3125,8 +3275,10 @@ static void test_stamp_report_iso8601_utc_format(void)
 static void test_stamp_report_write_json_basic(void)
 {
 	const struct stamp_report_field fields[] = {
-		{"rtt_min_ms", 0.123},
-		{"rtt_max_ms", NAN}, // → null
+		{"rtt_min_ms", 0.123, STAMP_REPORT_VALUE},
+		{"rtt_max_ms", NAN, STAMP_REPORT_VALUE}, // → null
+		{"ge_p", 0.000123, STAMP_REPORT_RATIO},
+		{"loss_periods", 7.0, STAMP_REPORT_COUNT},
 	};
 	struct stamp_report r = {
 		.target = "127.0.0.1:862",
@@ -3136,9 +3288,12 @@ static void test_stamp_report_write_json_basic(void)
 		.packets_tx = 10,
 		.packets_rx = 9,
 		.timeouts = 1,
+		.late = 1,
+		.reordered = 2,
+		.duplicates = 3,
 		.loss_ratio = 0.1,
 		.fields = fields,
-		.field_count = 2,
+		.field_count = 4,
 	};
 	FILE *fp = tmpfile();
 	EXPECT_TRUE(fp != NULL, "json tmpfile created");
@@ -3161,10 +3316,17 @@ static void test_stamp_report_write_json_basic(void)
 		    "json has rtt_min value");
 	EXPECT_TRUE(strstr(out, "\"rtt_max_ms\": null") != NULL,
 		    "json NaN field → null");
+	EXPECT_TRUE(strstr(out, "\"ge_p\": 0.000123,") != NULL,
+		    "json ratio field has 6 decimals");
+	EXPECT_TRUE(strstr(out, "\"loss_periods\": 7\n") != NULL,
+		    "json count field is an integer");
 	EXPECT_TRUE(strstr(out, "\"packets_tx\": 10") != NULL,
 		    "json has packets_tx");
 	EXPECT_TRUE(strstr(out, "\"samples_truncated\": false") != NULL,
 		    "json has samples_truncated false");
+	EXPECT_TRUE(strstr(out, "\"late\": 1,\n  \"reordered\": 2,\n  \"duplicates\": 3") !=
+			    NULL,
+		    "json has late/reordered/duplicates");
 }
 
 // samples_truncated=true が JSON に反映されることを検証
@@ -3200,8 +3362,10 @@ static void test_stamp_report_write_json_truncated(void)
 static void test_stamp_report_write_csv_basic(void)
 {
 	const struct stamp_report_field fields[] = {
-		{"rtt_min_ms", 0.123},
-		{"rtt_max_ms", NAN}, // → 空フィールド
+		{"ge_p", 0.000123, STAMP_REPORT_RATIO},
+		{"loss_periods", 7.0, STAMP_REPORT_COUNT},
+		{"rtt_min_ms", 0.123, STAMP_REPORT_VALUE},
+		{"rtt_max_ms", NAN, STAMP_REPORT_VALUE}, // → 空フィールド
 	};
 	struct stamp_report r = {
 		.target = "127.0.0.1:862",
@@ -3211,9 +3375,12 @@ static void test_stamp_report_write_csv_basic(void)
 		.packets_tx = 10,
 		.packets_rx = 9,
 		.timeouts = 1,
+		.late = 1,
+		.reordered = 2,
+		.duplicates = 3,
 		.loss_ratio = 0.1,
 		.fields = fields,
-		.field_count = 2,
+		.field_count = 4,
 	};
 	FILE *fp = tmpfile();
 	EXPECT_TRUE(fp != NULL, "csv tmpfile created");
@@ -3236,6 +3403,12 @@ static void test_stamp_report_write_csv_basic(void)
 		    "csv header has keys");
 	EXPECT_TRUE(strstr(out, "oneway,samples_truncated,packets_tx") != NULL,
 		    "csv header has samples_truncated column");
+	EXPECT_TRUE(strstr(out, "timeouts,late,reordered,duplicates,loss_ratio") != NULL,
+		    "csv header has late/reordered/duplicates columns");
+	EXPECT_TRUE(strstr(out, ",10,9,1,1,2,3,0.100000,") != NULL,
+		    "csv row has late/reordered/duplicates values");
+	EXPECT_TRUE(strstr(out, ",0.100000,0.000123,7,0.123,") != NULL,
+		    "csv ratio has 6 decimals, count is an integer");
 	// データ行末は ",0.123," + 空(NaN) で終わる
 	EXPECT_TRUE(strstr(out, ",0.123,\n") != NULL,
 		    "csv value then empty NaN field");
@@ -4794,154 +4967,3058 @@ cleanup:
 }
 
 // =============================================================================
-// Phase 7-3: テスト分離改善
+// Phase 15: recvmmsg/sendmmsg バッチ送受信 (Linux)
 // =============================================================================
 
-#ifndef _WIN32
-// reset_global_state() がグローバル状態を既定値へ復元することを単体で検証する。
-// 前テストの後処理に依存しない自己完結テスト（順序非依存）。
-static void test_signal_handler_reset(void)
+#ifdef __linux__
+static void test_mmsg_batch_init_bounds(void)
 {
-	__atomic_store_n(&g_running, 0, __ATOMIC_SEQ_CST);
-	reset_global_state();
-	EXPECT_TRUE(__atomic_load_n(&g_running, __ATOMIC_SEQ_CST) == 1,
-		    "reset_global_state restores g_running=1");
+	struct stamp_mmsg_batch batch;
+	EXPECT_TRUE(stamp_mmsg_batch_init(&batch, 0) == -1,
+		    "mmsg batch init rejects cap 0");
+	EXPECT_TRUE(stamp_mmsg_batch_init(&batch, STAMP_MMSG_MAX_BATCH + 1) == -1,
+		    "mmsg batch init rejects cap > max");
+	EXPECT_TRUE(stamp_mmsg_batch_init(&batch, 4) == 0,
+		    "mmsg batch init accepts cap 4");
+	EXPECT_EQ_ULL(batch.cap, 4, "mmsg batch cap");
+	EXPECT_TRUE(stamp_mmsg_slot_buf(&batch, 1) ==
+			    batch.bufs + STAMP_MAX_PACKET_SIZE,
+		    "mmsg slot buffers are contiguous");
+	stamp_mmsg_batch_free(&batch);
+	EXPECT_TRUE(batch.bufs == NULL && batch.cap == 0,
+		    "mmsg batch free resets state");
+	stamp_mmsg_batch_free(&batch);
 }
-#endif
 
-int main(void)
+// 1 回の recvmmsg で複数本を受信し、パケットごとの T2/TTL で応答を構築して
+// 1 回の sendmmsg で返送する（reflector -b の経路）
+static void test_mmsg_batch_loopback(void)
 {
-#ifdef _WIN32
-	if (init_winsock() != 0) {
-		printf("FAIL: WSAStartup\n");
-		return 1;
+#ifndef IP_RECVTTL
+	SKIP_TEST("mmsg batch loopback (IP_RECVTTL unavailable)");
+	return;
+#else
+	SOCKET client = INVALID_SOCKET;
+	SOCKET server = INVALID_SOCKET;
+	struct stamp_mmsg_batch batch;
+	memset(&batch, 0, sizeof(batch));
+
+	client = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	server = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (SOCKET_ERROR_CHECK(client) || SOCKET_ERROR_CHECK(server)) {
+		SKIP_TEST("mmsg batch loopback (socket failed)");
+		goto cleanup;
 	}
-#endif
 
-	g_ipv6_ok = ipv6_available();
+	int on = 1;
+	(void)setsockopt(server, IPPROTO_IP, IP_RECVTTL, &on, sizeof(on));
+	stamp_enable_so_timestamp(server);
 
-#ifndef _WIN32
-	test_signal_handler();
-	test_firewall_format_port_valid();
-	test_firewall_format_port_rejects_zero();
-	test_firewall_format_port_rejects_truncation();
-#endif
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addr_len = (socklen_t)sizeof(addr);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    getsockname(server, (struct sockaddr *)&addr, &addr_len) < 0) {
+		SKIP_TEST("mmsg batch loopback (bind failed)");
+		goto cleanup;
+	}
+	if (set_recv_timeout_ms(server, 300) != 0 ||
+	    set_recv_timeout_ms(client, 300) != 0) {
+		SKIP_TEST("mmsg batch loopback (set timeout failed)");
+		goto cleanup;
+	}
+	if (stamp_mmsg_batch_init(&batch, 8) != 0) {
+		SKIP_TEST("mmsg batch loopback (allocation failed)");
+		goto cleanup;
+	}
 
-	test_protocol_constants();
-	test_struct_layout();
-	test_stamp_validate_packet();
-	test_stamp_ntp_to_double();
-	test_stamp_get_ntp_timestamp();
-	test_byte_order();
-	test_stamp_parse_port();
-	test_stamp_parse_u32_range();
-	test_stamp_family_str();
-	// IPv6対応テスト
-	test_stamp_get_sockaddr_len();
-	test_stamp_sockaddr_get_port();
-	test_stamp_sockaddr_to_string();
-	test_stamp_resolve_address();
-	// NOTE: Integration test - performs real UDP I/O on loopback.
-	test_ipv6_socket_communication();
-#ifndef _WIN32
-	test_reflector_loopback_filtering_and_padding();
-#endif
-	// Windows getoptテスト (分割: basic/arguments/errors/mixed)
-#ifdef _WIN32
-	test_stamp_getopt_basic();
-	test_stamp_getopt_arguments();
-	test_stamp_getopt_errors();
-	test_stamp_getopt_mixed();
-#endif
+	// 44B / 14B(要パディング) / 60B の 3 本を連続送信
+	static const size_t lens[] = {STAMP_BASE_PACKET_SIZE, 14, 60};
+	for (uint32_t i = 0; i < 3; i++) {
+		uint8_t tx[64];
+		build_sender_like_payload(tx, lens[i], 100 + i, ERROR_ESTIMATE_DEFAULT);
+		if (sendto(client,
+			   tx,
+			   lens[i],
+			   0,
+			   (struct sockaddr *)&addr,
+			   sizeof(addr)) != (ssize_t)lens[i]) {
+			SKIP_TEST("mmsg batch loopback (sendto failed)");
+			goto cleanup;
+		}
+	}
 
-	// ===== 新規追加テスト =====
-	// Phase 1: NTP変換マクロ
-	test_nsec_to_ntp_frac();
-	test_usec_to_ntp_frac();
-	test_stamp_nsec_to_ntp_frac_overflow();
-	test_stamp_nsec_to_ntp_frac_boundary();
-#ifdef _WIN32
-	test_windows_100ns_to_ntp_frac();
-#endif
+	int n = stamp_mmsg_recv(server, &batch, false);
+	EXPECT_EQ_ULL((unsigned)n, 3, "mmsg recv returns all queued packets");
+	if (n != 3) {
+		goto cleanup;
+	}
 
-	// Phase 2: timespec/timeval変換 (UNIX)
-#ifndef _WIN32
-	test_stamp_timespec_to_ntp();
-	test_stamp_timeval_to_ntp();
+	for (unsigned int i = 0; i < 3; i++) {
+		const struct stamp_mmsg_slot *slot = &batch.slots[i];
+		EXPECT_EQ_ULL((unsigned)slot->len, lens[i], "mmsg slot length");
+		EXPECT_EQ_ULL(slot->ttl, 64, "mmsg slot TTL from own cmsg");
+		EXPECT_TRUE(slot->t2_sec != 0, "mmsg slot T2 set");
+		if (i > 0) {
+			const struct stamp_mmsg_slot *prev = &batch.slots[i - 1];
+			uint64_t t_prev = ((uint64_t)ntohl(prev->t2_sec) << 32) |
+					  ntohl(prev->t2_frac);
+			uint64_t t_cur = ((uint64_t)ntohl(slot->t2_sec) << 32) |
+					 ntohl(slot->t2_frac);
+			EXPECT_TRUE(t_cur >= t_prev, "mmsg per-packet T2 ordered");
+		}
+
+		uint8_t *buf = stamp_mmsg_slot_buf(&batch, i);
+		int send_len;
+		bool was_padded;
+		stamp_pad_to_base_size(buf, slot->len, &send_len, &was_padded);
+		stamp_build_reflector_packet(buf,
+					     send_len,
+					     slot->ttl,
+					     slot->t2_sec,
+					     slot->t2_frac,
+					     htons(ERROR_ESTIMATE_DEFAULT));
+		stamp_mmsg_queue_reply(&batch, i, send_len);
+	}
+	EXPECT_EQ_ULL(batch.tx_count, 3, "mmsg tx queue count");
+	EXPECT_EQ_ULL((unsigned)stamp_mmsg_send(server, &batch, 0),
+		      3,
+		      "mmsg sendmmsg sends whole queue");
+	EXPECT_EQ_ULL((unsigned)stamp_mmsg_send(server, &batch, 3),
+		      0,
+		      "mmsg send with empty remainder");
+
+	for (unsigned int i = 0; i < 3; i++) {
+		uint8_t rx[128];
+		ssize_t r = recv(client, rx, sizeof(rx), 0);
+		size_t expect_len = lens[i] < STAMP_BASE_PACKET_SIZE
+					    ? STAMP_BASE_PACKET_SIZE
+					    : lens[i];
+		EXPECT_EQ_ULL((unsigned long long)r, expect_len, "mmsg reply length");
+		if (r < (ssize_t)STAMP_BASE_PACKET_SIZE) {
+			continue;
+		}
+		const struct stamp_reflector_packet *rp =
+			(const struct stamp_reflector_packet *)rx;
+		EXPECT_EQ_ULL(ntohl(rp->sender_seq_num), 100 + i, "mmsg reply seq");
+		EXPECT_EQ_ULL(rp->sender_ttl, 64, "mmsg reply sender_ttl");
+		EXPECT_TRUE(rp->rx_sec == batch.slots[i].t2_sec &&
+				    rp->rx_frac == batch.slots[i].t2_frac,
+			    "mmsg reply carries its own T2");
+	}
+
+cleanup:
+	stamp_mmsg_batch_free(&batch);
+	if (!SOCKET_ERROR_CHECK(client)) {
+		CLOSE_SOCKET(client);
+	}
+	if (!SOCKET_ERROR_CHECK(server)) {
+		CLOSE_SOCKET(server);
+	}
 #endif
+}
 
-	// Phase 3: sockaddrユーティリティ追加
-	test_stamp_sockaddr_to_string_safe();
-	test_stamp_format_sockaddr_with_port();
-	test_stamp_format_sockaddr_with_port_null_addr();
-	test_stamp_sockaddr_to_string_safe_truncation();
+#ifdef STAMP_HAVE_IO_URING
+// multishot recvmsg が各パケットの制御メッセージ（TTL・受信タイムスタンプ）を
+// 既存の cmsg 抽出ヘルパーで読める形で渡し、sendmsg SQE で応答できること
+static void test_uring_recvmsg_multishot_loopback(void)
+{
+	SOCKET client = INVALID_SOCKET;
+	SOCKET server = INVALID_SOCKET;
+	struct stamp_uring *ring = calloc(1, sizeof(*ring));
+	bool ring_ok = false;
 
-	// Phase 4: stamp_resolve_address_list
-	test_stamp_resolve_address_list();
+	if (ring == NULL) {
+		SKIP_TEST("io_uring loopback (allocation failed)");
+		return;
+	}
+	if (stamp_uring_init(ring) != 0) {
+		SKIP_TEST("io_uring loopback (io_uring unavailable)");
+		free(ring);
+		return;
+	}
+	ring_ok = true;
 
-	// Phase 5: stamp_validate_packet拡張
-	test_stamp_validate_packet_boundary_sizes();
-	test_stamp_validate_test_payload_for_reflector();
-	test_stamp_check_reflector_input();
-	test_stamp_default_error_estimate_nbo();
-	test_stamp_pad_to_base_size();
+	client = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	server = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (SOCKET_ERROR_CHECK(client) || SOCKET_ERROR_CHECK(server)) {
+		SKIP_TEST("io_uring loopback (socket failed)");
+		goto cleanup;
+	}
+	int on = 1;
+	(void)setsockopt(server, IPPROTO_IP, IP_RECVTTL, &on, sizeof(on));
+	stamp_enable_so_timestamp(server);
 
-	// Phase 6: RTT計算
-	test_rtt_calculation();
-	test_negative_delay_detection();
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addr_len = (socklen_t)sizeof(addr);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    getsockname(server, (struct sockaddr *)&addr, &addr_len) < 0 ||
+	    set_recv_timeout_ms(client, 300) != 0) {
+		SKIP_TEST("io_uring loopback (bind failed)");
+		goto cleanup;
+	}
 
-	// Phase 7: 統計計算
-	test_statistics_calculation();
-	test_packet_loss_calculation();
-	test_packet_loss_underflow();
-	test_stamp_jitter_edge_cases();
-	test_stamp_percentile_sorted_basic();
-	test_stamp_percentile_sorted_edge();
-	test_stamp_double_cmp_nan();
-	test_stamp_pdv_from_sorted();
-	test_stamp_seq_is_consecutive();
-	test_stamp_report_fmt_double();
-	test_stamp_report_json_escape();
-	test_stamp_report_iso8601_utc_format();
-	test_stamp_report_write_json_basic();
-	test_stamp_report_write_json_truncated();
-	test_stamp_report_write_csv_basic();
-	test_stamp_packet_loss_edge_cases();
+	EXPECT_TRUE(stamp_uring_arm_recv(ring, server) == 0, "io_uring arm recv");
+	for (uint32_t i = 0; i < 3; i++) {
+		uint8_t tx[STAMP_BASE_PACKET_SIZE];
+		build_sender_like_payload(tx, sizeof(tx), 200 + i, ERROR_ESTIMATE_DEFAULT);
+		(void)sendto(client, tx, sizeof(tx), 0, (struct sockaddr *)&addr, sizeof(addr));
+	}
+
+	int received = 0;
+	int with_ts = 0;
+	int with_ttl = 0;
+	bool more = true;
+	struct stamp_uring_recv first;
+	memset(&first, 0, sizeof(first));
+	for (int round = 0; round < 10 && received < 3; round++) {
+		if (stamp_uring_submit_and_wait(ring, 100) != 0) {
+			break;
+		}
+		struct io_uring_cqe *cqe;
+		while ((cqe = stamp_uring_peek_cqe(ring)) != NULL) {
+			struct stamp_uring_recv rx;
+			if (cqe->res == -EINVAL) {
+				more = false;
+			} else if (stamp_uring_parse_recv(ring, cqe, &rx)) {
+				uint32_t sec;
+				uint32_t frac;
+				uint8_t ttl = 0;
+				if (stamp_extract_kernel_timestamp_linux(&rx.msg, &sec, &frac, false)) {
+					with_ts++;
+				}
+				stamp_extract_ttl_from_cmsg(&rx.msg, &ttl);
+				if (ttl == 64) {
+					with_ttl++;
+				}
+				EXPECT_EQ_ULL((unsigned)rx.len,
+					      STAMP_BASE_PACKET_SIZE,
+					      "io_uring recv payload length");
+				EXPECT_EQ_ULL(rx.addr->ss_family, AF_INET, "io_uring recv source family");
+				if (received == 0) {
+					first = rx;
+				} else {
+					stamp_uring_recycle(ring, rx.bid);
+				}
+				received++;
+			}
+			stamp_uring_cqe_seen(ring);
+		}
+		if (!more) {
+			break;
+		}
+	}
+	if (!more) {
+		SKIP_TEST("io_uring loopback (multishot recvmsg unsupported)");
+		goto cleanup;
+	}
+	EXPECT_EQ_ULL(received, 3, "io_uring multishot recv delivers each packet");
+	EXPECT_EQ_ULL(with_ts, 3, "io_uring recv carries per-packet kernel timestamp");
+	EXPECT_EQ_ULL(with_ttl, 3, "io_uring recv carries per-packet IP_TTL");
+	if (received == 0) {
+		goto cleanup;
+	}
 
-	// Phase 8: パケット構築
-	test_sender_packet_fields();
-	test_reflector_packet_fields();
-	test_sender_ttl_setting();
+	// 1 本目の受信バッファ上で応答を構築し、sendmsg SQE で返送
+	stamp_build_reflector_packet(first.payload, first.len, 64, 1, 2, htons(ERROR_ESTIMATE_DEFAULT));
+	EXPECT_TRUE(stamp_uring_queue_send(ring, server, &first, first.len, 64) == 0,
+		    "io_uring queue send");
+	int send_res = -1;
+	for (int round = 0; round < 10 && send_res < 0; round++) {
+		if (stamp_uring_submit_and_wait(ring, 100) != 0) {
+			break;
+		}
+		struct io_uring_cqe *cqe;
+		while ((cqe = stamp_uring_peek_cqe(ring)) != NULL) {
+			if (STAMP_URING_UD_KIND(cqe->user_data) == STAMP_URING_UD_SEND) {
+				EXPECT_EQ_ULL(STAMP_URING_UD_BID(cqe->user_data),
+					      first.bid,
+					      "io_uring send completion carries buffer id");
+				send_res = cqe->res;
+			}
+			stamp_uring_cqe_seen(ring);
+		}
+	}
+	EXPECT_EQ_ULL((unsigned)send_res, STAMP_BASE_PACKET_SIZE, "io_uring sendmsg completion");
 
-	// Phase 9: Error Estimate
-	test_error_estimate_fields();
+	uint8_t rx_buf[STAMP_BASE_PACKET_SIZE];
+	ssize_t r = recv(client, rx_buf, sizeof(rx_buf), 0);
+	EXPECT_EQ_ULL((unsigned long long)r, STAMP_BASE_PACKET_SIZE, "io_uring reply received");
+	if (r == (ssize_t)STAMP_BASE_PACKET_SIZE) {
+		const struct stamp_reflector_packet *rp =
+			(const struct stamp_reflector_packet *)rx_buf;
+		EXPECT_EQ_ULL(ntohl(rp->sender_seq_num), 200, "io_uring reply seq");
+	}
 
-	// Phase 10: HW タイムスタンプ
-#ifdef __linux__
-	test_stamp_extract_kernel_timestamp_linux_hw_priority();
-	test_stamp_extract_kernel_timestamp_linux_sw_fallback();
-	test_stamp_extract_kernel_timestamp_linux_ptp_hw();
-	test_stamp_extract_kernel_timestamp_linux_ptp_sw();
-	test_stamp_extract_kernel_timestamp_linux_timestampns();
-	test_stamp_extract_kernel_timestamp_linux_timestamp();
-	test_stamp_extract_kernel_timestamp_linux_legacy_fallback();
-	test_stamp_extract_kernel_timestamp_linux_all_zero();
-	test_stamp_extract_kernel_timestamp_linux_invalid_nsec();
-	test_stamp_extract_kernel_timestamp_linux_truncated_cmsg();
-	test_stamp_extract_kernel_timestamp_linux_scm_timestamp_invalid_usec();
-	test_stamp_extract_kernel_timestamp_linux_scm_timestamp_truncated();
-	test_stamp_extract_kernel_timestamp_linux_scm_timestamping_truncated();
-	test_stamp_extract_kernel_timestamp_linux_all_invalid_nsec();
-	test_stamp_extract_ttl_from_cmsg();
-#endif
-#ifdef _WIN32
-	test_stamp_extract_kernel_timestamp_windows();
-#endif
+cleanup:
+	if (ring_ok) {
+		stamp_uring_free(ring);
+	}
+	free(ring);
+	if (!SOCKET_ERROR_CHECK(client)) {
+		CLOSE_SOCKET(client);
+	}
+	if (!SOCKET_ERROR_CHECK(server)) {
+		CLOSE_SOCKET(server);
+	}
+}
+#endif // STAMP_HAVE_IO_URING
+#endif // __linux__
 
-	// Phase 11: PTP タイムスタンプ変換
-	test_stamp_ptp_to_double();
-#ifndef _WIN32
-	test_stamp_timespec_to_ptp();
+// =============================================================================
+// Phase 16: Sender 応答待ちプローブ表（パイプライン送信）
+// =============================================================================
+
+// 期限切れコールバックの呼び出し回数を数える
+static void count_expired_cb(const struct stamp_inflight_entry *e, void *ctx)
+{
+	(void)e;
+	(*(uint32_t *)ctx)++;
+}
+
+// 期限内の応答の照合（到着順どおり・順序逆転・重複・未送信 seq）
+static void test_inflight_match_classification(void)
+{
+	static struct stamp_inflight tbl;
+	const struct stamp_inflight_entry *ent;
+	EXPECT_TRUE(stamp_inflight_init(&tbl, STAMP_INFLIGHT_CAP) == 0,
+		    "inflight: table allocated");
+
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 0, &ent) == STAMP_INFLIGHT_MATCH_UNKNOWN,
+		    "inflight: empty table → unknown");
+	for (uint32_t seq = 0; seq < 4; seq++) {
+		EXPECT_TRUE(!stamp_inflight_insert(&tbl, seq, 100 + seq, 7, 1000 + seq),
+			    "inflight: insert without eviction");
+	}
+	EXPECT_EQ_ULL(tbl.pending, 4, "inflight: 4 pending");
+
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 1, &ent) == STAMP_INFLIGHT_MATCH_IN_ORDER,
+		    "inflight: seq 1 in order");
+	EXPECT_TRUE(ent != NULL && ent->t1_sec == 101 && ent->t1_frac == 7,
+		    "inflight: matched entry carries T1");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 3, &ent) == STAMP_INFLIGHT_MATCH_IN_ORDER,
+		    "inflight: seq 3 in order (gap allowed)");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 2, &ent) == STAMP_INFLIGHT_MATCH_REORDERED,
+		    "inflight: seq 2 after 3 → reordered");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 2, &ent) == STAMP_INFLIGHT_MATCH_DUPLICATE,
+		    "inflight: seq 2 again → duplicate");
+	EXPECT_TRUE(ent == NULL, "inflight: duplicate returns no entry");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 4, &ent) == STAMP_INFLIGHT_MATCH_UNKNOWN,
+		    "inflight: unsent seq → unknown");
+	EXPECT_EQ_ULL(tbl.pending, 1, "inflight: only seq 0 still pending");
+	stamp_inflight_free(&tbl);
+}
+
+// タイムアウト・遅着・次の期限
+static void test_inflight_expire_and_late(void)
+{
+	static struct stamp_inflight tbl;
+	const struct stamp_inflight_entry *ent;
+	uint64_t deadline = 0;
+	uint32_t expired = 0;
+	EXPECT_TRUE(stamp_inflight_init(&tbl, STAMP_INFLIGHT_CAP) == 0,
+		    "inflight: table allocated");
+
+	(void)stamp_inflight_insert(&tbl, 10, 1, 0, 1000);
+	(void)stamp_inflight_insert(&tbl, 11, 2, 0, 2000);
+	(void)stamp_inflight_insert(&tbl, 12, 3, 0, 3000);
+	EXPECT_TRUE(stamp_inflight_next_expiry(&tbl, 500, &deadline) && deadline == 1500,
+		    "inflight: next expiry from oldest pending");
+
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 10, &ent) == STAMP_INFLIGHT_MATCH_IN_ORDER,
+		    "inflight: seq 10 answered");
+	EXPECT_EQ_ULL(stamp_inflight_expire(&tbl, 2400, 500, count_expired_cb, &expired),
+		      0,
+		      "inflight: nothing expired before deadline");
+	EXPECT_TRUE(stamp_inflight_next_expiry(&tbl, 500, &deadline) && deadline == 2500,
+		    "inflight: answered oldest skipped for next expiry");
+	EXPECT_EQ_ULL(stamp_inflight_expire(&tbl, 2500, 500, count_expired_cb, &expired),
+		      1,
+		      "inflight: seq 11 expires at deadline");
+	EXPECT_EQ_ULL(expired, 1, "inflight: expire callback invoked");
+
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 11, &ent) == STAMP_INFLIGHT_MATCH_LATE,
+		    "inflight: reply after timeout → late");
+	EXPECT_TRUE(ent != NULL && ent->t1_sec == 2, "inflight: late entry carries T1");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 11, &ent) == STAMP_INFLIGHT_MATCH_DUPLICATE,
+		    "inflight: second late reply → duplicate");
+	EXPECT_EQ_ULL(tbl.pending, 1, "inflight: late reply does not change pending");
+
+	EXPECT_EQ_ULL(stamp_inflight_expire(&tbl, 10000, 500, count_expired_cb, &expired),
+		      1,
+		      "inflight: seq 12 expires");
+	EXPECT_TRUE(!stamp_inflight_next_expiry(&tbl, 500, &deadline),
+		    "inflight: no pending → no expiry");
+	stamp_inflight_free(&tbl);
+}
+
+// 容量超過時の追い出しと uint32_t ラップアラウンド
+static void test_inflight_eviction_and_wrap(void)
+{
+	static struct stamp_inflight tbl;
+	const struct stamp_inflight_entry *ent;
+	EXPECT_TRUE(stamp_inflight_init(&tbl, STAMP_INFLIGHT_CAP) == 0,
+		    "inflight: table allocated");
+
+	uint32_t base = UINT32_MAX - 2U;
+	uint32_t evicted = 0;
+	for (uint32_t i = 0; i < STAMP_INFLIGHT_CAP + 3U; i++) {
+		if (stamp_inflight_insert(&tbl, base + i, i, 0, i)) {
+			evicted++;
+		}
+	}
+	EXPECT_EQ_ULL(evicted, 3, "inflight: overflow evicts oldest pending");
+	EXPECT_EQ_ULL(tbl.pending, STAMP_INFLIGHT_CAP, "inflight: pending capped");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, base, &ent) == STAMP_INFLIGHT_MATCH_UNKNOWN,
+		    "inflight: evicted seq → unknown");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 0, &ent) == STAMP_INFLIGHT_MATCH_IN_ORDER,
+		    "inflight: seq after wrap matches");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, UINT32_MAX, &ent) ==
+			    STAMP_INFLIGHT_MATCH_UNKNOWN,
+		    "inflight: evicted pre-wrap seq → unknown");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, base + 5U, &ent) ==
+			    STAMP_INFLIGHT_MATCH_IN_ORDER,
+		    "inflight: later seq after wrap in order");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, base + 4U, &ent) ==
+			    STAMP_INFLIGHT_MATCH_REORDERED,
+		    "inflight: reordering detected after wrap");
+
+	uint32_t expired = 0;
+	(void)stamp_inflight_expire(&tbl, UINT64_MAX, 1, count_expired_cb, &expired);
+	EXPECT_EQ_ULL(expired, STAMP_INFLIGHT_CAP - 3U, "inflight: all remaining expire");
+	EXPECT_EQ_ULL(tbl.pending, 0, "inflight: none pending after expiry");
+	stamp_inflight_free(&tbl);
+}
+
+// =============================================================================
+// Phase 17: Sender 送信スケジュール（periodic / Poisson / offset）
+// =============================================================================
+
+// periodic: リング補充をまたいでも開始時刻 + k × 間隔の格子を保つ
+static void test_sched_periodic_grid(void)
+{
+	static struct stamp_sched sched;
+	stamp_sched_init(&sched, STAMP_SCHED_PERIODIC, 5000, 100, 0, 1);
+
+	bool on_grid = true;
+	for (uint64_t k = 0; k < STAMP_SCHED_RING_CAP * 3U; k++) {
+		uint64_t d = stamp_sched_peek(&sched);
+		if (d != 5000 + k * 100) {
+			on_grid = false;
+		}
+		// 予定時刻ちょうどに送信（読み飛ばしなし）
+		if (stamp_sched_advance(&sched, d) != 0) {
+			on_grid = false;
+		}
+	}
+	EXPECT_TRUE(on_grid, "sched: periodic deadlines stay on grid across refills");
+	EXPECT_TRUE(sched.count > STAMP_SCHED_RING_CAP / 2U,
+		    "sched: ring kept above half after refills");
+
+	// 3.5 間隔遅れて送信: 1 間隔以上過ぎた予定（+100, +200）を読み飛ばし、
+	// 遅れが 1 間隔未満の +300 から再開する
+	uint64_t d = stamp_sched_peek(&sched);
+	EXPECT_EQ_ULL(stamp_sched_advance(&sched, d + 350), 2,
+		      "sched: slots one interval overdue are skipped");
+	EXPECT_EQ_ULL(stamp_sched_peek(&sched), d + 300,
+		      "sched: resumes at first slot less than one interval late");
+	// 0.5 間隔遅れは読み飛ばさない
+	d = stamp_sched_peek(&sched);
+	EXPECT_EQ_ULL(stamp_sched_advance(&sched, d + 150), 0,
+		      "sched: less than one interval late is not skipped");
+}
+
+// 数周期遅れて起床: 読み飛ばし数と再開時刻、読み飛ばし数の累積
+static void test_sched_missed_slots(void)
+{
+	static struct stamp_sched sched;
+	stamp_sched_init(&sched, STAMP_SCHED_PERIODIC, 1000, 1000, 0, 1);
+
+	// 予定 1000 の送信が 5 周期遅れ（6000）: 2000〜5000 の 4 本を読み飛ばし、
+	// 遅れが 1 周期未満の 6000 から再開する
+	uint64_t missed = stamp_sched_advance(&sched, 6000);
+	EXPECT_EQ_ULL(missed, 4, "sched: 5 periods late skips 4 slots");
+	EXPECT_EQ_ULL(stamp_sched_peek(&sched), 6000,
+		      "sched: 5 periods late resumes at current slot");
+
+	// 端数の遅れ（+7.25 周期）: 再開は現在時刻以前で最も新しい格子点
+	missed += stamp_sched_advance(&sched, 6000 + 7250);
+	EXPECT_EQ_ULL(missed, 4 + 6, "sched: missed slots accumulate across wakes");
+	EXPECT_EQ_ULL(stamp_sched_peek(&sched), 13000,
+		      "sched: resumes on grid after fractional lateness");
+
+	// 予定 13000 を 15000 で送信: ちょうど 1 周期遅れた 14000 も読み飛ばす
+	missed += stamp_sched_advance(&sched, 15000);
+	EXPECT_EQ_ULL(missed, 4 + 6 + 1, "sched: exactly one period overdue skipped");
+	EXPECT_EQ_ULL(stamp_sched_peek(&sched), 15000,
+		      "sched: exact-period lateness resumes on current slot");
+
+	// リング容量を超える遅れでも補充しながら格子を保つ
+	uint64_t late = STAMP_SCHED_RING_CAP * 3U;
+	uint64_t d = stamp_sched_peek(&sched);
+	EXPECT_EQ_ULL(stamp_sched_advance(&sched, d + late * 1000), late - 1,
+		      "sched: lateness beyond ring capacity counted");
+	EXPECT_EQ_ULL(stamp_sched_peek(&sched), d + late * 1000,
+		      "sched: lateness beyond ring capacity stays on grid");
+	EXPECT_TRUE(sched.count > STAMP_SCHED_RING_CAP / 2U,
+		    "sched: ring refilled during long skip");
+}
+
+// スケジュール誤差（実送信 − 予定、マイクロ秒）の min/avg/max 集計
+static void test_sched_error_stats(void)
+{
+	static struct stamp_sched sched;
+	stamp_sched_init(&sched, STAMP_SCHED_PERIODIC, 0, 1000000, 0, 1);
+
+	struct stamp_welford err;
+	stamp_welford_init(&err);
+	// 予定ちょうど・1.5us・12us・0.5us 遅れで送信
+	static const uint64_t late_ns[] = {0, 1500, 12000, 500};
+	for (size_t i = 0; i < sizeof(late_ns) / sizeof(late_ns[0]); i++) {
+		uint64_t now = stamp_sched_peek(&sched) + late_ns[i];
+		stamp_welford_update(&err, stamp_sched_error_us(&sched, now));
+		EXPECT_EQ_ULL(stamp_sched_advance(&sched, now), 0,
+			      "sched: sub-period lateness not skipped");
+	}
+	EXPECT_EQ_ULL(stamp_welford_count(&err), 4, "sched err: count");
+	EXPECT_NEAR_DOUBLE(stamp_welford_min(&err), 0.0, 1e-9, "sched err: min");
+	EXPECT_NEAR_DOUBLE(stamp_welford_max(&err), 12.0, 1e-9, "sched err: max");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&err), 3.5, 1e-9, "sched err: avg");
+
+	// 予定より前の時刻は 0 とする（負の誤差で集計を崩さない）
+	uint64_t d = stamp_sched_peek(&sched);
+	EXPECT_NEAR_DOUBLE(stamp_sched_error_us(&sched, d - 1), 0.0, 1e-12,
+			   "sched err: early time clamps to 0");
+	// 読み飛ばし後の誤差は再開した予定を基準にする
+	EXPECT_EQ_ULL(stamp_sched_advance(&sched, d + 3000000 + 250000), 2,
+		      "sched err: 3.25 periods late skips 2 slots");
+	EXPECT_NEAR_DOUBLE(stamp_sched_error_us(&sched, d + 3000000 + 250000),
+			   250.0, 1e-9,
+			   "sched err: measured against resumed slot");
+}
+
+// -I / -S の値域（0 拒否・上限受理・上限超過と桁あふれ拒否）
+static void test_sched_interval_spin_bounds(void)
+{
+	uint32_t v = 0;
+
+	// -I: 1..UINT32_MAX マイクロ秒
+	EXPECT_TRUE(stamp_parse_u32_range("0", &v, UINT32_MAX) != 0,
+		    "-I 0 rejected");
+	EXPECT_TRUE(stamp_parse_u32_range("1", &v, UINT32_MAX) == 0 && v == 1,
+		    "-I 1 accepted");
+	EXPECT_TRUE(stamp_parse_u32_range("4294967295", &v, UINT32_MAX) == 0 &&
+			    v == UINT32_MAX,
+		    "-I UINT32_MAX accepted");
+	EXPECT_TRUE(stamp_parse_u32_range("4294967296", &v, UINT32_MAX) != 0,
+		    "-I UINT32_MAX + 1 rejected");
+	EXPECT_TRUE(stamp_parse_u32_range("18446744073709551616", &v,
+					  UINT32_MAX) != 0,
+		    "-I 64-bit overflow rejected");
+
+	// -S: 1..STAMP_SCHED_SPIN_USEC_MAX マイクロ秒
+	char buf[32];
+	EXPECT_TRUE(stamp_parse_u32_range("0", &v, STAMP_SCHED_SPIN_USEC_MAX) != 0,
+		    "-S 0 rejected");
+	snprintf(buf, sizeof(buf), "%u", STAMP_SCHED_SPIN_USEC_MAX);
+	EXPECT_TRUE(stamp_parse_u32_range(buf, &v, STAMP_SCHED_SPIN_USEC_MAX) == 0 &&
+			    v == STAMP_SCHED_SPIN_USEC_MAX,
+		    "-S max accepted");
+	snprintf(buf, sizeof(buf), "%u", STAMP_SCHED_SPIN_USEC_MAX + 1U);
+	EXPECT_TRUE(stamp_parse_u32_range(buf, &v, STAMP_SCHED_SPIN_USEC_MAX) != 0,
+		    "-S max + 1 rejected");
+	EXPECT_TRUE(stamp_parse_u32_range("4294967296", &v,
+					  STAMP_SCHED_SPIN_USEC_MAX) != 0,
+		    "-S overflow rejected");
+}
+
+// Poisson: 間隔の平均 ≈ -I、変動係数 ≈ 1、シードで再現可能
+static void test_sched_poisson_distribution(void)
+{
+	static struct stamp_sched sa;
+	static struct stamp_sched sb;
+	const uint64_t mean = 1000000;
+	const uint32_t n = 100000;
+	stamp_sched_init(&sa, STAMP_SCHED_POISSON, 0, mean, 0, 42);
+	stamp_sched_init(&sb, STAMP_SCHED_POISSON, 0, mean, 0, 42);
+
+	struct stamp_welford gaps;
+	stamp_welford_init(&gaps);
+	uint64_t prev = 0;
+	bool monotonic = true;
+	bool same_seed_same_plan = true;
+	for (uint32_t i = 0; i < n; i++) {
+		uint64_t d = stamp_sched_peek(&sa);
+		if (d < prev) {
+			monotonic = false;
+		}
+		if (d != stamp_sched_peek(&sb)) {
+			same_seed_same_plan = false;
+		}
+		stamp_welford_update(&gaps, (double)(d - prev));
+		prev = d;
+		(void)stamp_sched_advance(&sa, d);
+		(void)stamp_sched_advance(&sb, d);
+	}
+	EXPECT_TRUE(monotonic, "sched: poisson deadlines non-decreasing");
+	EXPECT_TRUE(same_seed_same_plan, "sched: same seed gives same schedule");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&gaps), (double)mean, (double)mean * 0.02,
+			   "sched: poisson mean gap ~ interval");
+	EXPECT_NEAR_DOUBLE(stamp_welford_stddev(&gaps) / stamp_welford_mean(&gaps),
+			   1.0,
+			   0.03,
+			   "sched: poisson coefficient of variation ~ 1");
+
+	stamp_sched_init(&sb, STAMP_SCHED_POISSON, 0, mean, 0, 43);
+	stamp_sched_init(&sa, STAMP_SCHED_POISSON, 0, mean, 0, 42);
+	EXPECT_TRUE(stamp_sched_peek(&sa) != stamp_sched_peek(&sb),
+		    "sched: different seed gives different schedule");
+}
+
+// offset: 開始オフセットは [0, J) から 1 回だけ引き、以後の間隔は固定
+// （RFC 3432 の周期ストリーム）。上限は間隔に丸める
+static void test_sched_offset_start(void)
+{
+	static struct stamp_sched sched;
+	bool in_bounds = true;
+	bool periodic = true;
+	uint64_t min_off = UINT64_MAX;
+	uint64_t max_off = 0;
+	for (uint64_t seed = 0; seed < 2000; seed++) {
+		stamp_sched_init(&sched, STAMP_SCHED_OFFSET, 1000, 1000, 250, seed);
+		uint64_t first = stamp_sched_peek(&sched);
+		uint64_t off = first - 1000;
+		if (first < 1000 || off >= 250 || off != sched.offset_ns) {
+			in_bounds = false;
+		}
+		min_off = off < min_off ? off : min_off;
+		max_off = off > max_off ? off : max_off;
+		// リング補充をまたいでも間隔は -I のまま
+		for (uint64_t k = 0; k < STAMP_SCHED_RING_CAP + 8U; k++) {
+			if (stamp_sched_peek(&sched) != first + k * 1000) {
+				periodic = false;
+			}
+			(void)stamp_sched_advance(&sched, stamp_sched_peek(&sched));
+		}
+	}
+	EXPECT_TRUE(in_bounds, "sched: start offset within [0, J)");
+	EXPECT_TRUE(min_off < 10 && max_off > 240,
+		    "sched: start offsets spread over the bound");
+	EXPECT_TRUE(periodic, "sched: offset mode keeps a fixed period");
+
+	stamp_sched_init(&sched, STAMP_SCHED_OFFSET, 0, 1000, 0, 7);
+	EXPECT_EQ_ULL(stamp_sched_peek(&sched), 0, "sched: -J 0 starts on the grid");
+	bool clamped = true;
+	for (uint64_t seed = 0; seed < 200; seed++) {
+		stamp_sched_init(&sched, STAMP_SCHED_OFFSET, 0, 1000, 5000, seed);
+		if (sched.offset_ns >= 1000) {
+			clamped = false;
+		}
+	}
+	EXPECT_TRUE(clamped, "sched: start offset clamped to interval");
+
+	enum stamp_sched_mode mode = STAMP_SCHED_PERIODIC;
+	EXPECT_TRUE(stamp_sched_parse_mode("poisson", &mode) == 0 &&
+			    mode == STAMP_SCHED_POISSON,
+		    "sched: parse poisson");
+	EXPECT_TRUE(stamp_sched_parse_mode("random", &mode) != 0,
+		    "sched: unknown schedule rejected");
+	EXPECT_TRUE(stamp_sched_parse_mode("offset", &mode) == 0 &&
+			    mode == STAMP_SCHED_OFFSET,
+		    "sched: parse offset");
+	EXPECT_TRUE(strcmp(stamp_sched_mode_str(STAMP_SCHED_OFFSET), "offset") == 0,
+		    "sched: mode name round-trips");
+}
+
+// =============================================================================
+// Phase 18: Sender 列車送信の集計
+// =============================================================================
+
+// 全本受信: T2 の広がりが dispersion、最大 seq − 最小 seq の RTT が遅延増加
+static void test_train_dispersion_and_delay_increase(void)
+{
+	static struct stamp_train_table tbl;
+	stamp_train_table_init(&tbl, 100, 4);
+
+	stamp_train_begin(&tbl, 100, 4);
+	// 到着順を入れ替えても seq 基準・T2 の最小/最大で求まること
+	stamp_train_on_reply(&tbl, 101, 1000000 + 1200, 0.110);
+	stamp_train_on_reply(&tbl, 100, 1000000, 0.100);
+	stamp_train_on_reply(&tbl, 103, 1000000 + 3600, 0.130);
+	EXPECT_EQ_ULL(tbl.sum.trains, 0, "train: not finished before all resolved");
+	stamp_train_on_reply(&tbl, 102, 1000000 + 2400, 0.120);
+
+	EXPECT_EQ_ULL(tbl.sum.trains, 1, "train: finished when all replies arrive");
+	EXPECT_EQ_ULL(tbl.sum.complete, 1, "train: complete train counted");
+	EXPECT_EQ_ULL(tbl.sum.lost, 0, "train: no intra-train loss");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&tbl.sum.dispersion_us), 3.6, 1e-9,
+			   "train: dispersion = max T2 - min T2");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&tbl.sum.delay_increase_ms), 0.030, 1e-9,
+			   "train: delay increase = RTT(last seq) - RTT(first seq)");
+
+	// 列車番号の索引: 2 本目の列車は seq 104..107
+	stamp_train_begin(&tbl, 104, 4);
+	EXPECT_TRUE(stamp_train_lookup(&tbl, 107) != NULL, "train: seq 107 in train 2");
+	EXPECT_TRUE(stamp_train_lookup(&tbl, 108) == NULL, "train: seq 108 not yet sent");
+	EXPECT_TRUE(stamp_train_lookup(&tbl, 100) == NULL, "train: finished train not active");
+}
+
+// ロス・短い列車・スロット再利用・flush
+static void test_train_loss_and_flush(void)
+{
+	static struct stamp_train_table tbl;
+	stamp_train_table_init(&tbl, 0, 8);
+
+	// 8 本中 2 本ロス
+	stamp_train_begin(&tbl, 0, 8);
+	for (uint32_t seq = 0; seq < 8; seq++) {
+		if (seq == 3 || seq == 7) {
+			stamp_train_on_loss(&tbl, seq);
+		} else {
+			stamp_train_on_reply(&tbl, seq, seq * 1000ULL, 1.0);
+		}
+	}
+	EXPECT_EQ_ULL(tbl.sum.trains, 1, "train: finished after losses resolve");
+	EXPECT_EQ_ULL(tbl.sum.complete, 0, "train: lossy train not complete");
+	EXPECT_EQ_ULL(tbl.sum.lost, 2, "train: intra-train loss counted");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&tbl.sum.dispersion_us), 6.0, 1e-9,
+			   "train: dispersion over received packets");
+
+	// -n の端数で 3 本だけ送った列車（seq 8..10、11..15 は未送信）
+	stamp_train_begin(&tbl, 8, 3);
+	EXPECT_TRUE(stamp_train_lookup(&tbl, 11) == NULL, "train: unsent seq not in train");
+	stamp_train_on_reply(&tbl, 8, 0, 1.0);
+
+	// 同じスロットを再利用すると古い列車は途中結果で確定（未解決はロス）
+	stamp_train_begin(&tbl, 8U + 8U * STAMP_TRAIN_RING_CAP, 8);
+	EXPECT_EQ_ULL(tbl.sum.trains, 2, "train: slot reuse finishes old train");
+	EXPECT_EQ_ULL(tbl.sum.lost, 4, "train: unresolved packets count as lost");
+
+	stamp_train_flush(&tbl);
+	EXPECT_EQ_ULL(tbl.sum.trains, 3, "train: flush finishes active trains");
+	EXPECT_EQ_ULL(tbl.sum.packets, 19, "train: packets across all trains");
+	EXPECT_EQ_ULL(stamp_welford_count(&tbl.sum.dispersion_us), 1,
+		      "train: dispersion needs two received packets");
+}
+
+// -G の列車: 送信中は先に送った分が全て解決しても確定しない
+static void test_train_open_close(void)
+{
+	static struct stamp_train_table tbl;
+	stamp_train_table_init(&tbl, 0, 4);
+
+	stamp_train_open(&tbl, 0);
+	stamp_train_on_reply(&tbl, 0, 1000, 1.0);
+	EXPECT_EQ_ULL(tbl.sum.trains, 0, "train open: first reply does not finish");
+	EXPECT_TRUE(stamp_train_lookup(&tbl, 1) == NULL, "train open: unsent seq not in train");
+	stamp_train_add_sent(&tbl, 0);
+	stamp_train_add_sent(&tbl, 0);
+	stamp_train_on_reply(&tbl, 1, 3000, 1.2);
+	stamp_train_on_loss(&tbl, 2);
+	EXPECT_EQ_ULL(tbl.sum.trains, 0, "train open: resolved members wait for close");
+	stamp_train_add_sent(&tbl, 4); // 別の列車の seq は無視
+	stamp_train_close(&tbl, 0);
+	EXPECT_EQ_ULL(tbl.sum.trains, 1, "train open: close finishes resolved train");
+	EXPECT_EQ_ULL(tbl.sum.packets, 3, "train open: sent counts added members");
+	EXPECT_EQ_ULL(tbl.sum.lost, 1, "train open: loss counted");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&tbl.sum.dispersion_us), 2.0, 1e-9,
+			   "train open: dispersion over members");
+
+	// 閉じた後は残りの解決で確定する
+	stamp_train_open(&tbl, 4);
+	stamp_train_add_sent(&tbl, 4);
+	stamp_train_close(&tbl, 4);
+	EXPECT_EQ_ULL(tbl.sum.trains, 1, "train open: unresolved train stays active");
+	stamp_train_on_reply(&tbl, 4, 0, 1.0);
+	stamp_train_on_reply(&tbl, 5, 0, 1.0);
+	EXPECT_EQ_ULL(tbl.sum.trains, 2, "train open: finishes after close and replies");
+	EXPECT_EQ_ULL(tbl.sum.complete, 1, "train open: complete train counted");
+}
+
+// 整数ナノ秒変換（NTP 小数部・PTP ナノ秒）
+static void test_timestamp_to_ns(void)
+{
+	uint64_t ntp = stamp_timestamp_to_ns(htonl(10), htonl(0x80000000U), 0);
+	EXPECT_EQ_ULL(ntp, 10500000000ULL, "ts_to_ns: NTP 10.5 s");
+	uint64_t ptp = stamp_timestamp_to_ns(htonl(10),
+					     htonl(123456789U),
+					     ERROR_ESTIMATE_Z_BIT);
+	EXPECT_EQ_ULL(ptp, 10123456789ULL, "ts_to_ns: PTP keeps nanoseconds");
+	uint64_t base = stamp_timestamp_to_ns(htonl(3900000000U), htonl(0), 0);
+	uint64_t next = stamp_timestamp_to_ns(htonl(3900000000U), htonl(5U), 0);
+	EXPECT_EQ_ULL(next - base, 1, "ts_to_ns: 1 ns resolution near current epoch");
+}
+
+// =============================================================================
+// Phase 19: 複数ターゲット Sender（タイマーホイール・ターゲット指定・レポート）
+// =============================================================================
+
+static void count_wheel_fire(struct stamp_wheel_node *node, void *ctx)
+{
+	uint32_t *fired = ctx;
+	(*fired)++;
+	node->deadline_ns = 0; // 満了したノードの印
+}
+
+// 登録・満了・取り消しと、1 周より先の期限の周回判定
+static void test_wheel_expire_and_cancel(void)
+{
+	static struct stamp_wheel wheel;
+	struct stamp_wheel_node n1 = {0};
+	struct stamp_wheel_node n2 = {0};
+	struct stamp_wheel_node far = {0};
+	struct stamp_wheel_node gone = {0};
+	uint64_t tick = 1000;
+	uint64_t deadline = 0;
+	uint32_t fired = 0;
+
+	stamp_wheel_init(&wheel, tick, 50000);
+	EXPECT_TRUE(!stamp_wheel_next_deadline(&wheel, &deadline),
+		    "wheel: empty has no deadline");
+	stamp_wheel_arm(&wheel, &n1, 52500);
+	stamp_wheel_arm(&wheel, &n2, 52900);
+	stamp_wheel_arm(&wheel, &gone, 51000);
+	// 1 周（STAMP_WHEEL_SLOTS tick）後の同じスロット
+	stamp_wheel_arm(&wheel, &far, 52100 + STAMP_WHEEL_SLOTS * tick);
+	stamp_wheel_cancel(&wheel, &gone);
+	EXPECT_EQ_ULL(wheel.count, 3, "wheel: cancel unlinks");
+	EXPECT_TRUE(stamp_wheel_next_deadline(&wheel, &deadline) &&
+			    deadline == 52500,
+		    "wheel: next deadline skips later revolution");
+
+	stamp_wheel_expire(&wheel, 52600, count_wheel_fire, &fired);
+	EXPECT_EQ_ULL(fired, 1, "wheel: only due node fires");
+	EXPECT_TRUE(n1.deadline_ns == 0 && n1.pprev == NULL,
+		    "wheel: fired node unlinked");
+	EXPECT_TRUE(n2.pprev != NULL, "wheel: same-tick later node stays armed");
+
+	stamp_wheel_expire(&wheel, 60000, count_wheel_fire, &fired);
+	EXPECT_EQ_ULL(fired, 2, "wheel: far node survives its first revolution");
+	EXPECT_TRUE(stamp_wheel_next_deadline(&wheel, &deadline) &&
+			    deadline == 52100 + STAMP_WHEEL_SLOTS * tick,
+		    "wheel: next deadline beyond one revolution");
+
+	// 長時間処理が止まった後も 1 周の走査で全件満了する
+	stamp_wheel_expire(&wheel, 10 * STAMP_WHEEL_SLOTS * tick,
+			   count_wheel_fire, &fired);
+	EXPECT_EQ_ULL(fired, 3, "wheel: overdue node fires after long stall");
+	EXPECT_EQ_ULL(wheel.count, 0, "wheel: empty after all fired");
+
+	// 処理済み tick より前の期限は次の期限処理で満了する
+	stamp_wheel_arm(&wheel, &n1, 1);
+	stamp_wheel_expire(&wheel, 10 * STAMP_WHEEL_SLOTS * tick,
+			   count_wheel_fire, &fired);
+	EXPECT_EQ_ULL(fired, 4, "wheel: past deadline fires immediately");
+}
+
+static void rearm_wheel_fire(struct stamp_wheel_node *node, void *ctx)
+{
+	struct stamp_wheel *wheel = ctx;
+	stamp_wheel_arm(wheel, node, node->deadline_ns + 1000);
+}
+
+// コールバック内での再登録は同じ期限処理で再び満了しない
+static void test_wheel_rearm_in_callback(void)
+{
+	static struct stamp_wheel wheel;
+	struct stamp_wheel_node node = {0};
+	uint64_t deadline = 0;
+
+	stamp_wheel_init(&wheel, 1000, 0);
+	stamp_wheel_arm(&wheel, &node, 500);
+	EXPECT_EQ_ULL(stamp_wheel_expire(&wheel, 5000, rearm_wheel_fire, &wheel),
+		      1,
+		      "wheel: re-armed node fires once per expire");
+	EXPECT_TRUE(stamp_wheel_next_deadline(&wheel, &deadline) &&
+			    deadline == 1500,
+		    "wheel: re-armed deadline kept");
+	EXPECT_EQ_ULL(stamp_wheel_expire(&wheel, 5000, rearm_wheel_fire, &wheel),
+		      1,
+		      "wheel: overdue re-armed node fires on next expire");
+}
+
+static void test_parse_target(void)
+{
+	char host[64];
+	uint16_t port = 0;
+
+	EXPECT_TRUE(stamp_parse_target("192.0.2.1:8620", host, sizeof(host),
+				       &port, STAMP_PORT) == 0 &&
+			    strcmp(host, "192.0.2.1") == 0 && port == 8620,
+		    "target: host:port");
+	EXPECT_TRUE(stamp_parse_target("example.net", host, sizeof(host),
+				       &port, STAMP_PORT) == 0 &&
+			    strcmp(host, "example.net") == 0 && port == STAMP_PORT,
+		    "target: host uses default port");
+	EXPECT_TRUE(stamp_parse_target("[2001:db8::1]:9000", host, sizeof(host),
+				       &port, STAMP_PORT) == 0 &&
+			    strcmp(host, "2001:db8::1") == 0 && port == 9000,
+		    "target: bracketed IPv6 with port");
+	EXPECT_TRUE(stamp_parse_target("2001:db8::1", host, sizeof(host),
+				       &port, STAMP_PORT) == 0 &&
+			    strcmp(host, "2001:db8::1") == 0 && port == STAMP_PORT,
+		    "target: bare IPv6 literal");
+	EXPECT_TRUE(stamp_parse_target("[::1]", host, sizeof(host),
+				       &port, STAMP_PORT) == 0 &&
+			    strcmp(host, "::1") == 0,
+		    "target: bracketed IPv6 without port");
+	EXPECT_TRUE(stamp_parse_target("host:0", host, sizeof(host), &port,
+				       STAMP_PORT) != 0,
+		    "target: port 0 rejected");
+	EXPECT_TRUE(stamp_parse_target(":862", host, sizeof(host), &port,
+				       STAMP_PORT) != 0,
+		    "target: empty host rejected");
+	EXPECT_TRUE(stamp_parse_target("[::1", host, sizeof(host), &port,
+				       STAMP_PORT) != 0,
+		    "target: unterminated bracket rejected");
+	EXPECT_TRUE(stamp_parse_target("[::1]x", host, sizeof(host), &port,
+				       STAMP_PORT) != 0,
+		    "target: junk after bracket rejected");
+	EXPECT_TRUE(stamp_parse_target("abcdefgh", host, 8, &port,
+				       STAMP_PORT) != 0,
+		    "target: host longer than buffer rejected");
+}
+
+// 複数ターゲットのレポートはターゲットをキーに 1 つの JSON / CSV にまとまる
+static void test_report_multi_target(void)
+{
+	const struct stamp_report_field f1[] = {{"rtt_avg_ms", 1.5, STAMP_REPORT_VALUE}};
+	const struct stamp_report_field f2[] = {{"rtt_avg_ms", NAN, STAMP_REPORT_VALUE}};
+	const struct stamp_report reports[] = {
+		{.target = "192.0.2.1:862", .family = "IPv4", .packets_tx = 4,
+		 .packets_rx = 4, .fields = f1, .field_count = 1},
+		{.target = "[2001:db8::1]:862", .family = "IPv6", .packets_tx = 4,
+		 .packets_rx = 2, .loss_ratio = 0.5, .fields = f2, .field_count = 1},
+	};
+	char out[2048];
+	size_t got;
+
+	FILE *fp = tmpfile();
+	EXPECT_TRUE(fp != NULL, "multi json tmpfile created");
+	if (fp == NULL) {
+		return;
+	}
+	stamp_report_write_json_multi(fp, reports, 2);
+	rewind(fp);
+	got = fread(out, 1, sizeof(out) - 1, fp);
+	out[got] = '\0';
+	fclose(fp);
+	EXPECT_TRUE(strstr(out, "\"targets\": {\n    \"192.0.2.1:862\": {\n"
+				"      \"family\": \"IPv4\"") != NULL,
+		    "multi json: first target keyed by address");
+	EXPECT_TRUE(strstr(out, "    },\n    \"[2001:db8::1]:862\": {") != NULL,
+		    "multi json: second target follows");
+	EXPECT_TRUE(strstr(out, "      \"rtt_avg_ms\": null\n    }\n  }\n}\n") !=
+			    NULL,
+		    "multi json: per-target fields and closing braces");
+	EXPECT_TRUE(strstr(out, "\"target\":") == NULL,
+		    "multi json: no top-level target");
+
+	fp = tmpfile();
+	EXPECT_TRUE(fp != NULL, "multi csv tmpfile created");
+	if (fp == NULL) {
+		return;
+	}
+	stamp_report_write_csv_multi(fp, reports, 2);
+	rewind(fp);
+	got = fread(out, 1, sizeof(out) - 1, fp);
+	out[got] = '\0';
+	fclose(fp);
+	size_t lines = 0;
+	for (const char *c = out; *c != '\0'; c++) {
+		lines += (*c == '\n');
+	}
+	EXPECT_EQ_ULL(lines, 4, "multi csv: comment, header and one row per target");
+	EXPECT_TRUE(strstr(out, ",192.0.2.1:862,IPv4,STAMP,") != NULL &&
+			    strstr(out, ",[2001:db8::1]:862,IPv6,STAMP,") != NULL,
+		    "multi csv: rows keyed by target");
+	EXPECT_TRUE(strstr(out, ",0.500000,\n") != NULL,
+		    "multi csv: missing metric is empty field");
+}
+
+// =============================================================================
+// Phase 20: 遅延分布のストリーミング分位点スケッチ
+// =============================================================================
+
+// 正確な nearest-rank 分位点に対し相対誤差 1/(2 × SUB) 以内で推定する
+static void test_sketch_quantile_accuracy(void)
+{
+	static struct stamp_sketch sk;
+	static double vals[20000];
+	struct stamp_rng rng;
+	size_t n = sizeof(vals) / sizeof(vals[0]);
+	const double ps[] = {1.0, 25.0, 50.0, 90.0, 95.0, 99.0, 99.9};
+	double tol = 1.0 / (2.0 * (double)STAMP_SKETCH_SUB);
+	bool within = true;
+
+	memset(&sk, 0, sizeof(sk));
+	stamp_rng_seed(&rng, 20260101);
+	for (size_t i = 0; i < n; i++) {
+		// 0.05 ms 付近から数百 ms まで桁をまたぐ裾の重い分布
+		vals[i] = 0.05 * exp(8.0 * stamp_rng_uniform01(&rng));
+		stamp_sketch_add(&sk, vals[i]);
+	}
+	qsort(vals, n, sizeof(vals[0]), stamp_double_cmp);
+	for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+		double exact = stamp_percentile_sorted(vals, n, ps[i]);
+		double est = stamp_sketch_quantile(&sk, ps[i]);
+		if (fabs(est - exact) > exact * tol) {
+			printf("  p%.1f: sketch %.9f exact %.9f\n", ps[i], est, exact);
+			within = false;
+		}
+	}
+	EXPECT_TRUE(within, "sketch: quantiles within relative error bound");
+	EXPECT_EQ_ULL(sk.count, n, "sketch: count");
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&sk, 0.0),
+			   vals[0],
+			   0.0,
+			   "sketch: p0 is exact min");
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&sk, 100.0),
+			   vals[n - 1],
+			   0.0,
+			   "sketch: p100 is exact max");
+	double pdv_exact = stamp_pdv_from_sorted(vals, n);
+	EXPECT_NEAR_DOUBLE(stamp_sketch_pdv(&sk),
+			   pdv_exact,
+			   stamp_percentile_sorted(vals, n, 95.0) * tol,
+			   "sketch: PDV is p95 - exact min");
+}
+
+// 負値（クロックずれのある片方向遅延）・0・非有限値・空のスケッチ
+static void test_sketch_signed_and_empty(void)
+{
+	static struct stamp_sketch sk;
+	memset(&sk, 0, sizeof(sk));
+
+	EXPECT_TRUE(isnan(stamp_sketch_quantile(&sk, 50.0)),
+		    "sketch: empty quantile is NaN");
+	EXPECT_TRUE(isnan(stamp_sketch_pdv(&sk)), "sketch: empty PDV is NaN");
+
+	const double in[] = {-3.0, -1.0, 0.0, 0.0, 2.0, 4.0, 8.0};
+	for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+		stamp_sketch_add(&sk, in[i]);
+	}
+	stamp_sketch_add(&sk, NAN);
+	stamp_sketch_add(&sk, INFINITY);
+	EXPECT_EQ_ULL(sk.count, 7, "sketch: non-finite values ignored");
+	double tol = 1.0 / (2.0 * (double)STAMP_SKETCH_SUB);
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&sk, 0.0),
+			   -3.0,
+			   0.0,
+			   "sketch: negative min exact");
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&sk, 20.0),
+			   -1.0,
+			   tol,
+			   "sketch: negative value ordered before zero");
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&sk, 50.0),
+			   0.0,
+			   0.0,
+			   "sketch: median hits zero bucket");
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&sk, 80.0),
+			   4.0,
+			   4.0 * tol,
+			   "sketch: positive value");
+	EXPECT_NEAR_DOUBLE(stamp_sketch_pdv(&sk),
+			   8.0 - -3.0,
+			   0.0,
+			   "sketch: PDV with p95 at max");
+}
+
+// 分割して加えたスケッチの併合は、まとめて加えたものと一致する
+static void test_sketch_merge(void)
+{
+	static struct stamp_sketch whole;
+	static struct stamp_sketch part1;
+	static struct stamp_sketch part2;
+	struct stamp_rng rng;
+	memset(&whole, 0, sizeof(whole));
+	memset(&part1, 0, sizeof(part1));
+	memset(&part2, 0, sizeof(part2));
+
+	stamp_rng_seed(&rng, 862);
+	for (int i = 0; i < 5000; i++) {
+		double v = 1.0 + 99.0 * stamp_rng_uniform01(&rng);
+		stamp_sketch_add(&whole, v);
+		stamp_sketch_add(i % 3 == 0 ? &part1 : &part2, v);
+	}
+	stamp_sketch_merge(&part1, &part2);
+	EXPECT_TRUE(memcmp(&whole, &part1, sizeof(whole)) == 0,
+		    "sketch: merge equals combined sketch");
+
+	static struct stamp_sketch empty;
+	memset(&empty, 0, sizeof(empty));
+	stamp_sketch_merge(&empty, &whole);
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(&empty, 99.0),
+			   stamp_sketch_quantile(&whole, 99.0),
+			   0.0,
+			   "sketch: merge into empty copies distribution");
+}
+
+// =============================================================================
+// Phase 21: 選択アルゴリズムによる正確なパーセンタイル
+// =============================================================================
+
+// 乱数・重複・整列済み・全要素同値・NaN 混在の入力で qsort + nearest-rank と
+// 一致する（NaN は最大扱い）
+static void test_select_matches_sort(void)
+{
+	static double src[5000];
+	static double sorted[5000];
+	static double work[5000];
+	struct stamp_rng rng;
+	size_t n = sizeof(src) / sizeof(src[0]);
+	const double ps[] = {99.0, 0.0, 50.0, 95.0, 50.0, 100.0, 0.1};
+	double out[sizeof(ps) / sizeof(ps[0])];
+	bool match = true;
+
+	stamp_rng_seed(&rng, 4242);
+	for (int pattern = 0; pattern < 5; pattern++) {
+		for (size_t i = 0; i < n; i++) {
+			switch (pattern) {
+			case 0: // 一様乱数（負値を含む）
+				src[i] = stamp_rng_uniform01(&rng) * 20.0 - 5.0;
+				break;
+			case 1: // 重複の多い値
+				src[i] = (double)(stamp_rng_next(&rng) % 7U);
+				break;
+			case 2: // 昇順
+				src[i] = (double)i * 0.25;
+				break;
+			case 3: // 10 本に 1 本が NaN
+				src[i] = i % 10U == 0 ? (double)NAN
+							 : stamp_rng_uniform01(&rng);
+				break;
+			default: // 全要素同値
+				src[i] = 1.5;
+				break;
+			}
+		}
+		memcpy(sorted, src, sizeof(src));
+		qsort(sorted, n, sizeof(sorted[0]), stamp_double_cmp);
+		memcpy(work, src, sizeof(src));
+		stamp_percentiles_select(work, n, ps, out, sizeof(ps) / sizeof(ps[0]));
+		for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+			double want = stamp_percentile_sorted(sorted, n, ps[i]);
+			if (isnan(want) ? !isnan(out[i]) : out[i] != want) {
+				printf("  pattern %d p%.1f: %.9f\n", pattern, ps[i], out[i]);
+				match = false;
+			}
+		}
+	}
+	EXPECT_TRUE(match, "select: percentiles match qsort + nearest-rank");
+
+	double one = 3.0;
+	stamp_percentiles_select(&one, 1, ps, out, 2);
+	EXPECT_NEAR_DOUBLE(out[0], 3.0, 0.0, "select: single element");
+	stamp_percentiles_select(&one, 0, ps, out, 2);
+	EXPECT_TRUE(isnan(out[0]) && isnan(out[1]), "select: empty is NaN");
+}
+
+// 基数ソートは負値・0・NaN を含めて stamp_double_cmp の順序に並べる
+static void test_radix_sort_order(void)
+{
+	double arr[] = {3.5, -0.25, NAN, 1e-9, -7.0, 0.0, 1e9, -1e-9, 2.0, NAN,
+			-3.5, 42.0, 0.5, -0.5, 8.0, 1.0, -2.0, 0.125};
+	size_t n = sizeof(arr) / sizeof(arr[0]);
+	double expect[sizeof(arr) / sizeof(arr[0])];
+	double tmp[sizeof(arr) / sizeof(arr[0])];
+	memcpy(expect, arr, sizeof(arr));
+	qsort(expect, n, sizeof(expect[0]), stamp_double_cmp);
+	stamp_radix_sort_doubles(arr, n, tmp);
+	bool same = true;
+	for (size_t i = 0; i < n; i++) {
+		same &= (isnan(expect[i]) && isnan(arr[i])) || expect[i] == arr[i];
+	}
+	EXPECT_TRUE(same, "radix: order matches stamp_double_cmp");
+	EXPECT_TRUE(stamp_double_less(1.0, NAN) && !stamp_double_less(NAN, 1.0) &&
+			    !stamp_double_less(NAN, NAN) &&
+			    stamp_double_less(-1.0, 0.0),
+		    "select: NaN-aware less");
+
+	// 順位数が上限を超えると基数ソートの経路になる
+	static double many[1000];
+	double ps[STAMP_SELECT_MAX_RANKS + 1];
+	double out[STAMP_SELECT_MAX_RANKS + 1];
+	for (size_t i = 0; i < 1000; i++) {
+		many[i] = (double)((i * 7919U) % 1000U);
+	}
+	for (size_t i = 0; i < STAMP_SELECT_MAX_RANKS + 1; i++) {
+		ps[i] = (double)i * 5.0;
+	}
+	stamp_percentiles_select(many, 1000, ps, out, STAMP_SELECT_MAX_RANKS + 1);
+	EXPECT_NEAR_DOUBLE(out[10], 499.0, 0.0, "select: radix path p50");
+	EXPECT_NEAR_DOUBLE(out[0], 0.0, 0.0, "select: radix path min");
+}
+
+// =============================================================================
+// Phase 22: Reflector のパケット単位ログ（出力レベル・リング）
+// =============================================================================
+
+// -L の解析と、sample:N / rate:N の間引き
+static void test_log_policy(void)
+{
+	struct stamp_log_policy pol;
+	struct stamp_log_limiter lim = {0};
+	EXPECT_TRUE(stamp_log_policy_parse("all", &pol) == 0 &&
+			    pol.mode == STAMP_LOG_ALL,
+		    "log policy: all");
+	EXPECT_TRUE(stamp_log_policy_parse("silent", &pol) == 0 &&
+			    pol.mode == STAMP_LOG_SILENT,
+		    "log policy: silent");
+	EXPECT_TRUE(stamp_log_policy_parse("sample:0", &pol) != 0 &&
+			    stamp_log_policy_parse("rate:", &pol) != 0 &&
+			    stamp_log_policy_parse("sample", &pol) != 0 &&
+			    stamp_log_policy_parse("verbose", &pol) != 0,
+		    "log policy: invalid forms rejected");
+
+	EXPECT_TRUE(stamp_log_policy_parse("sample:4", &pol) == 0 &&
+			    pol.mode == STAMP_LOG_SAMPLE && pol.n == 4,
+		    "log policy: sample:4");
+	uint32_t emitted = 0;
+	for (int i = 0; i < 20; i++) {
+		emitted += stamp_log_should_emit(&pol, &lim, 0) ? 1U : 0U;
+	}
+	EXPECT_EQ_ULL(emitted, 5, "log policy: sample emits 1 in N");
+
+	memset(&lim, 0, sizeof(lim));
+	EXPECT_TRUE(stamp_log_policy_parse("rate:3", &pol) == 0 &&
+			    pol.mode == STAMP_LOG_RATE && pol.n == 3,
+		    "log policy: rate:3");
+	emitted = 0;
+	for (int i = 0; i < 10; i++) {
+		emitted += stamp_log_should_emit(&pol, &lim, 100) ? 1U : 0U;
+	}
+	EXPECT_EQ_ULL(emitted, 3, "log policy: rate caps lines per second");
+	EXPECT_TRUE(stamp_log_should_emit(&pol, &lim, 101),
+		    "log policy: rate window resets next second");
+}
+
+// リングの FIFO 順・満杯時の破棄・周回
+static void test_logring_push_pop(void)
+{
+	struct stamp_logring ring;
+	struct stamp_log_record rec = {0};
+	struct stamp_log_record got;
+
+	EXPECT_TRUE(stamp_logring_init(&ring, 3) != 0,
+		    "logring: non power-of-two rejected");
+	if (stamp_logring_init(&ring, 4) != 0) {
+		EXPECT_TRUE(false, "logring: init");
+		return;
+	}
+	EXPECT_TRUE(!stamp_logring_pop(&ring, &got), "logring: empty pop");
+
+	bool ordered = true;
+	uint32_t next = 0;
+	for (uint32_t round = 0; round < 3; round++) {
+		for (uint32_t i = 0; i < 4; i++) {
+			rec.seq = round * 4U + i;
+			rec.ttl = (uint8_t)(64U + i);
+			ordered &= stamp_logring_push(&ring, &rec);
+		}
+		rec.seq = 999;
+		EXPECT_TRUE(!stamp_logring_push(&ring, &rec),
+			    "logring: push to full ring drops");
+		while (stamp_logring_pop(&ring, &got)) {
+			ordered &= (got.seq == next &&
+				    got.ttl == (uint8_t)(64U + next % 4U));
+			next++;
+		}
+	}
+	EXPECT_TRUE(ordered && next == 12, "logring: FIFO across wraps");
+	EXPECT_EQ_ULL(ring.dropped, 3, "logring: dropped lines counted");
+	stamp_logring_free(&ring);
+	stamp_logring_free(&ring);
+}
+
+// =============================================================================
+// Phase 23: ステートフル Reflector のセッション表
+// =============================================================================
+
+static void session_test_addr(struct sockaddr_storage *ss, uint32_t ip, uint16_t port)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+	memset(ss, 0, sizeof(*ss));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(ip);
+	sin->sin_port = htons(port);
+}
+
+static uint32_t session_test_seq(struct stamp_session_table *tbl,
+				 uint32_t ip,
+				 uint16_t port,
+				 uint16_t ssid,
+				 uint64_t now_sec)
+{
+	struct sockaddr_storage ss;
+	struct stamp_session_key key;
+	uint32_t seq = UINT32_MAX;
+	session_test_addr(&ss, ip, port);
+	stamp_session_key_from(&key, &ss, ssid);
+	if (!stamp_session_next_seq(tbl, &key, now_sec, &seq)) {
+		return UINT32_MAX;
+	}
+	return seq;
+}
+
+// (アドレス, ポート, SSID) ごとに独立した seq、SSID の読み出し
+static void test_session_independent_seq(void)
+{
+	struct stamp_session_table tbl;
+	if (stamp_session_table_init(&tbl, 8, 10, 1, 100) != 0) {
+		EXPECT_TRUE(false, "session: init");
+		return;
+	}
+	EXPECT_TRUE(session_test_seq(&tbl, 0x0A000001, 5000, 0, 100) == 0 &&
+			    session_test_seq(&tbl, 0x0A000001, 5000, 0, 100) == 1 &&
+			    session_test_seq(&tbl, 0x0A000001, 5000, 0, 100) == 2,
+		    "session: seq counts per session");
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000001, 5001, 0, 100), 0,
+		      "session: other port is a new session");
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000002, 5000, 0, 100), 0,
+		      "session: other address is a new session");
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000001, 5000, 7, 100), 0,
+		      "session: other SSID is a new session");
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000001, 5000, 0, 100), 3,
+		      "session: original session continues");
+	EXPECT_EQ_ULL(tbl.pool.active, 4, "session: active count");
+
+	uint8_t buf[STAMP_BASE_PACKET_SIZE] = {0};
+	buf[14] = 0x12;
+	buf[15] = 0x34;
+	EXPECT_EQ_ULL(stamp_sender_ssid(buf), 0x1234, "session: SSID from bytes 14-15");
+	stamp_session_table_free(&tbl);
+	stamp_session_table_free(&tbl);
+}
+
+// 無受信の期限切れ・受信中のセッションの延長・上限到達
+static void test_session_expiry_and_cap(void)
+{
+	struct stamp_session_table tbl;
+	if (stamp_session_table_init(&tbl, 2, 5, 2, 1000) != 0) {
+		EXPECT_TRUE(false, "session: init");
+		return;
+	}
+	session_test_seq(&tbl, 0x0A000001, 1, 0, 1000);
+	session_test_seq(&tbl, 0x0A000002, 1, 0, 1000);
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000003, 1, 0, 1001),
+		      UINT32_MAX,
+		      "session: new session refused at cap");
+	EXPECT_EQ_ULL(tbl.overflow, 1, "session: overflow counted");
+
+	// 1 件目だけ受信を続ける
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000001, 1, 0, 1003), 1,
+		      "session: refresh keeps seq");
+	EXPECT_EQ_ULL(stamp_session_expire(&tbl, 1005), 1,
+		      "session: idle session expires");
+	EXPECT_EQ_ULL(tbl.pool.active, 1, "session: active after expiry");
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000001, 1, 0, 1006), 2,
+		      "session: refreshed session survives first deadline");
+	EXPECT_EQ_ULL(session_test_seq(&tbl, 0x0A000002, 1, 0, 1006), 0,
+		      "session: expired session restarts at 0");
+	EXPECT_EQ_ULL(stamp_session_expire(&tbl, 1010), 0,
+		      "session: nothing expires before idle");
+	EXPECT_EQ_ULL(stamp_session_expire(&tbl, 1011), 2,
+		      "session: both sessions expire after idle");
+	EXPECT_TRUE(tbl.pool.active == 0 && tbl.pool.free_count == 2 &&
+			    tbl.pool.expired == 3,
+		    "session: pool returned after expiry");
+	stamp_session_table_free(&tbl);
+}
+
+// 削除後も同じ探索列上の他のキーが見つかる（後方シフト削除）
+static void test_session_remove_keeps_probe_chain(void)
+{
+	struct stamp_session_table tbl;
+	if (stamp_session_table_init(&tbl, 64, 30, 3, 0) != 0) {
+		EXPECT_TRUE(false, "session: init");
+		return;
+	}
+	for (uint32_t i = 0; i < 64; i++) {
+		session_test_seq(&tbl, 0xC0A80000U + i, 9, 0, 0);
+	}
+	// 偶数番を削除する
+	for (uint32_t i = 0; i < 64; i += 2) {
+		struct sockaddr_storage ss;
+		struct stamp_session_key key;
+		session_test_addr(&ss, 0xC0A80000U + i, 9);
+		stamp_session_key_from(&key, &ss, 0);
+		uint32_t idx = stamp_pool_find(&tbl.pool,
+					       &key,
+					       stamp_session_hash(&key, tbl.pool.seed));
+		if (idx != STAMP_SESSION_NONE) {
+			stamp_pool_remove(&tbl.pool, idx);
+		}
+	}
+	bool found = tbl.pool.active == 32;
+	for (uint32_t i = 1; i < 64; i += 2) {
+		found &= session_test_seq(&tbl, 0xC0A80000U + i, 9, 0, 0) == 1;
+	}
+	EXPECT_TRUE(found, "session: remaining keys found after removal");
+	EXPECT_EQ_ULL(tbl.pool.active, 32, "session: no sessions recreated");
+	stamp_session_table_free(&tbl);
+}
+
+// =============================================================================
+// Phase 24: Reflector の送信元別統計表
+// =============================================================================
+
+// 滞留時間の log2 ビン
+static void test_client_hist_bin(void)
+{
+	EXPECT_TRUE(stamp_client_hist_bin(0) == 0 && stamp_client_hist_bin(1) == 0,
+		    "clients: 0-1 ns in bin 0");
+	EXPECT_TRUE(stamp_client_hist_bin(1023) == 9 &&
+			    stamp_client_hist_bin(1024) == 10,
+		    "clients: power-of-two bin edges");
+	EXPECT_EQ_ULL(stamp_client_hist_bin(UINT64_MAX),
+		      STAMP_CLIENTS_HIST_BINS - 1U,
+		      "clients: overflow clamps to last bin");
+}
+
+// 送信元ごとの計数、無受信の退避と合計の保持、満杯時の untracked
+static void test_client_table(void)
+{
+	struct stamp_client_table tbl;
+	struct sockaddr_storage src1;
+	struct sockaddr_storage src2;
+	struct sockaddr_storage src3;
+	session_test_addr(&src1, 0x0A000001, 1000);
+	session_test_addr(&src2, 0x0A000001, 1001);
+	session_test_addr(&src3, 0x0A000003, 1000);
+	if (stamp_client_table_init(&tbl, 2, 10, 5, 50) != 0) {
+		EXPECT_TRUE(false, "clients: init");
+		return;
+	}
+
+	struct stamp_client *c1 = stamp_client_lookup(&tbl, &src1, 50);
+	if (c1 == NULL) {
+		EXPECT_TRUE(false, "clients: first lookup");
+		stamp_client_table_free(&tbl);
+		return;
+	}
+	stamp_client_count_reflected(c1, 44, 3000);
+	stamp_client_count_reflected(c1, 44, 5000);
+	c1->drops[STAMP_CLIENT_DROP_TTL]++;
+	EXPECT_TRUE(stamp_client_lookup(&tbl, &src1, 52) == c1 &&
+			    c1->first_seen_sec == 50 && c1->entry.last_seen_sec == 52,
+		    "clients: same source found, last seen updated");
+	EXPECT_TRUE(c1->packets == 2 && c1->bytes == 88 && c1->hist[11] == 1 &&
+			    c1->hist[12] == 1,
+		    "clients: packets, bytes and residence bins");
+
+	struct stamp_client *c2 = stamp_client_lookup(&tbl, &src2, 55);
+	EXPECT_TRUE(c2 != NULL && c2 != c1, "clients: other port is a new entry");
+	EXPECT_TRUE(stamp_client_lookup(&tbl, &src3, 55) == NULL &&
+			    tbl.untracked == 1,
+		    "clients: full table counts untracked");
+
+	// src1 は 62 で、src2 は 65 で期限切れ
+	EXPECT_EQ_ULL(stamp_client_expire(&tbl, 62), 1, "clients: idle entry evicted");
+	EXPECT_TRUE(tbl.retired.packets == 2 && tbl.retired.bytes == 88 &&
+			    tbl.retired.drops[STAMP_CLIENT_DROP_TTL] == 1 &&
+			    tbl.retired.hist[11] == 1,
+		    "clients: evicted counters kept in totals");
+	struct stamp_client *c3 = stamp_client_lookup(&tbl, &src3, 62);
+	EXPECT_TRUE(c3 != NULL && c3->packets == 0 && tbl.pool.active == 2,
+		    "clients: freed entry reused");
+
+	uint32_t in_use = 0;
+	for (uint32_t i = 0; i < tbl.pool.cap; i++) {
+		in_use += stamp_client_at(&tbl, i)->entry.key.family != 0 ? 1U : 0U;
+	}
+	EXPECT_EQ_ULL(in_use, 2, "clients: unused entries marked for dump");
+	stamp_client_table_free(&tbl);
+	stamp_client_table_free(&tbl);
+}
+
+// 表示用にキーから送信元を復元する
+static void test_session_key_addr(void)
+{
+	struct sockaddr_storage ss;
+	struct sockaddr_storage back;
+	struct stamp_session_key key;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+	memset(&ss, 0, sizeof(ss));
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = htons(862);
+	sin6->sin6_addr.s6_addr[15] = 1;
+	stamp_session_key_from(&key, &ss, 0);
+	stamp_session_key_addr(&key, &back);
+	EXPECT_TRUE(back.ss_family == AF_INET6 &&
+			    stamp_sockaddr_get_port(&back) == 862 &&
+			    memcmp(&((struct sockaddr_in6 *)&back)->sin6_addr,
+				   &sin6->sin6_addr,
+				   16) == 0,
+		    "session key: IPv6 address round trip");
+}
+
+// =============================================================================
+// Phase 25: Reflector のカーネル内入力フィルタ（cBPF）
+// =============================================================================
+
+// プレフィックスの解析（ホスト部の切り捨て・不正な形式）
+static void test_prefix_parse(void)
+{
+	struct stamp_prefix pfx;
+	EXPECT_TRUE(stamp_prefix_parse("10.1.2.3/8", &pfx) == 0 &&
+			    pfx.family == AF_INET && pfx.len == 8 &&
+			    pfx.addr[0] == 10 && pfx.addr[1] == 0 &&
+			    pfx.addr[3] == 0,
+		    "prefix: IPv4 host bits cleared");
+	EXPECT_TRUE(stamp_prefix_parse("2001:db8::1", &pfx) == 0 &&
+			    pfx.family == AF_INET6 && pfx.len == 128 &&
+			    pfx.addr[15] == 1,
+		    "prefix: bare IPv6 address is a host prefix");
+	EXPECT_TRUE(stamp_prefix_parse("0.0.0.0/0", &pfx) == 0 && pfx.len == 0,
+		    "prefix: /0 accepted");
+	EXPECT_TRUE(stamp_prefix_parse("10.0.0.0/33", &pfx) != 0 &&
+			    stamp_prefix_parse("2001:db8::/129", &pfx) != 0 &&
+			    stamp_prefix_parse("/8", &pfx) != 0 &&
+			    stamp_prefix_parse("10.0.0.0/", &pfx) != 0 &&
+			    stamp_prefix_parse("host.example", &pfx) != 0,
+		    "prefix: invalid forms rejected");
+
+	struct stamp_allowlist list = {.count = 0};
+	EXPECT_TRUE(stamp_allowlist_add(&list, "10.0.0.0/8,2001:db8::/32") == 0 &&
+			    list.count == 2,
+		    "allowlist: comma separated prefixes");
+	EXPECT_TRUE(stamp_allowlist_add(&list, "192.0.2.0/24,") != 0,
+		    "allowlist: empty item rejected");
+}
+
+#ifdef __linux__
+// 送信元 src_ip から dst へ len バイトを送る（先頭バイト = tag、multiplier = mult）
+static void bpf_test_send(uint32_t src_ip,
+			  const struct sockaddr_in *dst,
+			  size_t len,
+			  uint8_t tag,
+			  uint8_t mult)
+{
+	uint8_t pkt[STAMP_BASE_PACKET_SIZE] = {0};
+	pkt[0] = tag;
+	pkt[13] = mult;
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		return;
+	}
+	struct sockaddr_in src = {0};
+	src.sin_family = AF_INET;
+	src.sin_addr.s_addr = htonl(src_ip);
+	if (bind(fd, (const struct sockaddr *)&src, sizeof(src)) == 0) {
+		(void)sendto(fd,
+			     pkt,
+			     len,
+			     0,
+			     (const struct sockaddr *)dst,
+			     sizeof(*dst));
+	}
+	close(fd);
+}
+
+// 受信できたパケットの tag を順に集める（200 ms 待って無ければ終わり）
+static size_t bpf_test_drain(int fd, uint8_t *tags, size_t max)
+{
+	size_t n = 0;
+	uint8_t buf[STAMP_BASE_PACKET_SIZE];
+	while (n < max && recv(fd, buf, sizeof(buf), 0) > 0) {
+		tags[n++] = buf[0];
+	}
+	return n;
+}
+
+// 実ソケットに付けたフィルタが短すぎる・multiplier 0・許可外の送信元を落とす
+static void test_bpf_filter_loopback(void)
+{
+	struct stamp_allowlist allow = {.count = 0};
+	static struct stamp_bpf_prog prog;
+	uint8_t tags[8];
+
+	for (int with_allow = 0; with_allow < 2; with_allow++) {
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		struct sockaddr_in dst = {0};
+		socklen_t dst_len = sizeof(dst);
+		dst.sin_family = AF_INET;
+		dst.sin_addr.s_addr = htonl(0x7F000001);
+		struct timeval tv = {0, 200000};
+		if (with_allow) {
+			(void)stamp_allowlist_add(&allow, "127.0.0.2/32,::1");
+		}
+		stamp_bpf_build(&prog, &allow);
+		if (fd < 0 ||
+		    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+		    stamp_bpf_attach(fd, &prog) != 0 ||
+		    bind(fd, (const struct sockaddr *)&dst, sizeof(dst)) != 0 ||
+		    getsockname(fd, (struct sockaddr *)&dst, &dst_len) != 0) {
+			SKIP_TEST("bpf: SO_ATTACH_FILTER unavailable");
+			if (fd >= 0) {
+				close(fd);
+			}
+			return;
+		}
+
+		bpf_test_send(0x7F000002, &dst, 13, 1, 1); // 短すぎる
+		bpf_test_send(0x7F000002, &dst, STAMP_BASE_PACKET_SIZE, 2, 0);
+		bpf_test_send(0x7F000002, &dst, 14, 3, 1); // TWAMP Light 最小長
+		bpf_test_send(0x7F000001, &dst, STAMP_BASE_PACKET_SIZE, 4, 1);
+		bpf_test_send(0x7F000002, &dst, STAMP_BASE_PACKET_SIZE, 5, 1);
+		size_t n = bpf_test_drain(fd, tags, sizeof(tags));
+		if (with_allow) {
+			EXPECT_TRUE(n == 2 && tags[0] == 3 && tags[1] == 5,
+				    "bpf: allowlist drops other sources");
+		} else {
+			EXPECT_TRUE(n == 3 && tags[0] == 3 && tags[1] == 4 &&
+					    tags[2] == 5,
+				    "bpf: short and zero-multiplier packets "
+				    "dropped in kernel");
+		}
+		close(fd);
+	}
+}
+#endif
+
+// =============================================================================
+// Phase 26: AF_XDP エンジン（フレームの書き換え・XDP プログラム）
+// =============================================================================
+
+// Ethernet + IPv4/IPv6 + UDP のフレームを組み立てる（IPv4 は 60 バイトへの
+// 最小フレーム長パディング付き）
+static uint32_t xdp_test_frame(uint8_t *f, bool v6, uint32_t payload_len)
+{
+	memset(f, 0, 256);
+	for (uint8_t i = 0; i < 6; i++) {
+		f[i] = (uint8_t)(0xA0 + i);	// 宛先 MAC
+		f[6 + i] = (uint8_t)(0xB0 + i); // 送信元 MAC
+	}
+	uint32_t udp_len = 8U + payload_len;
+	uint8_t *ip = f + 14;
+	uint32_t l4;
+	if (!v6) {
+		stamp_xdp_put16(f + 12, 0x0800);
+		ip[0] = 0x45;
+		ip[1] = 0xB8; // DSCP EF（応答では 0 に戻す）
+		stamp_xdp_put16(ip + 2, 20U + udp_len);
+		stamp_xdp_put16(ip + 4, 0x1234);
+		ip[8] = 57;
+		ip[9] = 17;
+		memcpy(ip + 12, "\xC0\x00\x02\x01", 4); // 192.0.2.1
+		memcpy(ip + 16, "\xC0\x00\x02\x02", 4); // 192.0.2.2
+		l4 = 34;
+	} else {
+		stamp_xdp_put16(f + 12, 0x86DD);
+		ip[0] = 0x6B; // Traffic Class・Flow Label 付き
+		ip[3] = 0x77;
+		stamp_xdp_put16(ip + 4, udp_len);
+		ip[6] = 17;
+		ip[7] = 61;
+		ip[8] = 0x20;
+		ip[9] = 0x01;
+		ip[23] = 0x01; // 2001::1
+		ip[24] = 0x20;
+		ip[25] = 0x01;
+		ip[39] = 0x02; // 2001::2
+		l4 = 54;
+	}
+	stamp_xdp_put16(f + l4, 40000);
+	stamp_xdp_put16(f + l4 + 2, STAMP_PORT);
+	stamp_xdp_put16(f + l4 + 4, udp_len);
+	f[l4 + 8 + 13] = 1; // multiplier
+	uint32_t len = l4 + udp_len;
+	return len < 60U ? 60U : len;
+}
+
+// 受信フレームを応答へ書き換え、入れ替え・長さ・チェックサムを確認する
+static void test_xdp_frame_reply(void)
+{
+	uint8_t f[256];
+	struct stamp_xdp_frame frame;
+
+	for (int v6 = 0; v6 < 2; v6++) {
+		uint32_t len = xdp_test_frame(f, v6 != 0, 30);
+		EXPECT_TRUE(stamp_xdp_parse(f, len, STAMP_PORT, &frame) &&
+				    frame.payload_len == 30 &&
+				    frame.ttl == (v6 ? 61 : 57) &&
+				    frame.family == (v6 ? AF_INET6 : AF_INET),
+			    v6 ? "xdp: parse IPv6 frame"
+			       : "xdp: parse padded IPv4 frame by IP length");
+		struct sockaddr_storage src;
+		stamp_xdp_source(&frame, &src);
+		EXPECT_EQ_ULL(stamp_sockaddr_get_port(&src), 40000, "xdp: source port");
+
+		stamp_xdp_build_reply_headers(&frame, STAMP_BASE_PACKET_SIZE);
+		stamp_xdp_finish_reply(&frame);
+		uint8_t *ip = f + 14;
+		uint8_t *udp = f + frame.l4_off;
+		uint32_t udp_len = 8U + STAMP_BASE_PACKET_SIZE;
+		EXPECT_TRUE(f[0] == 0xB0 && f[5] == 0xB5 && f[6] == 0xA0 &&
+				    stamp_xdp_get16(udp) == STAMP_PORT &&
+				    stamp_xdp_get16(udp + 2) == 40000 &&
+				    stamp_xdp_get16(udp + 4) == udp_len &&
+				    frame.len == frame.l4_off + udp_len,
+			    "xdp: MACs and ports swapped, lengths padded");
+		uint64_t pseudo;
+		if (!v6) {
+			EXPECT_TRUE(ip[15] == 2 && ip[19] == 1 && ip[1] == 0 &&
+					    ip[8] == STAMP_XDP_REPLY_TTL &&
+					    stamp_xdp_get16(ip + 2) == 20U + udp_len &&
+					    stamp_xdp_csum_fold(stamp_xdp_csum_add(0, ip, 20)) == 0,
+				    "xdp: IPv4 reply header and checksum");
+			pseudo = stamp_xdp_csum_add(0, ip + 12, 8);
+		} else {
+			EXPECT_TRUE(ip[23] == 2 && ip[39] == 1 && ip[0] == 0x60 &&
+					    ip[3] == 0 && ip[7] == STAMP_XDP_REPLY_TTL &&
+					    stamp_xdp_get16(ip + 4) == udp_len,
+				    "xdp: IPv6 reply header");
+			pseudo = stamp_xdp_csum_add(0, ip + 8, 32);
+		}
+		pseudo += 17U + udp_len;
+		EXPECT_TRUE(stamp_xdp_get16(udp + 6) != 0 &&
+				    stamp_xdp_csum_fold(stamp_xdp_csum_add(pseudo, udp, udp_len)) == 0,
+			    "xdp: UDP checksum verifies");
+	}
+
+	uint32_t len = xdp_test_frame(f, false, STAMP_BASE_PACKET_SIZE);
+	EXPECT_TRUE(!stamp_xdp_parse(f, len, STAMP_PORT + 1, &frame),
+		    "xdp: other destination port rejected");
+	EXPECT_TRUE(!stamp_xdp_parse(f, len - 1, STAMP_PORT, &frame),
+		    "xdp: truncated frame rejected");
+	stamp_xdp_put16(f + 14 + 6, 0x2000); // MF
+	EXPECT_TRUE(!stamp_xdp_parse(f, len, STAMP_PORT, &frame),
+		    "xdp: fragment rejected");
+}
+
+static void allow_test_addr(const char *text, struct sockaddr_storage *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+	if (inet_pton(AF_INET, text, &sin->sin_addr) == 1) {
+		sin->sin_family = AF_INET;
+	} else if (inet_pton(AF_INET6, text, &sin6->sin6_addr) == 1) {
+		sin6->sin6_family = AF_INET6;
+	}
+}
+
+// 許可リストの照合（-E xdp はユーザー空間で照合する）
+static void test_allowlist_match(void)
+{
+	struct stamp_allowlist list = {.count = 0};
+	struct sockaddr_storage addr;
+	allow_test_addr("10.1.2.3", &addr);
+	EXPECT_TRUE(stamp_allowlist_match(&list, &addr),
+		    "allowlist: empty list accepts all");
+	(void)stamp_allowlist_add(&list, "10.0.0.0/9,2001:db8::/33");
+	EXPECT_TRUE(stamp_allowlist_match(&list, &addr), "allowlist: IPv4 match");
+	allow_test_addr("10.128.0.1", &addr);
+	EXPECT_TRUE(!stamp_allowlist_match(&list, &addr),
+		    "allowlist: IPv4 partial byte mismatch");
+	allow_test_addr("2001:db8:7fff::1", &addr);
+	EXPECT_TRUE(stamp_allowlist_match(&list, &addr), "allowlist: IPv6 match");
+	allow_test_addr("2001:db8:8000::1", &addr);
+	EXPECT_TRUE(!stamp_allowlist_match(&list, &addr),
+		    "allowlist: IPv6 partial byte mismatch");
+}
+
+#ifdef STAMP_HAVE_AF_XDP
+// 組み立てた XDP プログラムがカーネルの検証器を通る（権限が無ければスキップ）
+static void test_xdp_prog_verifier(void)
+{
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(uint32_t);
+	attr.value_size = sizeof(uint32_t);
+	attr.max_entries = 1;
+	long map = stamp_xdp_bpf(BPF_MAP_CREATE, &attr);
+	if (map < 0) {
+		SKIP_TEST("xdp: BPF map creation not permitted");
+		return;
+	}
+	static struct stamp_xdp_insns insns;
+	int32_t kfunc = stamp_xdp_btf_func_id("bpf_xdp_metadata_rx_timestamp");
+	for (int with_meta = 0; with_meta < 2; with_meta++) {
+		if (with_meta && kfunc <= 0) {
+			SKIP_TEST("xdp: RX metadata kfunc not in vmlinux BTF");
+			break;
+		}
+		stamp_xdp_build_prog(&insns, (int)map, STAMP_PORT, with_meta ? kfunc : 0);
+		// デバイス束縛のプログラムは XDP 対応（ndo_bpf を持つ）インターフェースが
+		// 要る。メタデータ非対応のドライバでも読み込み自体はできる
+		struct if_nameindex *ifs = with_meta ? if_nameindex() : NULL;
+		if (with_meta && ifs == NULL) {
+			SKIP_TEST("xdp: if_nameindex failed");
+			break;
+		}
+		long fd = -1;
+		int load_errno = 0;
+		for (uint32_t i = 0; fd < 0; i++) {
+			if (with_meta && ifs[i].if_index == 0) {
+				break;
+			}
+			memset(&attr, 0, sizeof(attr));
+			attr.prog_type = BPF_PROG_TYPE_XDP;
+			attr.insns = (uint64_t)(uintptr_t)insns.insns;
+			attr.insn_cnt = insns.len;
+			attr.license = (uint64_t)(uintptr_t) "Dual MIT/GPL";
+			attr.expected_attach_type = BPF_XDP;
+			if (with_meta) {
+				attr.prog_ifindex = ifs[i].if_index;
+				attr.prog_flags = BPF_F_XDP_DEV_BOUND_ONLY;
+			}
+			fd = stamp_xdp_bpf(BPF_PROG_LOAD, &attr);
+			load_errno = errno;
+			if (!with_meta) {
+				break;
+			}
+		}
+		if (ifs != NULL) {
+			if_freenameindex(ifs);
+		}
+		if (with_meta && fd < 0 && load_errno == EOPNOTSUPP) {
+			SKIP_TEST("xdp: no XDP-capable interface for device-bound program");
+			break;
+		}
+		EXPECT_TRUE(fd >= 0,
+			    with_meta ? "xdp: metadata program passes verifier"
+				      : "xdp: redirect program passes verifier");
+		if (fd >= 0) {
+			close((int)fd);
+		}
+	}
+	close((int)map);
+}
+#endif
+
+// =============================================================================
+// Phase 27: 送信元別レート制限と全体の受信上限
+// =============================================================================
+
+static void test_rate_parse(void)
+{
+	uint32_t pps = 0;
+	uint32_t burst = 0;
+	EXPECT_TRUE(stamp_rate_parse("100", &pps, &burst) == 0 && pps == 100 &&
+			    burst == 100,
+		    "rate: burst defaults to pps");
+	EXPECT_TRUE(stamp_rate_parse("50:8", &pps, &burst) == 0 && pps == 50 &&
+			    burst == 8,
+		    "rate: pps:burst");
+	EXPECT_TRUE(stamp_rate_parse("0", &pps, &burst) != 0 &&
+			    stamp_rate_parse("10:", &pps, &burst) != 0 &&
+			    stamp_rate_parse(":5", &pps, &burst) != 0 &&
+			    stamp_rate_parse("10:0", &pps, &burst) != 0 &&
+			    stamp_rate_parse("1000000001", &pps, &burst) != 0,
+		    "rate: invalid forms rejected");
+}
+
+static void test_rate_source_bucket(void)
+{
+	static struct stamp_rate_limiter lim;
+	struct sockaddr_storage src;
+	struct sockaddr_storage other;
+	allow_test_addr("192.0.2.1", &src);
+	allow_test_addr("2001:db8::1", &other);
+	// 10 pps（間隔 100 ms）、バースト 3
+	stamp_rate_init(&lim, 10, 3, 0, 42);
+	uint64_t t = 5 * NSEC_PER_SEC;
+	unsigned int passed = 0;
+	for (int i = 0; i < 10; i++) {
+		passed += stamp_rate_admit(&lim, &src, t) == STAMP_RATE_PASS;
+	}
+	EXPECT_EQ_ULL(passed, 3, "rate: burst admitted, rest dropped");
+	EXPECT_TRUE(stamp_rate_admit(&lim, &src, t) == STAMP_RATE_DROP_SOURCE,
+		    "rate: drop reason is per-source");
+	EXPECT_TRUE(stamp_rate_admit(&lim, &other, t) == STAMP_RATE_PASS,
+		    "rate: other source has its own bucket");
+	EXPECT_TRUE(stamp_rate_admit(&lim, &src, t + 99 * 1000000ULL) ==
+				    STAMP_RATE_DROP_SOURCE &&
+			    stamp_rate_admit(&lim, &src, t + 100 * 1000000ULL) ==
+				    STAMP_RATE_PASS,
+		    "rate: one token refills after the interval");
+	// 送信元ポートが違っても同じ送信元として数える
+	((struct sockaddr_in *)&src)->sin_port = htons(12345);
+	EXPECT_TRUE(stamp_rate_admit(&lim, &src, t + 100 * 1000000ULL) ==
+			    STAMP_RATE_DROP_SOURCE,
+		    "rate: source port ignored");
+
+	// 表が溢れても新しい送信元は満杯のバケットで受理される
+	passed = 0;
+	for (uint32_t i = 0; i < STAMP_RATE_SETS * STAMP_RATE_WAYS * 2U; i++) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&src;
+		sin->sin_addr.s_addr = htonl(0x0A000000U + i);
+		passed += stamp_rate_admit(&lim, &src, t) == STAMP_RATE_PASS;
+	}
+	EXPECT_EQ_ULL(passed,
+		      STAMP_RATE_SETS * STAMP_RATE_WAYS * 2U,
+		      "rate: new sources admitted when the table is full");
+}
+
+static void test_rate_global_cap(void)
+{
+	static struct stamp_rate_limiter lim;
+	struct sockaddr_storage src;
+	allow_test_addr("192.0.2.1", &src);
+	stamp_rate_init(&lim, 0, 0, 5, 7);
+	EXPECT_TRUE(stamp_rate_enabled(&lim), "rate: global cap enables limiter");
+	uint64_t t = 10 * NSEC_PER_SEC;
+	unsigned int passed = 0;
+	for (int i = 0; i < 8; i++) {
+		passed += stamp_rate_admit(&lim, &src, t + (uint64_t)i) ==
+			  STAMP_RATE_PASS;
+	}
+	EXPECT_EQ_ULL(passed, 5, "rate: global cap per 1 s window");
+	EXPECT_TRUE(stamp_rate_admit(&lim, &src, t + 999999999ULL) ==
+				    STAMP_RATE_DROP_GLOBAL &&
+			    stamp_rate_admit(&lim, &src, t + NSEC_PER_SEC) ==
+				    STAMP_RATE_PASS,
+		    "rate: global window resets each second");
+
+	// 送信元別で捨てた分は全体の上限を消費しない
+	stamp_rate_init(&lim, 1, 1, 2, 7);
+	struct sockaddr_storage other;
+	allow_test_addr("192.0.2.2", &other);
+	(void)stamp_rate_admit(&lim, &src, t);
+	for (int i = 0; i < 5; i++) {
+		(void)stamp_rate_admit(&lim, &src, t);
+	}
+	EXPECT_TRUE(stamp_rate_admit(&lim, &other, t) == STAMP_RATE_PASS,
+		    "rate: per-source drops do not consume global cap");
+
+	stamp_rate_init(&lim, 0, 0, 0, 7);
+	EXPECT_TRUE(!stamp_rate_enabled(&lim), "rate: disabled by default");
+}
+
+// =============================================================================
+// Phase 28: TX HW タイムスタンプの非同期回収
+// =============================================================================
+
+// OPT_ID のキーから seq を引き、応答待ちのプローブの T1 だけを差し替える
+static void test_inflight_tx_keys(void)
+{
+	struct stamp_inflight tbl;
+	const struct stamp_inflight_entry *entry;
+	EXPECT_TRUE(stamp_inflight_init(&tbl, 256) == 0 &&
+			    stamp_inflight_track_tx_keys(&tbl) == 0,
+		    "tx keys: table allocated");
+	EXPECT_TRUE(!stamp_inflight_tx_t1_outstanding(&tbl),
+		    "tx keys: nothing outstanding before send");
+	// seq 10, 11 を送信、seq 12 は送信失敗（キーだけ消費）、seq 13 を送信
+	(void)stamp_inflight_insert(&tbl, 10, 100, 0, 1000);
+	(void)stamp_inflight_insert(&tbl, 11, 110, 0, 1000);
+	stamp_inflight_skip_tx_key(&tbl);
+	(void)stamp_inflight_insert(&tbl, 13, 130, 0, 1000);
+	EXPECT_TRUE(stamp_inflight_tx_t1_outstanding(&tbl),
+		    "tx keys: outstanding after send");
+
+	EXPECT_TRUE(stamp_inflight_set_tx_t1(&tbl, 1, 111, 5) &&
+			    stamp_inflight_set_tx_t1(&tbl, 3, 131, 7),
+		    "tx keys: keys map to seq 11 and 13");
+	EXPECT_TRUE(!stamp_inflight_set_tx_t1(&tbl, 2, 999, 0),
+		    "tx keys: skipped key matches nothing");
+	EXPECT_TRUE(!stamp_inflight_set_tx_t1(&tbl, 4, 999, 0),
+		    "tx keys: unsent key ignored");
+	EXPECT_TRUE(!stamp_inflight_tx_t1_outstanding(&tbl),
+		    "tx keys: newest key acknowledged");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 11, &entry) ==
+				    STAMP_INFLIGHT_MATCH_IN_ORDER &&
+			    entry->t1_sec == 111 && entry->t1_frac == 5,
+		    "tx keys: HW T1 applied at reply match");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 13, &entry) ==
+				    STAMP_INFLIGHT_MATCH_IN_ORDER &&
+			    entry->t1_sec == 131,
+		    "tx keys: T1 after skipped key not shifted");
+	// 応答を照合済みのプローブへは後着の T1 を反映しない
+	EXPECT_TRUE(stamp_inflight_set_tx_t1(&tbl, 0, 555, 0) &&
+			    tbl.slots[10 & tbl.mask].t1_sec == 555,
+		    "tx keys: pending probe still updatable");
+	EXPECT_TRUE(!stamp_inflight_set_tx_t1(&tbl, 1, 777, 0) &&
+			    tbl.slots[11 & tbl.mask].t1_sec == 111,
+		    "tx keys: answered probe not rewritten");
+	stamp_inflight_free(&tbl);
+
+	// 追跡しない表はキーを扱わない
+	EXPECT_TRUE(stamp_inflight_init(&tbl, 256) == 0, "tx keys: plain table");
+	(void)stamp_inflight_insert(&tbl, 1, 1, 0, 1);
+	EXPECT_TRUE(!stamp_inflight_tx_t1_outstanding(&tbl) &&
+			    !stamp_inflight_set_tx_t1(&tbl, 0, 9, 9),
+		    "tx keys: untracked table ignores keys");
+	stamp_inflight_free(&tbl);
+}
+
+#ifdef __linux__
+// errqueue のメッセージを模した制御メッセージからキーと HW/SW 時刻を取り出す
+static void test_parse_tx_hw_timestamp(void)
+{
+	union {
+		char buf[256];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	struct stamp_tx_timestamp ts;
+
+	for (int variant = 0; variant < 3; variant++) {
+		memset(&control, 0, sizeof(control));
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(3 * sizeof(struct timespec)) +
+				     CMSG_SPACE(sizeof(struct sock_extended_err));
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_TIMESTAMPING;
+		cmsg->cmsg_len = CMSG_LEN(3 * sizeof(struct timespec));
+		struct timespec tss[3];
+		memset(tss, 0, sizeof(tss));
+		tss[0].tv_sec = 1700000000; // SW
+		if (variant != 1) {
+			tss[2].tv_sec = 1700000001; // HW
+			tss[2].tv_nsec = 500000000;
+		}
+		memcpy(CMSG_DATA(cmsg), tss, sizeof(tss));
+
+		cmsg = CMSG_NXTHDR(&msg, cmsg);
+		cmsg->cmsg_level = SOL_IPV6;
+		cmsg->cmsg_type = IPV6_RECVERR;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(struct sock_extended_err));
+		struct sock_extended_err ee;
+		memset(&ee, 0, sizeof(ee));
+		ee.ee_errno = variant == 2 ? ECONNREFUSED : ENOMSG;
+		ee.ee_origin = variant == 2 ? SO_EE_ORIGIN_ICMP6
+					    : SO_EE_ORIGIN_TIMESTAMPING;
+		ee.ee_data = 42;
+		memcpy(CMSG_DATA(cmsg), &ee, sizeof(ee));
+
+		bool ok = stamp_parse_tx_timestamp(&msg, &ts, false, true);
+		if (variant == 0) {
+			EXPECT_TRUE(ok && ts.key == 42 &&
+					    ntohl(ts.sec) == 1700000001U + (uint32_t)NTP_OFFSET &&
+					    ntohl(ts.frac) == 0x80000000U,
+				    "tx ts: key and HW time extracted");
+		} else {
+			EXPECT_TRUE(!ok,
+				    variant == 1 ? "tx ts: SW-only message ignored"
+						 : "tx ts: ICMP error ignored");
+		}
+		// SW 指定時は ts[0] を取り出す（-t の Reflector）
+		ok = stamp_parse_tx_timestamp(&msg, &ts, false, false);
+		if (variant == 2) {
+			EXPECT_TRUE(!ok, "tx ts: ICMP error ignored for SW");
+		} else {
+			EXPECT_TRUE(ok && ts.key == 42 &&
+					    ntohl(ts.sec) == 1700000000U + (uint32_t)NTP_OFFSET &&
+					    ts.frac == 0,
+				    "tx ts: key and SW time extracted");
+		}
+	}
+}
+
+static void count_tx_ts(const struct stamp_tx_timestamp *ts, void *ctx)
+{
+	(void)ts;
+	(*(unsigned int *)ctx)++;
+}
+
+// SW のタイムスタンプのキーが送信順に 0 から並ぶことを数える
+static void check_tx_key_order(const struct stamp_tx_timestamp *ts, void *ctx)
+{
+	unsigned int *next = ctx;
+	if (ts->key == *next) {
+		(*next)++;
+	}
+}
+
+// ループバックの SW TX タイムスタンプを一括で読み捨て、HW として扱わない
+static void test_collect_tx_timestamps_loopback(void)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+		    SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+	socklen_t alen = sizeof(addr);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    getsockname(fd, (struct sockaddr *)&addr, &alen) != 0 ||
+	    connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0) {
+		SKIP_TEST("tx ts: loopback socket with SO_TIMESTAMPING unavailable");
+		if (fd >= 0) {
+			close(fd);
+		}
+		return;
+	}
+	const unsigned int sends = STAMP_TX_TS_BATCH + 3U;
+	for (unsigned int i = 0; i < sends; i++) {
+		(void)send(fd, "x", 1, 0);
+	}
+	unsigned int hw = 0;
+	unsigned int read_total = 0;
+	for (int tries = 0; tries < 100 && read_total < sends; tries++) {
+		read_total += stamp_collect_tx_timestamps(fd,
+							  false,
+							  true,
+							  count_tx_ts,
+							  &hw);
+		if (read_total < sends) {
+			usleep(1000);
+		}
+	}
+	EXPECT_EQ_ULL(read_total, sends, "tx ts: errqueue drained in batches");
+	EXPECT_EQ_ULL(hw, 0, "tx ts: SW timestamps not reported as HW");
+	EXPECT_EQ_ULL(stamp_drain_errqueue(fd), 0, "tx ts: errqueue empty");
+
+	// SW 指定時はキー付きで全件を報告する（キーは続きの番号）
+	unsigned int next_key = sends;
+	read_total = 0;
+	for (unsigned int i = 0; i < sends; i++) {
+		(void)send(fd, "x", 1, 0);
+	}
+	for (int tries = 0; tries < 100 && read_total < sends; tries++) {
+		read_total += stamp_collect_tx_timestamps(fd,
+							  false,
+							  false,
+							  check_tx_key_order,
+							  &next_key);
+		if (read_total < sends) {
+			usleep(1000);
+		}
+	}
+	EXPECT_EQ_ULL(next_key, 2U * sends, "tx ts: SW keys reported in send order");
+	close(fd);
+}
+#endif
+
+// =============================================================================
+// Phase 29: Reflector の T3 の事後検証（-t）
+// =============================================================================
+
+static void test_t3_error_stats(void)
+{
+	struct stamp_t3_error err_a;
+	struct stamp_t3_error err_b;
+	memset(&err_a, 0, sizeof(err_a));
+	memset(&err_b, 0, sizeof(err_b));
+	stamp_t3_error_add(&err_a, 1500);
+	stamp_t3_error_add(&err_a, 3000);
+	stamp_t3_error_add(&err_a, -100);
+	EXPECT_TRUE(err_a.count == 3 && err_a.sum_ns == 4400 &&
+			    err_a.min_ns == -100 && err_a.max_ns == 3000 &&
+			    err_a.negative == 1,
+		    "t3 error: count, sum, min, max, negative");
+	EXPECT_TRUE(err_a.hist[stamp_client_hist_bin(1500)] == 1 &&
+			    err_a.hist[stamp_client_hist_bin(3000)] == 1 &&
+			    err_a.hist[stamp_client_hist_bin(100)] == 1,
+		    "t3 error: histogram of magnitudes");
+
+	stamp_t3_error_merge(&err_b, &err_a);
+	EXPECT_TRUE(err_b.count == 3 && err_b.min_ns == -100 &&
+			    err_b.max_ns == 3000,
+		    "t3 error: merge into empty takes extremes");
+	struct stamp_t3_error err_c;
+	memset(&err_c, 0, sizeof(err_c));
+	stamp_t3_error_add(&err_c, 9000);
+	stamp_t3_error_merge(&err_b, &err_c);
+	EXPECT_TRUE(err_b.count == 4 && err_b.max_ns == 9000 &&
+			    err_b.min_ns == -100 && err_b.sum_ns == 13400,
+		    "t3 error: merge widens range");
+	memset(&err_c, 0, sizeof(err_c));
+	stamp_t3_error_merge(&err_b, &err_c);
+	EXPECT_TRUE(err_b.count == 4 && err_b.min_ns == -100,
+		    "t3 error: empty merge is a no-op");
+}
+
+static void test_t3_followup_ring(void)
+{
+	struct stamp_t3_followup *f = malloc(sizeof(*f));
+	if (f == NULL) {
+		SKIP_TEST("t3 ring: allocation failed");
+		return;
+	}
+	stamp_t3_init(f);
+	struct sockaddr_storage src1;
+	struct sockaddr_storage src2;
+	allow_test_addr("192.0.2.1", &src1);
+	allow_test_addr("2001:db8::2", &src2);
+	EXPECT_TRUE(!stamp_t3_should_collect(f, 16, 5), "t3 ring: idle");
+
+	stamp_t3_record(f, 1000, &src1); // key 0
+	stamp_t3_skip_key(f);		  // key 1: 送信失敗で消費
+	stamp_t3_record(f, 2000, &src2); // key 2
+	EXPECT_EQ_ULL(f->outstanding, 2, "t3 ring: two outstanding");
+	EXPECT_TRUE(stamp_t3_should_collect(f, 16, 5),
+		    "t3 ring: collect when the second changes");
+	f->last_collect_sec = 5;
+	EXPECT_TRUE(!stamp_t3_should_collect(f, 16, 5) &&
+			    stamp_t3_should_collect(f, 2, 5),
+		    "t3 ring: collect once a batch is outstanding");
+
+	struct stamp_session_key key;
+	int64_t err = 0;
+	EXPECT_TRUE(stamp_t3_resolve(f, 2, 2750, &key, &err) && err == 750 &&
+			    key.family == AF_INET6,
+		    "t3 ring: skipped key keeps later keys aligned");
+	EXPECT_TRUE(!stamp_t3_resolve(f, 1, 5000, &key, &err) &&
+			    f->unmatched == 1,
+		    "t3 ring: consumed key has no record");
+	EXPECT_TRUE(stamp_t3_resolve(f, 0, 900, &key, &err) && err == -100 &&
+			    key.family == AF_INET,
+		    "t3 ring: out-of-order and negative error");
+	EXPECT_TRUE(!stamp_t3_resolve(f, 0, 1000, &key, &err) &&
+			    f->unmatched == 2,
+		    "t3 ring: duplicate timestamp ignored");
+	EXPECT_TRUE(f->outstanding == 0 && f->total.count == 2 &&
+			    f->total.sum_ns == 650,
+		    "t3 ring: totals");
+
+	// 一周しても回収されない記録は欠落として数え、古いキーは一致しない
+	for (uint32_t i = 0; i < STAMP_T3_RING + 5U; i++) {
+		stamp_t3_record(f, i, &src1);
+	}
+	EXPECT_EQ_ULL(f->missed, 5, "t3 ring: overwritten records counted");
+	EXPECT_EQ_ULL(f->outstanding, STAMP_T3_RING, "t3 ring: ring full");
+	EXPECT_TRUE(!stamp_t3_resolve(f, 3, 0, &key, &err),
+		    "t3 ring: stale key rejected");
+	EXPECT_TRUE(stamp_t3_resolve(f, 3 + STAMP_T3_RING, 100, &key, &err) &&
+			    err == 100 - (int64_t)STAMP_T3_RING,
+		    "t3 ring: newest key in slot matched");
+	free(f);
+}
+
+#ifdef __linux__
+// -t -b: キー付き TX タイムスタンプを有効にしても全プローブを反射する
+static void test_reflector_loopback_t3_check(void)
+{
+	static char *const extra_opts[] = {"-t", "-b", "4", NULL};
+	reflector_loopback_multi_client_impl(extra_opts, "reflector -t");
+}
+#endif
+
+// =============================================================================
+// Phase 30: 較正済み TSC による打刻（-C tsc）
+// =============================================================================
+
+static void test_clock_source_parse(void)
+{
+	enum stamp_clock_source src = STAMP_CLOCK_TSC;
+	EXPECT_TRUE(stamp_clock_source_parse("system", &src) == 0 &&
+			    src == STAMP_CLOCK_SYSTEM,
+		    "clock source: system");
+	EXPECT_TRUE(stamp_clock_source_parse("tsc", &src) == 0 &&
+			    src == STAMP_CLOCK_TSC,
+		    "clock source: tsc");
+	EXPECT_TRUE(stamp_clock_source_parse("hpet", &src) != 0 &&
+			    stamp_clock_source_parse("", &src) != 0,
+		    "clock source: unknown names rejected");
+}
+
+#ifdef STAMP_HAVE_TSC
+/**
+ * UNIX 時刻（ns）を clock_gettime 経路と同じ変換で STAMP 形式にする
+ */
+static void tsc_expected_stamp(uint64_t ns,
+			       uint32_t *sec,
+			       uint32_t *frac,
+			       bool ptp_mode)
+{
+	struct timespec ts = {(time_t)(ns / NSEC_PER_SEC),
+			      (long)(ns % NSEC_PER_SEC)};
+	stamp_timespec_to_stamp(&ts, sec, frac, ptp_mode);
+}
+
+// 3 GHz の合成の対で係数を求め、変換を clock_gettime 経路の変換と比べる
+static void test_tsc_conversion(void)
+{
+	// 秒の繰り上がりを跨ぐよう、基準点を秒の境界の 500 ns 手前に置く
+	const uint64_t base_ns = UINT64_C(1700000000) * NSEC_PER_SEC + 999999500U;
+	struct stamp_tsc_sample from = {UINT64_C(1000), base_ns - NSEC_PER_SEC};
+	struct stamp_tsc_sample to = {UINT64_C(1000) + UINT64_C(3000000000),
+				      base_ns};
+	uint64_t ns_mult = 0;
+	uint64_t ntp_mult = 0;
+	EXPECT_TRUE(stamp_tsc_mult(&from, &to, &ns_mult, &ntp_mult) == 0,
+		    "tsc: multipliers from two samples");
+	EXPECT_EQ_ULL(ns_mult, (1ULL << 32) / 3U, "tsc: ns multiplier");
+	EXPECT_EQ_ULL(ntp_mult,
+		      UINT64_C(6148914691),
+		      "tsc: NTP multiplier (2^64 / 3e9)");
+	EXPECT_TRUE(stamp_tsc_mult(&to, &from, &ns_mult, &ntp_mult) != 0,
+		    "tsc: backwards samples rejected");
+
+	struct stamp_tsc_params params;
+	stamp_tsc_params_set(&params, &to, (1ULL << 32) / 3U, UINT64_C(6148914691));
+	static const int64_t offsets_ns[] = {0, 1000, -1000, 5000000000LL, 333};
+	for (size_t i = 0; i < sizeof(offsets_ns) / sizeof(offsets_ns[0]); i++) {
+		uint64_t tsc = to.tsc + (uint64_t)(offsets_ns[i] * 3);
+		uint64_t ns = base_ns + (uint64_t)offsets_ns[i];
+		char msg[96];
+		for (int ptp = 0; ptp <= 1; ptp++) {
+			uint32_t got_sec;
+			uint32_t got_frac;
+			uint32_t want_sec;
+			uint32_t want_frac;
+			stamp_tsc_convert(&params, tsc, &got_sec, &got_frac, ptp != 0);
+			tsc_expected_stamp(ns, &want_sec, &want_frac, ptp != 0);
+			int64_t diff = (int64_t)ntohl(got_frac) -
+				       (int64_t)ntohl(want_frac);
+			// NTP の 1 単位は約 0.23 ns。係数の切り捨て分だけ許す
+			snprintf(msg,
+				 sizeof(msg),
+				 "tsc: %s at %+lld ns",
+				 ptp ? "PTP" : "NTP",
+				 (long long)offsets_ns[i]);
+			EXPECT_TRUE(got_sec == want_sec && diff >= -8 && diff <= 8,
+				    msg);
+		}
+	}
+}
+
+static void test_tsc_mult_plausible(void)
+{
+	const uint64_t mult = (1ULL << 32) / 3U;
+	EXPECT_TRUE(stamp_tsc_mult_plausible(mult, mult), "tsc slew: unchanged");
+	EXPECT_TRUE(stamp_tsc_mult_plausible(mult, mult + mult / 10000U) &&
+			    stamp_tsc_mult_plausible(mult, mult - mult / 10000U),
+		    "tsc slew: 100 ppm accepted");
+	EXPECT_TRUE(!stamp_tsc_mult_plausible(mult, mult + mult / 1000U) &&
+			    !stamp_tsc_mult_plausible(mult, mult / 2U),
+		    "tsc slew: clock step rejected");
+}
+
+// 実機の TSC 時計が CLOCK_REALTIME と一致し、再較正で係数が公開されること
+static void test_tsc_clock_live(void)
+{
+	static struct stamp_tsc_clock clk;
+	const char *reason = NULL;
+	if (stamp_tsc_start(&clk, &reason) != 0) {
+		char msg[96];
+		snprintf(msg, sizeof(msg), "tsc clock (%s)", reason);
+		SKIP_TEST(msg);
+		return;
+	}
+	EXPECT_TRUE(stamp_tsc_enabled(&clk) && stamp_tsc_mhz(&clk) > 1.0,
+		    "tsc clock: started with a frequency");
+	uint32_t seq = clk.seq;
+	stamp_tsc_recalibrate(&clk);
+	EXPECT_TRUE(clk.seq == seq + 2U, "tsc clock: recalibration published");
+
+	for (int ptp = 0; ptp <= 1; ptp++) {
+		uint16_t ee = ptp ? ERROR_ESTIMATE_Z_BIT : 0;
+		uint32_t tsc_sec;
+		uint32_t tsc_frac;
+		uint32_t sys_sec;
+		uint32_t sys_frac;
+		stamp_tsc_get_timestamp(&clk, &tsc_sec, &tsc_frac, ptp != 0);
+		stamp_get_timestamp(&sys_sec, &sys_frac, ptp != 0);
+		int64_t diff = (int64_t)(stamp_timestamp_to_ns(sys_sec, sys_frac, ee) -
+					 stamp_timestamp_to_ns(tsc_sec, tsc_frac, ee));
+		EXPECT_TRUE(diff > -1000000 && diff < 1000000,
+			    ptp ? "tsc clock: PTP within 1 ms of CLOCK_REALTIME"
+				: "tsc clock: NTP within 1 ms of CLOCK_REALTIME");
+	}
+	stamp_tsc_stop(&clk);
+	EXPECT_TRUE(!stamp_tsc_enabled(&clk), "tsc clock: stopped");
+}
+
+// -C tsc: 較正スレッドを持つ Reflector が全プローブを反射する
+static void test_reflector_loopback_tsc_clock(void)
+{
+	static char *const extra_opts[] = {"-C", "tsc", NULL};
+	reflector_loopback_multi_client_impl(extra_opts, "reflector -C tsc");
+}
+#endif
+
+// =============================================================================
+// Phase 31: 除算を使わない NTP 小数部の変換
+// =============================================================================
+
+// 全ナノ秒値で、従来の除算による丸めと一致し、逆変換で元に戻ること
+static void test_nsec_frac_exhaustive(void)
+{
+	uint64_t mismatches = 0;
+	uint64_t roundtrip_errors = 0;
+	for (uint32_t nsec = 0; nsec < NSEC_PER_SEC; nsec++) {
+		uint32_t ref = (uint32_t)(((uint64_t)nsec * NTP_FRAC_SCALE_INT +
+					   500000000ULL) /
+					  NSEC_PER_SEC);
+		uint32_t frac = stamp_nsec_frac_round(nsec);
+		mismatches += frac != ref;
+		roundtrip_errors += stamp_ntp_frac_to_nsec(frac) != nsec;
+	}
+	EXPECT_EQ_ULL(mismatches, 0, "nsec frac: matches division for all nsec");
+	EXPECT_EQ_ULL(roundtrip_errors, 0, "nsec frac: round trip for all nsec");
+
+	// 範囲外（10^9 以上 2^32 未満）も従来どおり商の下位 32 ビット
+	mismatches = 0;
+	for (uint64_t nsec = NSEC_PER_SEC; nsec <= UINT32_MAX; nsec += 65521U) {
+		uint32_t ref = (uint32_t)((nsec * NTP_FRAC_SCALE_INT + 500000000ULL) /
+					  NSEC_PER_SEC);
+		mismatches += stamp_nsec_frac_round((uint32_t)nsec) != ref;
+	}
+	EXPECT_TRUE(mismatches == 0 &&
+			    stamp_nsec_frac_round(UINT32_MAX) ==
+				    (uint32_t)(((uint64_t)UINT32_MAX *
+						      NTP_FRAC_SCALE_INT +
+					      500000000ULL) /
+					     NSEC_PER_SEC),
+		    "nsec frac: out-of-range values keep the low 32 bits");
+	EXPECT_TRUE(stamp_nsec_to_ntp_frac(UINT64_C(1) << 32) ==
+				stamp_nsec_to_ntp_frac(NSEC_PER_SEC - 1) &&
+			    stamp_nsec_to_ntp_frac(UINT64_MAX) ==
+				    stamp_nsec_to_ntp_frac(NSEC_PER_SEC - 1),
+		    "nsec frac: values from 2^32 clamp to the last nanosecond");
+}
+
+// 全マイクロ秒値（と 2^32 未満の抜き取り）で従来の除算と一致すること
+static void test_usec_frac_exhaustive(void)
+{
+	uint64_t mismatches = 0;
+	for (uint64_t usec = 0; usec <= UINT32_MAX;
+	     usec += usec < USEC_PER_SEC ? 1U : 4099U) {
+		uint32_t ref = (uint32_t)((usec * NTP_FRAC_SCALE_INT + 500000ULL) /
+					  USEC_PER_SEC);
+		mismatches += USEC_TO_NTP_FRAC(usec) != ref;
+	}
+	EXPECT_EQ_ULL(mismatches, 0, "usec frac: matches division");
+	EXPECT_EQ_ULL(USEC_TO_NTP_FRAC(UINT32_MAX),
+		      (uint32_t)(((uint64_t)UINT32_MAX * NTP_FRAC_SCALE_INT +
+				  500000ULL) /
+				 USEC_PER_SEC),
+		      "usec frac: largest input");
+}
+
+// =============================================================================
+// Phase 32: 整数ナノ秒による遅延計算
+// =============================================================================
+
+static struct stamp_wire_ts wire_ts_for_test(uint32_t sec, uint32_t frac, bool ptp)
+{
+	return stamp_wire_ts(htonl(sec),
+			     htonl(frac),
+			     ptp ? ERROR_ESTIMATE_PTP_DEFAULT : ERROR_ESTIMATE_DEFAULT);
+}
+
+static void test_ts_diff_ns(void)
+{
+	// 2023 年付近の NTP 秒。double の UNIX 時刻では 100 ns の差が丸まる
+	const uint32_t sec = 3900000000U;
+	struct stamp_wire_ts a = wire_ts_for_test(sec, 0x12345678U, false);
+	struct stamp_wire_ts b = wire_ts_for_test(sec, 0x12345678U + 430U, false);
+	EXPECT_TRUE(stamp_ts_diff_ns(a, b) == 100 && stamp_ts_diff_ns(b, a) == -100,
+		    "ts diff: 100 ns between NTP timestamps, both signs");
+	b = wire_ts_for_test(sec + 2U, 0x12345678U - 4U, false);
+	EXPECT_TRUE(stamp_ts_diff_ns(a, b) == 2 * (int64_t)NSEC_PER_SEC - 1,
+		    "ts diff: NTP borrow across seconds");
+
+	// NTP の Era の境界（2036 年）を跨ぐ
+	a = wire_ts_for_test(UINT32_MAX, 0x80000000U, false);
+	b = wire_ts_for_test(0, 0, false);
+	EXPECT_TRUE(stamp_ts_diff_ns(a, b) == 500000000 &&
+			    stamp_ts_diff_ns(b, a) == -500000000,
+		    "ts diff: NTP era wrap");
+	a = wire_ts_for_test(UINT32_MAX, 999999999U, true);
+	b = wire_ts_for_test(0, 1U, true);
+	EXPECT_TRUE(stamp_ts_diff_ns(a, b) == 2 && stamp_ts_diff_ns(b, a) == -2,
+		    "ts diff: PTP seconds wrap");
+
+	// 形式の混在（NTP 0.5 秒 → PTP 0.5 秒 + 123 ns）
+	a = wire_ts_for_test(sec, 0x80000000U, false);
+	b = wire_ts_for_test(sec + 1U, 500000123U, true);
+	EXPECT_TRUE(stamp_ts_diff_ns(a, b) == (int64_t)NSEC_PER_SEC + 123 &&
+			    stamp_ts_diff_ns(b, a) == -(int64_t)NSEC_PER_SEC - 123,
+		    "ts diff: NTP/PTP mixed");
+}
+
+static void test_compute_delays_ns(void)
+{
+	const uint32_t sec = 3900000000U;
+	// T1 → T2: 1 ms + 1 ns、T2 → T3: 10 µs、T3 → T4: 2 ms（PTP の Reflector）
+	struct stamp_wire_ts t1 = wire_ts_for_test(sec, 0, false);
+	struct stamp_wire_ts t2 = wire_ts_for_test(sec, 1000001U, true);
+	struct stamp_wire_ts t3 = wire_ts_for_test(sec, 1010001U, true);
+	struct stamp_wire_ts t4 =
+		wire_ts_for_test(sec, NSEC_TO_NTP_FRAC(3010001U), false);
+	struct stamp_delays_ns d;
+	stamp_compute_delays_ns(&t1, &t2, &t3, &t4, &d);
+	EXPECT_EQ_ULL((uint64_t)d.forward, 1000001, "delays ns: forward");
+	EXPECT_EQ_ULL((uint64_t)d.backward, 2000000, "delays ns: backward");
+	EXPECT_EQ_ULL((uint64_t)d.rtt, 3000001, "delays ns: rtt");
+	EXPECT_TRUE(d.offset_x2 == -999999 &&
+			    stamp_ns_to_ms(d.offset_x2) * 0.5 == -0.4999995,
+		    "delays ns: offset keeps the half nanosecond");
+	EXPECT_TRUE(stamp_ns_to_ms(d.rtt) == 3.000001,
+		    "delays ns: rtt in ms");
+}
+
+// =============================================================================
+// Phase 33: 順序逆転の指標（RFC 4737）と seq 隣接の IPDV
+// =============================================================================
+
+static uint32_t reorder_feed(struct stamp_reorder *r, const uint32_t *seqs, size_t n)
+{
+	const struct stamp_reorder_slot *pairs[2];
+	uint32_t total = 0;
+	for (size_t i = 0; i < n; i++) {
+		total += stamp_reorder_record(r, seqs[i], (double)seqs[i], 0, 0, pairs);
+	}
+	return total;
+}
+
+static void test_reorder_extent_and_n(void)
+{
+	struct stamp_reorder r;
+	// 3 が 4〜7 の後に届く（extent 4、4-reordered）
+	const uint32_t late4[] = {0, 1, 2, 4, 5, 6, 7, 3, 8, 9};
+	EXPECT_TRUE(stamp_reorder_init(&r, 256, 0) == 0, "reorder: init");
+	reorder_feed(&r, late4, sizeof(late4) / sizeof(late4[0]));
+	EXPECT_EQ_ULL(r.reordered, 1, "reorder: one reordered packet");
+	EXPECT_EQ_ULL(r.extent_max, 4, "reorder: extent counts later arrivals");
+	EXPECT_NEAR_DOUBLE(stamp_reorder_n_ratio(&r, 4, 10), 0.1, 1e-12,
+			   "reorder: 4-reordered");
+	EXPECT_NEAR_DOUBLE(stamp_reorder_n_ratio(&r, 1, 10), 0.1, 1e-12,
+			   "reorder: 4-reordered is also 1-reordered");
+	EXPECT_NEAR_DOUBLE(stamp_reorder_n_ratio(&r, 5, 10), 0.0, 1e-12,
+			   "reorder: not 5-reordered");
+	stamp_reorder_free(&r);
+
+	// 2 は直前の 5 より小さく 1-reordered、3 は直前の 2 より大きく n = 0
+	const uint32_t jump[] = {0, 5, 2, 3};
+	EXPECT_TRUE(stamp_reorder_init(&r, 256, 0) == 0, "reorder: init");
+	reorder_feed(&r, jump, sizeof(jump) / sizeof(jump[0]));
+	EXPECT_EQ_ULL(r.reordered, 2, "reorder: both below the highest seq");
+	EXPECT_EQ_ULL(r.extent_sum, 3, "reorder: extents 1 and 2");
+	EXPECT_NEAR_DOUBLE(stamp_reorder_extent_avg(&r), 1.5, 1e-12,
+			   "reorder: extent average");
+	EXPECT_EQ_ULL(r.n_hist[0], 1, "reorder: n = 0 bucket");
+	EXPECT_EQ_ULL(r.n_hist[1], 1, "reorder: n = 1 bucket");
+	stamp_reorder_free(&r);
+
+	// 先頭が遅れて届いた場合と seq のラップ
+	const uint32_t wrap[] = {UINT32_MAX, 0, UINT32_MAX - 1U};
+	EXPECT_TRUE(stamp_reorder_init(&r, 256, UINT32_MAX - 1U) == 0,
+		    "reorder: init");
+	reorder_feed(&r, wrap, sizeof(wrap) / sizeof(wrap[0]));
+	EXPECT_TRUE(r.reordered == 1 && r.extent_max == 2 && r.n_hist[2] == 1,
+		    "reorder: first seq arrives last across the wrap");
+	stamp_reorder_free(&r);
+
+	// 順序逆転なし
+	EXPECT_TRUE(stamp_reorder_init(&r, 256, 0) == 0, "reorder: init");
+	reorder_feed(&r, late4, 3);
+	EXPECT_TRUE(r.reordered == 0 && isnan(stamp_reorder_extent_avg(&r)),
+		    "reorder: in-order arrivals");
+	EXPECT_TRUE(isnan(stamp_reorder_n_ratio(&r, 1, 0)),
+		    "reorder: n ratio undefined without replies");
+	stamp_reorder_free(&r);
+}
+
+static void test_reorder_ipdv_pairs(void)
+{
+	struct stamp_reorder r;
+	const struct stamp_reorder_slot *pairs[2];
+	EXPECT_TRUE(stamp_reorder_init(&r, 16, 0) == 0, "reorder: init");
+	EXPECT_EQ_ULL(stamp_reorder_record(&r, 0, 1.0, 0, 0, pairs), 0,
+		      "ipdv pairs: first reply has no neighbour");
+	EXPECT_EQ_ULL(stamp_reorder_record(&r, 2, 3.0, 0, 0, pairs), 0,
+		      "ipdv pairs: seq 1 missing");
+	uint32_t count = stamp_reorder_record(&r, 1, 2.5, 0, 0, pairs);
+	EXPECT_TRUE(count == 2 && pairs[0]->rtt == 1.0 && pairs[1]->rtt == 3.0,
+		    "ipdv pairs: reordered reply pairs with both neighbours");
+	EXPECT_EQ_ULL(stamp_reorder_record(&r, 3, 4.0, 0, 0, pairs), 1,
+		      "ipdv pairs: in-order reply pairs with seq - 1");
+
+	// 表の範囲（16）より古い seq は extent も組も求めない
+	EXPECT_EQ_ULL(stamp_reorder_record(&r, 100, 1.0, 0, 0, pairs), 0,
+		      "ipdv pairs: gap");
+	EXPECT_EQ_ULL(stamp_reorder_record(&r, 50, 1.0, 0, 0, pairs), 0,
+		      "ipdv pairs: seq older than the table");
+	EXPECT_TRUE(r.reordered == 2 && r.extent_sum == 1,
+		    "reorder: old seq counted without extent");
+	EXPECT_TRUE(stamp_reorder_slot_of(&r, 85) != NULL &&
+			    stamp_reorder_slot_of(&r, 84) == NULL,
+		    "reorder: gap fills only the last table span");
+	stamp_reorder_free(&r);
+	EXPECT_TRUE(stamp_reorder_init(&r, 24, 0) != 0,
+		    "reorder: capacity must be a power of two");
+}
+
+// =============================================================================
+// Phase 34: 喪失区間（RFC 3357）と Gilbert-Elliott モデル
+// =============================================================================
+
+// "R"=受信、"L"=喪失の列を加える
+static void loss_feed(struct stamp_loss_pattern *lp, const char *pattern)
+{
+	for (const char *c = pattern; *c != '\0'; c++) {
+		stamp_loss_add(lp, *c == 'L');
+	}
+}
+
+static void test_loss_periods(void)
+{
+	struct stamp_loss_pattern lp;
+	memset(&lp, 0, sizeof(lp));
+	loss_feed(&lp, "RLLRRRLRLLLR");
+	EXPECT_EQ_ULL(stamp_loss_periods(&lp), 3, "loss periods: three periods");
+	EXPECT_EQ_ULL(lp.lost, 6, "loss periods: six lost");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&lp.period_len), 2.0, 1e-12,
+			   "loss periods: average length");
+	EXPECT_NEAR_DOUBLE(stamp_welford_max(&lp.period_len), 3.0, 1e-12,
+			   "loss periods: longest period");
+	EXPECT_TRUE(stamp_welford_count(&lp.period_gap) == 2 &&
+			    stamp_welford_mean(&lp.period_gap) == 2.0 &&
+			    stamp_welford_min(&lp.period_gap) == 1.0,
+		    "loss periods: gaps of 3 and 1 received");
+
+	// 計測終了時に継続中の区間
+	loss_feed(&lp, "LL");
+	EXPECT_EQ_ULL(stamp_loss_periods(&lp), 4, "loss periods: open period counted");
+	stamp_loss_close(&lp);
+	EXPECT_TRUE(stamp_loss_periods(&lp) == 4 &&
+			    stamp_welford_count(&lp.period_len) == 4 &&
+			    stamp_welford_min(&lp.period_gap) == 1.0,
+		    "loss periods: closing keeps the count");
+}
+
+static void test_loss_ge_fit(void)
+{
+	struct stamp_loss_pattern lp;
+	struct stamp_ge_fit ge;
+	memset(&lp, 0, sizeof(lp));
+	stamp_loss_ge_fit(&lp, &ge);
+	EXPECT_TRUE(isnan(ge.p) && isnan(ge.r) && isnan(ge.loss_bad),
+		    "ge fit: undefined without packets");
+	loss_feed(&lp, "RRRR");
+	stamp_loss_ge_fit(&lp, &ge);
+	EXPECT_TRUE(ge.p == 0.0 && isnan(ge.r), "ge fit: no loss");
+
+	// 受信 3 本・喪失 2 本の繰り返し: 両端が喪失の組が無く単純 Gilbert に落ちる
+	memset(&lp, 0, sizeof(lp));
+	for (int i = 0; i < 1000; i++) {
+		loss_feed(&lp, "RRRLL");
+	}
+	stamp_loss_ge_fit(&lp, &ge);
+	EXPECT_NEAR_DOUBLE(ge.p, 1.0 / 3.0, 1e-3, "ge fit: simple Gilbert p");
+	EXPECT_NEAR_DOUBLE(ge.r, 0.5, 1e-3, "ge fit: simple Gilbert r");
+	EXPECT_NEAR_DOUBLE(ge.loss_bad, 1.0, 1e-12, "ge fit: simple Gilbert loses all");
+
+	// p=0.05, r=0.3、悪状態で 70% を失うモデルから生成した列
+	memset(&lp, 0, sizeof(lp));
+	uint64_t x = UINT64_C(0x9E3779B97F4A7C15);
+	bool bad = false;
+	for (int i = 0; i < 2000000; i++) {
+		double u[2];
+		for (int k = 0; k < 2; k++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			u[k] = (double)(x >> 11) * 0x1.0p-53;
+		}
+		stamp_loss_add(&lp, bad && u[0] < 0.7);
+		bad = bad ? u[1] >= 0.3 : u[1] < 0.05;
+	}
+	stamp_loss_ge_fit(&lp, &ge);
+	EXPECT_NEAR_DOUBLE(ge.p, 0.05, 0.005, "ge fit: p recovered");
+	EXPECT_NEAR_DOUBLE(ge.r, 0.3, 0.03, "ge fit: r recovered");
+	EXPECT_NEAR_DOUBLE(ge.loss_bad, 0.7, 0.03, "ge fit: loss in bad state recovered");
+}
+
+// 確定順に結果を記録する（'R' / 'L'、seq は最後の 1 本）
+struct settle_log {
+	char outcome[16];
+	uint32_t count;
+	uint32_t last_seq;
+};
+
+static void settle_log_cb(uint32_t seq, bool lost, void *ctx)
+{
+	struct settle_log *log = ctx;
+	log->outcome[log->count++] = lost ? 'L' : 'R';
+	log->outcome[log->count] = '\0';
+	log->last_seq = seq;
+}
+
+static void test_inflight_settle(void)
+{
+	static struct stamp_inflight tbl;
+	const struct stamp_inflight_entry *ent;
+	struct settle_log log = {{0}, 0, 0};
+	uint32_t expired = 0;
+	EXPECT_TRUE(stamp_inflight_init(&tbl, STAMP_INFLIGHT_MIN_CAP) == 0,
+		    "settle: table allocated");
+	for (uint32_t seq = 0; seq < 5; seq++) {
+		(void)stamp_inflight_insert(&tbl, seq, 0, 0, 1000 + seq);
+	}
+	(void)stamp_inflight_match(&tbl, 1, &ent);
+	(void)stamp_inflight_match(&tbl, 3, &ent);
+	stamp_inflight_settle(&tbl, tbl.settled, settle_log_cb, &log);
+	EXPECT_EQ_ULL(log.count, 0, "settle: waits for the oldest pending");
+
+	(void)stamp_inflight_match(&tbl, 0, &ent);
+	stamp_inflight_settle(&tbl, tbl.settled, settle_log_cb, &log);
+	EXPECT_TRUE(strcmp(log.outcome, "RR") == 0 && log.last_seq == 1,
+		    "settle: answered replies in seq order");
+
+	(void)stamp_inflight_expire(&tbl, 10000, 500, count_expired_cb, &expired);
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 2, &ent) == STAMP_INFLIGHT_MATCH_LATE,
+		    "settle: late reply");
+	stamp_inflight_settle(&tbl, tbl.settled, settle_log_cb, &log);
+	EXPECT_TRUE(strcmp(log.outcome, "RRLRL") == 0,
+		    "settle: expired and late count as lost");
+	EXPECT_TRUE(stamp_inflight_match(&tbl, 2, &ent) == STAMP_INFLIGHT_MATCH_DUPLICATE,
+		    "settle: reply after a late one is a duplicate");
+
+	// 送信に失敗した seq 5 は報告せず、終了時は応答待ちも喪失として確定させる
+	(void)stamp_inflight_insert(&tbl, 6, 0, 0, 20000);
+	stamp_inflight_settle(&tbl, tbl.settled, settle_log_cb, &log);
+	EXPECT_EQ_ULL(log.count, 5, "settle: pending seq 6 not settled yet");
+	stamp_inflight_settle(&tbl, tbl.next_seq, settle_log_cb, &log);
+	EXPECT_TRUE(strcmp(log.outcome, "RRLRLL") == 0 && log.last_seq == 6,
+		    "settle: flush skips unsent seq and loses pending");
+
+	// スロットの再利用前に確定させる
+	for (uint32_t seq = 7; seq < 7 + STAMP_INFLIGHT_MIN_CAP; seq++) {
+		(void)stamp_inflight_insert(&tbl, seq, 0, 0, 30000);
+	}
+	log.count = 0;
+	stamp_inflight_settle(&tbl, 7 + STAMP_INFLIGHT_MIN_CAP - tbl.mask,
+			      settle_log_cb, &log);
+	EXPECT_TRUE(strcmp(log.outcome, "L") == 0 && log.last_seq == 7,
+		    "settle: forced before the slot is reused");
+	stamp_inflight_free(&tbl);
+}
+
+// =============================================================================
+// Phase 35: 区間レポートの集計面
+// =============================================================================
+
+static void test_interval_face(void)
+{
+	struct stamp_interval_stats iv;
+	EXPECT_TRUE(stamp_interval_init(&iv, false) == 0 && iv.sketch_fwd == NULL,
+		    "interval: round-trip face has no one-way sketches");
+	EXPECT_TRUE(isnan(stamp_interval_loss_ratio(&iv)),
+		    "interval: no settled probes gives NAN loss");
+
+	stamp_interval_on_reply(&iv, 2.0, 1.5, 0.5, 0.1);
+	stamp_interval_on_reply(&iv, 4.0, 2.5, 1.5, 0.3);
+	stamp_interval_on_ipdv(&iv, 2.0, 1.0, 1.0);
+	iv.settled = 4;
+	iv.lost = 1;
+	EXPECT_EQ_ULL(iv.received, 2, "interval: replies counted");
+	EXPECT_NEAR_DOUBLE(stamp_welford_mean(&iv.rtt), 3.0, 1e-12,
+			   "interval: rtt mean");
+	EXPECT_EQ_ULL(stamp_welford_count(&iv.fwd), 0,
+		      "interval: one-way delays skipped without -O");
+	EXPECT_EQ_ULL(stamp_welford_count(&iv.ipdv_fwd), 0,
+		      "interval: one-way ipdv skipped without -O");
+	EXPECT_NEAR_DOUBLE(stamp_interval_loss_ratio(&iv), 0.25, 1e-12,
+			   "interval: loss over settled probes");
+
+	struct stamp_sketch *sk = iv.sketch_rtt;
+	stamp_interval_reset(&iv, 12345);
+	EXPECT_TRUE(iv.sketch_rtt == sk && iv.start_ns == 12345 &&
+			    iv.received == 0 && iv.settled == 0 &&
+			    stamp_welford_count(&iv.rtt) == 0,
+		    "interval: reset empties the face and keeps the sketch");
+	stamp_interval_on_reply(&iv, 7.0, 0.0, 0.0, 0.0);
+	EXPECT_NEAR_DOUBLE(stamp_sketch_quantile(iv.sketch_rtt, 50.0), 7.0, 0.1,
+			   "interval: sketch holds only the new interval");
+	stamp_interval_free(&iv);
+	stamp_interval_free(&iv);
+	EXPECT_TRUE(iv.sketch_rtt == NULL, "interval: double free is safe");
+
+	EXPECT_TRUE(stamp_interval_init(&iv, true) == 0 && iv.sketch_fwd != NULL &&
+			    iv.sketch_bwd != NULL,
+		    "interval: one-way face allocated");
+	stamp_interval_on_reply(&iv, 4.0, 3.0, 1.0, 0.0);
+	stamp_interval_on_ipdv(&iv, 0.5, 0.25, 0.25);
+	EXPECT_TRUE(stamp_welford_mean(&iv.fwd) == 3.0 &&
+			    stamp_welford_mean(&iv.bwd) == 1.0 &&
+			    stamp_welford_mean(&iv.ipdv_fwd) == 0.25,
+		    "interval: one-way delays and ipdv");
+	stamp_interval_reset(&iv, 0);
+	EXPECT_EQ_ULL(stamp_welford_count(&iv.bwd), 0,
+		      "interval: one-way reset");
+	stamp_interval_free(&iv);
+}
+
+// =============================================================================
+// Phase 36: 毎パケット記録
+// =============================================================================
+
+static void test_pktlog_ring(void)
+{
+	static struct stamp_pktlog pl;
+	struct stamp_pkt_record rec;
+	memset(&rec, 0, sizeof(rec));
+	EXPECT_TRUE(stamp_pktlog_init(&pl, stdout, STAMP_PKTLOG_NDJSON) == 0,
+		    "pktlog: ring allocated");
+	for (uint32_t i = 0; i < STAMP_PKTLOG_CAP; i++) {
+		rec.seq = i;
+		(void)stamp_pktlog_push(&pl, &rec);
+	}
+	rec.seq = STAMP_PKTLOG_CAP;
+	EXPECT_TRUE(!stamp_pktlog_push(&pl, &rec) && pl.dropped == 1,
+		    "pktlog: full ring drops instead of waiting");
+	struct stamp_pkt_record out;
+	EXPECT_TRUE(stamp_pktlog_pop(&pl, &out) && out.seq == 0,
+		    "pktlog: FIFO order");
+	EXPECT_TRUE(stamp_pktlog_push(&pl, &rec), "pktlog: pop frees a slot");
+	uint32_t last = 0;
+	uint32_t count = 0;
+	while (stamp_pktlog_pop(&pl, &out)) {
+		last = out.seq;
+		count++;
+	}
+	EXPECT_TRUE(count == STAMP_PKTLOG_CAP && last == STAMP_PKTLOG_CAP,
+		    "pktlog: drained everything in order");
+	stamp_pktlog_free(&pl);
+	stamp_pktlog_free(&pl);
+}
+
+static void test_pktlog_error_estimate(void)
+{
+	EXPECT_EQ_ULL(stamp_error_estimate_ns(0x0001), 1,
+		      "pktlog: 2^-32 s rounds up to 1 ns");
+	// Scale 32, Multiplier 3 = 3 秒
+	EXPECT_EQ_ULL(stamp_error_estimate_ns((uint16_t)((32U << 8) | 3U)),
+		      3000000000ULL,
+		      "pktlog: scale 32 multiplier 3");
+	EXPECT_EQ_ULL(stamp_error_estimate_ns(ERROR_ESTIMATE_S_BIT |
+					      ERROR_ESTIMATE_Z_BIT | (22U << 8) |
+					      1U),
+		      976563,
+		      "pktlog: S/Z bits ignored, 2^-10 s rounded up");
+	EXPECT_EQ_ULL(stamp_error_estimate_ns((uint16_t)((63U << 8) | 255U)),
+		      UINT64_MAX,
+		      "pktlog: overflow saturates");
+	EXPECT_EQ_ULL(stamp_error_estimate_ns((uint16_t)(63U << 8)), 0,
+		      "pktlog: zero multiplier");
+}
+
+static void test_pktlog_format(void)
+{
+	struct stamp_wire_ts t1 = {NTP_OFFSET + 100U, 0x80000000U, false};
+	struct stamp_wire_ts t2 = {NTP_OFFSET + 100U, 500000100U, true};
+	struct stamp_wire_ts t3 = {NTP_OFFSET + 100U, 500000200U, true};
+	struct stamp_wire_ts t4 = {NTP_OFFSET + 100U, 0x80001000U, false};
+	struct stamp_delays_ns d;
+	stamp_compute_delays_ns(&t1, &t2, &t3, &t4, &d);
+	struct stamp_pkt_record rec;
+	stamp_pkt_record_fill(&rec, &t1, &t2, &t3, &t4, &d, 1, 0x4001);
+	rec.seq = 42;
+	rec.session = 0;
+	rec.ttl = 64;
+	EXPECT_TRUE(rec.t_ns[0] == 100500000000ULL && rec.t_ns[1] == 100500000100ULL,
+		    "pktlog: timestamps to UNIX ns");
+
+	char line[STAMP_PKTLOG_LINE_MAX];
+	size_t n = stamp_pktlog_format_line(&rec, "[::1]:862", line,
+					    STAMP_PKTLOG_NDJSON);
+	EXPECT_TRUE(n == strlen(line) &&
+			    strncmp(line, "{\"seq\":42,\"target\":\"[::1]:862\","
+					  "\"t1_ns\":100500000000,", 52) == 0 &&
+			    strstr(line, "\"fwd_ns\":100,") != NULL &&
+			    strstr(line, "\"ttl\":64,") != NULL &&
+			    strstr(line, "\"reflector_ee\":16385,") != NULL &&
+			    strcmp(line + n - 2, "}\n") == 0,
+		    "pktlog: NDJSON line");
+	n = stamp_pktlog_format_line(&rec, "h:1", line, STAMP_PKTLOG_CSV);
+	EXPECT_TRUE(strncmp(line, "42,h:1,100500000000,100500000100,", 33) == 0 &&
+			    line[n - 1] == '\n',
+		    "pktlog: CSV line");
+
+	// 出力バッファ経由で書き出す
+	FILE *fp = tmpfile();
+	if (fp == NULL) {
+		SKIP_TEST("pktlog: drain (tmpfile unavailable)");
+		return;
+	}
+	static struct stamp_pktlog pl;
+	const char *targets[] = {"h:1"};
+	EXPECT_TRUE(stamp_pktlog_init(&pl, fp, STAMP_PKTLOG_CSV) == 0,
+		    "pktlog: csv log allocated");
+	stamp_pktlog_begin(&pl);
+	(void)stamp_pktlog_push(&pl, &rec);
+	rec.seq = 43;
+	(void)stamp_pktlog_push(&pl, &rec);
+	EXPECT_EQ_ULL(stamp_pktlog_drain(&pl, targets, 1, false), 2,
+		      "pktlog: two lines drained");
+	EXPECT_TRUE(pl.len > 0, "pktlog: small batches stay buffered");
+	(void)stamp_pktlog_drain(&pl, targets, 1, true);
+	rewind(fp);
+	char got[STAMP_PKTLOG_LINE_MAX];
+	int lines = 0;
+	bool header = fgets(got, sizeof(got), fp) != NULL &&
+		      strncmp(got, "seq,target,t1_ns", 16) == 0;
+	while (fgets(got, sizeof(got), fp) != NULL) {
+		lines++;
+	}
+	EXPECT_TRUE(header && lines == 2 && pl.written == 2 && !pl.write_failed,
+		    "pktlog: header and rows written on flush");
+	stamp_pktlog_free(&pl);
+	fclose(fp);
+}
+
+// =============================================================================
+// Phase 7-3: テスト分離改善
+// =============================================================================
+
+#ifndef _WIN32
+// reset_global_state() がグローバル状態を既定値へ復元することを単体で検証する。
+// 前テストの後処理に依存しない自己完結テスト（順序非依存）。
+static void test_signal_handler_reset(void)
+{
+	__atomic_store_n(&g_running, 0, __ATOMIC_SEQ_CST);
+	reset_global_state();
+	EXPECT_TRUE(__atomic_load_n(&g_running, __ATOMIC_SEQ_CST) == 1,
+		    "reset_global_state restores g_running=1");
+}
+#endif
+
+int main(void)
+{
+#ifdef _WIN32
+	if (init_winsock() != 0) {
+		printf("FAIL: WSAStartup\n");
+		return 1;
+	}
+#endif
+
+	g_ipv6_ok = ipv6_available();
+
+#ifndef _WIN32
+	test_signal_handler();
+	test_firewall_format_port_valid();
+	test_firewall_format_port_rejects_zero();
+	test_firewall_format_port_rejects_truncation();
+#endif
+
+	test_protocol_constants();
+	test_struct_layout();
+	test_stamp_validate_packet();
+	test_stamp_ntp_to_double();
+	test_stamp_get_ntp_timestamp();
+	test_byte_order();
+	test_stamp_parse_port();
+	test_stamp_parse_u32_range();
+	test_stamp_parse_u32_or_zero();
+	test_stamp_family_str();
+	// IPv6対応テスト
+	test_stamp_get_sockaddr_len();
+	test_stamp_sockaddr_get_port();
+	test_stamp_sockaddr_to_string();
+	test_stamp_resolve_address();
+	// NOTE: Integration test - performs real UDP I/O on loopback.
+	test_ipv6_socket_communication();
+#ifndef _WIN32
+	test_reflector_loopback_filtering_and_padding();
+#endif
+#ifdef __linux__
+	test_reflector_loopback_workers_batch();
+	test_reflector_loopback_uring();
+#endif
+	// Windows getoptテスト (分割: basic/arguments/errors/mixed)
+#ifdef _WIN32
+	test_stamp_getopt_basic();
+	test_stamp_getopt_arguments();
+	test_stamp_getopt_errors();
+	test_stamp_getopt_mixed();
+#endif
+
+	// ===== 新規追加テスト =====
+	// Phase 1: NTP変換マクロ
+	test_nsec_to_ntp_frac();
+	test_usec_to_ntp_frac();
+	test_stamp_nsec_to_ntp_frac_overflow();
+	test_stamp_nsec_to_ntp_frac_boundary();
+#ifdef _WIN32
+	test_windows_100ns_to_ntp_frac();
+#endif
+
+	// Phase 2: timespec/timeval変換 (UNIX)
+#ifndef _WIN32
+	test_stamp_timespec_to_ntp();
+	test_stamp_timeval_to_ntp();
+#endif
+
+	// Phase 3: sockaddrユーティリティ追加
+	test_stamp_sockaddr_to_string_safe();
+	test_stamp_format_sockaddr_with_port();
+	test_stamp_format_sockaddr_with_port_null_addr();
+	test_stamp_sockaddr_to_string_safe_truncation();
+
+	// Phase 4: stamp_resolve_address_list
+	test_stamp_resolve_address_list();
+
+	// Phase 5: stamp_validate_packet拡張
+	test_stamp_validate_packet_boundary_sizes();
+	test_stamp_validate_test_payload_for_reflector();
+	test_stamp_check_reflector_input();
+	test_stamp_default_error_estimate_nbo();
+	test_stamp_pad_to_base_size();
+
+	// Phase 6: RTT計算
+	test_rtt_calculation();
+	test_negative_delay_detection();
+
+	// Phase 7: 統計計算
+	test_statistics_calculation();
+	test_packet_loss_calculation();
+	test_packet_loss_underflow();
+	test_stamp_jitter_edge_cases();
+	test_stamp_percentile_sorted_basic();
+	test_stamp_percentile_sorted_edge();
+	test_stamp_double_cmp_nan();
+	test_stamp_pdv_from_sorted();
+	test_stamp_seq_is_consecutive();
+	test_stamp_report_fmt_double();
+	test_stamp_report_json_escape();
+	test_stamp_report_iso8601_utc_format();
+	test_stamp_report_write_json_basic();
+	test_stamp_report_write_json_truncated();
+	test_stamp_report_write_csv_basic();
+	test_stamp_packet_loss_edge_cases();
+
+	// Phase 8: パケット構築
+	test_sender_packet_fields();
+	test_reflector_packet_fields();
+	test_sender_ttl_setting();
+
+	// Phase 9: Error Estimate
+	test_error_estimate_fields();
+
+	// Phase 10: HW タイムスタンプ
+#ifdef __linux__
+	test_stamp_extract_kernel_timestamp_linux_hw_priority();
+	test_stamp_extract_kernel_timestamp_linux_sw_fallback();
+	test_stamp_extract_kernel_timestamp_linux_ptp_hw();
+	test_stamp_extract_kernel_timestamp_linux_ptp_sw();
+	test_stamp_extract_kernel_timestamp_linux_timestampns();
+	test_stamp_extract_kernel_timestamp_linux_timestamp();
+	test_stamp_extract_kernel_timestamp_linux_legacy_fallback();
+	test_stamp_extract_kernel_timestamp_linux_all_zero();
+	test_stamp_extract_kernel_timestamp_linux_invalid_nsec();
+	test_stamp_extract_kernel_timestamp_linux_truncated_cmsg();
+	test_stamp_extract_kernel_timestamp_linux_scm_timestamp_invalid_usec();
+	test_stamp_extract_kernel_timestamp_linux_scm_timestamp_truncated();
+	test_stamp_extract_kernel_timestamp_linux_scm_timestamping_truncated();
+	test_stamp_extract_kernel_timestamp_linux_all_invalid_nsec();
+	test_stamp_extract_ttl_from_cmsg();
+#endif
+#ifdef _WIN32
+	test_stamp_extract_kernel_timestamp_windows();
+#endif
+
+	// Phase 11: PTP タイムスタンプ変換
+	test_stamp_ptp_to_double();
+#ifndef _WIN32
+	test_stamp_timespec_to_ptp();
 #endif
 	test_ntp_ptp_cross_conversion();
 	test_stamp_timestamp_to_double_dispatch();
@@ -4986,6 +8063,129 @@ int main(void)
 	test_e2e_stamp_loopback_multi_seq();
 	test_e2e_stamp_loopback_padded();
 
+#ifdef __linux__
+	// Phase 15: recvmmsg/sendmmsg バッチ
+	test_mmsg_batch_init_bounds();
+	test_mmsg_batch_loopback();
+#endif
+#ifdef STAMP_HAVE_IO_URING
+	test_uring_recvmsg_multishot_loopback();
+#endif
+
+	// Phase 16: Sender 応答待ちプローブ表
+	test_inflight_match_classification();
+	test_inflight_expire_and_late();
+	test_inflight_eviction_and_wrap();
+
+	// Phase 17: Sender 送信スケジュール
+	test_sched_periodic_grid();
+	test_sched_missed_slots();
+	test_sched_error_stats();
+	test_sched_interval_spin_bounds();
+	test_sched_poisson_distribution();
+	test_sched_offset_start();
+
+	// Phase 18: Sender 列車送信の集計
+	test_train_dispersion_and_delay_increase();
+	test_train_loss_and_flush();
+	test_train_open_close();
+	test_timestamp_to_ns();
+
+	// Phase 19: 複数ターゲット Sender
+	test_wheel_expire_and_cancel();
+	test_wheel_rearm_in_callback();
+	test_parse_target();
+	test_report_multi_target();
+
+	// Phase 20: 分位点スケッチ
+	test_sketch_quantile_accuracy();
+	test_sketch_signed_and_empty();
+	test_sketch_merge();
+
+	// Phase 21: 選択アルゴリズムによるパーセンタイル
+	test_select_matches_sort();
+	test_radix_sort_order();
+
+	// Phase 22: Reflector のパケット単位ログ
+	test_log_policy();
+	test_logring_push_pop();
+
+	// Phase 23: ステートフル Reflector のセッション表
+	test_session_independent_seq();
+	test_session_expiry_and_cap();
+	test_session_remove_keeps_probe_chain();
+
+	// Phase 24: Reflector の送信元別統計表
+	test_client_hist_bin();
+	test_client_table();
+	test_session_key_addr();
+
+	// Phase 25: カーネル内入力フィルタ
+	test_prefix_parse();
+#ifdef __linux__
+	test_bpf_filter_loopback();
+#endif
+
+	// Phase 26: AF_XDP エンジン
+	test_xdp_frame_reply();
+	test_allowlist_match();
+#ifdef STAMP_HAVE_AF_XDP
+	test_xdp_prog_verifier();
+#endif
+
+	// Phase 27: レート制限
+	test_rate_parse();
+	test_rate_source_bucket();
+	test_rate_global_cap();
+
+	// Phase 28: TX HW タイムスタンプの非同期回収
+	test_inflight_tx_keys();
+#ifdef __linux__
+	test_parse_tx_hw_timestamp();
+	test_collect_tx_timestamps_loopback();
+#endif
+
+	// Phase 29: T3 の事後検証
+	test_t3_error_stats();
+	test_t3_followup_ring();
+#ifdef __linux__
+	test_reflector_loopback_t3_check();
+#endif
+
+	// Phase 30: 較正済み TSC による打刻
+	test_clock_source_parse();
+#ifdef STAMP_HAVE_TSC
+	test_tsc_conversion();
+	test_tsc_mult_plausible();
+	test_tsc_clock_live();
+	test_reflector_loopback_tsc_clock();
+#endif
+
+	// Phase 31: 除算を使わない NTP 小数部の変換
+	test_nsec_frac_exhaustive();
+	test_usec_frac_exhaustive();
+
+	// Phase 32: 整数ナノ秒による遅延計算
+	test_ts_diff_ns();
+	test_compute_delays_ns();
+
+	// Phase 33: 順序逆転の指標と seq 隣接の IPDV
+	test_reorder_extent_and_n();
+	test_reorder_ipdv_pairs();
+
+	// Phase 34: 喪失区間と Gilbert-Elliott モデル
+	test_loss_periods();
+	test_loss_ge_fit();
+	test_inflight_settle();
+
+	// Phase 35: 区間レポートの集計面
+	test_interval_face();
+
+	// Phase 36: 毎パケット記録
+	test_pktlog_ring();
+	test_pktlog_error_estimate();
+	test_pktlog_format();
+
 #ifndef _WIN32
 	// Phase 7-3: テスト分離確認
 	test_signal_handler_reset();